@@ -0,0 +1,103 @@
+#include "access_log.h"
+
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+namespace access_log {
+
+namespace {
+
+std::optional<double> ParseRate(std::string_view str) noexcept {
+    double value = 0;
+    auto res = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (res.ec != std::errc{} || res.ptr != str.data() + str.size() || !(value >= 0 && value <= 1))
+        return std::nullopt;
+    return value;
+}
+
+// "2xx" -> 1
+std::optional<size_t> StatusClassFromName(std::string_view name) noexcept {
+    if (name.size() != 3 || name[0] < '1' || name[0] > '5' || name.substr(1) != "xx")
+        return std::nullopt;
+    return static_cast<size_t>(name[0] - '1');
+}
+
+std::uint64_t Threshold(double rate) noexcept {
+    return static_cast<std::uint64_t>(std::ldexp(rate, 32));
+}
+
+// xorshift64*, seeded per thread; sampling needs speed, not quality
+std::uint32_t NextRandom() noexcept {
+    thread_local std::uint64_t state = [] {
+        auto seed = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())
+                ^ std::hash<std::thread::id>{}(std::this_thread::get_id());
+        return seed | 1;
+    }();
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<std::uint32_t>((state * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+} // namespace
+
+std::optional<size_t> EndpointFromName(std::string_view name) noexcept {
+    if (auto route = router::RouteFromName(name))
+        return EndpointOf(*route);
+    if (name == "static")
+        return STATIC_FILES;
+    if (name == "unknown")
+        return UNKNOWN_TARGET;
+    if (name == "metrics")
+        return METRICS;
+    if (name == "tick-trace")
+        return TICK_TRACE;
+    return std::nullopt;
+}
+
+std::string_view EndpointName(size_t endpoint) noexcept {
+    if (endpoint < router::ROUTE_COUNT)
+        return router::ROUTE_NAMES[endpoint];
+    if (endpoint == METRICS)
+        return "metrics";
+    if (endpoint == TICK_TRACE)
+        return "tick-trace";
+    return endpoint == STATIC_FILES ? "static" : "unknown";
+}
+
+bool ApplySamplingSpec(SamplingOptions& options, std::string_view spec) noexcept {
+    auto eq = spec.find('=');
+    if (eq == std::string_view::npos)
+        return false;
+    auto name = spec.substr(0, eq);
+    auto rate = ParseRate(spec.substr(eq + 1));
+    if (!rate)
+        return false;
+    if (auto endpoint = EndpointFromName(name)) {
+        options.endpoints[*endpoint] = *rate;
+        return true;
+    }
+    auto status_class = StatusClassFromName(name);
+    if (!status_class || *status_class == 4)
+        return false;
+    options.status_classes[*status_class] = *rate;
+    return true;
+}
+
+Sampler::Sampler(const SamplingOptions& options) {
+    for (size_t i = 0; i < NUM_ENDPOINTS; ++i)
+        endpoints_[i] = Threshold(options.endpoints[i]);
+    for (size_t i = 0; i < NUM_STATUS_CLASSES; ++i)
+        status_classes_[i] = Threshold(options.status_classes[i]);
+}
+
+bool Sampler::Pick(std::uint64_t threshold) noexcept {
+    if (threshold >= ALWAYS)
+        return true;
+    return threshold != 0 && NextRandom() < threshold;
+}
+
+} // namespace access_log
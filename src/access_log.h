@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "http_status.h"
+#include "router.h"
+
+namespace access_log {
+
+// Every API route, then static files, API targets matching no route, the metrics scrape and the tick trace
+inline constexpr size_t STATIC_FILES = router::ROUTE_COUNT;
+inline constexpr size_t UNKNOWN_TARGET = router::ROUTE_COUNT + 1;
+inline constexpr size_t METRICS = router::ROUTE_COUNT + 2;
+inline constexpr size_t TICK_TRACE = router::ROUTE_COUNT + 3;
+inline constexpr size_t NUM_ENDPOINTS = router::ROUTE_COUNT + 4;
+
+using http_status::NUM_STATUS_CLASSES;
+
+constexpr size_t EndpointOf(router::RouteId route) noexcept {
+    return static_cast<size_t>(route);
+}
+
+// Route names as in --rate-limit, plus "static", "unknown", "metrics" and "tick-trace"
+std::optional<size_t> EndpointFromName(std::string_view name) noexcept;
+std::string_view EndpointName(size_t endpoint) noexcept;
+
+struct SamplingOptions {
+    // Share of requests to each endpoint that are logged, from 0 to 1
+    std::array<double, NUM_ENDPOINTS> endpoints;
+    // Share of responses of each status class logged for the requests kept above
+    std::array<double, NUM_STATUS_CLASSES> status_classes;
+
+    SamplingOptions() {
+        endpoints.fill(1);
+        status_classes.fill(1);
+    }
+};
+
+// Applies "endpoint=rate" or "Nxx=rate", e.g. "state=0.01" or "2xx=0.1"; false when malformed.
+// Server errors are always logged, so "5xx" is refused.
+bool ApplySamplingSpec(SamplingOptions& options, std::string_view spec) noexcept;
+
+// Decides which access log records are kept. A response is logged when its request
+// was, unless its status class drops it; 5xx responses are logged whatever the rates.
+// Thread-safe, each thread draws from its own generator.
+class Sampler {
+public:
+    explicit Sampler(const SamplingOptions& options = {});
+
+    bool SampleRequest(size_t endpoint) const noexcept {
+        return Pick(endpoints_[endpoint]);
+    }
+    bool KeepResponse(bool request_sampled, unsigned status) const noexcept {
+        if (status >= 500)
+            return true;
+        return request_sampled && Pick(status_classes_[http_status::StatusClass(status)]);
+    }
+private:
+    // Rates scaled to 2^32, 2^32 itself being "always"
+    static constexpr std::uint64_t ALWAYS = std::uint64_t{1} << 32;
+
+    static bool Pick(std::uint64_t threshold) noexcept;
+
+    std::array<std::uint64_t, NUM_ENDPOINTS> endpoints_;
+    std::array<std::uint64_t, NUM_STATUS_CLASSES> status_classes_;
+};
+
+} // namespace access_log
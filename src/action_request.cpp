@@ -0,0 +1,128 @@
+#include "action_request.h"
+#include <boost/json.hpp>
+
+namespace action_request {
+
+namespace json = boost::json;
+
+namespace {
+
+constexpr std::string_view MOVE_KEY = "move";
+constexpr size_t PARSE_BUFFER_SIZE = 1024;
+
+class Scanner {
+public:
+    explicit Scanner(std::string_view text) noexcept: text_(text) {}
+
+    bool Consume(char ch) noexcept {
+        SkipSpaces();
+        if (pos_ == text_.size() || text_[pos_] != ch)
+            return false;
+        ++pos_;
+        return true;
+    }
+    // Strings with escapes or control characters are left to the full parser
+    bool String(std::string_view& out) noexcept {
+        if (!Consume('"'))
+            return false;
+        auto start = pos_;
+        for (; pos_ < text_.size(); ++pos_) {
+            auto ch = static_cast<unsigned char>(text_[pos_]);
+            if (ch == '"') {
+                out = text_.substr(start, pos_++ - start);
+                return true;
+            }
+            if (ch == '\\' || ch < 0x20)
+                return false;
+        }
+        return false;
+    }
+    bool AtEnd() noexcept {
+        SkipSpaces();
+        return pos_ == text_.size();
+    }
+private:
+    void SkipSpaces() noexcept {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                                       text_[pos_] == '\n' || text_[pos_] == '\r'))
+            ++pos_;
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+// Handles objects whose values are all plain strings, which covers every well-behaved client.
+// Returns false when the body needs the full parser.
+bool ScanFlatObject(std::string_view body, std::optional<std::string_view>& move) noexcept {
+    Scanner scanner{body};
+    if (!scanner.Consume('{'))
+        return false;
+    if (!scanner.Consume('}')) {
+        do {
+            std::string_view key, value;
+            if (!scanner.String(key) || !scanner.Consume(':') || !scanner.String(value))
+                return false;
+            if (key == MOVE_KEY)
+                move = value;
+        } while (scanner.Consume(','));
+        if (!scanner.Consume('}'))
+            return false;
+    }
+    return scanner.AtEnd();
+}
+
+std::optional<model::Direction> ToDirection(std::optional<std::string_view> move) noexcept {
+    if (!move)
+        return std::nullopt;
+    auto dir = StrToDir(*move);
+    if (dir == model::Direction::NONE)
+        return std::nullopt;
+    return dir;
+}
+
+std::optional<model::Direction> ParseMoveDocument(std::string_view body) {
+    unsigned char buffer[PARSE_BUFFER_SIZE];
+    json::monotonic_resource resource(buffer, sizeof(buffer));
+    boost::system::error_code ec;
+    auto value = json::parse(body, ec, &resource);
+    if (ec || !value.is_object())
+        return std::nullopt;
+    auto move = value.as_object().if_contains(MOVE_KEY);
+    if (move == nullptr || !move->is_string())
+        return std::nullopt;
+    return ToDirection(std::string_view{move->get_string()});
+}
+
+} // namespace
+
+std::optional<std::string_view> ExtractBearerToken(std::string_view authorization) noexcept {
+    if (!authorization.starts_with(BEARER_PREFIX) ||
+        authorization.size() != BEARER_PREFIX.size() + token::TOKEN_LENGTH)
+            return std::nullopt;
+    return authorization.substr(BEARER_PREFIX.size());
+}
+
+model::Direction StrToDir(std::string_view dir) noexcept {
+    if (dir.empty())
+        return model::Direction::STOP;
+    else if (dir == "U")
+        return model::Direction::NORTH;
+    else if (dir == "D")
+        return model::Direction::SOUTH;
+    else if (dir == "L")
+        return model::Direction::WEST;
+    else if (dir == "R")
+        return model::Direction::EAST;
+    else
+        return model::Direction::NONE;
+}
+
+std::optional<model::Direction> ParseMove(std::string_view body) {
+    std::optional<std::string_view> move;
+    if (ScanFlatObject(body, move))
+        return ToDirection(move);
+    return ParseMoveDocument(body);
+}
+
+} // namespace action_request
@@ -0,0 +1,22 @@
+#pragma once
+#include <optional>
+#include <string_view>
+
+#include "model.h"
+#include "token.h"
+
+namespace action_request {
+
+constexpr std::string_view BEARER_PREFIX = "Bearer ";
+
+// Token part of "Bearer <32 hex digits>", pointing into the header value
+std::optional<std::string_view> ExtractBearerToken(std::string_view authorization) noexcept;
+
+// "" stops the dog, "U", "D", "L", "R" set the direction; anything else is NONE
+model::Direction StrToDir(std::string_view dir) noexcept;
+
+// Direction requested by a {"move": "<dir>"} body, nullopt if the body is malformed.
+// Flat objects are scanned in place; other shapes are parsed into a stack buffer.
+std::optional<model::Direction> ParseMove(std::string_view body);
+
+} // namespace action_request
@@ -0,0 +1,111 @@
+#include "api_dispatcher.h"
+
+#include <boost/asio/post.hpp>
+
+namespace api_dispatcher {
+
+PriorityDispatcher::~PriorityDispatcher() {
+    auto release = [](Entry* entry) {
+        while (entry)
+            delete std::exchange(entry, entry->next);
+    };
+    for (auto& queue: queues_)
+        release(queue.head);
+    release(free_);
+}
+
+bool PriorityDispatcher::Post(Priority priority, Task&& task) {
+    const auto index = static_cast<size_t>(priority);
+    auto& counters = counters_[index];
+    {
+        std::lock_guard lock {mutex_};
+        auto& queue = queues_[index];
+        if (queue.size >= options_.queue_capacity ||
+                (options_.max_queued != 0 && queued_.load(std::memory_order_relaxed) >= options_.max_queued)) {
+            counters.rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        auto* entry = free_ ? std::exchange(free_, free_->next) : new Entry;
+        entry->task = std::move(task);
+        entry->enqueued = Clock::now();
+        entry->next = nullptr;
+        (queue.tail ? queue.tail->next : queue.head) = entry;
+        queue.tail = entry;
+        ++queue.size;
+        counters.queued.fetch_add(1, std::memory_order_relaxed);
+        queued_.fetch_add(1, std::memory_order_relaxed);
+    }
+    net::post(strand_, [this] {
+        RunNext();
+    });
+    return true;
+}
+
+// Highest non-empty class, unless a lower one has been passed over too often
+size_t PriorityDispatcher::PickQueue() noexcept {
+    size_t chosen = NUM_PRIORITIES;
+    for (size_t i = 0; i < NUM_PRIORITIES; ++i) {
+        if (!queues_[i].size == 0 && queues_[i].skipped >= options_.max_skips) {
+            chosen = i;
+            break;
+        }
+    }
+    for (size_t i = 0; i < NUM_PRIORITIES && chosen == NUM_PRIORITIES; ++i) {
+        if (!queues_[i].size == 0)
+            chosen = i;
+    }
+    for (size_t i = 0; i < NUM_PRIORITIES; ++i) {
+        if (i == chosen)
+            queues_[i].skipped = 0;
+        else if (!queues_[i].size == 0)
+            ++queues_[i].skipped;
+    }
+    return chosen;
+}
+
+void PriorityDispatcher::RunNext() {
+    Task task;
+    Clock::time_point enqueued;
+    size_t index;
+    {
+        std::lock_guard lock {mutex_};
+        index = PickQueue();
+        // Every posted RunNext has its own entry, the queues cannot be empty here
+        if (index == NUM_PRIORITIES)
+            return;
+        auto& queue = queues_[index];
+        auto* entry = std::exchange(queue.head, queue.head->next);
+        if (!queue.head)
+            queue.tail = nullptr;
+        --queue.size;
+        task = std::move(entry->task);
+        enqueued = entry->enqueued;
+        entry->next = std::exchange(free_, entry);
+    }
+    auto& counters = counters_[index];
+    counters.queued.fetch_sub(1, std::memory_order_relaxed);
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+
+    auto wait = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - enqueued).count());
+    counters.dispatched.fetch_add(1, std::memory_order_relaxed);
+    counters.total_wait_us.fetch_add(wait, std::memory_order_relaxed);
+    // Only the strand writes the maximum
+    if (wait > counters.max_wait_us.load(std::memory_order_relaxed))
+        counters.max_wait_us.store(wait, std::memory_order_relaxed);
+
+    task();
+}
+
+std::array<ClassStats, NUM_PRIORITIES> PriorityDispatcher::Stats() const noexcept {
+    std::array<ClassStats, NUM_PRIORITIES> stats;
+    for (size_t i = 0; i < NUM_PRIORITIES; ++i) {
+        const auto& counters = counters_[i];
+        stats[i] = {counters.dispatched.load(std::memory_order_relaxed), counters.rejected.load(std::memory_order_relaxed),
+                    counters.total_wait_us.load(std::memory_order_relaxed), counters.max_wait_us.load(std::memory_order_relaxed),
+                    counters.queued.load(std::memory_order_relaxed)};
+    }
+    return stats;
+}
+
+} // namespace api_dispatcher
@@ -0,0 +1,186 @@
+#pragma once
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace api_dispatcher {
+
+namespace net = boost::asio;
+using Strand = net::strand<net::io_context::executor_type>;
+using Clock = std::chrono::steady_clock;
+
+enum class Priority : std::uint8_t {
+    // player input and test-mode ticks
+    High,
+    // state and players polls
+    Normal,
+    // joins and records, both touch Postgres
+    Low
+};
+constexpr size_t NUM_PRIORITIES = 3;
+
+struct Options {
+    // Tasks each class may hold before new ones of that class are refused
+    size_t queue_capacity = 1024;
+    // Tasks of all classes together, 0 means only the per-class capacity applies
+    size_t max_queued = 0;
+    // How many times a waiting class may be passed over in favour of higher ones
+    unsigned max_skips = 8;
+};
+
+struct ClassStats {
+    std::uint64_t dispatched = 0;
+    std::uint64_t rejected = 0;
+    // time from Post to the start of the task on the strand
+    std::uint64_t total_wait_us = 0;
+    std::uint64_t max_wait_us = 0;
+    size_t queued = 0;
+};
+
+// A move-only void() callable. One that fits the buffer is kept in place, so queueing
+// a request allocates nothing; a larger one, or one that may throw when moved, goes to the heap.
+class Task {
+public:
+    static constexpr size_t CAPACITY = 384;
+
+    Task() noexcept = default;
+    template <typename F>
+        requires (!std::is_same_v<std::remove_cvref_t<F>, Task> && std::is_invocable_v<std::remove_cvref_t<F>&>)
+    Task(F&& f) {
+        using Fn = std::remove_cvref_t<F>;
+        if constexpr (FITS<Fn>) {
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = &INLINE_OPS<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &HEAP_OPS<Fn>;
+        }
+    }
+    Task(Task&& other) noexcept: ops_(std::exchange(other.ops_, nullptr)) {
+        if (ops_)
+            ops_->relocate(other.storage_, storage_);
+    }
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            if ((ops_ = std::exchange(other.ops_, nullptr)))
+                ops_->relocate(other.storage_, storage_);
+        }
+        return *this;
+    }
+    ~Task() {
+        Reset();
+    }
+
+    void operator()() {
+        ops_->invoke(storage_);
+    }
+    explicit operator bool() const noexcept {
+        return ops_ != nullptr;
+    }
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        // Moves the callable to the other buffer and ends it in this one
+        void (*relocate)(void* from, void* to) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+    template <typename Fn>
+    static constexpr bool FITS = sizeof(Fn) <= CAPACITY && alignof(Fn) <= alignof(std::max_align_t) &&
+                                 std::is_nothrow_move_constructible_v<Fn>;
+    template <typename Fn>
+    static constexpr Ops INLINE_OPS {
+        [](void* storage) {
+            (*std::launder(static_cast<Fn*>(storage)))();
+        },
+        [](void* from, void* to) noexcept {
+            auto* fn = std::launder(static_cast<Fn*>(from));
+            new (to) Fn(std::move(*fn));
+            fn->~Fn();
+        },
+        [](void* storage) noexcept {
+            std::launder(static_cast<Fn*>(storage))->~Fn();
+        }
+    };
+    template <typename Fn>
+    static constexpr Ops HEAP_OPS {
+        [](void* storage) {
+            (**static_cast<Fn**>(storage))();
+        },
+        [](void* from, void* to) noexcept {
+            *static_cast<Fn**>(to) = *static_cast<Fn**>(from);
+        },
+        [](void* storage) noexcept {
+            delete *static_cast<Fn**>(storage);
+        }
+    };
+
+    void Reset() noexcept {
+        if (ops_)
+            std::exchange(ops_, nullptr)->destroy(storage_);
+    }
+
+    alignas(std::max_align_t) std::byte storage_[CAPACITY];
+    const Ops* ops_ = nullptr;
+};
+
+// Runs tasks on the API strand highest priority first instead of FIFO.
+// Each task takes one strand turn of its own, so a ticker sharing the strand
+// is never stuck behind the whole queue.
+class PriorityDispatcher {
+public:
+    explicit PriorityDispatcher(Strand& strand, const Options& options = {}): strand_(strand), options_(options) {}
+    PriorityDispatcher(const PriorityDispatcher&) = delete;
+    PriorityDispatcher& operator=(const PriorityDispatcher&) = delete;
+    ~PriorityDispatcher();
+
+    // Thread-safe; false when the task was refused because the queues are full
+    bool Post(Priority priority, Task&& task);
+    size_t Queued() const noexcept {
+        return queued_.load(std::memory_order_relaxed);
+    }
+    std::array<ClassStats, NUM_PRIORITIES> Stats() const noexcept;
+private:
+    // Queued in place: an entry links to the next one of its class, or of the free list
+    struct Entry {
+        Task task;
+        Clock::time_point enqueued;
+        Entry* next = nullptr;
+    };
+    struct Queue {
+        Entry* head = nullptr;
+        Entry* tail = nullptr;
+        size_t size = 0;
+        unsigned skipped = 0;
+    };
+    struct Counters {
+        std::atomic<std::uint64_t> dispatched {0};
+        std::atomic<std::uint64_t> rejected {0};
+        std::atomic<std::uint64_t> total_wait_us {0};
+        std::atomic<std::uint64_t> max_wait_us {0};
+        std::atomic<size_t> queued {0};
+    };
+
+    // Runs on the strand, once per posted task
+    void RunNext();
+    size_t PickQueue() noexcept;
+
+    Strand& strand_;
+    const Options options_;
+    std::mutex mutex_;
+    std::array<Queue, NUM_PRIORITIES> queues_;
+    // Entries of tasks already taken, reused by later ones so that the queues stop allocating
+    Entry* free_ = nullptr;
+    std::array<Counters, NUM_PRIORITIES> counters_;
+    std::atomic<size_t> queued_ {0};
+};
+
+} // namespace api_dispatcher
@@ -1,4 +1,5 @@
 #include "api_handler.h"
+#include "tick_profiler.h"
 #include <iostream>
 #include <list>
 
@@ -7,38 +8,6 @@ namespace api_handler {
 
 using PlayerInfo = std::pair<std::string,std::string>;
 
-std::string DirToStr(const model::Direction& dir) {
-    switch (dir) {
-        case model::Direction::NORTH:
-            return "U";
-        case model::Direction::SOUTH:
-            return "D";
-        case model::Direction::WEST:
-            return "L";
-        case model::Direction::EAST:
-            return "R";
-        case model::Direction::STOP:
-            return "";
-        default:
-            return "NULL";
-    }
-}
-
-model::Direction StrToDir(const std::string& dir_str) {
-    if (dir_str.empty())
-        return model::Direction::STOP;
-    else if (dir_str == "U")
-        return model::Direction::NORTH;
-    else if (dir_str == "D")
-        return model::Direction::SOUTH;
-    else if (dir_str == "L")
-        return model::Direction::WEST;
-    else if (dir_str == "R")
-        return model::Direction::EAST;
-    else
-        return model::Direction::NONE;
-}
-
 StringResponse MakeStringResponse(http::status status, std::string_view body, unsigned http_version,
                                   bool keep_alive, std::string_view content_type, const std::string_view& allowed_methods) {
     StringResponse response(status, http_version);
@@ -51,129 +20,76 @@ StringResponse MakeStringResponse(http::status status, std::string_view body, un
     return response;
 }
 
-const model::Map* ApiHandler::GetMap(const std::string &req_target) {
-    auto mapIdStr = req_target.substr(req_target.rfind('/') + 1);
-    model::Map::Id mapId {mapIdStr};
-    return game_.FindMap(mapId);
-}
-
-std::string ApiHandler::GetMapsJson() {
-    auto maps = game_.GetMaps();
-    json::array maps_json;
-    for (const auto &map: maps) {
-        json::object map_json;
-        map_json.emplace("id", *map.GetId());
-        map_json.emplace("name", map.GetName());
-        maps_json.push_back(map_json);
-    }
-    return json::serialize(maps_json);
-}
-
-std::pair<int,int> GetRecordsParams(const std::string& target) {
-    std::string_view req_target{target};
-    url::url_view target_url_view(req_target);
-    auto params = target_url_view.params();
-    int start = 0, size = 100;
-    if (auto p = params.find("start"); p != params.end())
-        start = std::stoi((*p).value);
-    if (auto p = params.find("maxItems"); p != params.end())
-        size = std::stoi((*p).value);
-    return {start, size};
+std::string_view ApiHandler::CreatePlayerInfo(std::pair<const app::Player*,std::string> info) {
+    writer_.Reset();
+    writer_.StartObject();
+    writer_.Member("authToken", info.second);
+    writer_.Member("playerId", *info.first->GetDogId());
+    writer_.EndObject();
+    return writer_.View();
 }
 
-std::string CreatePlayerInfo(std::pair<const app::Player*,std::string> info) {
-    json::object playerInfo;
-    std::string player_token = info.second;
-    playerInfo.emplace("authToken", player_token);
-    playerInfo.emplace("playerId", *info.first->GetDogId());
-    return json::serialize(playerInfo);
-}
-
-std::string ApiHandler::GetPlayersInfo() {
-    json::object players_info;
-    auto dogs = game_.GetSessions().begin()->GetDogs();
-    for (auto &dog: dogs) {
-        json::object player_info;
-        player_info.emplace("name", dog.GetName());
-        players_info.emplace(std::to_string(*dog.GetId()), player_info);
-    }
-    return json::serialize(players_info);
+std::string_view ApiHandler::GetPlayersInfo() {
+    if (snapshot_)
+        return snapshot_->players;
+    return WritePlayersInfo();
 }
 
-json::object LoadBagItem(std::pair<size_t,size_t> bag_item) {
-    json::object obj_json;
-    obj_json.emplace("id", bag_item.first);
-    obj_json.emplace("type", bag_item.second);
-    return obj_json;
+std::string_view ApiHandler::GetGameState() {
+    if (schedule_.GetOptions().max_extrapolation > 0)
+        return WriteGameState(latency::Clock::now());
+    if (snapshot_)
+        return snapshot_->state;
+    return WriteGameState(last_tick_at_);
 }
 
-json::object LoadPlayer(model::Dog& dog) {
-    json::object dog_info;
-    json::array pos_json, speed_json, bag_json;
-    auto pos = dog.GetPos(), speed = dog.GetSpeed();
-    std::string dir_str = DirToStr(dog.GetDir());
-    pos_json.emplace_back(pos.first);
-    pos_json.emplace_back(pos.second);
-    speed_json.emplace_back(speed.first);
-    speed_json.emplace_back(speed.second);
-
-    auto bag = dog.GetBag();
-    for (auto &obj: bag)
-        bag_json.emplace_back(LoadBagItem(obj));
-
-    auto score = dog.GetScore();
-
-    dog_info.emplace("pos", pos_json);
-    dog_info.emplace("speed", speed_json);
-    dog_info.emplace("dir", dir_str);
-    dog_info.emplace("bag", bag_json);
-    dog_info.emplace("score", score);
-
-    return dog_info;
+void ApiHandler::PublishSnapshot() {
+    tick_profiler::Scope scope {"snapshot"};
+    if (!snapshot_)
+        snapshot_.emplace();
+    // Assigned, not moved, so that the strings keep their capacity from one snapshot to the next
+    snapshot_->players = WritePlayersInfo();
+    snapshot_->state = WriteGameState(last_tick_at_);
 }
 
-json::object LoadLostObject(model::LostObject& lost_object) {
-    json::object object_info;
-    json::array pos_json;
-    auto pos = lost_object.GetPos();
-    auto obj_type = lost_object.GetType();
-    pos_json.emplace_back(pos.first);
-    pos_json.emplace_back(pos.second);
-    object_info.emplace("type", obj_type);
-    object_info.emplace("pos", pos_json);
-    return object_info;
+std::string_view ApiHandler::WritePlayersInfo() {
+    writer_.Reset();
+    if (game_.GetSessions().empty())
+        writer_.StartObject().EndObject();
+    else
+        model_json::WritePlayersInfo(writer_, game_.GetSessions().front());
+    return writer_.View();
 }
 
-std::string ApiHandler::GetGameState() {
-    json::object game_state;
-    json::object dogs_json;
-    json::object lost_objects_json;
-
-    auto dogs = game_.GetSessions().begin()->GetDogs();
-    for (auto &dog: dogs)
-        dogs_json.emplace(std::to_string(*dog.GetId()), LoadPlayer(dog));
-
-    auto lost_objects = game_.GetSessions().begin()->GetLostObjects();
-    for (auto &lost_object: lost_objects)
-        lost_objects_json.emplace(std::to_string(*lost_object.GetId()), LoadLostObject(lost_object));
-
-    game_state.emplace("players", dogs_json);
-    game_state.emplace("lostObjects", lost_objects_json);
-    return json::serialize(game_state);
+std::string_view ApiHandler::WriteGameState(latency::Clock::time_point at) {
+    model_json::StateTime time {static_cast<double>(game_time_ms_) / MILLISECONDS};
+    if (at > last_tick_at_) {
+        auto ahead = std::min<latency::Clock::duration>(at - last_tick_at_,
+                std::chrono::milliseconds{schedule_.GetOptions().max_extrapolation});
+        time.ahead = std::chrono::duration<double>(ahead).count();
+    }
+    game_.SyncPositions();
+    writer_.Reset();
+    // Without extrapolation clients get the state as it always was, tickTime is for interpolating ones
+    const bool timed = schedule_.GetOptions().max_extrapolation > 0;
+    if (game_.GetSessions().empty()) {
+        writer_.StartObject().Key("players").StartObject().EndObject().Key("lostObjects").StartObject().EndObject();
+        if (timed)
+            writer_.Member("tickTime", time.tick);
+        writer_.EndObject();
+    } else if (timed) {
+        model_json::WriteGameState(writer_, game_.GetSessions().front(), time);
+    } else {
+        model_json::WriteGameState(writer_, game_.GetSessions().front());
+    }
+    return writer_.View();
 }
 
-std::string ApiHandler::GetPlayerRecords(int start, int size) {
-    json::array records_json;
+std::string_view ApiHandler::GetPlayerRecords(int start, int size) {
     auto records = db_.GetPlayers(start, size);
-    for (auto &record: records) {
-        json::object record_json;
-        record_json.emplace("name", record.name_);
-        record_json.emplace("score", record.score_);
-        auto playTime = static_cast<double>(record.playing_time_) / MILLISECONDS;
-        record_json.emplace("playTime", playTime);
-        records_json.emplace_back(record_json);
-    }
-    return json::serialize(records_json);
+    writer_.Reset();
+    model_json::WriteRecords(writer_, records);
+    return writer_.View();
 }
 
 AuthorizationResponse ValidateJoinRequest(const StringRequest&& req, PlayerInfo& info) {
@@ -199,62 +115,34 @@ AuthorizationResponse ValidateJoinRequest(const StringRequest&& req, PlayerInfo&
     return AuthorizationResponse::OK;
 }
 
-AuthenticationResponse ValidateAuthenticationRequest(const StringRequest&& req, std::string& token) {
+AuthenticationResponse ValidateAuthenticationRequest(const StringRequest&& req, std::string_view& token) {
     if (req.method() != http::verb::get && req.method() != http::verb::head)
         return AuthenticationResponse::InvalidMethod;
-    bool auth_header = false;
-    for (auto &el: req.base()) {
-        if (el.name_string() == "authorization" || el.name_string() == "Authorization") {
-            auth_header = true;
-            token = el.value();
-        }
-    }
-    if (!auth_header)
+    auto auth_header = req.find(http::field::authorization);
+    if (auth_header == req.end())
         return AuthenticationResponse::InvalidHeader;
-    if (!token.starts_with("Bearer") ||
-        token.length() != (HeaderValues::KeyLength + HeaderValues::TokenLength))
-            return AuthenticationResponse::InvalidToken;
-    token = token.substr(HeaderValues::KeyLength);
+    auto bearer = action_request::ExtractBearerToken(AsStringView(auth_header->value()));
+    if (!bearer)
+        return AuthenticationResponse::InvalidToken;
+    token = *bearer;
     return AuthenticationResponse::OK;
 }
 
-AuthenticationResponse ValidateMoveRequest(const StringRequest&& req, std::string& token) {
+AuthenticationResponse ValidateMoveRequest(const StringRequest&& req, std::string_view& token) {
     if (req.method() != http::verb::post)
         return AuthenticationResponse::InvalidMethod;
-    bool auth_header = false, content_header = false;
-    for (auto &el: req.base()) {
-        if (el.name_string() == "authorization" || el.name_string() == "Authorization") {
-            auth_header = true;
-            token = el.value();
-        }
-        if ((el.name_string() == "content-type" ||
-            el.name_string() == "Content-Type") && (el.value() == "application/json"))
-                content_header = true;
-    }
-    if (!auth_header)
+    auto auth_header = req.find(http::field::authorization);
+    if (auth_header == req.end())
         return AuthenticationResponse::InvalidHeader;
-    if (!content_header)
+    if (AsStringView(req[http::field::content_type]) != BasicLiterals::AppJson)
         return AuthenticationResponse::InvalidContent;
-    if (!token.starts_with("Bearer") ||
-        token.length() != (HeaderValues::KeyLength + HeaderValues::TokenLength))
-            return AuthenticationResponse::InvalidToken;
-    token = token.substr(HeaderValues::KeyLength);
+    auto bearer = action_request::ExtractBearerToken(AsStringView(auth_header->value()));
+    if (!bearer)
+        return AuthenticationResponse::InvalidToken;
+    token = *bearer;
     return AuthenticationResponse::OK;
 }
 
-std::pair<ParsingResponse,model::Direction> ParseMoveRequest(const std::string& req_body) {
-    auto body = json::parse(req_body);
-    if (body.is_null() ||
-        !body.is_object() ||
-        !(body.as_object().contains("move")))
-            return {ParsingResponse::ParsingError, model::Direction::NONE};
-    model::Direction dir = StrToDir(value_to<std::string>(body.as_object().at("move")));
-    if (dir == model::Direction::NONE)
-        return {ParsingResponse::ParsingError, model::Direction::NONE};
-    else
-        return {ParsingResponse::OK, dir};
-}
-
 std::pair<ParsingResponse,int> ParseTickRequest(const std::string& req_body) {
     if (req_body.empty())
         return {ParsingResponse::ParsingError, NULL};
@@ -284,7 +172,32 @@ std::pair<app::Player*,std::string> ApiHandler::AddPlayer(const std::string& dog
     return players_.AddPlayer(dog_id, *game_.FindSession(session_id));
 }
 
-StringResponse ApiHandler::HandleMapRequests(const StringRequest &&req, const std::string& target) {
+StringResponse MakeDocumentResponse(const StringRequest& req, const map_catalog::Document& doc,
+                                    const compression::Options& compression) {
+    auto encoding = compression.Enabled() ?
+            compression::ChooseEncoding(AsStringView(req[http::field::accept_encoding])) : compression::Encoding::Identity;
+    auto [body, body_encoding] = doc.Select(encoding);
+    auto etag = doc.ETag(encoding);
+    StringResponse response(http::status::ok, req.version());
+    if (http_conditional::MatchesIfNoneMatch(AsStringView(req[http::field::if_none_match]), etag)) {
+        response.result(http::status::not_modified);
+    } else {
+        response.set(http::field::content_type, BasicLiterals::AppJson);
+        response.body() = body;
+        response.content_length(body.size());
+        if (body_encoding != compression::Encoding::Identity)
+            response.set(http::field::content_encoding, compression::EncodingName(body_encoding));
+    }
+    response.keep_alive(req.keep_alive());
+    response.set(http::field::etag, etag);
+    response.set(http::field::cache_control, BasicLiterals::CacheMaps);
+    if (doc.HasVariants())
+        response.set(http::field::vary, "Accept-Encoding");
+    response.set(http::field::allow, BasicLiterals::AllowGet);
+    return response;
+}
+
+StringResponse ApiHandler::HandleMapRequests(const StringRequest &req, const router::Match& match) const {
     const auto json_response = [&req](http::status status, std::string_view text) {
         return api_handler::MakeStringResponse(status, text, req.version(), req.keep_alive(),
                                                BasicLiterals::AppJson, BasicLiterals::AllowGet);
@@ -292,13 +205,13 @@ StringResponse ApiHandler::HandleMapRequests(const StringRequest &&req, const st
 
     if (req.method() != http::verb::get && req.method() != http::verb::head)
         return json_response(http::status::method_not_allowed, ResponseLiterals::InvalidMethod);
-    if (target.starts_with(RequestLiterals::MapTarget)) {
-        auto map = GetMap(target);
-        if (map != nullptr)
-            return json_response(http::status::ok, map->GetJsonString());
-        return json_response(http::status::not_found, ResponseLiterals::MapNotFound);
-    } else if (target.starts_with(RequestLiterals::MapsTarget))
-        return json_response(http::status::ok, GetMapsJson());
+    if (match.id == router::RouteId::Map) {
+        auto doc = catalog_.FindMap(match.param);
+        if (doc == nullptr)
+            return json_response(http::status::not_found, ResponseLiterals::MapNotFound);
+        return MakeDocumentResponse(req, *doc, compression_);
+    } else if (match.id == router::RouteId::Maps)
+        return MakeDocumentResponse(req, catalog_.GetList(), compression_);
     return json_response(http::status::bad_request, ResponseLiterals::BadRequest);
 }
 
@@ -328,54 +241,91 @@ StringResponse ApiHandler::HandleJoinGameRequest(const StringRequest &&req) {
         return json_response(http::status::bad_request, ResponseLiterals::InvalidArgument);
 }
 
-StringResponse ApiHandler::HandleGameStateRequest(const StringRequest &&req, const std::string& target) {
-    const auto json_response = [&req](http::status status, std::string_view text) {
-        return api_handler::MakeStringResponse(status, text, req.version(),req.keep_alive(),
-                                               BasicLiterals::AppJson, BasicLiterals::AllowGet);
+ApiHandler::AuthResult ApiHandler::Authenticate(const StringRequest& req, router::RouteId route) const {
+    const bool is_action = route == router::RouteId::Action;
+    const auto json_response = [&req, is_action](http::status status, std::string_view text) {
+        return api_handler::MakeStringResponse(status, text, req.version(),req.keep_alive(), BasicLiterals::AppJson,
+                                               is_action ? BasicLiterals::AllowPost : BasicLiterals::AllowGet);
     };
 
-    std::string token;
-    auto get_valid_res = ValidateAuthenticationRequest(std::forward<decltype(req)>(req), token);
-    if (get_valid_res == AuthenticationResponse::OK) {
-        auto player = players_.FindByToken(token);
-        if (player == nullptr)
+    std::string_view token;
+    auto valid_res = is_action ? ValidateMoveRequest(std::move(req), token) :
+                                 ValidateAuthenticationRequest(std::move(req), token);
+    if (valid_res == AuthenticationResponse::OK) {
+        auto player = players_.Resolve(token);
+        if (!player)
             return json_response(http::status::unauthorized, ResponseLiterals::PlayerNotFound);
-        if (target.starts_with("/api/v1/game/players"))
-            return json_response(http::status::ok, GetPlayersInfo());
-        else if (target.starts_with("/api/v1/game/state"))
-            return json_response(http::status::ok, GetGameState());
-        else
-            return json_response(http::status::bad_request, ResponseLiterals::InvalidTarget);
-    } else if (get_valid_res == AuthenticationResponse::InvalidMethod)
+        return *player;
+    } else if (valid_res == AuthenticationResponse::InvalidMethod)
         return json_response(http::status::method_not_allowed, ResponseLiterals::InvalidMethod);
+    else if (valid_res == AuthenticationResponse::InvalidContent)
+        return json_response(http::status::bad_request, ResponseLiterals::InvalidArgument);
     else
         return json_response(http::status::unauthorized, ResponseLiterals::InvalidToken);
 }
 
-StringResponse ApiHandler::HandleActionRequest(const StringRequest &&req) {
+StringResponse ApiHandler::HandleGameStateRequest(const StringRequest &&req, router::RouteId route,
+                                                  const app::PlayerRef& player_ref) {
     const auto json_response = [&req](http::status status, std::string_view text) {
         return api_handler::MakeStringResponse(status, text, req.version(),req.keep_alive(),
-                                               BasicLiterals::AppJson, BasicLiterals::AllowPost);
+                                               BasicLiterals::AppJson, BasicLiterals::AllowGet);
     };
 
-    std::string token, body {req.body()};
-    auto valid_res = ValidateMoveRequest(std::forward<decltype(req)>(req), token);
-    if (valid_res == AuthenticationResponse::OK) {
-        auto move_res = ParseMoveRequest(body);
-        if (move_res.first == ParsingResponse::OK) {
-            auto player = players_.FindByToken(token);
-            if (player == nullptr)
-                return json_response(http::status::unauthorized, ResponseLiterals::PlayerNotFound);
-            players_.FindByToken(token)->setDogSpeed(move_res.second);
-            return json_response(http::status::ok, ResponseLiterals::OK);
-        } else
-            return json_response(http::status::bad_request, ResponseLiterals::MoveParseError);
-    } else if (valid_res == AuthenticationResponse::InvalidMethod)
-        return json_response(http::status::method_not_allowed, ResponseLiterals::InvalidMethod);
-    else if (valid_res == AuthenticationResponse::InvalidContent)
-        return json_response(http::status::bad_request, ResponseLiterals::InvalidArgument);
+    // The player may have retired since the token was resolved
+    if (players_.FindByRef(player_ref) == nullptr)
+        return json_response(http::status::unauthorized, ResponseLiterals::PlayerNotFound);
+    if (route == router::RouteId::Players)
+        return json_response(http::status::ok, GetPlayersInfo());
+    else if (route == router::RouteId::State)
+        return json_response(http::status::ok, GetGameState());
     else
-        return json_response(http::status::unauthorized, ResponseLiterals::InvalidToken);
+        return json_response(http::status::bad_request, ResponseLiterals::InvalidTarget);
+}
+
+StringResponse ApiHandler::HandleActionRequest(const StringRequest &&req, const app::PlayerRef& player_ref) {
+    const auto json_response = [&req](http::status status, std::string_view text) {
+        return api_handler::MakeStringResponse(status, text, req.version(),req.keep_alive(),
+                                               BasicLiterals::AppJson, BasicLiterals::AllowPost);
+    };
+
+    auto dir = action_request::ParseMove(req.body());
+    if (!dir.has_value())
+        return json_response(http::status::bad_request, ResponseLiterals::MoveParseError);
+    auto player = players_.FindByRef(player_ref);
+    if (player == nullptr)
+        return json_response(http::status::unauthorized, ResponseLiterals::PlayerNotFound);
+    player->setDogSpeed(*dir);
+    return json_response(http::status::ok, ResponseLiterals::OK);
+}
+
+void ApiHandler::Tick(int nof_ms) {
+    using Clock = latency::Clock;
+    tick_profiler::Scope scope {"tick"};
+    const auto start = Clock::now();
+    model::TickStats stats;
+    std::vector<model::DogInfo> retired_players;
+    const bool snapshot_due = schedule_.Advance(nof_ms, [this, &stats, &retired_players](int step) {
+        auto retired = game_.UpdateGame(step, &stats);
+        retired_players.insert(retired_players.end(), retired.begin(), retired.end());
+    });
+    for (auto &player: retired_players)
+        players_.DeletePLayer({model::Dog::Id{player.dog_id_}, model::GameSession::Id{player.session_id_}});
+    const auto saving = Clock::now();
+    if (!retired_players.empty()) {
+        tick_profiler::Scope save_scope {"save_players"};
+        if (player_writer_)
+            player_writer_->Push(retired_players);
+        else
+            db_.SavePlayers(retired_players);
+    }
+    const auto saved = Clock::now();
+    metrics_.OnPlayersHandOff(saved - saving);
+    metrics_.OnTick(stats, retired_players.size(), saved - start);
+    metrics_.PublishSessions(game_);
+    game_time_ms_ += nof_ms;
+    last_tick_at_ = Clock::now();
+    if (snapshot_due)
+        PublishSnapshot();
 }
 
 StringResponse ApiHandler::HandleTickRequest(const StringRequest &&req) {
@@ -389,49 +339,63 @@ StringResponse ApiHandler::HandleTickRequest(const StringRequest &&req) {
         return json_response(http::status::method_not_allowed, ResponseLiterals::InvalidMethod);
     auto tick_res = ParseTickRequest(body);
     if (tick_res.first == ParsingResponse::OK) {
-        auto retired_players = game_.UpdateGame(tick_res.second);
-        for (auto &player: retired_players)
-            players_.DeletePLayer(player.dog_id_);
-        db_.SavePlayers(retired_players);
+        Tick(tick_res.second);
         tick_signal_(tick_res.second);
         return json_response(http::status::ok, ResponseLiterals::OK);
     } else
         return json_response(http::status::bad_request, ResponseLiterals::TickParseError);
 }
 
-StringResponse ApiHandler::HandleRecordsRequest(const StringRequest &&req, const std::string &target) {
+StringResponse ApiHandler::HandleRecordsRequest(const StringRequest &&req, std::string_view query) {
     const auto json_response = [&req](http::status status, std::string_view text) {
         return api_handler::MakeStringResponse(status, text, req.version(),req.keep_alive(),
                                                BasicLiterals::AppJson, BasicLiterals::AllowGet);
     };
-    auto rec_params = GetRecordsParams(target);
-    if (rec_params.second > MAX_RECORDS)
+    auto start = router::IntQueryParam(query, "start", 0);
+    auto size = router::IntQueryParam(query, "maxItems", MAX_RECORDS);
+    if (!start || !size || *start < 0 || *size < 0)
+        return json_response(http::status::bad_request, ResponseLiterals::BadRequest);
+    if (*size > MAX_RECORDS)
         return json_response(http::status::bad_request, ResponseLiterals::InvalidSize);
-    return json_response(http::status::ok, GetPlayerRecords(rec_params.first, rec_params.second));
+    return json_response(http::status::ok, GetPlayerRecords(*start, *size));
 }
 
-StringResponse ApiHandler::HandleApiRequest(const StringRequest&& req) {
+StringResponse ApiHandler::HandleApiRequest(const StringRequest&& req, const router::Match& match) {
     const auto json_response = [&req](http::status status, std::string_view text) {
         return api_handler::MakeStringResponse(status, text, req.version(),req.keep_alive(),
                                                BasicLiterals::AppJson, BasicLiterals::AllowAll);
     };
 
-    std::string target {req.target()};
-    if (target.starts_with(RequestLiterals::JoinTarget))
-        return HandleJoinGameRequest(std::forward<decltype(req)>(req));
-    else if (target.starts_with(RequestLiterals::MoveTarget))
-        return HandleActionRequest(std::forward<decltype(req)>(req));
-    else if (target.starts_with(RequestLiterals::PlayersTarget) ||
-                target.starts_with(RequestLiterals::GameStateTarget))
-        return HandleGameStateRequest(std::forward<decltype(req)>(req), target);
-    else if (test_mode_ && target.starts_with(RequestLiterals::TickTarget))
-        return HandleTickRequest(std::forward<decltype(req)>(req));
-    else if (target.starts_with(RequestLiterals::RecordsTarget))
-        return HandleRecordsRequest(std::forward<decltype(req)>(req), target);
-    else if (target.starts_with(RequestLiterals::MapsTarget))
-        return HandleMapRequests(std::forward<decltype(req)>(req), target);
-    else
-        return json_response(http::status::bad_request, ResponseLiterals::InvalidTarget);
+    switch (match.id) {
+        case router::RouteId::Join:
+            return HandleJoinGameRequest(std::forward<decltype(req)>(req));
+        case router::RouteId::Action:
+        case router::RouteId::Players:
+        case router::RouteId::State: {
+            auto auth = Authenticate(req, match.id);
+            if (auto player = std::get_if<app::PlayerRef>(&auth))
+                return HandleApiRequest(std::forward<decltype(req)>(req), match, *player);
+            return std::get<StringResponse>(std::move(auth));
+        }
+        case router::RouteId::Tick:
+            if (test_mode_)
+                return HandleTickRequest(std::forward<decltype(req)>(req));
+            break;
+        case router::RouteId::Records:
+            return HandleRecordsRequest(std::forward<decltype(req)>(req), match.query);
+        case router::RouteId::Maps:
+        case router::RouteId::Map:
+            return HandleMapRequests(req, match);
+    }
+    return json_response(http::status::bad_request, ResponseLiterals::InvalidTarget);
+}
+
+StringResponse ApiHandler::HandleApiRequest(const StringRequest&& req, const router::Match& match, const app::PlayerRef& player) {
+    if (match.id == router::RouteId::Action)
+        return HandleActionRequest(std::forward<decltype(req)>(req), player);
+    else if (match.id == router::RouteId::Players || match.id == router::RouteId::State)
+        return HandleGameStateRequest(std::forward<decltype(req)>(req), match.id, player);
+    return HandleApiRequest(std::forward<decltype(req)>(req), match);
 }
 
 } // namespace api_handler
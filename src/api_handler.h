@@ -1,12 +1,20 @@
 #pragma once
 #include "app.h"
 #include "postgres.h"
+#include "db_writer.h"
+#include "model_json.h"
+#include "compression.h"
+#include "map_catalog.h"
+#include "http_conditional.h"
+#include "router.h"
+#include "action_request.h"
+#include "metrics.h"
+#include "sim_schedule.h"
 #include <boost/json.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/signals2.hpp>
-#include <boost/url.hpp>
+#include <variant>
 
-using literal = std::string_view;
 
 class ResponseLiterals {
 public:
@@ -22,21 +30,11 @@ public:
     static constexpr literal MoveParseError = R"({"code": "invalidArgument", "message": "Failed to parse action"})";
     static constexpr literal TickParseError = R"({"code": "invalidArgument", "message": "Failed to parse tick request JSON"})";
     static constexpr literal BadRequest = R"({"code": "badRequest", "message": "Bad request"})";
+    static constexpr literal TooManyRequests = R"({"code": "tooManyRequests", "message": "Request rate limit exceeded"})";
+    static constexpr literal Overloaded = R"({"code": "overloaded", "message": "Server is busy, retry later"})";
     static constexpr literal OK = R"({})";
 };
 
-class RequestLiterals {
-public:
-    static constexpr literal JoinTarget = "/api/v1/game/join";
-    static constexpr literal MoveTarget = "/api/v1/game/player/action";
-    static constexpr literal PlayersTarget = "/api/v1/game/players";
-    static constexpr literal GameStateTarget = "/api/v1/game/state";
-    static constexpr literal TickTarget = "/api/v1/game/tick";
-    static constexpr literal RecordsTarget = "/api/v1/game/records";
-    static constexpr literal MapsTarget = "/api/v1/maps";
-    static constexpr literal MapTarget = "/api/v1/maps/";
-};
-
 class BasicLiterals {
 public:
     static constexpr literal AppJson = "application/json";
@@ -44,6 +42,7 @@ public:
     static constexpr literal AllowGet = "GET, HEAD";
     static constexpr literal AllowPost = "POST";
     static constexpr literal AllowAll = "GET, HEAD, POST";
+    static constexpr literal CacheMaps = "public, max-age=60";
 };
 
 namespace api_handler {
@@ -51,12 +50,17 @@ namespace api_handler {
 namespace json = boost::json;
 namespace http = boost::beast::http;
 namespace sig = boost::signals2;
-namespace url = boost::urls;
 using StringResponse = http::response<http::string_body>;
 using StringRequest = http::request<http::string_body>;
 using TickSignal = sig::signal<void(int nof_ms)>;
 
+// beast::string_view is not std::string_view in every Boost configuration
+inline std::string_view AsStringView(boost::beast::string_view str) noexcept {
+    return {str.data(), str.size()};
+}
+
 constexpr int MAX_RECORDS = 100;
+constexpr size_t RESPONSE_BUFFER_SIZE = 64 * 1024;
 
 enum class AuthorizationResponse {
     OK,
@@ -79,24 +83,30 @@ enum class ParsingResponse {
     ParsingError
 };
 
-enum HeaderValues {
-    KeyLength = 7,
-    TokenLength = 32
-};
-
 class ApiHandler {
-    const model::Map* GetMap(const std::string &req_target);
-    std::string GetMapsJson();
 public:
-    explicit ApiHandler(model::Game& game, database::Database& db, bool test_mode = false, bool rand_pos = false):
+    explicit ApiHandler(model::Game& game, database::PlayerStore& db, bool test_mode = false, bool rand_pos = false,
+                        const compression::Options& compression = {}, const sim_schedule::Options& simulation = {}):
                 game_(game), db_(db),
-                test_mode_(test_mode), rand_pos_(rand_pos) {}
-    StringResponse HandleApiRequest(const StringRequest&& req);
+                test_mode_(test_mode), rand_pos_(rand_pos), compression_(compression),
+                catalog_(game.GetMaps(), compression), schedule_(simulation) {}
+    using AuthResult = std::variant<app::PlayerRef, StringResponse>;
+
+    // Handles a request as routed by router::MatchRoute, whose views point into its target;
+    // map routes are better served through HandleMapRequests
+    StringResponse HandleApiRequest(const StringRequest&& req, const router::Match& match);
+    // Same for a request whose token was resolved by Authenticate
+    StringResponse HandleApiRequest(const StringRequest&& req, const router::Match& match, const app::PlayerRef& player);
+    // Checks method, headers and token of a route that requires a token (router::RequiresToken).
+    // Thread-safe: lets IO threads reject unauthorized requests without queuing on the API strand.
+    AuthResult Authenticate(const StringRequest& req, router::RouteId route) const;
+    // Serves the precomputed map catalog; does not touch mutable state and may run off the API strand
+    StringResponse HandleMapRequests(const StringRequest& req, const router::Match& match) const;
     const std::vector<app::Player>& GetPlayers() const noexcept {
         return players_.GetPlayers();
     }
-    void DeletePlayer(const std::uint32_t& dog_id) {
-        players_.DeletePLayer(dog_id);
+    void DeletePlayer(const app::PlayerRef& player) {
+        players_.DeletePLayer(player);
     }
     void AddPlayer(const app::PlayerBase& player, model::GameSession& session) {
         players_.AddPlayer(player, session);
@@ -104,22 +114,61 @@ public:
     [[nodiscard]] sig::connection DoOnTick(const TickSignal::slot_type& handler) {
         return tick_signal_.connect(handler);
     }
+    // Advances the game in substeps, retires and saves idle players and publishes a snapshot
+    // when one is due; runs on the API strand, whether from the ticker or from a tick request
+    void Tick(int nof_ms);
+    // Retired players are then queued for it instead of being written on the API strand
+    void SetPlayerWriter(std::shared_ptr<db_writer::WriteBehind> writer) {
+        player_writer_ = std::move(writer);
+    }
+    const db_writer::WriteBehind* PlayerWriter() const noexcept {
+        return player_writer_.get();
+    }
+    // Debug endpoints, the tick request and the tick trace, are served only in test mode
+    bool TestMode() const noexcept {
+        return test_mode_;
+    }
+    metrics::GameMetrics& Metrics() noexcept {
+        return metrics_;
+    }
+    const metrics::GameMetrics& Metrics() const noexcept {
+        return metrics_;
+    }
 private:
     std::pair<app::Player*,std::string> AddPlayer(const std::string& dog_name, const model::Map* map);
-    std::string GetPlayersInfo();
-    std::string GetGameState();
-    std::string GetPlayerRecords(int start, int size);
+    std::string_view CreatePlayerInfo(std::pair<const app::Player*,std::string> info);
+    std::string_view GetPlayersInfo();
+    std::string_view GetGameState();
+    std::string_view WritePlayersInfo();
+    // Extrapolated to `at` when that is past the last tick and extrapolation is on; tickTime only then
+    std::string_view WriteGameState(latency::Clock::time_point at);
+    void PublishSnapshot();
+    std::string_view GetPlayerRecords(int start, int size);
     StringResponse HandleJoinGameRequest(const StringRequest&& req);
-    StringResponse HandleMapRequests(const StringRequest&& req, const std::string& target);
-    StringResponse HandleGameStateRequest(const StringRequest&& req, const std::string& target);
-    StringResponse HandleActionRequest(const StringRequest&& req);
+    StringResponse HandleGameStateRequest(const StringRequest&& req, router::RouteId route, const app::PlayerRef& player_ref);
+    StringResponse HandleActionRequest(const StringRequest&& req, const app::PlayerRef& player_ref);
     StringResponse HandleTickRequest(const StringRequest&& req);
-    StringResponse HandleRecordsRequest(const StringRequest&& req, const std::string& target);
+    StringResponse HandleRecordsRequest(const StringRequest&& req, std::string_view query);
     model::Game& game_;
     app::Players players_;
     bool test_mode_, rand_pos_;
     TickSignal tick_signal_;
-    database::Database& db_;
+    database::PlayerStore& db_;
+    std::shared_ptr<db_writer::WriteBehind> player_writer_;
+    json_writer::JsonWriter writer_ {RESPONSE_BUFFER_SIZE};
+    compression::Options compression_;
+    map_catalog::MapCatalog catalog_;
+    metrics::GameMetrics metrics_;
+    sim_schedule::Schedule schedule_;
+    // State documents as of the last snapshot, served to every poll until the next one
+    struct Snapshot {
+        std::string players;
+        std::string state;
+    };
+    std::optional<Snapshot> snapshot_;
+    // Game time at the end of the last tick and when that tick ended
+    std::uint64_t game_time_ms_ = 0;
+    latency::Clock::time_point last_tick_at_ = latency::Clock::now();
 };
 
 
@@ -1,6 +1,7 @@
 #pragma once
-#include <sstream>
+#include <random>
 #include "model.h"
+#include "token.h"
 
 namespace app {
 
@@ -18,9 +19,12 @@ private:
         return dist(random_device_);
     }()};
 public:
-    std::string getToken();
-private:
-    static constexpr size_t fmt_mult = 2;
+    token::TokenKey getKey() {
+        return {generator1_(), generator2_()};
+    }
+    std::string getToken() {
+        return token::EncodeToken(getKey());
+    }
 };
 
 class PlayerBase {
@@ -65,7 +69,7 @@ public:
     }
 
     void setDogSpeed(const model::Direction& dir) {
-        session_.FindDog(dog_id_)->SetSpeed(dir);
+        session_.SetDogSpeed(dog_id_, dir);
     }
     Player(model::GameSession& session, const model::Dog::Id dog_id) noexcept:
         PlayerBase(dog_id, session.GetId()),
@@ -80,29 +84,59 @@ private:
     model::GameSession& session_;
 };
 
+// What a token resolves to, safe to carry across threads. Dog ids are unique only within a
+// session, a player is known by both.
+struct PlayerRef {
+    model::Dog::Id dog_id;
+    model::GameSession::Id session_id;
+
+    std::uint64_t Pack() const noexcept {
+        return (static_cast<std::uint64_t>(*session_id) << 32) | *dog_id;
+    }
+    static PlayerRef Unpack(std::uint64_t value) noexcept {
+        return {model::Dog::Id{static_cast<std::uint32_t>(value)},
+                model::GameSession::Id{static_cast<std::uint32_t>(value >> 32)}};
+    }
+};
+
 class Players {
 public:
     std::pair<Player*,std::string> AddPlayer(const model::Dog::Id dog_id, model::GameSession& session);
     void AddPlayer(const PlayerBase& player, model::GameSession& session);
-    Player* FindByToken(const std::string& token) {
-        if (auto it = token_to_index_.find(token); it != token_to_index_.end()) {
-            return &players_.at(it->second);
+    // Thread-safe, may run on any thread while players join and retire on the API strand
+    std::optional<PlayerRef> Resolve(const token::TokenKey& key) const noexcept {
+        if (auto value = token_to_index_.Find(key))
+            return PlayerRef::Unpack(*value);
+        return std::nullopt;
+    }
+    std::optional<PlayerRef> Resolve(std::string_view token) const noexcept {
+        auto key = token::DecodeToken(token);
+        return key ? Resolve(*key) : std::nullopt;
+    }
+    Player* FindByRef(const PlayerRef& ref) noexcept {
+        if (auto it = ref_to_index_.find(ref.Pack()); it != ref_to_index_.end()) {
+            return &players_[it->second];
         }
         return nullptr;
     }
+    Player* FindByToken(const token::TokenKey& key) noexcept {
+        auto ref = Resolve(key);
+        return ref ? FindByRef(*ref) : nullptr;
+    }
+    Player* FindByToken(std::string_view token) noexcept {
+        auto key = token::DecodeToken(token);
+        return key ? FindByToken(*key) : nullptr;
+    }
     const std::vector<Player>& GetPlayers() const noexcept {
         return players_;
     }
-    void DeletePLayer(const std::uint32_t& dog_id);
+    void DeletePLayer(const PlayerRef& ref);
 private:
-    using TokenToIndex = std::unordered_map<std::string,size_t>;
-    using DogIdHasher = util::TaggedHasher<model::Dog::Id>;
-    using DogToIndex = std::unordered_map<model::Dog::Id,size_t,DogIdHasher>;
-
     std::vector<Player> players_;
     TokenGenerator generator_;
-    TokenToIndex token_to_index_;
-    DogToIndex dog_to_index_;
+    token::TokenDirectory token_to_index_;
+    // Keyed by PlayerRef::Pack
+    std::unordered_map<std::uint64_t, size_t> ref_to_index_;
 };
 
 } // namespace app
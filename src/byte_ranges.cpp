@@ -0,0 +1,169 @@
+#include "byte_ranges.h"
+#include <cctype>
+#include <charconv>
+#include <random>
+
+namespace byte_ranges {
+
+namespace {
+
+std::string_view Trim(std::string_view str) noexcept {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+        str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+        str.remove_suffix(1);
+    return str;
+}
+
+std::optional<std::uint64_t> ParseNumber(std::string_view str) noexcept {
+    std::uint64_t value = 0;
+    if (str.empty())
+        return std::nullopt;
+    auto res = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (res.ec != std::errc{} || res.ptr != str.data() + str.size())
+        return std::nullopt;
+    return value;
+}
+
+std::string MakeBoundary() {
+    thread_local std::mt19937_64 generator {std::random_device{}()};
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string boundary {"GAME_SERVER_BYTERANGES_"};
+    auto value = generator();
+    for (int shift = 60; shift >= 0; shift -= 4)
+        boundary.push_back(hex[(value >> shift) & 0xF]);
+    return boundary;
+}
+
+} // namespace
+
+std::pair<RangeStatus,std::vector<ByteRange>> ParseRange(std::string_view header, std::uint64_t size, size_t max_ranges) {
+    constexpr std::string_view unit = "bytes=";
+    header = Trim(header);
+    if (header.size() < unit.size())
+        return {RangeStatus::Ignored, {}};
+    for (size_t i = 0; i < unit.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(header[i])) != unit[i])
+            return {RangeStatus::Ignored, {}};
+    }
+    header.remove_prefix(unit.size());
+
+    std::vector<ByteRange> ranges;
+    size_t specs = 0;
+    while (true) {
+        auto end = header.find(',');
+        auto spec = Trim(header.substr(0, end));
+        if (!spec.empty()) {
+            if (++specs > max_ranges)
+                return {RangeStatus::Ignored, {}};
+            auto dash = spec.find('-');
+            if (dash == std::string_view::npos)
+                return {RangeStatus::Ignored, {}};
+            auto first = spec.substr(0, dash), last = spec.substr(dash + 1);
+            if (first.empty()) {
+                // suffix range: the last N bytes
+                auto suffix = ParseNumber(last);
+                if (!suffix.has_value())
+                    return {RangeStatus::Ignored, {}};
+                if (*suffix > 0 && size > 0) {
+                    auto length = std::min(*suffix, size);
+                    ranges.push_back({size - length, length});
+                }
+            } else {
+                auto from = ParseNumber(first);
+                auto to = last.empty() ? std::optional<std::uint64_t>{size - 1} : ParseNumber(last);
+                if (!from.has_value() || !to.has_value() || (!last.empty() && *to < *from))
+                    return {RangeStatus::Ignored, {}};
+                if (*from < size)
+                    ranges.push_back({*from, std::min(*to, size - 1) - *from + 1});
+            }
+        }
+        if (end == std::string_view::npos)
+            break;
+        header.remove_prefix(end + 1);
+    }
+    if (specs == 0)
+        return {RangeStatus::Ignored, {}};
+    if (ranges.empty())
+        return {RangeStatus::Unsatisfiable, {}};
+    return {RangeStatus::Satisfiable, std::move(ranges)};
+}
+
+std::string ContentRange(const ByteRange& range, std::uint64_t total_size) {
+    return "bytes " + std::to_string(range.offset) + "-" + std::to_string(range.offset + range.length - 1) +
+           "/" + std::to_string(total_size);
+}
+
+std::string MakeRangesBody(RangesBody::value_type& body, const std::vector<ByteRange>& ranges,
+                           std::string_view content_type, std::uint64_t total_size) {
+    body.parts.clear();
+    body.trailer.clear();
+    if (ranges.size() == 1) {
+        body.parts.push_back({{}, ranges.front().offset, ranges.front().length});
+        return std::string{content_type};
+    }
+    auto boundary = MakeBoundary();
+    for (const auto& range: ranges) {
+        std::string header = body.parts.empty() ? "--" : "\r\n--";
+        header.append(boundary);
+        header.append("\r\nContent-Type: ").append(content_type);
+        header.append("\r\nContent-Range: ").append(ContentRange(range, total_size));
+        header.append("\r\n\r\n");
+        body.parts.push_back({std::move(header), range.offset, range.length});
+    }
+    body.trailer = "\r\n--" + boundary + "--\r\n";
+    return "multipart/byteranges; boundary=" + boundary;
+}
+
+std::uint64_t RangesBody::size(const value_type& body) {
+    std::uint64_t total = body.trailer.size();
+    for (const auto& part: body.parts)
+        total += part.header.size() + part.length;
+    return total;
+}
+
+boost::optional<std::pair<RangesBody::writer::const_buffers_type, bool>> RangesBody::writer::get(beast::error_code& ec) {
+    ec = {};
+    while (part_ < body_.parts.size()) {
+        const auto& part = body_.parts[part_];
+        if (!header_sent_) {
+            header_sent_ = true;
+            if (!part.header.empty())
+                return {{const_buffers_type{part.header.data(), part.header.size()}, true}};
+        }
+        auto remaining = part.length - sent_;
+        if (remaining == 0) {
+            ++part_;
+            header_sent_ = false;
+            sent_ = 0;
+            continue;
+        }
+        if (body_.data) {
+            const char* begin = body_.data->data() + part.offset + sent_;
+            sent_ += remaining;
+            return {{const_buffers_type{begin, static_cast<size_t>(remaining)}, true}};
+        }
+        if (!chunk_)
+            chunk_ = std::make_unique<char[]>(CHUNK_SIZE);
+        auto amount = static_cast<size_t>(std::min<std::uint64_t>(remaining, CHUNK_SIZE));
+        body_.file->seek(part.offset + sent_, ec);
+        if (ec)
+            return boost::none;
+        auto read = body_.file->read(chunk_.get(), amount, ec);
+        if (ec)
+            return boost::none;
+        if (read == 0) {
+            ec = http::error::short_read;
+            return boost::none;
+        }
+        sent_ += read;
+        return {{const_buffers_type{chunk_.get(), read}, true}};
+    }
+    if (!trailer_sent_ && !body_.trailer.empty()) {
+        trailer_sent_ = true;
+        return {{const_buffers_type{body_.trailer.data(), body_.trailer.size()}, false}};
+    }
+    return boost::none;
+}
+
+} // namespace byte_ranges
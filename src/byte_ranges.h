@@ -0,0 +1,82 @@
+#pragma once
+#include <boost/beast/core/file.hpp>
+#include <boost/beast/http.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_cache.h"
+
+namespace byte_ranges {
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+
+struct ByteRange {
+    std::uint64_t offset;
+    std::uint64_t length;
+};
+
+enum class RangeStatus {
+    // no Range header, or one that must be ignored: the full body is sent
+    Ignored,
+    Satisfiable,
+    Unsatisfiable
+};
+
+constexpr size_t MAX_RANGES = 16;
+
+// Parses a "bytes=" Range header against a representation of the given size
+std::pair<RangeStatus,std::vector<ByteRange>> ParseRange(std::string_view header, std::uint64_t size,
+                                                         size_t max_ranges = MAX_RANGES);
+
+// Body streaming selected ranges either from a shared in-memory buffer or from an
+// open file with offset reads, wrapping them into multipart/byteranges when needed
+struct RangesBody {
+    struct Part {
+        std::string header;
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+    };
+
+    struct value_type {
+        file_cache::Buffer data;
+        std::shared_ptr<beast::file> file;
+        std::vector<Part> parts;
+        std::string trailer;
+    };
+
+    static std::uint64_t size(const value_type& body);
+
+    class writer {
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template<bool isRequest, class Fields>
+        explicit writer(const http::header<isRequest, Fields>&, const value_type& body): body_(body) {}
+
+        void init(beast::error_code& ec) {
+            ec = {};
+        }
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec);
+    private:
+        static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+        const value_type& body_;
+        size_t part_ = 0;
+        bool header_sent_ = false;
+        bool trailer_sent_ = false;
+        std::uint64_t sent_ = 0;
+        std::unique_ptr<char[]> chunk_;
+    };
+};
+
+// Fills the body for the given ranges; several ranges become multipart/byteranges parts.
+// Returns the Content-Type of the whole response.
+std::string MakeRangesBody(RangesBody::value_type& body, const std::vector<ByteRange>& ranges,
+                           std::string_view content_type, std::uint64_t total_size);
+std::string ContentRange(const ByteRange& range, std::uint64_t total_size);
+
+} // namespace byte_ranges
@@ -0,0 +1,166 @@
+#include "compression.h"
+#include <array>
+#include <cctype>
+#include <memory>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace compression {
+
+namespace {
+
+constexpr int WINDOW_BITS = 15;
+constexpr int GZIP_WINDOW_BITS = WINDOW_BITS + 16;
+constexpr int MEM_LEVEL = 8;
+
+class Deflater {
+public:
+    Deflater(Encoding encoding, int level): level_(level) {
+        int window_bits = encoding == Encoding::Gzip ? GZIP_WINDOW_BITS : WINDOW_BITS;
+        if (deflateInit2(&stream_, level, Z_DEFLATED, window_bits, MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("Failed to initialize deflate stream");
+    }
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+    ~Deflater() {
+        deflateEnd(&stream_);
+    }
+
+    int Level() const noexcept {
+        return level_;
+    }
+
+    std::string Compress(std::string_view data) {
+        deflateReset(&stream_);
+        std::string out;
+        out.resize(deflateBound(&stream_, data.size()));
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream_.avail_in = static_cast<uInt>(data.size());
+        stream_.next_out = reinterpret_cast<Bytef*>(out.data());
+        stream_.avail_out = static_cast<uInt>(out.size());
+        if (deflate(&stream_, Z_FINISH) != Z_STREAM_END)
+            throw std::runtime_error("Failed to deflate response body");
+        out.resize(stream_.total_out);
+        return out;
+    }
+private:
+    z_stream stream_ {};
+    int level_;
+};
+
+Deflater& ThreadDeflater(Encoding encoding, int level) {
+    thread_local std::array<std::unique_ptr<Deflater>, 2> deflaters;
+    auto& deflater = deflaters[encoding == Encoding::Gzip ? 0 : 1];
+    if (!deflater || deflater->Level() != level)
+        deflater = std::make_unique<Deflater>(encoding, level);
+    return *deflater;
+}
+
+std::string_view Trim(std::string_view str) noexcept {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+        str.remove_prefix(1);
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+        str.remove_suffix(1);
+    return str;
+}
+
+bool IEquals(std::string_view lhs, std::string_view rhs) noexcept {
+    if (lhs.size() != rhs.size())
+        return false;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(lhs[i])) != std::tolower(static_cast<unsigned char>(rhs[i])))
+            return false;
+    }
+    return true;
+}
+
+double ParseQuality(std::string_view params) noexcept {
+    while (!params.empty()) {
+        auto end = params.find(';');
+        auto param = Trim(params.substr(0, end));
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            param.remove_prefix(2);
+            double q = 0.0, scale = 1.0;
+            bool fraction = false;
+            for (char ch: param) {
+                if (ch == '.') {
+                    fraction = true;
+                } else if (ch >= '0' && ch <= '9') {
+                    if (fraction) {
+                        scale /= 10;
+                        q += (ch - '0') * scale;
+                    } else {
+                        q = q * 10 + (ch - '0');
+                    }
+                } else {
+                    return 0.0;
+                }
+            }
+            return q;
+        }
+        if (end == std::string_view::npos)
+            break;
+        params.remove_prefix(end + 1);
+    }
+    return 1.0;
+}
+
+} // namespace
+
+Encoding ChooseEncoding(std::string_view accept_encoding) noexcept {
+    double gzip_q = -1.0, deflate_q = -1.0, any_q = -1.0;
+    while (!accept_encoding.empty()) {
+        auto end = accept_encoding.find(',');
+        auto item = accept_encoding.substr(0, end);
+        auto params_pos = item.find(';');
+        auto coding = Trim(item.substr(0, params_pos));
+        double q = params_pos == std::string_view::npos ? 1.0 : ParseQuality(item.substr(params_pos + 1));
+        if (IEquals(coding, "gzip") || IEquals(coding, "x-gzip"))
+            gzip_q = q;
+        else if (IEquals(coding, "deflate"))
+            deflate_q = q;
+        else if (coding == "*")
+            any_q = q;
+        if (end == std::string_view::npos)
+            break;
+        accept_encoding.remove_prefix(end + 1);
+    }
+    if (gzip_q < 0)
+        gzip_q = any_q;
+    if (deflate_q < 0)
+        deflate_q = any_q;
+    if (gzip_q > 0 && gzip_q >= deflate_q)
+        return Encoding::Gzip;
+    if (deflate_q > 0)
+        return Encoding::Deflate;
+    return Encoding::Identity;
+}
+
+std::string_view EncodingName(Encoding encoding) noexcept {
+    switch (encoding) {
+        case Encoding::Gzip:
+            return "gzip";
+        case Encoding::Deflate:
+            return "deflate";
+        default:
+            return "identity";
+    }
+}
+
+bool IsCompressible(std::string_view content_type) noexcept {
+    return content_type.starts_with("text/") || content_type.starts_with("application/json") ||
+           content_type.starts_with("application/xml") || content_type.starts_with("application/javascript") ||
+           content_type.starts_with("image/svg+xml");
+}
+
+Decision Decide(std::string_view content_type, bool encoded, size_t body_size, Encoding encoding, const Options& options) noexcept {
+    if (encoded || !IsCompressible(content_type))
+        return {};
+    return {true, options.Enabled() && encoding != Encoding::Identity && body_size >= options.min_size};
+}
+
+std::string Compress(std::string_view data, Encoding encoding, int level) {
+    return ThreadDeflater(encoding, level).Compress(data);
+}
+
+} // namespace compression
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace compression {
+
+enum class Encoding {
+    Identity,
+    Gzip,
+    Deflate
+};
+
+struct Options {
+    // zlib level, 0 disables compression entirely
+    int level = 6;
+    // bodies shorter than this are sent as is
+    size_t min_size = 1024;
+
+    bool Enabled() const noexcept {
+        return level > 0;
+    }
+};
+
+// Picks the best coding the client accepts, honoring q-values; gzip wins ties
+Encoding ChooseEncoding(std::string_view accept_encoding) noexcept;
+std::string_view EncodingName(Encoding encoding) noexcept;
+bool IsCompressible(std::string_view content_type) noexcept;
+
+struct Decision {
+    // Vary goes on every compressible response, the client's Accept-Encoding picked its body
+    bool vary = false;
+    bool compress = false;
+};
+// For a response the handler built, before any coding is applied; already encoded bodies are left alone
+Decision Decide(std::string_view content_type, bool encoded, size_t body_size, Encoding encoding, const Options& options) noexcept;
+
+// Compresses with a deflate stream owned by the calling thread and reset between calls
+std::string Compress(std::string_view data, Encoding encoding, int level);
+
+} // namespace compression
@@ -0,0 +1,288 @@
+#include "db_writer.h"
+#include "logger.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace db_writer {
+using namespace std::literals;
+namespace fs = std::filesystem;
+namespace json = boost::json;
+
+void WriteSpill(std::ostream& out, const std::vector<model::DogInfo>& records) {
+    for (const auto& record: records) {
+        out << record.score_ << ' ' << record.playing_time_ << ' ' << record.name_.size() << '\n';
+        out.write(record.name_.data(), static_cast<std::streamsize>(record.name_.size()));
+        out << '\n';
+    }
+}
+
+std::vector<model::DogInfo> ReadSpill(std::istream& in) {
+    std::vector<model::DogInfo> records;
+    size_t score, playing_time, name_size;
+    while (in >> score >> playing_time >> name_size && in.get() == '\n') {
+        std::string name(name_size, '\0');
+        if (!in.read(name.data(), static_cast<std::streamsize>(name_size)) || in.get() != '\n')
+            break;
+        records.emplace_back(0, name, score, playing_time);
+    }
+    return records;
+}
+
+WriteBehind::WriteBehind(Sink sink, const Options& options): sink_(std::move(sink)), options_(options) {
+    if (options_.capacity == 0 || options_.batch_size == 0)
+        throw std::invalid_argument("Queue capacity and batch size must be positive"s);
+    if (options_.overflow == OverflowPolicy::Spill && options_.spill_path.empty())
+        throw std::invalid_argument("Spilling overflow needs a spill file"s);
+    // Left by an earlier run that could not reach the database
+    spill_pending_ = !options_.spill_path.empty() && fs::exists(options_.spill_path);
+    thread_ = std::thread{[this] {
+        Run();
+    }};
+}
+
+WriteBehind::~WriteBehind() {
+    Shutdown();
+}
+
+void WriteBehind::Push(const std::vector<model::DogInfo>& records) {
+    if (records.empty())
+        return;
+    std::unique_lock lock {mutex_};
+    auto record = records.begin();
+    while (record != records.end()) {
+        if (queue_.size() >= options_.capacity) {
+            if (options_.overflow != OverflowPolicy::Block || stop_)
+                break;
+            drained_.wait(lock, [this] {
+                return stop_ || queue_.size() < options_.capacity;
+            });
+            continue;
+        }
+        if (queue_.empty())
+            oldest_ = Clock::now();
+        queue_.push_back(*record++);
+    }
+    lock.unlock();
+    queued_.notify_one();
+
+    if (record == records.end())
+        return;
+    std::vector<model::DogInfo> overflow(record, records.end());
+    if (options_.overflow == OverflowPolicy::Spill)
+        Spill(overflow);
+    else
+        dropped_.fetch_add(overflow.size(), std::memory_order_relaxed);
+}
+
+void WriteBehind::Shutdown() {
+    {
+        std::lock_guard lock {mutex_};
+        stop_ = true;
+    }
+    queued_.notify_all();
+    drained_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+Stats WriteBehind::GetStats() const {
+    Stats stats;
+    {
+        std::lock_guard lock {mutex_};
+        stats.queued = queue_.size();
+    }
+    stats.committed = committed_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.failed_commits = failed_commits_.load(std::memory_order_relaxed);
+    stats.spilled = spilled_.load(std::memory_order_relaxed);
+    stats.replayed = replayed_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    commit_duration_.AddTo(stats.commit_duration);
+    return stats;
+}
+
+void WriteBehind::Run() {
+    // Without a spill file a failed batch is kept here, and holds up the queue so that the overflow policy applies
+    std::vector<model::DogInfo> failed;
+    // Set while the database is taken to be down
+    std::optional<Clock::time_point> retry_at;
+    if (!options_.spill_path.empty() && (spill_pending_ || fs::exists(options_.spill_path + ".replay")))
+        retry_at = Clock::now();
+
+    for (;;) {
+        if (retry_at && Clock::now() >= *retry_at) {
+            retry_at.reset();
+            if (!failed.empty() && Commit(failed))
+                failed.clear();
+            if (!failed.empty() || !Replay())
+                retry_at = Clock::now() + options_.retry_delay;
+        }
+        auto [batch, stopped] = NextBatch(retry_at, !failed.empty());
+        if (stopped)
+            break;
+        if (batch.empty() || (!retry_at && Commit(batch)))
+            continue;
+        // The database is down: spilled batches are not tried until the retry
+        if (!options_.spill_path.empty())
+            Spill(batch);
+        else
+            failed = std::move(batch);
+        if (!retry_at)
+            retry_at = Clock::now() + options_.retry_delay;
+    }
+
+    // One more attempt at everything left, what fails from then on is spilled without trying
+    {
+        std::lock_guard lock {mutex_};
+        failed.insert(failed.end(), queue_.begin(), queue_.end());
+        queue_.clear();
+    }
+    drained_.notify_all();
+    bool down = false;
+    for (size_t start = 0; start < failed.size(); start += options_.batch_size) {
+        auto end = failed.begin() + static_cast<std::ptrdiff_t>(std::min(failed.size(), start + options_.batch_size));
+        std::vector<model::DogInfo> batch(failed.begin() + static_cast<std::ptrdiff_t>(start), end);
+        if (!down && Commit(batch))
+            continue;
+        down = true;
+        if (!options_.spill_path.empty())
+            Spill(batch);
+        else
+            dropped_.fetch_add(batch.size(), std::memory_order_relaxed);
+    }
+    if (!down)
+        Replay();
+}
+
+std::pair<std::vector<model::DogInfo>, bool> WriteBehind::NextBatch(std::optional<Clock::time_point> wake, bool hold) {
+    std::unique_lock lock {mutex_};
+    auto ready = [this, hold] {
+        return stop_ || (!hold && !queue_.empty());
+    };
+    if (!wake)
+        queued_.wait(lock, ready);
+    else if (!queued_.wait_until(lock, *wake, ready))
+        return {{}, false};
+    // A batch fills up for as long as its oldest record may wait
+    queued_.wait_until(lock, oldest_ + options_.max_delay, [this] {
+        return stop_ || queue_.size() >= options_.batch_size;
+    });
+    if (stop_)
+        return {{}, true};
+    const auto end = queue_.begin() + static_cast<std::ptrdiff_t>(std::min(queue_.size(), options_.batch_size));
+    std::vector<model::DogInfo> batch(queue_.begin(), end);
+    queue_.erase(queue_.begin(), end);
+    lock.unlock();
+    drained_.notify_all();
+    return {std::move(batch), false};
+}
+
+bool WriteBehind::Commit(const std::vector<model::DogInfo>& batch) {
+    const auto start = latency::Clock::now();
+    try {
+        sink_(batch);
+    } catch (const std::exception& e) {
+        commit_duration_.Record(latency::Clock::now() - start);
+        failed_commits_.fetch_add(1, std::memory_order_relaxed);
+        logger::Log(json::value{{"records"s, batch.size()}, {"exception"s, e.what()}}, "db write failed"sv);
+        return false;
+    }
+    commit_duration_.Record(latency::Clock::now() - start);
+    committed_.fetch_add(batch.size(), std::memory_order_relaxed);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void WriteBehind::Spill(const std::vector<model::DogInfo>& records) {
+    std::lock_guard lock {spill_mutex_};
+    std::ofstream out {options_.spill_path, std::ios::binary | std::ios::app};
+    WriteSpill(out, records);
+    out.flush();
+    if (!out) {
+        dropped_.fetch_add(records.size(), std::memory_order_relaxed);
+        logger::Log(json::value{{"records"s, records.size()}, {"file"s, options_.spill_path}}, "db spill failed"sv);
+        return;
+    }
+    spilled_.fetch_add(records.size(), std::memory_order_relaxed);
+    spill_pending_ = true;
+}
+
+bool WriteBehind::Replay() {
+    if (options_.spill_path.empty())
+        return true;
+    // The spill file is moved aside while it is replayed, so that Push can go on spilling into a new one
+    const auto replay_path = options_.spill_path + ".replay";
+    for (;;) {
+        {
+            std::lock_guard lock {spill_mutex_};
+            // One left by a crash during a replay is finished first
+            if (!fs::exists(replay_path)) {
+                if (!spill_pending_)
+                    return true;
+                spill_pending_ = false;
+                std::error_code ec;
+                fs::rename(options_.spill_path, replay_path, ec);
+                if (ec)
+                    return true;
+            }
+        }
+        std::vector<model::DogInfo> records;
+        {
+            std::ifstream in {replay_path, std::ios::binary};
+            records = ReadSpill(in);
+        }
+        size_t done = 0;
+        while (done < records.size()) {
+            const auto end = records.begin() + static_cast<std::ptrdiff_t>(std::min(records.size(), done + options_.batch_size));
+            std::vector<model::DogInfo> batch(records.begin() + static_cast<std::ptrdiff_t>(done), end);
+            if (!Commit(batch))
+                break;
+            done += batch.size();
+            replayed_.fetch_add(batch.size(), std::memory_order_relaxed);
+        }
+        std::lock_guard lock {spill_mutex_};
+        if (done < records.size()) {
+            const std::vector<model::DogInfo> rest(records.begin() + static_cast<std::ptrdiff_t>(done), records.end());
+            std::ofstream out {options_.spill_path, std::ios::binary | std::ios::app};
+            WriteSpill(out, rest);
+            out.flush();
+            if (!out) {
+                // The replay file still holds them and is finished first on the next retry
+                KeepReplay(replay_path, rest, done);
+                return false;
+            }
+            spill_pending_ = true;
+        }
+        fs::remove(replay_path);
+        if (done < records.size())
+            return false;
+    }
+}
+
+void WriteBehind::KeepReplay(const std::string& replay_path, const std::vector<model::DogInfo>& rest, size_t committed) {
+    logger::Log(json::value{{"records"s, rest.size()}, {"file"s, options_.spill_path}}, "db spill failed"sv);
+    if (committed == 0)
+        return;
+    // Cut the committed records off, or the next replay commits them twice; the file is
+    // replaced only once the rest is safely written
+    const auto temporary = replay_path + ".tmp";
+    {
+        std::ofstream out {temporary, std::ios::binary | std::ios::trunc};
+        WriteSpill(out, rest);
+        out.flush();
+        if (!out) {
+            std::error_code ec;
+            fs::remove(temporary, ec);
+            logger::Log(json::value{{"records"s, committed}, {"file"s, replay_path}}, "db replay kept whole"sv);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temporary, replay_path, ec);
+    if (ec)
+        logger::Log(json::value{{"records"s, committed}, {"file"s, replay_path}}, "db replay kept whole"sv);
+}
+
+} // namespace db_writer
@@ -0,0 +1,125 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency.h"
+#include "model.h"
+
+namespace db_writer {
+
+using Clock = std::chrono::steady_clock;
+
+// What Push does when the queue is full
+enum class OverflowPolicy {
+    // Waits for the writer thread to make room, holding up the caller
+    Block,
+    // Appends the records to the spill file, to be written once the queue has drained
+    Spill,
+    // Loses the records and counts them, callers never wait
+    Drop
+};
+
+struct Options {
+    // Records queued at most
+    size_t capacity = 1 << 16;
+    // A batch is committed once it has this many records...
+    size_t batch_size = 1000;
+    // ...or its oldest record has waited this long
+    std::chrono::milliseconds max_delay {100};
+    OverflowPolicy overflow = OverflowPolicy::Block;
+    // Batches that failed to commit or overflowed are kept here and retried; empty keeps failed batches
+    // in memory instead, and then overflow cannot be OverflowPolicy::Spill
+    std::string spill_path;
+    // Wait after a failed commit before trying the database again
+    std::chrono::milliseconds retry_delay {1000};
+};
+
+struct Stats {
+    // Waiting in the queue, not yet taken by the writer thread
+    std::uint64_t queued = 0;
+    std::uint64_t committed = 0;
+    std::uint64_t batches = 0;
+    std::uint64_t failed_commits = 0;
+    // Records written to the spill file, and read back from it and committed
+    std::uint64_t spilled = 0;
+    std::uint64_t replayed = 0;
+    std::uint64_t dropped = 0;
+    // Sink calls on the writer thread, failed ones included
+    latency::HistogramSnapshot commit_duration;
+};
+
+// Length-prefixed records, so any name reads back as written
+void WriteSpill(std::ostream& out, const std::vector<model::DogInfo>& records);
+// Stops at the first incomplete record, as left by a crash while spilling
+std::vector<model::DogInfo> ReadSpill(std::istream& in);
+
+// Takes retired-player records off the game strand: Push only queues them, a thread of its own
+// commits them in batches through the sink, which owns a database connection used by nothing else.
+// A failed commit is spilled to disk, or kept in memory, and retried after options.retry_delay.
+class WriteBehind {
+public:
+    // Commits one batch in a single transaction, throwing when it could not
+    using Sink = std::function<void(const std::vector<model::DogInfo>& batch)>;
+
+    // Throws std::invalid_argument on inconsistent options
+    WriteBehind(Sink sink, const Options& options = {});
+    WriteBehind(const WriteBehind&) = delete;
+    WriteBehind& operator=(const WriteBehind&) = delete;
+    ~WriteBehind();
+
+    // Thread-safe; does nothing for no records
+    void Push(const std::vector<model::DogInfo>& records);
+    // Commits what is queued and stops the thread; a batch still failing at that point is spilled,
+    // or counted as dropped when there is no spill file. Push is not to be called afterwards.
+    void Shutdown();
+    // Thread-safe
+    Stats GetStats() const;
+
+private:
+    void Run();
+    // Waits for the next batch to fill up or for its delay, held back while hold is set. Returns an
+    // empty batch at the wake time, and true once stopped, leaving the queue to the final flush.
+    std::pair<std::vector<model::DogInfo>, bool> NextBatch(std::optional<Clock::time_point> wake, bool hold);
+    bool Commit(const std::vector<model::DogInfo>& batch);
+    void Spill(const std::vector<model::DogInfo>& records);
+    // Commits the spill file, keeping what fails to commit; false on a failure
+    bool Replay();
+    // What failed to commit could not be spilled again: the replay file is kept for it, cut down to
+    // the records not yet committed when that can be written
+    void KeepReplay(const std::string& replay_path, const std::vector<model::DogInfo>& rest, size_t committed);
+
+    Sink sink_;
+    Options options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable drained_;
+    std::deque<model::DogInfo> queue_;
+    Clock::time_point oldest_;
+    bool stop_ = false;
+
+    std::mutex spill_mutex_;
+    bool spill_pending_ = false;
+
+    std::atomic<std::uint64_t> committed_ {0};
+    std::atomic<std::uint64_t> batches_ {0};
+    std::atomic<std::uint64_t> failed_commits_ {0};
+    std::atomic<std::uint64_t> spilled_ {0};
+    std::atomic<std::uint64_t> replayed_ {0};
+    std::atomic<std::uint64_t> dropped_ {0};
+    latency::AtomicHistogram commit_duration_;
+
+    std::thread thread_;
+};
+
+} // namespace db_writer
@@ -0,0 +1,224 @@
+#include "file_cache.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace file_cache {
+
+namespace {
+
+const std::unordered_map<std::string,std::string> ExtToContent = {
+        {".htm", "text/html"}, {".html", "text/html"}, {".css", "text/css"},
+        {".txt", "text/plain"}, {".js", "text/javascript"}, {".json", "application/json"},
+        {".xml", "application/xml"}, {".png", "image/png"}, {".jpg", "image/jpeg"},
+        {".jpe", "image/jpeg"}, {".jpeg", "image/jpeg"}, {".gif", "image/gif"},
+        {".bmp", "image/bmp"}, {".ico", "image/vnd.microsoft.icon"}, {".tiff", "image/tiff"},
+        {".tif", "image/tiff"}, {".svg", "image/svg+xml"}, {".svgz", "image/svg+xml"},
+        {".mp3", "audio/mpeg"}
+};
+
+std::optional<std::string> ReadFile(const fs::path& path) {
+    std::ifstream in {path, std::ios::binary};
+    if (!in.is_open())
+        return std::nullopt;
+    std::string data(std::istreambuf_iterator<char>(in), {});
+    if (in.bad())
+        return std::nullopt;
+    return data;
+}
+
+std::string MakeETag(std::uintmax_t size, fs::file_time_type mtime, std::string_view suffix = {}) {
+    static constexpr char hex[] = "0123456789abcdef";
+    auto append_hex = [](std::string& out, std::uint64_t value) {
+        for (int shift = 60; shift >= 0; shift -= 4)
+            out.push_back(hex[(value >> shift) & 0xF]);
+    };
+    std::string etag {"\""};
+    append_hex(etag, size);
+    etag.push_back('-');
+    append_hex(etag, static_cast<std::uint64_t>(mtime.time_since_epoch().count()));
+    etag.append(suffix);
+    etag.push_back('"');
+    return etag;
+}
+
+std::uintmax_t AssetBytes(const Asset& asset) noexcept {
+    return (asset.data ? asset.data->size() : 0) + (asset.gzip ? asset.gzip->size() : 0);
+}
+
+// Without empty, "." or ".." segments a request path under the root is its own canonical key,
+// symbolic links aside
+bool IsPlainPath(std::string_view path) noexcept {
+    if (path.empty() || path.front() != '/')
+        return false;
+    for (size_t start = 1; start <= path.size();) {
+        auto end = std::min(path.find('/', start), path.size());
+        auto segment = path.substr(start, end - start);
+        if (segment.empty() || segment == "." || segment == "..")
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+} // namespace
+
+CacheMode CacheModeFromString(std::string_view mode) {
+    if (mode == "off")
+        return CacheMode::Off;
+    if (mode == "on")
+        return CacheMode::Immutable;
+    if (mode == "dev")
+        return CacheMode::Dev;
+    throw std::invalid_argument("Unknown static cache mode: " + std::string{mode});
+}
+
+std::string GetContentType(const fs::path& path) {
+    if (auto pos = ExtToContent.find(path.extension().string()); pos != ExtToContent.end())
+        return pos->second;
+    return "application/octet-stream";
+}
+
+bool IsSubPath(const fs::path& canonical_path, const fs::path& canonical_base) {
+    for (auto b = canonical_base.begin(), p = canonical_path.begin(); b != canonical_base.end(); ++b, ++p) {
+        if (p == canonical_path.end() || *p != *b) return false;
+    }
+    return true;
+}
+
+FileCache::FileCache(const fs::path& root, CacheMode mode, std::uintmax_t max_file_size, std::uintmax_t max_bytes):
+        root_(fs::weakly_canonical(root)), mode_(mode), max_file_size_(max_file_size), max_bytes_(max_bytes) {}
+
+fs::path FileCache::Resolve(std::string_view rel_path) const {
+    std::string rel {rel_path};
+    if (rel == "/")
+        rel += "index.html";
+    auto path = fs::weakly_canonical(root_.string() + rel);
+    if (!IsSubPath(path, root_))
+        return {};
+    return path;
+}
+
+std::shared_ptr<const Asset> FileCache::Load(const fs::path& path) const {
+    std::error_code ec;
+    auto status = fs::status(path, ec);
+    if (ec || !fs::is_regular_file(status))
+        return nullptr;
+    auto size = fs::file_size(path, ec);
+    if (ec || size > max_file_size_)
+        return nullptr;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec)
+        return nullptr;
+    auto data = ReadFile(path);
+    if (!data.has_value())
+        return nullptr;
+
+    auto asset = std::make_shared<Asset>();
+    asset->data = std::make_shared<const std::string>(std::move(*data));
+    asset->content_type = GetContentType(path);
+    asset->path = path;
+    asset->mtime = mtime;
+    asset->file_size = size;
+    asset->etag = MakeETag(size, mtime);
+    asset->modified = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+            std::chrono::file_clock::to_sys(mtime));
+    asset->last_modified = http_conditional::FormatHttpDate(asset->modified);
+
+    auto gz_path = path;
+    gz_path += ".gz";
+    if (auto gz_mtime = fs::last_write_time(gz_path, ec); !ec && gz_mtime >= mtime) {
+        if (auto gz_data = ReadFile(gz_path); gz_data.has_value()) {
+            asset->gzip = std::make_shared<const std::string>(std::move(*gz_data));
+            asset->gzip_etag = MakeETag(size, mtime, "-gzip");
+        }
+    }
+    return asset;
+}
+
+bool FileCache::IsStale(const Asset& asset) const {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(asset.path, ec);
+    if (ec || mtime != asset.mtime)
+        return true;
+    auto size = fs::file_size(asset.path, ec);
+    return ec || size != asset.file_size;
+}
+
+std::shared_ptr<const Asset> FileCache::Find(std::string_view rel_path) {
+    if (mode_ == CacheMode::Off)
+        return nullptr;
+    auto lookup = [this](const std::string& key) -> std::shared_ptr<const Asset> {
+        std::shared_lock lock {mutex_};
+        if (auto it = assets_.find(key); it != assets_.end()) {
+            if (mode_ != CacheMode::Dev || !IsStale(*it->second))
+                return it->second;
+        }
+        return nullptr;
+    };
+    // Plain request paths are tried as they are, canonicalization only happens on a miss
+    const bool plain = IsPlainPath(rel_path) && rel_path != "/";
+    if (plain) {
+        if (auto asset = lookup(std::string{rel_path}))
+            return asset;
+    }
+    auto path = Resolve(rel_path);
+    if (path.empty())
+        return nullptr;
+    auto key = "/" + path.lexically_relative(root_).generic_string();
+    if (!plain || key != rel_path) {
+        if (auto asset = lookup(key))
+            return asset;
+    }
+    auto asset = Load(path);
+    Store(std::move(key), asset);
+    return asset;
+}
+
+void FileCache::Store(std::string key, const std::shared_ptr<const Asset>& asset) {
+    std::unique_lock lock {mutex_};
+    if (auto it = assets_.find(key); it != assets_.end()) {
+        bytes_ -= AssetBytes(*it->second);
+        assets_.erase(it);
+    }
+    if (!asset || AssetBytes(*asset) > max_bytes_)
+        return;
+    // Any entry goes, the cache only has to stay bounded
+    while (!assets_.empty() && bytes_ + AssetBytes(*asset) > max_bytes_) {
+        bytes_ -= AssetBytes(*assets_.begin()->second);
+        assets_.erase(assets_.begin());
+    }
+    bytes_ += AssetBytes(*asset);
+    assets_.emplace(std::move(key), asset);
+}
+
+void FileCache::Preload() {
+    if (mode_ == CacheMode::Off)
+        return;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(root_, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file() || it->path().extension() == ".gz")
+            continue;
+        auto rel = "/" + fs::relative(it->path(), root_).generic_string();
+        if (auto asset = Load(it->path()))
+            Store(std::move(rel), asset);
+    }
+}
+
+void FileCache::Clear() {
+    std::unique_lock lock {mutex_};
+    assets_.clear();
+    bytes_ = 0;
+}
+
+size_t FileCache::Size() const {
+    std::shared_lock lock {mutex_};
+    return assets_.size();
+}
+
+std::uintmax_t FileCache::Bytes() const {
+    std::shared_lock lock {mutex_};
+    return bytes_;
+}
+
+} // namespace file_cache
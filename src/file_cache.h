@@ -0,0 +1,122 @@
+#pragma once
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "http_conditional.h"
+
+namespace file_cache {
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace fs = std::filesystem;
+
+using Buffer = std::shared_ptr<const std::string>;
+
+// Response body referring to a shared immutable buffer, sent without copying it
+struct SharedBufferBody {
+    using value_type = Buffer;
+
+    static std::uint64_t size(const value_type& body) {
+        return body ? body->size() : 0;
+    }
+
+    class writer {
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template<bool isRequest, class Fields>
+        explicit writer(const http::header<isRequest, Fields>&, const value_type& body): body_(body) {}
+
+        void init(beast::error_code& ec) {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) {
+            ec = {};
+            if (!body_)
+                return boost::none;
+            return {{const_buffers_type{body_->data(), body_->size()}, false}};
+        }
+    private:
+        const value_type& body_;
+    };
+};
+
+enum class CacheMode {
+    // every request goes to the disk
+    Off,
+    // files are loaded once and never re-read
+    Immutable,
+    // cached files are revalidated against their size and mtime on every hit
+    Dev
+};
+
+CacheMode CacheModeFromString(std::string_view mode);
+
+struct Asset {
+    Buffer data;
+    // contents of a precompressed "<file>.gz" sibling, if there is one
+    Buffer gzip;
+    std::string content_type;
+    std::string etag;
+    std::string gzip_etag;
+    std::string last_modified;
+    std::chrono::system_clock::time_point modified;
+    fs::path path;
+    fs::file_time_type mtime;
+    std::uintmax_t file_size = 0;
+};
+
+std::string GetContentType(const fs::path& path);
+bool IsSubPath(const fs::path& canonical_path, const fs::path& canonical_base);
+
+class FileCache {
+public:
+    static constexpr std::uintmax_t DEFAULT_MAX_FILE_SIZE = 16 * 1024 * 1024;
+    static constexpr std::uintmax_t DEFAULT_MAX_BYTES = 256 * 1024 * 1024;
+
+    // Beyond max_bytes of cached files (gzip siblings included) other entries are evicted
+    FileCache(const fs::path& root, CacheMode mode, std::uintmax_t max_file_size = DEFAULT_MAX_FILE_SIZE,
+              std::uintmax_t max_bytes = DEFAULT_MAX_BYTES);
+
+    CacheMode Mode() const noexcept {
+        return mode_;
+    }
+    const fs::path& Root() const noexcept {
+        return root_;
+    }
+    // Loads every regular file under the root
+    void Preload();
+    // Looks a decoded request path (e.g. "/index.html") up, loading it on a miss.
+    // Returns nullptr for missing files, paths outside the root and files too large to cache.
+    std::shared_ptr<const Asset> Find(std::string_view rel_path);
+    // Resolves a request path to a file on disk inside the root, or an empty path
+    fs::path Resolve(std::string_view rel_path) const;
+    void Clear();
+    size_t Size() const;
+    std::uintmax_t Bytes() const;
+private:
+    std::shared_ptr<const Asset> Load(const fs::path& path) const;
+    bool IsStale(const Asset& asset) const;
+    // Takes the unique lock
+    void Store(std::string key, const std::shared_ptr<const Asset>& asset);
+
+    fs::path root_;
+    CacheMode mode_;
+    std::uintmax_t max_file_size_;
+    std::uintmax_t max_bytes_;
+    mutable std::shared_mutex mutex_;
+    // Keyed by the canonical path relative to the root, "/dir/file", so that every file is cached once
+    std::unordered_map<std::string, std::shared_ptr<const Asset>> assets_;
+    std::uintmax_t bytes_ = 0;
+};
+
+} // namespace file_cache
@@ -0,0 +1,63 @@
+#include "http_conditional.h"
+#include <ctime>
+
+namespace http_conditional {
+
+bool MatchesIfNoneMatch(std::string_view if_none_match, std::string_view etag) noexcept {
+    auto opaque = [](std::string_view tag) {
+        if (tag.starts_with("W/"))
+            tag.remove_prefix(2);
+        return tag;
+    };
+    etag = opaque(etag);
+    while (!if_none_match.empty()) {
+        auto end = if_none_match.find(',');
+        auto candidate = if_none_match.substr(0, end);
+        while (!candidate.empty() && candidate.front() == ' ')
+            candidate.remove_prefix(1);
+        while (!candidate.empty() && candidate.back() == ' ')
+            candidate.remove_suffix(1);
+        if (candidate == "*" || opaque(candidate) == etag)
+            return true;
+        if (end == std::string_view::npos)
+            break;
+        if_none_match.remove_prefix(end + 1);
+    }
+    return false;
+}
+
+std::string FormatHttpDate(std::chrono::system_clock::time_point time) {
+    auto time_t = std::chrono::system_clock::to_time_t(time);
+    std::tm tm {};
+    gmtime_r(&time_t, &tm);
+    char buf[32];
+    auto size = std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return {buf, size};
+}
+
+std::optional<std::chrono::system_clock::time_point> ParseHttpDate(std::string_view date) {
+    std::string date_str {date};
+    std::tm tm {};
+    auto end = strptime(date_str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == nullptr || *end != '\0')
+        return std::nullopt;
+    return std::chrono::system_clock::from_time_t(timegm(&tm));
+}
+
+bool NotModifiedSince(std::string_view if_modified_since, std::chrono::system_clock::time_point modified) {
+    auto since = ParseHttpDate(if_modified_since);
+    return since.has_value() && std::chrono::floor<std::chrono::seconds>(modified) <= *since;
+}
+
+bool IfRangeMatches(std::string_view if_range, std::string_view etag, std::chrono::system_clock::time_point modified) {
+    if (if_range.empty())
+        return true;
+    if (if_range.starts_with("W/"))
+        return false;
+    if (if_range.starts_with('"'))
+        return !etag.empty() && !etag.starts_with("W/") && if_range == etag;
+    auto date = ParseHttpDate(if_range);
+    return date.has_value() && std::chrono::floor<std::chrono::seconds>(modified) == *date;
+}
+
+} // namespace http_conditional
@@ -0,0 +1,23 @@
+#pragma once
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace http_conditional {
+
+// Weak comparison as required for If-None-Match: W/ prefixes are ignored and "*" matches anything
+bool MatchesIfNoneMatch(std::string_view if_none_match, std::string_view etag) noexcept;
+
+// RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string FormatHttpDate(std::chrono::system_clock::time_point time);
+std::optional<std::chrono::system_clock::time_point> ParseHttpDate(std::string_view date);
+
+// True when a resource modified at the given time may be answered with 304 for If-Modified-Since
+bool NotModifiedSince(std::string_view if_modified_since, std::chrono::system_clock::time_point modified);
+
+// If-Range holds either a strong ETag or an HTTP-date; a Range is honored only while it still matches.
+// An empty If-Range always matches.
+bool IfRangeMatches(std::string_view if_range, std::string_view etag, std::chrono::system_clock::time_point modified);
+
+} // namespace http_conditional
@@ -1,48 +1,284 @@
 #include "http_server.h"
-#include <boost/asio/dispatch.hpp>
 
 namespace http_server {
 
+    namespace {
+        const ConnectionLimits DEFAULT_LIMITS {};
+
+#ifdef SO_REUSEPORT
+        // SO_REUSEPORT as an asio settable socket option, asio has none of its own
+        class ReusePort {
+        public:
+            explicit ReusePort(bool enabled) noexcept: value_(enabled ? 1 : 0) {}
+
+            template <typename Protocol>
+            int level(const Protocol&) const noexcept {
+                return SOL_SOCKET;
+            }
+            template <typename Protocol>
+            int name(const Protocol&) const noexcept {
+                return SO_REUSEPORT;
+            }
+            template <typename Protocol>
+            const void* data(const Protocol&) const noexcept {
+                return &value_;
+            }
+            template <typename Protocol>
+            size_t size(const Protocol&) const noexcept {
+                return sizeof(value_);
+            }
+        private:
+            int value_;
+        };
+#endif
+    }
+
     void ReportError(beast::error_code ec, std::string_view what) {
-        logger::json::value data {{"code"s, ec.value()}, {"text"s, ec.what()}, {"where"s, what}};
-        BOOST_LOG_TRIVIAL(error) << logger::logging::add_value(logger::additional_data, data) << "error"s;
+        logger::Log("error"sv, [&](json_writer::JsonWriter& data) {
+            data.StartObject().Member("code", ec.value()).Member("text", ec.what()).Member("where", what).EndObject();
+        });
+    }
+
+    void SetReusePort(tcp::acceptor& acceptor) {
+#ifdef SO_REUSEPORT
+        acceptor.set_option(ReusePort(true));
+#else
+        throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+    }
+
+    const ConnectionLimits& ConnectionTracker::Ticket::Limits() const noexcept {
+        return tracker_ ? tracker_->Limits() : DEFAULT_LIMITS;
+    }
+
+    void ConnectionTracker::Ticket::OnIdleReaped() const noexcept {
+        if (tracker_)
+            tracker_->idle_reaped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void ConnectionTracker::Ticket::Reset() noexcept {
+        if (auto tracker = std::move(tracker_))
+            tracker->Release(address_);
+    }
+
+    std::optional<ConnectionTracker::Ticket> ConnectionTracker::Admit(const net::ip::address& address) {
+        auto active = active_.fetch_add(1, std::memory_order_relaxed);
+        if (limits_.max_connections != 0 && active >= limits_.max_connections) {
+            active_.fetch_sub(1, std::memory_order_relaxed);
+            rejected_total_limit_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        if (limits_.max_connections_per_ip != 0) {
+            std::lock_guard lock {per_ip_mutex_};
+            auto& count = per_ip_[address];
+            if (count >= limits_.max_connections_per_ip) {
+                active_.fetch_sub(1, std::memory_order_relaxed);
+                rejected_ip_limit_.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            ++count;
+        }
+        accepted_.fetch_add(1, std::memory_order_relaxed);
+        return Ticket{shared_from_this(), address};
+    }
+
+    void ConnectionTracker::Release(const net::ip::address& address) noexcept {
+        if (limits_.max_connections_per_ip != 0) {
+            std::lock_guard lock {per_ip_mutex_};
+            if (auto it = per_ip_.find(address); it != per_ip_.end() && --it->second == 0)
+                per_ip_.erase(it);
+        }
+        active_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    AdmissionStats ConnectionTracker::Stats() const noexcept {
+        return {active_.load(std::memory_order_relaxed), accepted_.load(std::memory_order_relaxed),
+                rejected_total_limit_.load(std::memory_order_relaxed), rejected_ip_limit_.load(std::memory_order_relaxed),
+                idle_reaped_.load(std::memory_order_relaxed)};
+    }
+
+    SessionBase::SessionBase(tcp::socket&& socket, ConnectionTracker::Ticket&& ticket, std::shared_ptr<latency::Recorder> latency):
+            stream_(std::move(socket)), ticket_(std::move(ticket)), buffer_(BufferPool::Acquire()), latency_(std::move(latency)),
+            can_read_(stream_.get_executor()), can_write_(stream_.get_executor()), idle_timer_(stream_.get_executor()),
+            write_timer_(stream_.get_executor()) {
+        // Pipelined responses go out as separate small writes, Nagle would hold them back
+        beast::error_code ec;
+        stream_.socket().set_option(tcp::no_delay(true), ec);
+        remote_ = stream_.socket().remote_endpoint(ec).address();
+    }
+
+    SessionBase::~SessionBase() {
+        buffer_->clear();
+        if (buffer_->capacity() > MAX_POOLED_BUFFER_SIZE)
+            buffer_->shrink_to_fit();
     }
 
     void SessionBase::Run() {
-        net::dispatch(stream_.get_executor(), beast::bind_front_handler(&SessionBase::Read, GetSharedThis()));
+        auto self = GetSharedThis();
+        net::co_spawn(stream_.get_executor(), ReadLoop(self), net::detached);
+        net::co_spawn(stream_.get_executor(), WriteLoop(self), net::detached);
+        net::dispatch(stream_.get_executor(), [self] {
+            self->ArmIdleTimer();
+        });
+    }
+
+    bool SessionBase::IsIdle() const noexcept {
+        return !reading_request_ && next_read_seq_ == next_write_seq_ && buffer_->size() == 0;
     }
 
-    void SessionBase::Read() {
-        request_ = {};
-        stream_.expires_after(30s);
-        http::async_read(stream_, buffer_, request_,
-                         beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis()));
+    // The read timeout cannot be shortened once the read is pending, and the read for the next
+    // request usually starts before the previous response is written, hence a timer of its own
+    void SessionBase::ArmIdleTimer() {
+        idle_timer_.expires_after(ticket_.Limits().idle_timeout);
+        idle_timer_.async_wait([self = GetSharedThis()](beast::error_code ec) {
+            if (!ec && !self->closed_ && self->IsIdle()) {
+                self->ticket_.OnIdleReaped();
+                self->Close();
+            }
+        });
     }
 
-    void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
-        if (ec == http::error::end_of_stream)
-            return Close();
-        if (ec)
-            return ReportError(ec, "read"sv);
-        HandleRequest(std::move(request_));
+    // Writing a response may take io_timeout; a stalled write closes the socket, as the stream deadline would
+    void SessionBase::ArmWriteTimer() {
+        write_timer_.expires_after(ticket_.Limits().io_timeout);
+        write_timer_.async_wait([self = GetSharedThis()](beast::error_code ec) {
+            if (!ec)
+                self->stream_.socket().close(ec);
+        });
     }
 
-    void SessionBase::OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
-        if (ec)
-            return ReportError(ec, "write"sv);
-        if (close)
-            return Close();
-        Read();
+    net::awaitable<void> SessionBase::Wait(net::steady_timer& event) {
+        event.expires_at(net::steady_timer::time_point::max());
+        beast::error_code ec;
+        co_await event.async_wait(net::redirect_error(net::use_awaitable, ec));
+    }
+
+    net::awaitable<void> SessionBase::ReadLoop([[maybe_unused]] std::shared_ptr<SessionBase> self) {
+        while (!closed_) {
+            if (next_read_seq_ - next_write_seq_ == MAX_PIPELINE_DEPTH) {
+                co_await Wait(can_read_);
+                continue;
+            }
+            HttpRequest request;
+            beast::error_code ec;
+            if (buffer_->size() == 0) {
+                // The connection is idle until the first bytes of a request come, which is the
+                // idle timer's business; the parser then consumes them, hence reading_request_
+                auto size = co_await stream_.async_read_some(buffer_->prepare(beast::read_size(*buffer_, READ_SIZE)),
+                                                             net::redirect_error(net::use_awaitable, ec));
+                buffer_->commit(size);
+            }
+            if (ec == net::error::eof)
+                break;
+            if (!ec) {
+                reading_request_ = true;
+                // The stream deadline is the read timeout only, lifted once the request is in:
+                // writes have a timer of their own and do not push it back
+                stream_.expires_after(ticket_.Limits().io_timeout);
+                co_await http::async_read(stream_, *buffer_, request, net::redirect_error(net::use_awaitable, ec));
+                stream_.expires_never();
+                reading_request_ = false;
+            }
+            if (ec == http::error::end_of_stream)
+                break;
+            if (ec) {
+                if (!closed_)
+                    ReportError(ec, "read"sv);
+                // Responses in flight cannot be delivered anymore
+                Abort();
+                break;
+            }
+            idle_timer_.cancel();
+            if (latency_)
+                timings_[next_read_seq_ % MAX_PIPELINE_DEPTH] = {latency::Clock::now()};
+            const bool keep_alive = request.keep_alive();
+            HandleRequest(std::move(request), next_read_seq_++);
+            if (!keep_alive)
+                break;
+        }
+        reading_done_ = true;
+        can_write_.cancel();
+    }
+
+    net::awaitable<void> SessionBase::WriteLoop([[maybe_unused]] std::shared_ptr<SessionBase> self) {
+        while (!closed_) {
+            auto& slot = pending_[next_write_seq_ % MAX_PIPELINE_DEPTH];
+            if (!slot) {
+                if (reading_done_ && next_write_seq_ == next_read_seq_)
+                    break;
+                co_await Wait(can_write_);
+                continue;
+            }
+            auto writer = std::move(slot);
+            ArmWriteTimer();
+            const auto& timing = timings_[next_write_seq_ % MAX_PIPELINE_DEPTH];
+            const bool timed = latency_ && timing.label != latency::NO_LABEL;
+            const auto write_start = timed ? latency::Clock::now() : latency::Clock::time_point{};
+            auto ec = co_await writer->Write(stream_);
+            // Nothing left to cancel: the timer went off and closed the socket under the write
+            if (write_timer_.cancel() == 0 && ec)
+                ec = beast::error::timeout;
+            if (timed && !ec) {
+                const auto written = latency::Clock::now();
+                latency_->Record(timing.label, writer->Status(), latency::Phase::Write, written - write_start);
+                latency_->Record(timing.label, writer->Status(), latency::Phase::Total, written - timing.received);
+            }
+            ++next_write_seq_;
+            can_read_.cancel();
+            if (ec) {
+                if (!closed_)
+                    ReportError(ec, "write"sv);
+                Abort();
+                co_return;
+            }
+            if (writer->NeedEof())
+                break;
+            if (!reading_done_ && next_write_seq_ == next_read_seq_)
+                ArmIdleTimer();
+        }
+        Close();
+    }
+
+    void SessionBase::OnResponse(std::uint64_t seq, ResponseWriterPtr&& writer, std::uint32_t label) {
+        if (closed_)
+            return;
+        pending_[seq % MAX_PIPELINE_DEPTH] = std::move(writer);
+        timings_[seq % MAX_PIPELINE_DEPTH].label = label;
+        can_write_.cancel();
     }
 
     void SessionBase::Close() {
-        stream_.socket().shutdown(tcp::socket::shutdown_send);
+        if (closed_)
+            return;
+        closed_ = true;
+        beast::error_code ec;
+        stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+        // Stops a read of requests that will never be answered
+        stream_.socket().cancel(ec);
+        can_read_.cancel();
+        idle_timer_.cancel();
+    }
+
+    // Unlike Close, drops the connection at once; the timers are cancelled too, or their
+    // handlers would keep the session, and its ticket, until they went off
+    void SessionBase::Abort() {
+        closed_ = true;
+        beast::error_code ec;
+        stream_.socket().close(ec);
+        can_read_.cancel();
+        can_write_.cancel();
+        idle_timer_.cancel();
+        write_timer_.cancel();
     }
 
     void SessionBase::LogRequest(const HttpRequest& req) {
-        auto addr = stream_.socket().remote_endpoint().address().to_string();
-        logger::json::value data {{"ip"s, addr}, {"URI"s, req.target()}, {"method"s, req.method_string()}};
-        BOOST_LOG_TRIVIAL(info) << logger::logging::add_value(logger::additional_data, data) << "request received"s;
+        logger::Log("request received"sv, [&](json_writer::JsonWriter& data) {
+            data.StartObject()
+                    .Member("ip", remote_.to_string())
+                    .Member("URI", std::string_view{req.target()})
+                    .Member("method", std::string_view{req.method_string()})
+                    .EndObject();
+        });
     }
 
 }  // namespace http_server
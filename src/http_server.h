@@ -1,14 +1,29 @@
 #pragma once
 #include "sdk.h"
 //
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/dispatch.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/json.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <type_traits>
 
+#include "latency.h"
 #include "logger.h"
+#include "object_pool.h"
 
 #define BOOST_BEAST_USE_STD_STRING_VIEW
 
@@ -23,68 +38,273 @@ namespace http_server {
 
     void ReportError(beast::error_code ec, std::string_view what);
 
+    // Requests a session reads ahead of the responses it has written
+    constexpr size_t MAX_PIPELINE_DEPTH = 16;
+    // Most a session reads from the socket at once while waiting for a request
+    constexpr size_t READ_SIZE = 4096;
+    // Read buffers grown beyond this are not kept for reuse
+    constexpr size_t MAX_POOLED_BUFFER_SIZE = 64 * 1024;
+
+    struct ConnectionLimits {
+        // 0 means unlimited
+        size_t max_connections = 0;
+        size_t max_connections_per_ip = 0;
+        // How long a connection with nothing in flight may wait for its next request
+        std::chrono::steady_clock::duration idle_timeout = 30s;
+        // How long reading a request or writing a response may take
+        std::chrono::steady_clock::duration io_timeout = 30s;
+    };
+
+    struct AdmissionStats {
+        size_t active = 0;
+        std::uint64_t accepted = 0;
+        std::uint64_t rejected_total_limit = 0;
+        std::uint64_t rejected_ip_limit = 0;
+        std::uint64_t idle_reaped = 0;
+    };
+
+    // Counts connections across every listener and session sharing it, thread-safe
+    class ConnectionTracker: public std::enable_shared_from_this<ConnectionTracker> {
+    public:
+        explicit ConnectionTracker(const ConnectionLimits& limits = {}): limits_(limits) {}
+
+        // Keeps a connection counted for as long as it lives
+        class Ticket {
+        public:
+            Ticket() = default;
+            Ticket(Ticket&& other) noexcept = default;
+            Ticket& operator=(Ticket&& other) noexcept {
+                if (this != &other) {
+                    Reset();
+                    tracker_ = std::move(other.tracker_);
+                    address_ = other.address_;
+                }
+                return *this;
+            }
+            ~Ticket() {
+                Reset();
+            }
+            const ConnectionLimits& Limits() const noexcept;
+            void OnIdleReaped() const noexcept;
+        private:
+            friend class ConnectionTracker;
+            Ticket(std::shared_ptr<ConnectionTracker> tracker, const net::ip::address& address):
+                    tracker_(std::move(tracker)), address_(address) {}
+            void Reset() noexcept;
+
+            std::shared_ptr<ConnectionTracker> tracker_;
+            net::ip::address address_;
+        };
+
+        // Empty when the connection is over a limit and has to be dropped
+        std::optional<Ticket> Admit(const net::ip::address& address);
+        AdmissionStats Stats() const noexcept;
+        const ConnectionLimits& Limits() const noexcept {
+            return limits_;
+        }
+    private:
+        void Release(const net::ip::address& address) noexcept;
+
+        const ConnectionLimits limits_;
+        std::atomic<size_t> active_ {0};
+        std::atomic<std::uint64_t> accepted_ {0};
+        std::atomic<std::uint64_t> rejected_total_limit_ {0};
+        std::atomic<std::uint64_t> rejected_ip_limit_ {0};
+        std::atomic<std::uint64_t> idle_reaped_ {0};
+        // Filled only when there is a per-IP limit; accepts are rare next to requests
+        std::mutex per_ip_mutex_;
+        std::map<net::ip::address, size_t> per_ip_;
+    };
+
+    // A response of any type, waiting for its turn to be written
+    class ResponseWriter {
+    public:
+        virtual ~ResponseWriter() = default;
+        virtual net::awaitable<beast::error_code> Write(beast::tcp_stream& stream) = 0;
+        virtual bool NeedEof() const noexcept = 0;
+        virtual unsigned Status() const noexcept = 0;
+        // Drops the response and returns the writer to its pool
+        virtual void Recycle() noexcept = 0;
+
+        struct Deleter {
+            void operator()(ResponseWriter* writer) const noexcept {
+                writer->Recycle();
+            }
+        };
+    };
+    using ResponseWriterPtr = std::unique_ptr<ResponseWriter, ResponseWriter::Deleter>;
+
+    template <typename Body, typename Fields>
+    class TypedResponseWriter final: public ResponseWriter {
+    public:
+        using Response = http::response<Body, Fields>;
+        using Pool = object_pool::ObjectPool<TypedResponseWriter>;
+
+        static ResponseWriterPtr Make(Response&& response) {
+            auto writer = Pool::Acquire();
+            writer->response_ = std::move(response);
+            return ResponseWriterPtr{writer.release()};
+        }
+
+        net::awaitable<beast::error_code> Write(beast::tcp_stream& stream) override {
+            beast::error_code ec;
+            co_await http::async_write(stream, response_, net::redirect_error(net::use_awaitable, ec));
+            co_return ec;
+        }
+        bool NeedEof() const noexcept override {
+            return response_.need_eof();
+        }
+        unsigned Status() const noexcept override {
+            return response_.result_int();
+        }
+        void Recycle() noexcept override {
+            // Releases bodies holding files or shared buffers right away
+            response_ = {};
+            Pool::Release(this);
+        }
+    private:
+        Response response_;
+    };
+
+    struct ListenOptions {
+        // Lets several acceptors, one per io_context, bind the same port; the kernel spreads connections
+        bool reuse_port = false;
+        // Shared by all listeners of the server; no limits when empty
+        std::shared_ptr<ConnectionTracker> tracker;
+        // Off when the handler logs requests itself, e.g. to sample them
+        bool log_requests = true;
+        // Receives the write and total time of responses sent with a label
+        std::shared_ptr<latency::Recorder> latency;
+    };
+
+    // Reads requests in a coroutine and keeps reading while earlier requests are being handled
+    // (HTTP pipelining); responses are written strictly in request order.
     class SessionBase {
     public:
         SessionBase(const SessionBase&) = delete;
         SessionBase& operator=(const SessionBase&) = delete;
         void Run();
-        virtual ~SessionBase() = default;
+        virtual ~SessionBase();
     protected:
-        explicit SessionBase(tcp::socket&& socket): stream_(std::move(socket)) {}
+        SessionBase(tcp::socket&& socket, ConnectionTracker::Ticket&& ticket, std::shared_ptr<latency::Recorder> latency);
 
+        // May be called from any thread; the label says which latency histograms the response goes to
         template <typename Body, typename Fields>
-        void Write(http::response<Body, Fields>&& response) {
-            auto safe_response = std::make_shared<http::response<Body, Fields>>(std::move(response));
-            auto self = GetSharedThis();
-            http::async_write(stream_, *safe_response, [safe_response, self](beast::error_code ec, std::size_t bytes_written) {
-                self->OnWrite(safe_response->need_eof(), ec, bytes_written);
+        void Write(http::response<Body, Fields>&& response, std::uint64_t seq, std::uint32_t label) {
+            auto writer = TypedResponseWriter<Body, Fields>::Make(std::move(response));
+            net::dispatch(stream_.get_executor(), [self = GetSharedThis(), seq, label, writer = std::move(writer)]() mutable {
+                self->OnResponse(seq, std::move(writer), label);
             });
         }
 
         using HttpRequest = http::request<beast::http::string_body>;
+        using Executor = beast::tcp_stream::executor_type;
+        Executor GetExecutor() noexcept {
+            return stream_.get_executor();
+        }
         void LogRequest(const HttpRequest& req);
+        const net::ip::address& RemoteAddress() const noexcept {
+            return remote_;
+        }
     private:
-        void Read();
-        void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read);
-        void OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written);
+        using BufferPool = object_pool::ObjectPool<beast::flat_buffer>;
+
+        net::awaitable<void> ReadLoop(std::shared_ptr<SessionBase> self);
+        net::awaitable<void> WriteLoop(std::shared_ptr<SessionBase> self);
+        net::awaitable<void> Wait(net::steady_timer& event);
+        void OnResponse(std::uint64_t seq, ResponseWriterPtr&& writer, std::uint32_t label);
+        bool IsIdle() const noexcept;
+        void ArmIdleTimer();
+        void ArmWriteTimer();
         void Close();
+        void Abort();
 
-        virtual void HandleRequest(HttpRequest&& request) = 0;
+        virtual void HandleRequest(HttpRequest&& request, std::uint64_t seq) = 0;
         virtual std::shared_ptr<SessionBase> GetSharedThis() = 0;
         beast::tcp_stream stream_;
-        beast::flat_buffer buffer_;
-        HttpRequest request_;
+        // Taken once, the peer may be gone by the time a request is logged
+        net::ip::address remote_;
+        ConnectionTracker::Ticket ticket_;
+        BufferPool::Handle buffer_;
+        std::array<ResponseWriterPtr, MAX_PIPELINE_DEPTH> pending_;
+        struct Timing {
+            latency::Clock::time_point received;
+            std::uint32_t label = latency::NO_LABEL;
+        };
+        // Indexed like pending_; filled only when latency is recorded
+        std::array<Timing, MAX_PIPELINE_DEPTH> timings_;
+        std::shared_ptr<latency::Recorder> latency_;
+        std::uint64_t next_read_seq_ = 0;
+        std::uint64_t next_write_seq_ = 0;
+        bool reading_done_ = false;
+        // From the first bytes of a request to its end; not idle then, even with an empty buffer
+        bool reading_request_ = false;
+        bool closed_ = false;
+        // Wake-ups between the two loops, both run on the session strand
+        net::steady_timer can_read_;
+        net::steady_timer can_write_;
+        // Reaps keep-alive connections with nothing in flight
+        net::steady_timer idle_timer_;
+        // Bounds the response write in progress, apart from the read timeout
+        net::steady_timer write_timer_;
     };
 
     template <typename RequestHandler>
     class Session : public SessionBase, public std::enable_shared_from_this<Session<RequestHandler>> {
     public:
         template<typename Handler>
-        Session(tcp::socket&& socket, Handler&& request_handler):
-                SessionBase(std::move(socket)), request_handler_(std::forward<Handler>(request_handler)) {}
+        Session(tcp::socket&& socket, ConnectionTracker::Ticket&& ticket, Handler&& request_handler, const ListenOptions& options):
+                SessionBase(std::move(socket), std::move(ticket), options.latency),
+                request_handler_(std::forward<Handler>(request_handler)), log_requests_(options.log_requests) {}
     private:
+        // Handlers name the latency label of a response, if they want it recorded. Its associated
+        // executor is the connection's: work for the response, e.g. compression, belongs there.
+        struct Sender {
+            using executor_type = Executor;
+
+            std::shared_ptr<Session> self;
+            std::uint64_t seq;
+
+            executor_type get_executor() const noexcept {
+                return self->GetExecutor();
+            }
+            template <typename Response>
+            void operator()(Response&& response, std::uint32_t label = latency::NO_LABEL) const {
+                self->Write(std::move(response), seq, label);
+            }
+        };
+
         std::shared_ptr<SessionBase> GetSharedThis() override {
             return this->shared_from_this();
         }
 
-        void HandleRequest(HttpRequest&& request) override {
-            LogRequest(request);
-            request_handler_(std::move(request), [self = this->shared_from_this()](auto&& response) {
-                self->Write(std::move(response));
-            });
+        void HandleRequest(HttpRequest&& request, std::uint64_t seq) override {
+            if (log_requests_)
+                LogRequest(request);
+            Sender send {this->shared_from_this(), seq};
+            // Handlers that care about the client, e.g. to limit it, take its address as well
+            if constexpr (std::is_invocable_v<RequestHandler&, HttpRequest&&, decltype(send), const net::ip::address&>)
+                request_handler_(std::move(request), std::move(send), RemoteAddress());
+            else
+                request_handler_(std::move(request), std::move(send));
         }
         RequestHandler request_handler_;
+        bool log_requests_;
     };
 
+    void SetReusePort(tcp::acceptor& acceptor);
+
     template <typename RequestHandler>
     class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
     public:
         template<typename Handler>
-        Listener(net::io_context &ioc, const tcp::endpoint& endpoint, Handler&& request_handler):
-                ioc_(ioc), acceptor_(net::make_strand(ioc)),
+        Listener(net::io_context &ioc, const tcp::endpoint& endpoint, Handler&& request_handler, const ListenOptions& options = {}):
+                ioc_(ioc), acceptor_(net::make_strand(ioc)), options_(options),
                 request_handler_(std::forward<Handler>(request_handler)) {
             acceptor_.open(endpoint.protocol());
             acceptor_.set_option(net::socket_base::reuse_address(true));
+            if (options.reuse_port)
+                SetReusePort(acceptor_);
             acceptor_.bind(endpoint);
             acceptor_.listen(net::socket_base::max_listen_connections);
         }
@@ -92,6 +312,9 @@ namespace http_server {
         void Run() {
             DoAccept();
         }
+        tcp::endpoint LocalEndpoint() const {
+            return acceptor_.local_endpoint();
+        }
     private:
         void DoAccept() {
             acceptor_.async_accept(
@@ -108,17 +331,34 @@ namespace http_server {
         }
 
         void AsyncRunSession(tcp::socket&& socket) {
-            std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_)->Run();
+            ConnectionTracker::Ticket ticket;
+            if (options_.tracker) {
+                beast::error_code ec;
+                auto endpoint = socket.remote_endpoint(ec);
+                if (ec)
+                    return;
+                auto admitted = options_.tracker->Admit(endpoint.address());
+                // Refused connections are closed right away so that they do not hold a descriptor
+                if (!admitted)
+                    return;
+                ticket = std::move(*admitted);
+            }
+            std::make_shared<Session<RequestHandler>>(std::move(socket), std::move(ticket), request_handler_, options_)->Run();
         }
         net::io_context& ioc_;
         tcp::acceptor acceptor_;
+        const ListenOptions options_;
         RequestHandler request_handler_;
     };
 
+    // Returns the endpoint actually bound, useful with port 0
     template <typename RequestHandler>
-    void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler) {
+    tcp::endpoint ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler,
+                            const ListenOptions& options = {}) {
         using MyListener = Listener<std::decay_t<RequestHandler>>;
-        std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler))->Run();
+        auto listener = std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler), options);
+        listener->Run();
+        return listener->LocalEndpoint();
     }
 
 }  // namespace http_server
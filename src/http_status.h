@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+namespace http_status {
+
+// 1xx to 5xx
+inline constexpr size_t NUM_STATUS_CLASSES = 5;
+
+// Statuses outside 100..599 count as server errors
+constexpr size_t StatusClass(unsigned status) noexcept {
+    return status < 100 || status >= 600 ? NUM_STATUS_CLASSES - 1 : status / 100 - 1;
+}
+
+} // namespace http_status
@@ -0,0 +1,131 @@
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+
+namespace json_writer {
+
+JsonWriter& JsonWriter::StartObject() {
+    Separate();
+    buffer_.push_back('{');
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndObject() {
+    buffer_.push_back('}');
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::StartArray() {
+    Separate();
+    buffer_.push_back('[');
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndArray() {
+    buffer_.push_back(']');
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Key(std::string_view key) {
+    Separate();
+    WriteEscaped(key);
+    buffer_.push_back(':');
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value) {
+    Separate();
+    WriteEscaped(value);
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Int(std::int64_t value) {
+    Separate();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    buffer_.append(buf, res.ptr);
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Uint(std::uint64_t value) {
+    Separate();
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    buffer_.append(buf, res.ptr);
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Double(double value) {
+    if (!std::isfinite(value))
+        return Null();
+    Separate();
+    // Shortest round-trip digits, then rewritten from "2.5e-01" to json::serialize's "2.5E-1"
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::scientific);
+    std::string_view digits {buf, static_cast<size_t>(res.ptr - buf)};
+    auto exp_pos = digits.find('e');
+    buffer_.append(digits.substr(0, exp_pos));
+    buffer_.push_back('E');
+    auto exponent = digits.substr(exp_pos + 1);
+    if (exponent.front() == '-')
+        buffer_.push_back('-');
+    exponent.remove_prefix(1);
+    while (exponent.size() > 1 && exponent.front() == '0')
+        exponent.remove_prefix(1);
+    buffer_.append(exponent);
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value) {
+    Separate();
+    buffer_.append(value ? "true" : "false");
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+    Separate();
+    buffer_.append("null");
+    need_comma_ = true;
+    return *this;
+}
+
+void JsonWriter::WriteEscaped(std::string_view value) {
+    static constexpr char hex[] = "0123456789abcdef";
+    buffer_.push_back('"');
+    auto plain_start = value.begin();
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        auto ch = static_cast<unsigned char>(*it);
+        if (ch >= 0x20 && ch != '"' && ch != '\\')
+            continue;
+        buffer_.append(plain_start, it);
+        plain_start = it + 1;
+        buffer_.push_back('\\');
+        switch (ch) {
+            case '"': buffer_.push_back('"'); break;
+            case '\\': buffer_.push_back('\\'); break;
+            case '\b': buffer_.push_back('b'); break;
+            case '\f': buffer_.push_back('f'); break;
+            case '\n': buffer_.push_back('n'); break;
+            case '\r': buffer_.push_back('r'); break;
+            case '\t': buffer_.push_back('t'); break;
+            default:
+                buffer_.append("u00");
+                buffer_.push_back(hex[ch >> 4]);
+                buffer_.push_back(hex[ch & 0xF]);
+        }
+    }
+    buffer_.append(plain_start, value.end());
+    buffer_.push_back('"');
+}
+
+} // namespace json_writer
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace json_writer {
+
+// Streaming JSON writer appending straight into a reusable buffer.
+// Output matches json::serialize: no whitespace, same string escaping and
+// the same shortest round-trip scientific notation for doubles ("1E0", "2.5E-1").
+class JsonWriter {
+public:
+    JsonWriter() = default;
+    explicit JsonWriter(size_t capacity) {
+        buffer_.reserve(capacity);
+    }
+
+    // Drops the contents but keeps the allocated capacity
+    void Reset() noexcept {
+        buffer_.clear();
+        need_comma_ = false;
+    }
+
+    JsonWriter& StartObject();
+    JsonWriter& EndObject();
+    JsonWriter& StartArray();
+    JsonWriter& EndArray();
+    JsonWriter& Key(std::string_view key);
+
+    JsonWriter& String(std::string_view value);
+    JsonWriter& Int(std::int64_t value);
+    JsonWriter& Uint(std::uint64_t value);
+    JsonWriter& Double(double value);
+    JsonWriter& Bool(bool value);
+    JsonWriter& Null();
+
+    template <typename T>
+    JsonWriter& Member(std::string_view key, const T& value) {
+        Key(key);
+        return Value(value);
+    }
+
+    std::string_view View() const noexcept {
+        return buffer_;
+    }
+    size_t Size() const noexcept {
+        return buffer_.size();
+    }
+    std::string Release() {
+        need_comma_ = false;
+        return std::move(buffer_);
+    }
+private:
+    JsonWriter& Value(std::string_view value) {
+        return String(value);
+    }
+    JsonWriter& Value(const std::string& value) {
+        return String(value);
+    }
+    JsonWriter& Value(const char* value) {
+        return String(value);
+    }
+    JsonWriter& Value(double value) {
+        return Double(value);
+    }
+    JsonWriter& Value(bool value) {
+        return Bool(value);
+    }
+    template <typename T>
+    JsonWriter& Value(T value) requires std::is_integral_v<T> {
+        if constexpr (std::is_signed_v<T>)
+            return Int(value);
+        else
+            return Uint(value);
+    }
+
+    void Separate() {
+        if (need_comma_)
+            buffer_.push_back(',');
+    }
+    void WriteEscaped(std::string_view value);
+
+    std::string buffer_;
+    bool need_comma_ = false;
+};
+
+} // namespace json_writer
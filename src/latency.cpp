@@ -0,0 +1,131 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace latency {
+
+namespace {
+
+constexpr size_t HALF = size_t{1} << (Buckets::SUB_BITS - 1);
+
+void UpdateMax(std::atomic<std::uint64_t>& max, std::uint64_t value) noexcept {
+    auto current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+} // namespace
+
+size_t Buckets::IndexOf(std::uint64_t value) noexcept {
+    value = std::min(value, (std::uint64_t{1} << MAX_BITS) - 1);
+    if (value < 2 * HALF)
+        return static_cast<size_t>(value);
+    // Keeps the top SUB_BITS bits of the value
+    const unsigned shift = static_cast<unsigned>(std::bit_width(value)) - SUB_BITS;
+    return shift * HALF + static_cast<size_t>(value >> shift);
+}
+
+std::uint64_t Buckets::LowerBound(size_t index) noexcept {
+    if (index < 2 * HALF)
+        return index;
+    const size_t shift = index / HALF - 1;
+    return static_cast<std::uint64_t>(index % HALF + HALF) << shift;
+}
+
+std::uint64_t Buckets::UpperBound(size_t index) noexcept {
+    if (index < 2 * HALF)
+        return index;
+    const size_t shift = index / HALF - 1;
+    return (static_cast<std::uint64_t>(index % HALF + HALF + 1) << shift) - 1;
+}
+
+std::uint64_t HistogramSnapshot::Percentile(double q) const noexcept {
+    if (count == 0)
+        return 0;
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(q * static_cast<double>(count) + 0.5));
+    std::uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(Buckets::UpperBound(i), max_us);
+    }
+    return max_us;
+}
+
+void HistogramSnapshot::Merge(const HistogramSnapshot& other) noexcept {
+    for (size_t i = 0; i < counts.size(); ++i)
+        counts[i] += other.counts[i];
+    count += other.count;
+    sum_us += other.sum_us;
+    max_us = std::max(max_us, other.max_us);
+}
+
+size_t ShardIndex() noexcept {
+    static std::atomic<size_t> next {0};
+    thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed) % NUM_SHARDS;
+    return index;
+}
+
+void AtomicHistogram::Record(Clock::duration value) noexcept {
+    const auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(0,
+            std::chrono::duration_cast<std::chrono::microseconds>(value).count()));
+    counts_[Buckets::IndexOf(us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    UpdateMax(max_us_, us);
+}
+
+void AtomicHistogram::AddTo(HistogramSnapshot& snapshot) const noexcept {
+    for (size_t i = 0; i < Buckets::COUNT; ++i)
+        snapshot.counts[i] += counts_[i].load(std::memory_order_relaxed);
+    snapshot.count += count_.load(std::memory_order_relaxed);
+    snapshot.sum_us += sum_us_.load(std::memory_order_relaxed);
+    snapshot.max_us = std::max(snapshot.max_us, max_us_.load(std::memory_order_relaxed));
+}
+
+Recorder::Recorder(size_t num_labels):
+        num_labels_(num_labels), num_slots_(num_labels * NUM_STATUS_CLASSES * NUM_PHASES) {
+    for (auto& shard: shards_) {
+        shard.histograms = std::make_unique<std::atomic<AtomicHistogram*>[]>(num_slots_);
+        for (size_t i = 0; i < num_slots_; ++i)
+            shard.histograms[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+Recorder::~Recorder() {
+    for (auto& shard: shards_) {
+        for (size_t i = 0; i < num_slots_; ++i)
+            delete shard.histograms[i].load(std::memory_order_relaxed);
+    }
+}
+
+void Recorder::Record(std::uint32_t label, unsigned status, Phase phase, Clock::duration value) noexcept {
+    if (label >= num_labels_)
+        return;
+    auto& slot = shards_[ShardIndex()].histograms[Slot(label, StatusClass(status), phase)];
+    auto* histogram = slot.load(std::memory_order_acquire);
+    if (!histogram) {
+        // Threads beyond NUM_SHARDS share shards, so two of them may race here
+        auto* fresh = new (std::nothrow) AtomicHistogram;
+        if (!fresh)
+            return;
+        if (slot.compare_exchange_strong(histogram, fresh, std::memory_order_acq_rel))
+            histogram = fresh;
+        else
+            delete fresh;
+    }
+    histogram->Record(value);
+}
+
+HistogramSnapshot Recorder::Snapshot(std::uint32_t label, size_t status_class, Phase phase) const {
+    HistogramSnapshot snapshot;
+    if (label >= num_labels_ || status_class >= NUM_STATUS_CLASSES)
+        return snapshot;
+    for (const auto& shard: shards_) {
+        if (const auto* histogram = shard.histograms[Slot(label, status_class, phase)].load(std::memory_order_acquire))
+            histogram->AddTo(snapshot);
+    }
+    return snapshot;
+}
+
+} // namespace latency
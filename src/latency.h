@@ -0,0 +1,107 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "http_status.h"
+
+namespace latency {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Phase : std::uint8_t {
+    // From handing a request to the API strand to it running there
+    Queue,
+    // From the handler receiving a request to the response being ready, queue wait excluded
+    Handler,
+    // Writing the response to the socket, once earlier pipelined responses are out
+    Write,
+    // From the request being read to its response being written
+    Total
+};
+inline constexpr size_t NUM_PHASES = 4;
+
+constexpr std::string_view PhaseName(Phase phase) noexcept {
+    constexpr std::string_view names[] = {"queue", "handler", "write", "total"};
+    return names[static_cast<size_t>(phase)];
+}
+
+using http_status::NUM_STATUS_CLASSES;
+using http_status::StatusClass;
+
+// Responses sent with no label are not recorded
+inline constexpr std::uint32_t NO_LABEL = UINT32_MAX;
+
+// Log-linear buckets in the manner of HdrHistogram: microseconds, exact below 32,
+// then 16 buckets per power of two, so a value is off by at most 1/16; up to 2^36 us.
+struct Buckets {
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr unsigned MAX_BITS = 36;
+    static constexpr size_t COUNT = (MAX_BITS - SUB_BITS + 2) << (SUB_BITS - 1);
+
+    static size_t IndexOf(std::uint64_t value) noexcept;
+    // Smallest and largest value counted in a bucket
+    static std::uint64_t LowerBound(size_t index) noexcept;
+    static std::uint64_t UpperBound(size_t index) noexcept;
+};
+
+struct HistogramSnapshot {
+    std::array<std::uint64_t, Buckets::COUNT> counts {};
+    std::uint64_t count = 0;
+    std::uint64_t sum_us = 0;
+    std::uint64_t max_us = 0;
+
+    // Upper bound of the bucket holding the q-th quantile, 0 when empty
+    std::uint64_t Percentile(double q) const noexcept;
+    void Merge(const HistogramSnapshot& other) noexcept;
+};
+
+// Threads are spread over this many shards round-robin
+inline constexpr size_t NUM_SHARDS = 16;
+size_t ShardIndex() noexcept;
+
+// Updated with relaxed atomics, readers may see a value counted but not yet summed
+class AtomicHistogram {
+public:
+    void Record(Clock::duration value) noexcept;
+    void AddTo(HistogramSnapshot& snapshot) const noexcept;
+private:
+    std::array<std::atomic<std::uint64_t>, Buckets::COUNT> counts_ {};
+    std::atomic<std::uint64_t> count_ {0};
+    std::atomic<std::uint64_t> sum_us_ {0};
+    std::atomic<std::uint64_t> max_us_ {0};
+};
+
+// Histograms of every label (an endpoint, say), status class and phase.
+// Each thread records into a shard of its own with relaxed atomics; a histogram
+// is allocated on its first value, and shards are merged on read.
+class Recorder {
+public:
+    explicit Recorder(size_t num_labels);
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+    ~Recorder();
+
+    void Record(std::uint32_t label, unsigned status, Phase phase, Clock::duration value) noexcept;
+    HistogramSnapshot Snapshot(std::uint32_t label, size_t status_class, Phase phase) const;
+    size_t NumLabels() const noexcept {
+        return num_labels_;
+    }
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<AtomicHistogram*>[]> histograms;
+    };
+
+    size_t Slot(std::uint32_t label, size_t status_class, Phase phase) const noexcept {
+        return (label * NUM_STATUS_CLASSES + status_class) * NUM_PHASES + static_cast<size_t>(phase);
+    }
+
+    const size_t num_labels_;
+    const size_t num_slots_;
+    std::array<Shard, NUM_SHARDS> shards_;
+};
+
+} // namespace latency
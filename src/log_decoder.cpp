@@ -0,0 +1,27 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "logger.h"
+
+// Prints a log written with --binary-log as the JSON lines the server would have written
+int main(int argc, const char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: log_decoder <binary log file>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream in {argv[1], std::ios::binary};
+    if (!in) {
+        std::cerr << "Failed to open " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    try {
+        std::ios::sync_with_stdio(false);
+        logger::DecodeBinaryLog(in, std::cout);
+        std::cout.flush();
+        return EXIT_SUCCESS;
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
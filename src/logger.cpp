@@ -1,20 +1,435 @@
 #include "logger.h"
 
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 namespace logger {
-void LoggerFormatter(logging::record_view const& rec, logging::formatting_ostream& strm) {
-    auto ts = rec[timestamp];
-    auto data = rec[additional_data].get();
-    auto message = rec[expr::message].get<std::string>();
-    json::value res {{"timestamp", to_iso_extended_string(*ts)}, {"data", data}, {"message", message}};
-    strm << res;
-}
-
-void InitLogging() {
-    logging::add_common_attributes();
-    logging::add_console_log(
-            std::clog,
-            keywords::format = &LoggerFormatter,
-            keywords::auto_flush = true
-    );
-}
-} // namespace logger
\ No newline at end of file
+
+RecordRing::RecordRing(size_t capacity): capacity_(capacity), buffer_(std::make_unique<char[]>(capacity)) {
+    if (capacity_ < 2 * sizeof(Header) || (capacity_ & (capacity_ - 1)) != 0)
+        throw std::invalid_argument("Log ring size must be a power of two");
+}
+
+bool RecordRing::TryPush(Clock::time_point time, std::string_view data, std::string_view message) noexcept {
+    if (!Fits(data, message))
+        return false;
+    const auto size = RecordSize(data.size(), message.size());
+    auto head = head_.load(std::memory_order_relaxed);
+    const auto tail = tail_.load(std::memory_order_acquire);
+    auto pos = head & (capacity_ - 1);
+    // A record never wraps around, the end of the buffer is skipped instead
+    const auto to_end = capacity_ - pos;
+    const auto padding = to_end < size ? to_end : 0;
+    if (head + padding + size - tail > capacity_)
+        return false;
+    if (padding >= sizeof(Header)) {
+        auto* marker = reinterpret_cast<Header*>(&buffer_[pos]);
+        marker->size = static_cast<std::uint32_t>(padding);
+        marker->data_size = PADDING;
+    }
+    if (padding != 0) {
+        head += padding;
+        pos = 0;
+    }
+    auto* header = reinterpret_cast<Header*>(&buffer_[pos]);
+    *header = {static_cast<std::uint32_t>(size), static_cast<std::uint32_t>(data.size()),
+               static_cast<std::uint32_t>(message.size()), 0, time.time_since_epoch().count()};
+    char* payload = reinterpret_cast<char*>(header + 1);
+    // Empty views may carry a null pointer, which memcpy must not be given
+    if (!data.empty())
+        std::memcpy(payload, data.data(), data.size());
+    if (!message.empty())
+        std::memcpy(payload + data.size(), message.data(), message.size());
+    head_.store(head + size, std::memory_order_release);
+    return true;
+}
+
+namespace {
+
+using namespace std::literals;
+
+// Same text as boost::posix_time::to_iso_extended_string of the local time,
+// fractional seconds included only when there are any
+class TimestampFormatter {
+public:
+    std::string_view Format(Clock::time_point time) {
+        const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+        auto seconds = static_cast<std::time_t>(micros / 1'000'000);
+        auto fraction = micros % 1'000'000;
+        if (fraction < 0) {
+            fraction += 1'000'000;
+            --seconds;
+        }
+        if (seconds != cached_second_) {
+            std::tm tm {};
+            localtime_r(&seconds, &tm);
+            std::strftime(second_text_, sizeof(second_text_), "%Y-%m-%dT%H:%M:%S", &tm);
+            cached_second_ = seconds;
+        }
+        if (fraction == 0)
+            return second_text_;
+        std::snprintf(text_, sizeof(text_), "%s.%06ld", second_text_, static_cast<long>(fraction));
+        return text_;
+    }
+private:
+    std::time_t cached_second_ = -1;
+    char second_text_[32] {};
+    char text_[48] {};
+};
+
+void AppendLine(std::string& out, json_writer::JsonWriter& escaper, TimestampFormatter& timestamps, const RecordRing::Record& record) {
+    out += R"({"timestamp":")";
+    out += timestamps.Format(record.time);
+    out += R"(","data":)";
+    out += record.data.empty() ? "null"sv : record.data;
+    out += R"(,"message":)";
+    escaper.Reset();
+    escaper.String(record.message);
+    out += escaper.View();
+    out += "}\n";
+}
+
+// Written once at the start of a binary log
+constexpr std::string_view BINARY_MAGIC {"GSLOG\x01\r\n", 8};
+// Anything larger is damage, not a record
+constexpr std::uint64_t MAX_BINARY_FIELD = 1 << 30;
+
+void AppendVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+// Zigzag varint time delta, varint data size, varint message size, data, message.
+// Records of different threads interleave, so deltas may be negative.
+void AppendBinary(std::string& out, Clock::rep& last_time, const RecordRing::Record& record) {
+    const auto time = record.time.time_since_epoch().count();
+    const auto delta = static_cast<std::uint64_t>(time) - static_cast<std::uint64_t>(last_time);
+    last_time = time;
+    AppendVarint(out, (delta << 1) ^ (static_cast<std::int64_t>(delta) < 0 ? ~std::uint64_t{0} : 0));
+    AppendVarint(out, record.data.size());
+    AppendVarint(out, record.message.size());
+    out += record.data;
+    out += record.message;
+}
+
+// Empty at the end of the stream
+std::optional<std::uint64_t> ReadVarint(std::istream& in) {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        auto byte = in.get();
+        if (byte == std::char_traits<char>::eof())
+            return std::nullopt;
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    throw std::runtime_error("Damaged binary log: bad varint");
+}
+
+class AsyncLogger {
+public:
+    static AsyncLogger& Instance() {
+        static AsyncLogger instance;
+        return instance;
+    }
+
+    ~AsyncLogger() {
+        Stop();
+    }
+
+    void Start(const Options& options) {
+        std::lock_guard lock {control_mutex_};
+        if (running_.load())
+            return;
+        {
+            std::lock_guard output_lock {output_mutex_};
+            options_ = options;
+            ring_size_.store(options.ring_size, std::memory_order_relaxed);
+            overflow_.store(options.overflow, std::memory_order_relaxed);
+            last_time_ = 0;
+            if (options_.format == Format::Binary) {
+                options_.output->write(BINARY_MAGIC.data(), BINARY_MAGIC.size());
+                options_.output->flush();
+            }
+        }
+        stop_ = false;
+        // Rings sized by earlier options are replaced on their thread's next record
+        generation_.fetch_add(1, std::memory_order_relaxed);
+        running_.store(true, std::memory_order_release);
+        thread_ = std::thread{[this] {
+            Run();
+        }};
+    }
+
+    void Stop() {
+        std::lock_guard lock {control_mutex_};
+        if (!running_.load())
+            return;
+        // New records are written synchronously from here on, the thread drains what is buffered
+        // once the writers that saw it running are done pushing
+        running_.store(false);
+        std::vector<Registered> rings;
+        {
+            std::lock_guard rings_lock {rings_mutex_};
+            rings = rings_;
+        }
+        for (const auto& registered: rings) {
+            while (registered.pushing->value.load())
+                std::this_thread::yield();
+        }
+        {
+            std::lock_guard wake_lock {wake_mutex_};
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        std::lock_guard output_lock {output_mutex_};
+        options_ = {};
+    }
+
+    void Write(std::string_view data, std::string_view message) {
+        const auto now = Clock::now();
+        if (!running_.load(std::memory_order_acquire))
+            return WriteNow(now, data, message);
+        auto& slot = ThreadRing();
+        auto& ring = *slot.ring;
+        if (!ring.Fits(data, message))
+            return WriteNow(now, data, message);
+        // Stop waits for the flag of every ring to clear, so no record is pushed after the final drain.
+        // The flag is this thread's own; the only shared line touched is running_, which is read.
+        slot.pushing->value.store(true);
+        Pushing pushing {slot.pushing->value};
+        if (!running_.load())
+            return WriteNow(now, data, message);
+        while (!ring.TryPush(now, data, message)) {
+            if (overflow_.load(std::memory_order_relaxed) == OverflowPolicy::Drop || !running_.load()) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            wake_.notify_one();
+            std::this_thread::yield();
+        }
+    }
+
+    void SetEnabled(bool enabled) noexcept {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+    bool Enabled() const noexcept {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    Stats GetStats() const noexcept {
+        return {written_.load(std::memory_order_relaxed), dropped_.load(std::memory_order_relaxed)};
+    }
+private:
+    // Set by a logging thread while it may push into its ring, on a cache line of its own
+    struct alignas(64) PushFlag {
+        std::atomic<bool> value {false};
+    };
+    struct ThreadSlot {
+        std::shared_ptr<RecordRing> ring;
+        // Set when the thread exits; the ring is dropped once drained
+        std::shared_ptr<std::atomic<bool>> orphaned;
+        std::shared_ptr<PushFlag> pushing;
+        std::uint64_t generation = 0;
+        ~ThreadSlot() {
+            if (orphaned)
+                orphaned->store(true, std::memory_order_release);
+        }
+    };
+    struct Pushing {
+        std::atomic<bool>& flag;
+        ~Pushing() {
+            flag.store(false, std::memory_order_release);
+        }
+    };
+    struct Registered {
+        std::shared_ptr<RecordRing> ring;
+        std::shared_ptr<std::atomic<bool>> orphaned;
+        std::shared_ptr<PushFlag> pushing;
+    };
+
+    ThreadSlot& ThreadRing() {
+        thread_local ThreadSlot slot;
+        const auto generation = generation_.load(std::memory_order_relaxed);
+        if (slot.generation != generation) {
+            if (slot.orphaned)
+                slot.orphaned->store(true, std::memory_order_release);
+            slot.ring = std::make_shared<RecordRing>(ring_size_.load(std::memory_order_relaxed));
+            slot.orphaned = std::make_shared<std::atomic<bool>>(false);
+            slot.pushing = std::make_shared<PushFlag>();
+            slot.generation = generation;
+            // Once per thread and start, the only lock a logging thread ever takes. A ring registered
+            // after Stop took its copy is never pushed into: this thread sees running_ cleared.
+            std::lock_guard lock {rings_mutex_};
+            rings_.push_back({slot.ring, slot.orphaned, slot.pushing});
+        }
+        return slot;
+    }
+
+    void WriteNow(Clock::time_point time, std::string_view data, std::string_view message) {
+        std::string line;
+        std::lock_guard lock {output_mutex_};
+        if (options_.format == Format::Binary) {
+            AppendBinary(line, last_time_, {time, data, message});
+        } else {
+            json_writer::JsonWriter escaper;
+            TimestampFormatter timestamps;
+            AppendLine(line, escaper, timestamps, {time, data, message});
+        }
+        *options_.output << line;
+        options_.output->flush();
+        written_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Drains every ring into one buffer, written and flushed once per batch
+    size_t DrainOnce(std::string& batch, json_writer::JsonWriter& escaper, TimestampFormatter& timestamps) {
+        std::vector<Registered> rings;
+        {
+            std::lock_guard lock {rings_mutex_};
+            std::erase_if(rings_, [](const Registered& r) {
+                return r.orphaned->load(std::memory_order_acquire) && r.ring->Empty();
+            });
+            rings = rings_;
+        }
+        size_t count = 0;
+        batch.clear();
+        // Timestamp deltas chain through every record written, synchronous ones included
+        std::unique_lock lock {output_mutex_, std::defer_lock};
+        if (options_.format == Format::Binary)
+            lock.lock();
+        for (auto& registered: rings) {
+            count += registered.ring->Drain([&](const RecordRing::Record& record) {
+                if (options_.format == Format::Binary)
+                    AppendBinary(batch, last_time_, record);
+                else
+                    AppendLine(batch, escaper, timestamps, record);
+            });
+        }
+        if (count != 0) {
+            if (!lock.owns_lock())
+                lock.lock();
+            options_.output->write(batch.data(), static_cast<std::streamsize>(batch.size()));
+            options_.output->flush();
+            written_.fetch_add(count, std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    void Run() {
+        std::string batch;
+        json_writer::JsonWriter escaper;
+        TimestampFormatter timestamps;
+        for (;;) {
+            if (DrainOnce(batch, escaper, timestamps) != 0)
+                continue;
+            std::unique_lock lock {wake_mutex_};
+            if (stop_)
+                break;
+            wake_.wait_for(lock, options_.idle_wait);
+        }
+        // Records pushed before Stop was called
+        while (DrainOnce(batch, escaper, timestamps) != 0) {}
+    }
+
+    // Changed only while the writer thread is stopped; logging threads read the copies below
+    Options options_;
+    std::atomic<size_t> ring_size_ {Options{}.ring_size};
+    std::atomic<OverflowPolicy> overflow_ {OverflowPolicy::Drop};
+    std::atomic<bool> running_ {false};
+    std::atomic<bool> enabled_ {true};
+    std::atomic<std::uint64_t> written_ {0};
+    std::atomic<std::uint64_t> dropped_ {0};
+    std::atomic<std::uint64_t> generation_ {0};
+    std::mutex control_mutex_;
+    std::mutex rings_mutex_;
+    std::vector<Registered> rings_;
+    std::mutex output_mutex_;
+    // Time of the last binary record written
+    Clock::rep last_time_ = 0;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+} // namespace
+
+void InitLogging(const Options& options) {
+    if (options.ring_size < 1024 || (options.ring_size & (options.ring_size - 1)) != 0)
+        throw std::invalid_argument("Log ring size must be a power of two of at least 1024");
+    AsyncLogger::Instance().Start(options);
+}
+
+void ShutdownLogging() {
+    AsyncLogger::Instance().Stop();
+}
+
+void SetLoggingEnabled(bool enabled) noexcept {
+    AsyncLogger::Instance().SetEnabled(enabled);
+}
+
+bool LoggingEnabled() noexcept {
+    return AsyncLogger::Instance().Enabled();
+}
+
+Stats GetStats() noexcept {
+    return AsyncLogger::Instance().GetStats();
+}
+
+void Write(std::string_view data, std::string_view message) {
+    auto& logger = AsyncLogger::Instance();
+    if (logger.Enabled())
+        logger.Write(data, message);
+}
+
+json_writer::JsonWriter& ThreadWriter() {
+    thread_local json_writer::JsonWriter writer {256};
+    return writer;
+}
+
+size_t DecodeBinaryLog(std::istream& in, std::ostream& out) {
+    std::string magic(BINARY_MAGIC.size(), '\0');
+    if (!in.read(magic.data(), static_cast<std::streamsize>(magic.size())) || magic != BINARY_MAGIC)
+        throw std::runtime_error("Not a binary log");
+    json_writer::JsonWriter escaper;
+    TimestampFormatter timestamps;
+    std::string payload, line;
+    Clock::rep time = 0;
+    size_t count = 0;
+    for (;;) {
+        auto delta = ReadVarint(in);
+        auto data_size = delta ? ReadVarint(in) : std::nullopt;
+        auto message_size = data_size ? ReadVarint(in) : std::nullopt;
+        if (!message_size)
+            break;
+        if (*data_size > MAX_BINARY_FIELD || *message_size > MAX_BINARY_FIELD)
+            throw std::runtime_error("Damaged binary log: bad record size");
+        payload.resize(*data_size + *message_size);
+        if (!in.read(payload.data(), static_cast<std::streamsize>(payload.size())))
+            break;
+        time += static_cast<Clock::rep>((*delta >> 1) ^ (~(*delta & 1) + 1));
+        std::string_view view {payload};
+        line.clear();
+        AppendLine(line, escaper, timestamps, {Clock::time_point{Clock::duration{time}},
+                                               view.substr(0, *data_size), view.substr(*data_size)});
+        out << line;
+        ++count;
+    }
+    return count;
+}
+
+void Log(const json::value& data, std::string_view message) {
+    if (LoggingEnabled())
+        Write(json::serialize(data), message);
+}
+
+} // namespace logger
@@ -1,27 +1,145 @@
 #pragma once
-#include <boost/log/trivial.hpp>
-#include <boost/log/core.hpp>
-#include <boost/log/expressions.hpp>
-#include <boost/log/utility/setup/file.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/log/utility/manipulators/add_value.hpp>
-#include <boost/date_time.hpp>
 #include <boost/json.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string_view>
+
+#include "json_writer.h"
 
 namespace logger {
-namespace logging = boost::log;
-namespace keywords = boost::log::keywords;
-namespace sinks = boost::log::sinks;
-namespace expr = boost::log::expressions;
-namespace attr = boost::log::attributes;
 namespace json = boost::json;
 
-BOOST_LOG_ATTRIBUTE_KEYWORD(timestamp, "TimeStamp", boost::posix_time::ptime)
-BOOST_LOG_ATTRIBUTE_KEYWORD(additional_data, "AdditionalData", json::value)
+using Clock = std::chrono::system_clock;
 
-void LoggerFormatter(logging::record_view const& rec, logging::formatting_ostream& strm);
+enum class OverflowPolicy {
+    // Loses the record and counts it, callers never wait
+    Drop,
+    // Waits for the writer thread to make room
+    Block
+};
 
-void InitLogging();
-} // namespace logger
+enum class Format {
+    // One JSON object per line
+    Json,
+    // Length-prefixed records with delta-encoded timestamps, read back by log_decoder
+    Binary
+};
+
+struct Options {
+    // Bytes buffered per logging thread, a power of two
+    size_t ring_size = 1 << 20;
+    OverflowPolicy overflow = OverflowPolicy::Drop;
+    // How long the writer thread sleeps when there is nothing to write
+    std::chrono::milliseconds idle_wait {10};
+    std::ostream* output = &std::clog;
+    // Binary output has to be opened in binary mode
+    Format format = Format::Json;
+};
+
+struct Stats {
+    std::uint64_t written = 0;
+    std::uint64_t dropped = 0;
+};
+
+// Single-producer single-consumer ring of variable-size records, wait-free on both sides
+class RecordRing {
+public:
+    struct Record {
+        Clock::time_point time;
+        std::string_view data;
+        std::string_view message;
+    };
+
+    explicit RecordRing(size_t capacity);
+
+    // Producer side; false when the ring is full or the record can never fit
+    bool TryPush(Clock::time_point time, std::string_view data, std::string_view message) noexcept;
+    bool Fits(std::string_view data, std::string_view message) const noexcept {
+        return RecordSize(data.size(), message.size()) <= capacity_ / 2;
+    }
+
+    // Consumer side; records are valid only during the callback
+    template <typename Fn>
+    size_t Drain(Fn&& fn) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        const auto head = head_.load(std::memory_order_acquire);
+        size_t count = 0;
+        while (tail != head) {
+            const auto pos = tail & (capacity_ - 1);
+            if (capacity_ - pos < sizeof(Header)) {
+                tail += capacity_ - pos;
+                continue;
+            }
+            const auto* header = reinterpret_cast<const Header*>(&buffer_[pos]);
+            if (header->data_size != PADDING) {
+                const char* payload = reinterpret_cast<const char*>(header + 1);
+                fn(Record{Clock::time_point{Clock::duration{header->time}},
+                          {payload, header->data_size}, {payload + header->data_size, header->message_size}});
+                ++count;
+            }
+            tail += header->size;
+        }
+        tail_.store(tail, std::memory_order_release);
+        return count;
+    }
+    bool Empty() const noexcept {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+private:
+    struct Header {
+        std::uint32_t size;
+        // PADDING marks the unused end of the buffer, only size is valid then. An end too short
+        // for a header is skipped without a marker.
+        std::uint32_t data_size;
+        std::uint32_t message_size;
+        std::uint32_t reserved;
+        Clock::rep time;
+    };
+    static constexpr std::uint32_t PADDING = UINT32_MAX;
+
+    static size_t RecordSize(size_t data_size, size_t message_size) noexcept {
+        return (sizeof(Header) + data_size + message_size + alignof(Header) - 1) & ~(alignof(Header) - 1);
+    }
 
+    const size_t capacity_;
+    std::unique_ptr<char[]> buffer_;
+    alignas(64) std::atomic<std::uint64_t> head_ {0};
+    alignas(64) std::atomic<std::uint64_t> tail_ {0};
+};
+
+// Starts the writer thread; until then, and after ShutdownLogging, records are written synchronously
+void InitLogging(const Options& options = {});
+// Writes out everything buffered and stops the writer thread
+void ShutdownLogging();
+void SetLoggingEnabled(bool enabled) noexcept;
+bool LoggingEnabled() noexcept;
+Stats GetStats() noexcept;
+
+// One record, data being an encoded JSON value. The line written is
+// {"timestamp":"<local ISO time>","data":<data>,"message":"<message>"}
+void Write(std::string_view data, std::string_view message);
+
+json_writer::JsonWriter& ThreadWriter();
+
+// Turns a binary log back into the lines the JSON format would have written;
+// returns the number of records, throws std::runtime_error on a damaged log.
+// A record cut off at the end, as left by a crash, ends the log quietly.
+size_t DecodeBinaryLog(std::istream& in, std::ostream& out);
+
+// Hot paths encode their data straight into a per-thread writer, no json::value involved
+template <typename Encode>
+void Log(std::string_view message, Encode&& encode) {
+    if (!LoggingEnabled())
+        return;
+    auto& writer = ThreadWriter();
+    writer.Reset();
+    encode(writer);
+    Write(writer.View(), message);
+}
+
+void Log(const json::value& data, std::string_view message);
+
+} // namespace logger
@@ -13,9 +13,11 @@
 
 #include "json_loader.h"
 #include "request_handler.h"
+#include "runtime.h"
 #include "ticker.h"
 #include "model_serialization.h"
 #include "app_serialization.h"
+#include "tick_profiler.h"
 
 namespace {
 
@@ -47,6 +49,32 @@ struct Args {
     bool randomize_spawn_points = false;
     std::string state_file_path = "NULL";
     int save_state_period = 0;
+    int gzip_level = 6;
+    size_t gzip_min_size = 1024;
+    std::string static_cache = "on";
+    unsigned threads = 0;
+    bool thread_per_core = false;
+    size_t max_connections = 0;
+    size_t max_connections_per_ip = 0;
+    int idle_timeout = 30000;
+    size_t max_api_queue = 0;
+    size_t api_class_queue = 1024;
+    std::vector<std::string> rate_limits;
+    std::string log_overflow = "drop";
+    std::vector<std::string> log_samples;
+    std::string binary_log;
+    size_t tick_trace = 0;
+    std::string tick_trace_file = "tick-trace.json";
+    std::string tick_overrun = "catch-up";
+    int sim_substep = 0;
+    int snapshot_period = 0;
+    int max_extrapolation = 0;
+    std::string motion = "stepping";
+    size_t db_queue = 1 << 16;
+    size_t db_batch = 1000;
+    int db_batch_delay = 100;
+    std::string db_overflow = "block";
+    std::string db_spill_file;
 };
 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
@@ -56,11 +84,53 @@ struct Args {
     Args args;
     desc.add_options() ("help,h", "produce help message")
             ("tick-period,t", po::value<int>(&args.tick_period)->value_name("milliseconds"s),"set tick period")
+            ("tick-overrun", po::value(&args.tick_overrun)->value_name("catch-up|skip"s),
+                    "set whether ticks missed while a tick overran are run back to back or dropped")
+            ("sim-substep", po::value<int>(&args.sim_substep)->value_name("milliseconds"s),
+                    "split ticks into simulation steps of at most this length, 0 runs a tick as one step")
+            ("snapshot-period", po::value<int>(&args.snapshot_period)->value_name("milliseconds"s),
+                    "publish the state served to clients once per this much game time, 0 serves the live state")
+            ("max-extrapolation", po::value<int>(&args.max_extrapolation)->value_name("milliseconds"s),
+                    "extrapolate dog positions in state responses up to this long past the last tick, 0 disables it")
+            ("motion", po::value(&args.motion)->value_name("stepping|events"s),
+                    "move every dog every tick, or only process dogs when they reach a road end or an item")
+            ("db-queue", po::value<size_t>(&args.db_queue)->value_name("count"s),
+                    "set how many retired players may wait to be written to the database")
+            ("db-batch", po::value<size_t>(&args.db_batch)->value_name("count"s),
+                    "write retired players to the database in transactions of up to this many")
+            ("db-batch-delay", po::value<int>(&args.db_batch_delay)->value_name("milliseconds"s),
+                    "set how long a retired player may wait for its batch to fill up")
+            ("db-overflow", po::value(&args.db_overflow)->value_name("block|spill|drop"s),
+                    "set what the game does when the database queue is full")
+            ("db-spill-file", po::value(&args.db_spill_file)->value_name("file"s),
+                    "keep retired players the database does not take in this file and retry them")
             ("config-file,c", po::value(&args.config_file)->value_name("file"s), "set config file path")
             ("www-root,w", po::value(&args.static_files_root)->value_name("dir"s), "set static files root")
             ("randomize-spawn-points", po::bool_switch(&args.randomize_spawn_points), "spawn dogs at random positions")
             ("state-file", po::value(&args.state_file_path)->value_name("file"s), "set save file path")
-            ("save-state-period", po::value<int>(&args.save_state_period)->value_name("milliseconds"s), "set save period");
+            ("save-state-period", po::value<int>(&args.save_state_period)->value_name("milliseconds"s), "set save period")
+            ("gzip-level", po::value<int>(&args.gzip_level)->value_name("0-9"s), "set response compression level, 0 disables it")
+            ("gzip-min-size", po::value<size_t>(&args.gzip_min_size)->value_name("bytes"s), "set minimal body size to compress")
+            ("static-cache", po::value(&args.static_cache)->value_name("on|off|dev"s), "set static files caching mode")
+            ("threads", po::value<unsigned>(&args.threads)->value_name("count"s), "set worker threads count, defaults to the number of cores")
+            ("thread-per-core", po::bool_switch(&args.thread_per_core), "run an io_context with its own listener on each pinned thread")
+            ("max-connections", po::value<size_t>(&args.max_connections)->value_name("count"s), "set open connections limit, 0 disables it")
+            ("max-connections-per-ip", po::value<size_t>(&args.max_connections_per_ip)->value_name("count"s), "set open connections limit per client address, 0 disables it")
+            ("idle-timeout", po::value<int>(&args.idle_timeout)->value_name("milliseconds"s), "set how long an idle keep-alive connection is kept")
+            ("max-api-queue", po::value<size_t>(&args.max_api_queue)->value_name("count"s), "set API requests queue limit, 0 disables it, excess requests get 503")
+            ("api-class-queue", po::value<size_t>(&args.api_class_queue)->value_name("count"s), "set queue limit of each API request priority class")
+            ("rate-limit", po::value(&args.rate_limits)->multitoken()->value_name("endpoint=rate[:burst]"s),
+                    "limit requests per second to an endpoint (join, action, players, state, tick, records, maps, map), "
+                    "per player for token endpoints and per client address for the others")
+            ("log-overflow", po::value(&args.log_overflow)->value_name("drop|block"s), "set what logging threads do when the log buffer is full")
+            ("log-sample", po::value(&args.log_samples)->multitoken()->value_name("endpoint|Nxx=rate"s),
+                    "log only this share of requests to an endpoint (join, action, players, state, tick, records, maps, map, static, unknown, metrics, tick-trace) "
+                    "or of responses of a status class (1xx to 4xx); 5xx responses are always logged")
+            ("binary-log", po::value(&args.binary_log)->value_name("file"s), "write the log to a file in compact binary form, see log_decoder")
+            ("tick-trace", po::value<size_t>(&args.tick_trace)->value_name("events"s),
+                    "keep this many latest tick phase timings, served as Chrome trace JSON at /debug/tick-trace in test mode (no --tick-period) "
+                    "and written to --tick-trace-file on SIGUSR1")
+            ("tick-trace-file", po::value(&args.tick_trace_file)->value_name("file"s), "set the file SIGUSR1 writes the tick trace to");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -77,12 +147,60 @@ struct Args {
     return args;
 }
 
-void SerializeGameState(const model::Game &game, const std::vector<app::Player>& players, const std::string& state_file_path) {
+// Percentiles of every endpoint that served requests, all status classes together
+json::value LatencySummary(const latency::Recorder& recorder) {
+    json::object summary;
+    for (std::uint32_t endpoint = 0; endpoint < recorder.NumLabels(); ++endpoint) {
+        json::object endpoint_stats;
+        for (size_t p = 0; p < latency::NUM_PHASES; ++p) {
+            const auto phase = static_cast<latency::Phase>(p);
+            latency::HistogramSnapshot merged;
+            for (size_t status_class = 0; status_class < latency::NUM_STATUS_CLASSES; ++status_class)
+                merged.Merge(recorder.Snapshot(endpoint, status_class, phase));
+            if (merged.count == 0)
+                continue;
+            endpoint_stats.emplace(latency::PhaseName(phase),
+                                   json::object{{"count"s, merged.count}, {"p50_us"s, merged.Percentile(0.5)},
+                                                {"p99_us"s, merged.Percentile(0.99)}, {"max_us"s, merged.max_us}});
+        }
+        if (!endpoint_stats.empty())
+            summary.emplace(access_log::EndpointName(endpoint), std::move(endpoint_stats));
+    }
+    return summary;
+}
+
+access_log::SamplingOptions ParseLogSampling(const std::vector<std::string>& specs) {
+    access_log::SamplingOptions sampling;
+    for (const auto& spec: specs) {
+        if (!access_log::ApplySamplingSpec(sampling, spec))
+            throw std::runtime_error("Invalid log sampling "s + spec);
+    }
+    return sampling;
+}
+
+http_handler::RateLimits ParseRateLimits(const std::vector<std::string>& specs) {
+    http_handler::RateLimits limits {};
+    for (const auto& spec: specs) {
+        auto eq = spec.find('=');
+        auto route = router::RouteFromName(std::string_view{spec}.substr(0, eq));
+        auto limit = eq == std::string::npos ? std::nullopt : rate_limiter::ParseLimit(std::string_view{spec}.substr(eq + 1));
+        if (!route || !limit)
+            throw std::runtime_error("Invalid rate limit "s + spec);
+        limits[static_cast<size_t>(*route)] = *limit;
+    }
+    return limits;
+}
+
+void SerializeGameState(model::Game &game, const std::vector<app::Player>& players, const std::string& state_file_path,
+                        metrics::GameMetrics& metrics) {
+    tick_profiler::Scope scope {"save_state"};
+    const auto start = latency::Clock::now();
     auto temp_path = state_file_path + "_temp";
     std::ofstream out_file{state_file_path + "_temp", std::ios::binary};
     OutputBinaryArchive output_archive{out_file};
     std::vector<serialization::GameSessionRepr> sessionReprs;
     std::vector<serialization::PlayerRepr> playerReprs;
+    game.SyncPositions();
     for (auto &session: game.GetSessions())
         sessionReprs.emplace_back(session);
     for (auto &player: players) {
@@ -91,9 +209,12 @@ void SerializeGameState(const model::Game &game, const std::vector<app::Player>&
     }
     output_archive << sessionReprs;
     output_archive << playerReprs;
+    out_file.flush();
+    const auto bytes = static_cast<std::uint64_t>(out_file.tellp());
     out_file.close();
     std::filesystem::remove(state_file_path);
     std::filesystem::rename(temp_path, state_file_path);
+    metrics.OnSaveState(latency::Clock::now() - start, bytes);
 }
 
 void DeserializeGameState(model::Game &game, http_handler::RequestHandler& handler, const std::string& state_file_path) {
@@ -117,55 +238,115 @@ void DeserializeGameState(model::Game &game, http_handler::RequestHandler& handl
     in_file.close();
 }
 
-template <typename Fn>
-void RunWorkers(unsigned num_of_threads, const Fn& func) {
-    num_of_threads = std::max(1u, num_of_threads);
-    std::vector<std::thread> workers;
-    workers.reserve(num_of_threads - 1);
-    while (--num_of_threads) {
-        workers.emplace_back(func);
-    }
-    func();
+// /debug/tick-trace is served in test mode only; any server writes the trace on SIGUSR1
+void WriteTickTraceOnSignal(net::signal_set& signals, const std::string& path) {
+    signals.async_wait([&signals, path](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
+        if (ec)
+            return;
+        json::value data {{"file"s, path}};
+        logger::Log(data, tick_profiler::WriteChromeTrace(path) ? "tick trace written"sv : "tick trace not written"sv);
+        WriteTickTraceOnSignal(signals, path);
+    });
 }
 
 }  // namespace
 
 int main(int argc, const char* argv[]) {
+    // Outlives the logger, which is shut down on both exit paths
+    std::ofstream binary_log;
     try {
         if (auto args = ParseCommandLine(argc, argv)) {
             // 1. Загружаем карту из файла и построить модель игры
             model::Game game = json_loader::LoadGame(args->config_file);
+            if (args->motion == "events"s)
+                game.SetMotion(model::Motion::Events);
+            else if (args->motion != "stepping"s)
+                throw std::runtime_error("Motion must be stepping or events"s);
             std::string static_path{args->static_files_root};
             std::string save_path{args->state_file_path};
 
-            // 2. Инициализируем io_context
-            const unsigned num_threads = std::thread::hardware_concurrency();
-            net::io_context ioc((int) num_threads);
+            // 2. Инициализируем io_context: общий для всех потоков или по одному на ядро
+            const unsigned num_threads = args->threads != 0 ? args->threads : std::thread::hardware_concurrency();
+            runtime::Runtime runtime(num_threads, args->thread_per_core);
+            auto& ioc = runtime.Main();
 
             // 3. Создаём последовательный обработчик и обрабатываем параметры
+            // Игровой strand живёт в основном io_context: симуляция и API выполняются на его ядре
             auto strand = net::make_strand(ioc);
             bool test_mode = true, rand_pos = args->randomize_spawn_points;
+            if (args->tick_period < 0)
+                throw std::runtime_error("Tick period must be positive, or 0 for ticks by the API"s);
             if (args->tick_period != 0)
                 test_mode = false;
+            if (args->gzip_level < 0 || args->gzip_level > 9)
+                throw std::runtime_error("Compression level must be between 0 and 9"s);
+            compression::Options compression {args->gzip_level, args->gzip_min_size};
+            auto cache_mode = file_cache::CacheModeFromString(args->static_cache);
 
             // 4. Создаем БД для игры
             auto db_url = GetConfigFromEnv();
             database::Database db {pqxx::connection(db_url)};
+            // Retired players are written off the game strand, by a thread and a connection of their own
+            db_writer::Options db_options {args->db_queue, args->db_batch, std::chrono::milliseconds{args->db_batch_delay}};
+            if (args->db_overflow == "spill"s)
+                db_options.overflow = db_writer::OverflowPolicy::Spill;
+            else if (args->db_overflow == "drop"s)
+                db_options.overflow = db_writer::OverflowPolicy::Drop;
+            else if (args->db_overflow != "block"s)
+                throw std::runtime_error("Database overflow policy must be block, spill or drop"s);
+            db_options.spill_path = args->db_spill_file;
+            auto player_db = std::make_shared<database::Database>(pqxx::connection(db_url));
+            auto player_writer = std::make_shared<db_writer::WriteBehind>(
+                    [player_db](const std::vector<model::DogInfo>& batch) {
+                        player_db->SavePlayers(batch);
+                    }, db_options);
 
+            http_handler::OverloadOptions overload;
+            overload.queues.max_queued = args->max_api_queue;
+            overload.queues.queue_capacity = args->api_class_queue;
+            overload.rate_limits = ParseRateLimits(args->rate_limits);
+            if (args->sim_substep < 0 || args->snapshot_period < 0 || args->max_extrapolation < 0)
+                throw std::runtime_error("Simulation substep, snapshot period and extrapolation must not be negative"s);
+            sim_schedule::Options simulation {args->sim_substep, args->snapshot_period, args->max_extrapolation};
             auto handler = std::make_shared<http_handler::RequestHandler>
-                    (game, db, std::move(static_path), strand, test_mode, rand_pos);
+                    (game, db, std::move(static_path), strand, test_mode, rand_pos, compression, cache_mode, overload,
+                     ParseLogSampling(args->log_samples), simulation);
+            handler->GetApiHandler().SetPlayerWriter(player_writer);
+            if (cache_mode == file_cache::CacheMode::Immutable)
+                handler->GetStaticCache().Preload();
 
             // 5. Добавляем асинхронный обработчик сигналов SIGINT и SIGTERM
             net::signal_set signals(ioc, SIGINT, SIGTERM);
-            signals.async_wait([&ioc, &game, &handler, save_path](const sys::error_code &ec, [[maybe_unused]] int signal_number) {
+            signals.async_wait([&runtime, &strand, &game, &handler, save_path](const sys::error_code &ec, [[maybe_unused]] int signal_number) {
                 if (!ec) {
-                    SerializeGameState(game, handler->GetPlayers(), save_path);
-                    ioc.stop();
+                    // Состояние сохраняется на игровом strand, чтобы не пересечься с тиком
+                    net::dispatch(strand, [&runtime, &game, &handler, save_path] {
+                        SerializeGameState(game, handler->GetPlayers(), save_path, handler->GetApiHandler().Metrics());
+                        runtime.Stop();
+                    });
                 }
             });
 
-            // 6. Инициализируем формат логирования
-            logger::InitLogging();
+            // 6. Запускаем поток записи логов
+            logger::Options log_options;
+            if (args->log_overflow == "block"s)
+                log_options.overflow = logger::OverflowPolicy::Block;
+            else if (args->log_overflow != "drop"s)
+                throw std::runtime_error("Log overflow policy must be drop or block"s);
+            if (!args->binary_log.empty()) {
+                binary_log.open(args->binary_log, std::ios::binary | std::ios::trunc);
+                if (!binary_log)
+                    throw std::runtime_error("Failed to open binary log "s + args->binary_log);
+                log_options.output = &binary_log;
+                log_options.format = logger::Format::Binary;
+            }
+            logger::InitLogging(log_options);
+            net::signal_set trace_signals(ioc);
+            if (args->tick_trace != 0) {
+                tick_profiler::Enable(args->tick_trace);
+                trace_signals.add(SIGUSR1);
+                WriteTickTraceOnSignal(trace_signals, args->tick_trace_file);
+            }
 
             // 7. Загружаем состояние игры
             if (args->state_file_path != "NULL") {
@@ -174,53 +355,108 @@ int main(int argc, const char* argv[]) {
 
             int nof_ms_total = 0;
             sig::connection conn;
+            std::shared_ptr<ticker::Ticker> game_ticker;
             if (!test_mode) {
                 // 8. Создаем тикер для обновления состояния игры во времени и сериализации
                 std::chrono::milliseconds update_period {args->tick_period};
                 int save_period = args->save_state_period;
-                auto handle = [&game, &handler, save_period, save_path, &nof_ms_total, &db](ticker::duration time_period) {
-                    int nof_ms = static_cast<int>(time_period.count()) / MICROSECONDS;
-                    auto retired_players = game.UpdateGame(nof_ms);
-                    for (auto &player: retired_players)
-                        handler->DeletePlayer(player.dog_id_);
-                    db.SavePlayers(retired_players);
+                auto overrun = ticker::OverrunPolicy::CatchUp;
+                if (args->tick_overrun == "skip"s)
+                    overrun = ticker::OverrunPolicy::Skip;
+                else if (args->tick_overrun != "catch-up"s)
+                    throw std::runtime_error("Tick overrun policy must be catch-up or skip"s);
+                // The game counts whole milliseconds, the fractions are carried to the next tick
+                auto handle = [&game, &handler, save_period, save_path, &nof_ms_total, carry = ticker::duration{}]
+                        (ticker::duration time_period) mutable {
+                    carry += time_period;
+                    auto whole = std::chrono::duration_cast<std::chrono::milliseconds>(carry);
+                    carry -= whole;
+                    int nof_ms = static_cast<int>(whole.count());
+                    handler->GetApiHandler().Tick(nof_ms);
                     nof_ms_total += nof_ms;
                     if ((save_path != "NULL") && (save_period > 0) && (nof_ms_total > save_period))
-                        SerializeGameState(game, handler->GetPlayers(), save_path);
+                        SerializeGameState(game, handler->GetPlayers(), save_path, handler->GetApiHandler().Metrics());
                 };
 
-                auto ticker = std::make_shared<ticker::Ticker>(strand, update_period, handle);
-                ticker->Start();
+                game_ticker = std::make_shared<ticker::Ticker>(strand, update_period, handle, overrun);
+                handler->SetTicker(game_ticker);
+                game_ticker->Start();
             } else {
                 conn = handler->GetApiHandler().DoOnTick([total = 0, save_path, &game, &handler](int nof_ms) mutable {
                    total += nof_ms;
                    if (save_path != "NULL")
-                       SerializeGameState(game, handler->GetPlayers(), save_path);
+                       SerializeGameState(game, handler->GetPlayers(), save_path, handler->GetApiHandler().Metrics());
                 });
             }
 
             // 9. Запускаем обработчик HTTP-запросов, делегируя их обработчику запросов
             const auto address = net::ip::make_address("0.0.0.0");
             constexpr net::ip::port_type port = 8080;
-            http_server::ServeHttp(ioc, {address, port}, [&handler](auto &&req, auto &&send) {
-                (*handler)(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
-            });
+            // В режиме thread-per-core у каждого io_context свой acceptor на том же порту (SO_REUSEPORT)
+            if (args->idle_timeout <= 0)
+                throw std::runtime_error("Idle timeout must be positive"s);
+            http_server::ConnectionLimits limits;
+            limits.max_connections = args->max_connections;
+            limits.max_connections_per_ip = args->max_connections_per_ip;
+            limits.idle_timeout = std::chrono::milliseconds{args->idle_timeout};
+            auto connections = std::make_shared<http_server::ConnectionTracker>(limits);
+            handler->SetConnectionTracker(connections);
+            // Запросы логирует обработчик, чтобы выборка запроса и ответа совпадала
+            const http_server::ListenOptions listen_options {runtime.ThreadPerCore(), connections, false, handler->Latency()};
+            for (auto& context: runtime.Contexts()) {
+                http_server::ServeHttp(*context, {address, port}, [&handler](auto &&req, auto &&send, const net::ip::address& client) {
+                    (*handler)(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send), client);
+                }, listen_options);
+            }
 
             json::value data{{"port"s,    port},
                              {"address"s, address.to_string()}};
-            BOOST_LOG_TRIVIAL(info) << logger::logging::add_value(logger::additional_data, data) << "server started"s;
+            logger::Log(data, "server started"sv);
 
             // 10. Запускаем обработку асинхронных операций
-            RunWorkers(std::max(1u, num_threads), [&ioc] {
-                ioc.run();
-            });
+            runtime.Run();
+
+            auto stats = connections->Stats();
+            json::value shed {{"rejected_total_limit"s, stats.rejected_total_limit},
+                              {"rejected_ip_limit"s, stats.rejected_ip_limit},
+                              {"idle_reaped"s, stats.idle_reaped},
+                              {"overload_503"s, handler->ShedRequests()},
+                              {"rate_limited_429"s, handler->RateLimitedRequests()}};
+            logger::Log(shed, "admission stats"sv);
+
+            json::array queues;
+            for (const auto& queue: handler->ApiQueueStats()) {
+                queues.push_back({{"dispatched"s, queue.dispatched},
+                                  {"rejected"s, queue.rejected},
+                                  {"mean_wait_us"s, queue.dispatched ? queue.total_wait_us / queue.dispatched : 0},
+                                  {"max_wait_us"s, queue.max_wait_us}});
+            }
+            json::value queue_stats {{"high"s, queues.at(0)}, {"normal"s, queues.at(1)}, {"low"s, queues.at(2)}};
+            logger::Log(queue_stats, "api queue stats"sv);
+            logger::Log(LatencySummary(*handler->Latency()), "latency stats"sv);
+            if (game_ticker) {
+                auto tick_stats = game_ticker->GetStats();
+                logger::Log(json::value{{"ticks"s, tick_stats.ticks}, {"overruns"s, tick_stats.overruns},
+                                        {"skipped"s, tick_stats.skipped},
+                                        {"jitter_p99_us"s, tick_stats.jitter.Percentile(0.99)},
+                                        {"duration_p99_us"s, tick_stats.duration.Percentile(0.99)}}, "ticker stats"sv);
+            }
+            // Flushes the players retired up to the end
+            player_writer->Shutdown();
+            auto db_stats = player_writer->GetStats();
+            logger::Log(json::value{{"committed"s, db_stats.committed}, {"batches"s, db_stats.batches},
+                                    {"failed_commits"s, db_stats.failed_commits}, {"spilled"s, db_stats.spilled},
+                                    {"replayed"s, db_stats.replayed}, {"dropped"s, db_stats.dropped}}, "db writer stats"sv);
+            auto log_stats = logger::GetStats();
+            logger::Log(json::value{{"written"s, log_stats.written}, {"dropped"s, log_stats.dropped}}, "log stats"sv);
         }
         json::value data {{"code"s, 0}};
-        BOOST_LOG_TRIVIAL(error) << logger::logging::add_value(logger::additional_data, data) << "server exited"s;
+        logger::Log(data, "server exited"sv);
+        logger::ShutdownLogging();
         return EXIT_SUCCESS;
     } catch (const std::exception& ex) {
-        json::value data {{"code"s, 1}, {"exception"s, ex.what()}};
-        BOOST_LOG_TRIVIAL(error)  << "server exited with error: "s << ex.what();
+        logger::Write({}, "server exited with error: "s + ex.what());
+        logger::ShutdownLogging();
         return EXIT_FAILURE;
     }
 }
@@ -0,0 +1,66 @@
+#include "map_catalog.h"
+#include "model_json.h"
+
+namespace map_catalog {
+
+namespace {
+
+std::string MakeETag(std::string_view body, std::string_view suffix = {}) {
+    // FNV-1a over the representation bytes
+    std::uint64_t hash = 14695981039346656037ull;
+    for (unsigned char ch: body) {
+        hash ^= ch;
+        hash *= 1099511628211ull;
+    }
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string etag {"\""};
+    for (int shift = 60; shift >= 0; shift -= 4)
+        etag.push_back(hex[(hash >> shift) & 0xF]);
+    etag.append(suffix);
+    etag.push_back('"');
+    return etag;
+}
+
+Document MakeDocument(std::string body, const compression::Options& options) {
+    Document doc;
+    doc.etag = MakeETag(body);
+    if (options.Enabled() && body.size() >= options.min_size) {
+        doc.gzip = compression::Compress(body, compression::Encoding::Gzip, options.level);
+        doc.deflate = compression::Compress(body, compression::Encoding::Deflate, options.level);
+        doc.gzip_etag = MakeETag(body, "-gzip");
+        doc.deflate_etag = MakeETag(body, "-deflate");
+    }
+    doc.body = std::move(body);
+    return doc;
+}
+
+} // namespace
+
+std::pair<std::string_view,compression::Encoding> Document::Select(compression::Encoding encoding) const noexcept {
+    if (encoding == compression::Encoding::Gzip && !gzip.empty())
+        return {gzip, encoding};
+    if (encoding == compression::Encoding::Deflate && !deflate.empty())
+        return {deflate, encoding};
+    return {body, compression::Encoding::Identity};
+}
+
+std::string_view Document::ETag(compression::Encoding encoding) const noexcept {
+    switch (Select(encoding).second) {
+        case compression::Encoding::Gzip:
+            return gzip_etag;
+        case compression::Encoding::Deflate:
+            return deflate_etag;
+        default:
+            return etag;
+    }
+}
+
+MapCatalog::MapCatalog(const model::Game::Maps& maps, const compression::Options& compression) {
+    json_writer::JsonWriter writer;
+    model_json::WriteMapsList(writer, maps);
+    list_ = MakeDocument(writer.Release(), compression);
+    for (const auto& map: maps)
+        maps_.emplace(*map.GetId(), MakeDocument(map.GetJsonString(), compression));
+}
+
+} // namespace map_catalog
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "compression.h"
+#include "model.h"
+
+namespace map_catalog {
+
+// A response body prepared once, with its precompressed variants
+struct Document {
+    std::string body;
+    std::string gzip;
+    std::string deflate;
+    std::string etag;
+    std::string gzip_etag;
+    std::string deflate_etag;
+
+    // Falls back to the identity body when no variant was prepared for the coding
+    std::pair<std::string_view,compression::Encoding> Select(compression::Encoding encoding) const noexcept;
+    // Strong ETag of the representation sent for the given coding
+    std::string_view ETag(compression::Encoding encoding) const noexcept;
+    bool HasVariants() const noexcept {
+        return !gzip.empty() || !deflate.empty();
+    }
+};
+
+// Maps never change after json_loader::LoadGame, so the catalog and every map
+// document are serialized, tagged and compressed once at startup and are safe to
+// read from any thread afterwards.
+class MapCatalog {
+public:
+    MapCatalog(const model::Game::Maps& maps, const compression::Options& compression);
+
+    const Document& GetList() const noexcept {
+        return list_;
+    }
+    const Document* FindMap(std::string_view id) const noexcept {
+        if (auto it = maps_.find(id); it != maps_.end())
+            return &it->second;
+        return nullptr;
+    }
+private:
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const noexcept {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    Document list_;
+    std::unordered_map<std::string, Document, StringHash, std::equal_to<>> maps_;
+};
+
+} // namespace map_catalog
@@ -0,0 +1,204 @@
+#include "metrics.h"
+
+#include <charconv>
+
+namespace metrics {
+
+namespace {
+
+std::string_view TypeName(Type type) noexcept {
+    switch (type) {
+        case Type::Counter:
+            return "counter";
+        case Type::Gauge:
+            return "gauge";
+        default:
+            return "histogram";
+    }
+}
+
+void AppendEscaped(std::string& out, std::string_view value) {
+    for (char c: value) {
+        if (c == '\\' || c == '"')
+            out += '\\';
+        if (c == '\n')
+            out += "\\n";
+        else
+            out += c;
+    }
+}
+
+template <typename Integer>
+void AppendInteger(std::string& out, Integer value) {
+    char buffer[24];
+    auto [end, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    out.append(buffer, end);
+}
+
+latency::HistogramSnapshot SnapshotOf(const latency::AtomicHistogram& histogram) {
+    latency::HistogramSnapshot snapshot;
+    histogram.AddTo(snapshot);
+    return snapshot;
+}
+
+} // namespace
+
+std::uint64_t Counter::Value() const noexcept {
+    std::uint64_t sum = 0;
+    for (size_t i = 0; i < latency::NUM_SHARDS; ++i)
+        sum += cells_[i].value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+TextWriter& TextWriter::Family(std::string_view name, Type type, std::string_view help) {
+    out_.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out_.append("# TYPE ").append(name).append(" ").append(TypeName(type)).append("\n");
+    return *this;
+}
+
+void TextWriter::WriteName(std::string_view name, std::string_view suffix, Labels labels, const Label* extra) {
+    out_.append(name).append(suffix);
+    if (labels.size() == 0 && !extra) {
+        out_ += ' ';
+        return;
+    }
+    char separator = '{';
+    const auto append = [&](const Label& label) {
+        out_ += separator;
+        out_.append(label.name).append("=\"");
+        AppendEscaped(out_, label.value);
+        out_ += '"';
+        separator = ',';
+    };
+    for (const auto& label: labels)
+        append(label);
+    if (extra)
+        append(*extra);
+    out_.append("} ");
+}
+
+void TextWriter::WriteValue(double value) {
+    char buffer[64];
+    auto [end, ec] = std::to_chars(std::begin(buffer), std::end(buffer), value, std::chars_format::fixed);
+    out_.append(buffer, ec == std::errc{} ? end : buffer);
+}
+
+TextWriter& TextWriter::Sample(std::string_view name, Labels labels, std::uint64_t value) {
+    WriteName(name, {}, labels);
+    AppendInteger(out_, value);
+    out_ += '\n';
+    return *this;
+}
+
+TextWriter& TextWriter::Sample(std::string_view name, Labels labels, std::int64_t value) {
+    WriteName(name, {}, labels);
+    AppendInteger(out_, value);
+    out_ += '\n';
+    return *this;
+}
+
+TextWriter& TextWriter::Sample(std::string_view name, Labels labels, double value) {
+    WriteName(name, {}, labels);
+    WriteValue(value);
+    out_ += '\n';
+    return *this;
+}
+
+TextWriter& TextWriter::Histogram(std::string_view name, Labels labels, const latency::HistogramSnapshot& snapshot) {
+    char bound[32];
+    size_t bucket = 0;
+    std::uint64_t cumulative = 0;
+    for (auto bound_us: HISTOGRAM_BOUNDS_US) {
+        while (bucket < latency::Buckets::COUNT && latency::Buckets::UpperBound(bucket) <= bound_us)
+            cumulative += snapshot.counts[bucket++];
+        auto [end, ec] = std::to_chars(std::begin(bound), std::end(bound), static_cast<double>(bound_us) / 1e6,
+                                       std::chars_format::fixed);
+        const Label le {"le", {bound, static_cast<size_t>(end - bound)}};
+        WriteName(name, "_bucket", labels, &le);
+        AppendInteger(out_, cumulative);
+        out_ += '\n';
+    }
+    const Label inf {"le", "+Inf"};
+    WriteName(name, "_bucket", labels, &inf);
+    AppendInteger(out_, snapshot.count);
+    out_ += '\n';
+    WriteName(name, "_sum", labels);
+    WriteValue(static_cast<double>(snapshot.sum_us) / 1e6);
+    out_ += '\n';
+    WriteName(name, "_count", labels);
+    AppendInteger(out_, snapshot.count);
+    out_ += '\n';
+    return *this;
+}
+
+void GameMetrics::OnTick(const model::TickStats& stats, size_t retired_players, latency::Clock::duration total) noexcept {
+    tick_.Record(total);
+    move_.Record(stats.move);
+    retire_.Record(stats.retire);
+    collide_.Record(stats.collide);
+    loot_spawned_.Add(stats.loot_spawned);
+    retired_players_.Add(retired_players);
+}
+
+void GameMetrics::OnSaveState(latency::Clock::duration duration, std::uint64_t bytes) noexcept {
+    save_.Record(duration);
+    saved_bytes_.Add(bytes);
+    last_save_bytes_.Set(static_cast<std::int64_t>(bytes));
+}
+
+void GameMetrics::PublishSessions(const model::Game& game) {
+    // Filled outside the lock, the scrape only ever waits for a swap
+    scratch_.resize(game.GetSessions().size());
+    auto entry = scratch_.begin();
+    for (const auto& session: game.GetSessions()) {
+        entry->session = *session.GetId();
+        entry->map = *session.GetMapId();
+        entry->dogs = session.NumberOfPlayers();
+        entry->loot = session.NumberOfLostObjects();
+        ++entry;
+    }
+    std::lock_guard lock {sessions_mutex_};
+    sessions_.swap(scratch_);
+}
+
+std::vector<GameMetrics::SessionEntities> GameMetrics::Sessions() const {
+    std::lock_guard lock {sessions_mutex_};
+    return sessions_;
+}
+
+void GameMetrics::Write(TextWriter& writer) const {
+    writer.Family("game_tick_duration_seconds", Type::Histogram, "Game ticks, handing retired players over included")
+            .Histogram("game_tick_duration_seconds", {}, SnapshotOf(tick_));
+    writer.Family("game_tick_phase_duration_seconds", Type::Histogram, "Game tick phases over all sessions")
+            .Histogram("game_tick_phase_duration_seconds", {{"phase", "move"}}, SnapshotOf(move_))
+            .Histogram("game_tick_phase_duration_seconds", {{"phase", "retire"}}, SnapshotOf(retire_))
+            .Histogram("game_tick_phase_duration_seconds", {{"phase", "collide"}}, SnapshotOf(collide_));
+    writer.Family("game_loot_spawned_total", Type::Counter, "Lost objects generated")
+            .Sample("game_loot_spawned_total", {}, loot_spawned_.Value());
+    writer.Family("game_players_retired_total", Type::Counter, "Players retired for inactivity")
+            .Sample("game_players_retired_total", {}, retired_players_.Value());
+    writer.Family("game_db_handoff_duration_seconds", Type::Histogram,
+                  "Handing retired players over on the game strand, waits on a full database queue included")
+            .Histogram("game_db_handoff_duration_seconds", {}, SnapshotOf(hand_off_));
+    writer.Family("game_save_state_duration_seconds", Type::Histogram, "Writing the game state file")
+            .Histogram("game_save_state_duration_seconds", {}, SnapshotOf(save_));
+    writer.Family("game_save_state_bytes", Type::Gauge, "Size of the last game state file")
+            .Sample("game_save_state_bytes", {}, last_save_bytes_.Value());
+    writer.Family("game_save_state_bytes_total", Type::Counter, "Bytes of game state written")
+            .Sample("game_save_state_bytes_total", {}, saved_bytes_.Value());
+
+    const auto sessions = Sessions();
+    std::string id;
+    writer.Family("game_session_dogs", Type::Gauge, "Dogs in a game session as of the last tick");
+    for (const auto& session: sessions) {
+        id = std::to_string(session.session);
+        writer.Sample("game_session_dogs", {{"session", id}, {"map", session.map}}, session.dogs);
+    }
+    writer.Family("game_session_loot", Type::Gauge, "Lost objects in a game session as of the last tick");
+    for (const auto& session: sessions) {
+        id = std::to_string(session.session);
+        writer.Sample("game_session_loot", {{"session", id}, {"map", session.map}}, session.loot);
+    }
+}
+
+} // namespace metrics
@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "latency.h"
+#include "model.h"
+
+namespace metrics {
+
+// Prometheus text exposition format
+inline constexpr std::string_view CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+// Added to from any thread, each into a cache line of its own; summed on read
+class Counter {
+public:
+    Counter(): cells_(std::make_unique<Cell[]>(latency::NUM_SHARDS)) {}
+
+    void Add(std::uint64_t value = 1) noexcept {
+        cells_[latency::ShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+    std::uint64_t Value() const noexcept;
+private:
+    struct alignas(64) Cell {
+        std::atomic<std::uint64_t> value {0};
+    };
+    std::unique_ptr<Cell[]> cells_;
+};
+
+// A value set by one writer at a time
+class Gauge {
+public:
+    void Set(std::int64_t value) noexcept {
+        value_.store(value, std::memory_order_relaxed);
+    }
+    std::int64_t Value() const noexcept {
+        return value_.load(std::memory_order_relaxed);
+    }
+private:
+    std::atomic<std::int64_t> value_ {0};
+};
+
+enum class Type {
+    Counter,
+    Gauge,
+    Histogram
+};
+
+struct Label {
+    std::string_view name;
+    std::string_view value;
+};
+using Labels = std::initializer_list<Label>;
+
+// Renders metric families; the samples of a family follow its Family call
+class TextWriter {
+public:
+    TextWriter& Family(std::string_view name, Type type, std::string_view help);
+    TextWriter& Sample(std::string_view name, Labels labels, std::uint64_t value);
+    TextWriter& Sample(std::string_view name, Labels labels, std::int64_t value);
+    TextWriter& Sample(std::string_view name, Labels labels, double value);
+    // Cumulative buckets, sum and count of a histogram of microseconds, in seconds. A snapshot
+    // bucket straddling a bound is counted above it: no value is counted under a bound it exceeds.
+    TextWriter& Histogram(std::string_view name, Labels labels, const latency::HistogramSnapshot& snapshot);
+
+    const std::string& Text() const noexcept {
+        return out_;
+    }
+    std::string Release() noexcept {
+        return std::move(out_);
+    }
+private:
+    void WriteName(std::string_view name, std::string_view suffix, Labels labels, const Label* extra = nullptr);
+    void WriteValue(double value);
+
+    std::string out_;
+};
+
+// Histogram bounds in microseconds, from 100 us to 10 s
+inline constexpr std::uint64_t HISTOGRAM_BOUNDS_US[] = {
+        100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000,
+        100'000, 250'000, 500'000, 1'000'000, 2'500'000, 5'000'000, 10'000'000};
+
+// Simulation figures. Written on the game strand, read by scrapes on any thread,
+// so that a scrape never waits for the game strand.
+class GameMetrics {
+public:
+    struct SessionEntities {
+        std::uint32_t session;
+        std::string map;
+        std::uint64_t dogs;
+        std::uint64_t loot;
+    };
+
+    void OnTick(const model::TickStats& stats, size_t retired_players, latency::Clock::duration total) noexcept;
+    // Handing a tick's retired players over: the queue push, waits on a full queue included,
+    // or the whole database write when there is no writer thread
+    void OnPlayersHandOff(latency::Clock::duration duration) noexcept {
+        hand_off_.Record(duration);
+    }
+    void OnSaveState(latency::Clock::duration duration, std::uint64_t bytes) noexcept;
+    // Copies the entity counts of every session, scrapes see them as of the last call
+    void PublishSessions(const model::Game& game);
+    std::vector<SessionEntities> Sessions() const;
+
+    void Write(TextWriter& writer) const;
+private:
+    latency::AtomicHistogram tick_;
+    latency::AtomicHistogram move_;
+    latency::AtomicHistogram retire_;
+    latency::AtomicHistogram collide_;
+    latency::AtomicHistogram hand_off_;
+    latency::AtomicHistogram save_;
+    Counter loot_spawned_;
+    Counter retired_players_;
+    Counter saved_bytes_;
+    Gauge last_save_bytes_;
+
+    mutable std::mutex sessions_mutex_;
+    std::vector<SessionEntities> sessions_;
+    std::vector<SessionEntities> scratch_;
+};
+
+} // namespace metrics
@@ -1,5 +1,6 @@
 #include "model.h"
 #include "loot_generator.h"
+#include "tick_profiler.h"
 #include <cmath>
 #include <optional>
 #include <stdexcept>
@@ -7,6 +8,12 @@
 namespace model {
 using namespace std::literals;
 
+namespace {
+// Under Motion::Events, how far past the edge of its road a dog is stepped to resolve a turn or a stop,
+// and how far ahead an item has to be for the dog to be scheduled for it again
+constexpr double EVENT_TOLERANCE = 1e-6;
+}  // namespace
+
 PointF Map::GetRandomPosition(const Road::Id& road_id, bool rand) const {
     auto road = roads_.at(road_id_to_index_.at(road_id));
     PointF pos{};
@@ -128,14 +135,12 @@ Dog::Id GameSession::AddDog(const std::string& dog_name, bool rand_pos) {
 void GameSessionBase::AddNewDog(const Dog& dog) {
     const size_t index = dogs_.size();
     util::Tagged<std::uint32_t,Dog> dog_id {*dog.GetId()};
-    model::Road::Id road_id {*dog.GetId()};
     if (auto [it, inserted] = dog_to_index_.emplace(dog_id, index); !inserted) {
         throw std::invalid_argument("Dog with id "s + std::to_string(*dog_id) + " already exists"s);
     } else {
         try {
-            dogs_.emplace_back(dog_id, dog.GetName(), dog.GetDefaultSpeed(), road_id);
-            for (auto &obj: dog.GetBagContent())
-                dogs_.at(it->second).GatherLostObject(obj);
+            // Restored dogs keep their position, speed, score and bag
+            dogs_.push_back(dog);
             ++curr_dog_id_;
         } catch (...) {
             dog_to_index_.erase(it);
@@ -190,7 +195,12 @@ const PointF Road::BoundToRoad(const PointF &pos) const {
 }
 
 void Dog::Move(int time_interval, const Map& map) {
-    double time_delta = static_cast<double>(time_interval) / MILLISECONDS;
+    // Gathering looks along the path of the step
+    SetPrevPos(pos_);
+    Step(static_cast<double>(time_interval) / MILLISECONDS, map);
+}
+
+void Dog::Step(double time_delta, const Map& map) {
     auto x_coord = pos_.x + time_delta * speed_.vx, y_coord = pos_.y + time_delta * speed_.vy;
     PointF prev_pos {pos_.x, pos_.y};
     PointF new_pos {x_coord, y_coord};
@@ -223,15 +233,195 @@ void Dog::Move(int time_interval, const Map& map) {
     }
 }
 
-void GameSession::UpdateGameState(int time_interval) {
-    for (auto& dog: dogs_)
-        dog.Move(time_interval, map_);
+double Dog::TimeOnRoad(const Map& map) const {
+    auto road = map.FindRoad(curr_road_id_);
+    if (!road)
+        return 0.0;
+    // Roads are axis-aligned, a dog only ever moves along one axis
+    double time = std::numeric_limits<double>::infinity();
+    if (speed_.vx > 0)
+        time = (road->GetTopRight().x - pos_.x) / speed_.vx;
+    else if (speed_.vx < 0)
+        time = (road->GetBottomLeft().x - pos_.x) / speed_.vx;
+    else if (speed_.vy > 0)
+        time = (road->GetTopRight().y - pos_.y) / speed_.vy;
+    else if (speed_.vy < 0)
+        time = (road->GetBottomLeft().y - pos_.y) / speed_.vy;
+    return std::max(time, 0.0);
+}
+
+PointF Dog::Extrapolate(double seconds, const Map& map) const {
+    PointF ahead {pos_.x + seconds * speed_.vx, pos_.y + seconds * speed_.vy};
+    auto road = map.FindRoad(curr_road_id_);
+    return road ? road->BoundToRoad(ahead) : pos_;
+}
+
+size_t GameSession::UpdateGameState(int time_interval) {
+    if (motion_ == Motion::Events) {
+        // The loot of a tick is there for the whole of it, as the stepping collision detection sees it
+        auto nof_loot = GenerateLoot(time_interval);
+        tick_profiler::Scope scope {"move", *GetId()};
+        ProcessDueEvents(time_interval);
+        return nof_loot;
+    }
+    {
+        tick_profiler::Scope scope {"move", *GetId()};
+        for (auto& dog: dogs_)
+            dog.Move(time_interval, map_);
+    }
+    clock_ += time_interval;
+    return GenerateLoot(time_interval);
+}
+
+size_t GameSession::GenerateLoot(int time_interval) {
+    tick_profiler::Scope scope {"loot", *GetId()};
     auto time_interval_ms = std::chrono::milliseconds(time_interval);
     auto nof_loot = loot_generator_.Generate(time_interval_ms, NumberOfLostObjects(), NumberOfPlayers());
     for (int i = 0; i < nof_loot; i++) {
         auto obj_type = loot_gen::LootGenerator::GenerateType(map_.GetLootTypes());
         this->AddObject(obj_type);
+        if (motion_ != Motion::Events)
+            continue;
+        // Only the dogs heading for the new item move their events forward
+        const auto pos = lost_objects_.back().GetPosition();
+        for (auto& dog: dogs_) {
+            auto reach = ReachTime(dog, pos, LOOT_WIDTH, Now() - dog.Anchor());
+            if (reach && dog.Anchor() + *reach < dog.NextEvent()) {
+                dog.SetNextEvent(dog.Anchor() + *reach);
+                events_.push({dog.NextEvent(), dog.GetId()});
+            }
+        }
     }
+    return nof_loot;
+}
+
+void GameSession::ProcessDueEvents(int time_interval) {
+    clock_ += time_interval;
+    const double now = Now();
+    while (!events_.empty() && events_.top().time <= now) {
+        auto event = events_.top();
+        events_.pop();
+        auto dog = FindDog(event.dog);
+        // Retired, or rescheduled since
+        if (!dog || dog->NextEvent() != event.time)
+            continue;
+        dog->AdvanceTo(event.time);
+        const auto& speed = dog->GetDogSpeed();
+        const double speed_abs = std::abs(speed.vx) + std::abs(speed.vy);
+        if (dog->TimeOnRoad(map_) * speed_abs <= EVENT_TOLERANCE) {
+            // Just past the edge, Step turns into the crossing road or stops at the edge as Move does
+            dog->Step(EVENT_TOLERANCE / speed_abs, map_);
+        }
+        Sweep(*dog);
+        Schedule(*dog);
+    }
+}
+
+std::optional<double> GameSession::ReachTime(const Dog& dog, const PointF& item, double width, double after) const {
+    // The collision detection test, along the whole way to the end of the road
+    const auto& pos = dog.GetPosition();
+    const auto& speed = dog.GetDogSpeed();
+    const double speed2 = speed.vx * speed.vx + speed.vy * speed.vy;
+    if (speed2 == 0.0)
+        return std::nullopt;
+    const double dx = item.x - pos.x, dy = item.y - pos.y;
+    const double time = (dx * speed.vx + dy * speed.vy) / speed2;
+    const double sq_distance = dx * dx + dy * dy - time * time * speed2;
+    const double radius = DOG_WIDTH + width;
+    if (time <= after || sq_distance > radius * radius || time > dog.TimeOnRoad(map_))
+        return std::nullopt;
+    return time;
+}
+
+void GameSession::Schedule(Dog& dog) {
+    const auto& speed = dog.GetDogSpeed();
+    const double speed_abs = std::abs(speed.vx) + std::abs(speed.vy);
+    if (speed_abs == 0.0) {
+        dog.SetNextEvent(std::numeric_limits<double>::infinity());
+        return;
+    }
+    double next = dog.TimeOnRoad(map_);
+    const double after = EVENT_TOLERANCE / speed_abs;
+    auto reach = [&](const PointF& item, double width) {
+        if (auto time = ReachTime(dog, item, width, after); time && *time < next)
+            next = *time;
+    };
+    for (const auto& object: lost_objects_)
+        reach(object.GetPosition(), LOOT_WIDTH);
+    for (const auto& office: map_.GetOffices())
+        reach({static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y)}, OFFICE_WIDTH);
+    dog.SetNextEvent(dog.Anchor() + next);
+    events_.push({dog.NextEvent(), dog.GetId()});
+}
+
+void GameSession::Sweep(Dog& dog) {
+    using collision_detector::GatheringEvent;
+    const auto from = dog.GetPreviousPosition(), to = dog.GetPosition();
+    dog.SetPrevPos(to);
+    if (from == to)
+        return;
+    const size_t gatherer = dog_to_index_.at(dog.GetId());
+    // Events fire right at the closest approach, where rounding may leave the item just past the
+    // end of the segment: the sweep reaches a little further
+    const double stretch = 1.0 + EVENT_TOLERANCE / std::hypot(to.x - from.x, to.y - from.y);
+    const PointF end {from.x + (to.x - from.x) * stretch, from.y + (to.y - from.y) * stretch};
+    std::vector<GatheringEvent> events;
+    auto check = [&](size_t item, const PointF& pos, double width) {
+        auto result = collision_detector::TryCollectPoint({from.x, from.y}, {end.x, end.y}, {pos.x, pos.y});
+        if (result.IsCollected(DOG_WIDTH + width))
+            events.emplace_back(item, gatherer, result.sq_distance, result.proj_ratio);
+    };
+    for (size_t i = 0; i < lost_objects_.size(); ++i)
+        check(i, lost_objects_[i].GetPosition(), LOOT_WIDTH);
+    const auto& offices = map_.GetOffices();
+    for (size_t i = 0; i < offices.size(); ++i)
+        check(lost_objects_.size() + i, {static_cast<double>(offices[i].GetPosition().x),
+                                         static_cast<double>(offices[i].GetPosition().y)}, OFFICE_WIDTH);
+    if (events.empty())
+        return;
+    std::sort(events.begin(), events.end(), [](const auto& l, const auto& r) {
+        return l.time < r.time;
+    });
+    collision_detector::FilterGatherEvents(events, lost_objects_.size());
+    ProcessEvents(events);
+}
+
+void GameSession::SetDogSpeed(const Dog::Id& id, const Direction& dir) {
+    auto dog = FindDog(id);
+    if (!dog)
+        return;
+    if (motion_ == Motion::Events) {
+        dog->AdvanceTo(Now());
+        Sweep(*dog);
+    }
+    dog->SetSpeed(dir);
+    if (motion_ == Motion::Events)
+        Schedule(*dog);
+}
+
+void GameSession::SetMotion(Motion motion) {
+    if (motion == motion_)
+        return;
+    SyncPositions();
+    motion_ = motion;
+    events_ = {};
+    for (auto& dog: dogs_) {
+        dog.SetNextEvent(std::numeric_limits<double>::infinity());
+        if (motion_ != Motion::Events)
+            continue;
+        // Stepping leaves the anchor behind, and the path up to here has been swept already
+        dog.SetAnchor(Now());
+        dog.SetPrevPos(dog.GetPosition());
+        Schedule(dog);
+    }
+}
+
+void GameSession::SyncPositions() {
+    if (motion_ != Motion::Events)
+        return;
+    // Every event up to now has been processed, so the dogs keep to their roads on the way
+    for (auto& dog: dogs_)
+        dog.AdvanceTo(Now());
 }
 
 void GameSession::ProcessEvents(const std::vector<collision_detector::GatheringEvent>& events) {
@@ -264,7 +454,7 @@ std::vector<DogInfo> GameSession::GetRetiredPLayers(int time_interval) {
         dog.IncrementTime(time_interval);
         if (dog.GetDownTime() >= dog_retirement_time_) {
             retired_players.emplace_back(*dog.GetId(), dog.GetName(),
-                                         dog.GetScore(), dog.GetPLayingTime());
+                                         dog.GetScore(), dog.GetPLayingTime(), *GetId());
             if (auto it = dog_to_index_.find(dog.GetId()); it != dog_to_index_.end())
                 dog_to_index_.erase(it);
         }
@@ -273,9 +463,9 @@ std::vector<DogInfo> GameSession::GetRetiredPLayers(int time_interval) {
 }
 
 void GameSession::DeleteRetiredPlayers() {
-    std::remove_if(dogs_.begin(), dogs_.end(), [&](const auto &item) {
+    dogs_.erase(std::remove_if(dogs_.begin(), dogs_.end(), [&](const auto &item) {
        return (dog_to_index_.find(item.GetId()) == dog_to_index_.end());
-    });
+    }), dogs_.end());
     for (int i = 0; i < dogs_.size(); i++) {
         if (auto it = dog_to_index_.find(dogs_[i].GetId()); it != dog_to_index_.end())
             it->second = i;
@@ -283,32 +473,58 @@ void GameSession::DeleteRetiredPlayers() {
 }
 
 void GameSession::RemoveLostObjects() {
-    std::remove_if(lost_objects_.begin(), lost_objects_.end(), [&](const auto &item){
+    lost_objects_.erase(std::remove_if(lost_objects_.begin(), lost_objects_.end(), [&](const auto &item){
         return (object_to_index_.find(item.GetId()) == object_to_index_.end());
-    });
+    }), lost_objects_.end());
     for (int i = 0; i < lost_objects_.size(); i++) {
         if (auto it = object_to_index_.find(lost_objects_[i].GetId()); it != object_to_index_.end())
             it->second = i;
     }
 }
 
-std::vector<DogInfo> Game::UpdateGame(int time_interval) {
+std::vector<DogInfo> Game::UpdateGame(int time_interval, TickStats* stats) {
+    using Clock = std::chrono::steady_clock;
     std::vector<DogInfo> all_retired_players;
     for (auto &session: sessions_) {
-        session.UpdateGameState(time_interval);
+        auto start = stats ? Clock::now() : Clock::time_point{};
+        auto nof_loot = session.UpdateGameState(time_interval);
+        auto moved = stats ? Clock::now() : Clock::time_point{};
+        tick_profiler::Scope scope {"retire", *session.GetId()};
         auto retired_players = session.GetRetiredPLayers(time_interval);
         session.DeleteRetiredPlayers();
         all_retired_players.reserve(all_retired_players.size() + distance(retired_players.begin(), retired_players.end()));
         all_retired_players.insert(all_retired_players.end(), retired_players.begin(), retired_players.end());
+        if (stats) {
+            stats->move += moved - start;
+            stats->retire += Clock::now() - moved;
+            stats->loot_spawned += nof_loot;
+        }
     }
+    auto collide_start = stats ? Clock::now() : Clock::time_point{};
     for (auto &gather_handler: gather_handlers_) {
-        auto gather_events = collision_detector::FindGatherEvents(gather_handler);
-        collision_detector::FilterGatherEvents(gather_events, gather_handler.LostObjectsCount());
-        gather_handler.GetGameSession().ProcessEvents(gather_events);
+        auto& session = gather_handler.GetGameSession();
+        // Gathered along the way as the events fall due
+        if (session.GetMotion() == Motion::Events)
+            continue;
+        std::vector<collision_detector::GatheringEvent> gather_events;
+        {
+            tick_profiler::Scope scope {"find_gather_events", *session.GetId()};
+            gather_events = collision_detector::FindGatherEvents(gather_handler);
+            collision_detector::FilterGatherEvents(gather_events, gather_handler.LostObjectsCount());
+        }
+        tick_profiler::Scope scope {"process_events", *session.GetId()};
+        session.ProcessEvents(gather_events);
     }
+    if (stats)
+        stats->collide += Clock::now() - collide_start;
     return all_retired_players;
 }
 
+void Game::SyncPositions() {
+    for (auto &session: sessions_)
+        session.SyncPositions();
+}
+
 Dog::Id Game::AddDog(const std::string& dog_name, const GameSession::Id& id, bool rand_pos) {
     auto session = GetSession(id);
     return session->AddDog(dog_name, rand_pos);
@@ -335,6 +551,7 @@ GameSessionBase::Id Game::AddSession(const Map& map) {
             sessions_.emplace_back(session_id, map, loot_generator_);
             gather_handlers_.emplace_back(sessions_.at(it->second));
             sessions_.at(it->second).SetRetirementTime(dog_retirement_time_);
+            sessions_.at(it->second).SetMotion(motion_);
         } catch (...) {
             session_id_to_index_.erase(it);
             throw;
@@ -358,6 +575,7 @@ void Game::AddGameSession(const GameSessionBase &session) {
                 sessions_.at(it->second).AddNewObject(object);
             gather_handlers_.emplace_back(sessions_.at(it->second));
             sessions_.at(it->second).SetRetirementTime(dog_retirement_time_);
+            sessions_.at(it->second).SetMotion(motion_);
             ++curr_session_id_;
         } catch (...) {
             session_id_to_index_.erase(it);
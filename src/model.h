@@ -1,4 +1,8 @@
 #pragma once
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <queue>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -26,6 +30,19 @@ using Score = size_t;
 using Time = size_t;
 
 constexpr double ROAD_BORDER = 0.4;
+// Half-widths used by gathering
+constexpr double DOG_WIDTH = 0.6;
+constexpr double LOOT_WIDTH = 0.0;
+constexpr double OFFICE_WIDTH = 0.5;
+
+// How dogs are moved through a tick
+enum class Motion {
+    // Every dog is moved by every tick, gathering looks along the path of the tick
+    Stepping,
+    // A moving dog is scheduled for its next event, leaving the area of its road or reaching an item,
+    // and only processed when that falls due; in between its position follows from its speed
+    Events,
+};
 
 enum class Direction {
     NORTH,
@@ -78,8 +95,21 @@ struct DogInfo {
     std::uint32_t dog_id_;
     std::string name_;
     size_t score_, playing_time_;
-    DogInfo(const std::uint32_t& dog_id, const std::string& name, const size_t& score, const size_t& playing_time):
-        dog_id_(dog_id), name_(name), score_(score), playing_time_(playing_time) {}
+    // Dog ids are unique only within their session
+    std::uint32_t session_id_ = 0;
+    DogInfo(const std::uint32_t& dog_id, const std::string& name, const size_t& score, const size_t& playing_time,
+            const std::uint32_t& session_id = 0):
+        dog_id_(dog_id), name_(name), score_(score), playing_time_(playing_time), session_id_(session_id) {}
+};
+
+// Where the time of one UpdateGame went, filled only when asked for
+struct TickStats {
+    using Duration = std::chrono::steady_clock::duration;
+    // Moving dogs and generating loot
+    Duration move {};
+    Duration retire {};
+    Duration collide {};
+    size_t loot_spawned = 0;
 };
 
 struct Size {
@@ -420,6 +450,33 @@ public:
         return bag_;
     }
     void Move(int time_interval, const Map& map);
+    // Moves on for that long, stopping at the end of the road or turning into a crossing one like Move
+    void Step(double seconds, const Map& map);
+    // Seconds until the dog leaves the area of its current road at its speed
+    double TimeOnRoad(const Map& map) const;
+    // Where the dog would be after moving on for that long, kept within its current road
+    PointF Extrapolate(double seconds, const Map& map) const;
+    // Motion::Events: the dog was at GetPosition() at session time Anchor(), seconds
+    double Anchor() const noexcept {
+        return anchor_;
+    }
+    PointF PositionAt(double time) const noexcept {
+        return {pos_.x + (time - anchor_) * speed_.vx, pos_.y + (time - anchor_) * speed_.vy};
+    }
+    void AdvanceTo(double time) noexcept {
+        pos_ = PositionAt(time);
+        anchor_ = time;
+    }
+    // Takes the current position as the one at that time
+    void SetAnchor(double time) noexcept {
+        anchor_ = time;
+    }
+    double NextEvent() const noexcept {
+        return next_event_;
+    }
+    void SetNextEvent(double time) noexcept {
+        next_event_ = time;
+    }
     void GatherLostObject(const LostObject& object) {
         bag_.emplace_back(object);
     };
@@ -451,6 +508,8 @@ private:
     Score score_ = 0;
     Time playing_time_ = 0, down_time_ = 0;
     bool has_moved_ = false;
+    double anchor_ = 0.0;
+    double next_event_ = std::numeric_limits<double>::infinity();
 };
 
 class GameSessionBase {
@@ -523,17 +582,52 @@ public:
     void SetRetirementTime(const size_t& retirement_time) {
         dog_retirement_time_ = retirement_time;
     }
+    // Switching to Motion::Events schedules every dog there is, from the current time
+    void SetMotion(Motion motion);
+    Motion GetMotion() const noexcept {
+        return motion_;
+    }
+    // Session time, seconds
+    double Now() const noexcept {
+        return static_cast<double>(clock_) / MILLISECONDS;
+    }
 
-    void UpdateGameState(int time_interval);
+    // Under Motion::Events the dog is rescheduled from the current time
+    void SetDogSpeed(const Dog::Id& id, const Direction& dir);
+    // Under Motion::Events brings the positions of all dogs up to the current time; call before reading them
+    void SyncPositions();
+
+    // Returns the number of lost objects generated
+    size_t UpdateGameState(int time_interval);
     void ProcessEvents(const std::vector<collision_detector::GatheringEvent> &events);
     std::vector<DogInfo> GetRetiredPLayers(int time_interval);
     void DeleteRetiredPlayers();
     void RemoveLostObjects();
 private:
+    struct DogEvent {
+        double time;
+        Dog::Id dog;
+        bool operator>(const DogEvent& other) const noexcept {
+            return time > other.time;
+        }
+    };
+
+    size_t GenerateLoot(int time_interval);
+    void ProcessDueEvents(int time_interval);
+    // Seconds past the dog's anchor at which it reaches the item, if later than after and before it leaves its road
+    std::optional<double> ReachTime(const Dog& dog, const PointF& item, double width, double after) const;
+    void Schedule(Dog& dog);
+    // Gathers along the path from the dog's previous position to its current one
+    void Sweep(Dog& dog);
+
     std::unordered_set<std::string> dog_names_;
     const Map& map_;
     loot_gen::LootGenerator &loot_generator_;
     size_t dog_retirement_time_ = 60000;
+    Motion motion_ = Motion::Stepping;
+    // Game time the session has run, milliseconds
+    Time clock_ = 0;
+    std::priority_queue<DogEvent, std::vector<DogEvent>, std::greater<>> events_;
 };
 
 class ItemGathererProviderGame: public collision_detector::ItemGathererProvider {
@@ -554,17 +648,17 @@ public:
     collision_detector::Item GetItem(size_t idx) const override {
         if (idx < LostObjectsCount()) {
             auto obj = game_session_.GetLostObjects().at(idx);
-            return {{obj.GetPos().first, obj.GetPos().second}, 0};
+            return {{obj.GetPos().first, obj.GetPos().second}, LOOT_WIDTH};
         }
         auto office = game_session_.GetMap().GetOffices().at(idx - LostObjectsCount());
-        return {{static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y)}, 0.5};
+        return {{static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y)}, OFFICE_WIDTH};
     }
     collision_detector::Gatherer GetGatherer(size_t idx) const override {
         std::vector<Dog> dogs = game_session_.GetDogs();
         auto dog = dogs.at(idx);
         return {{dog.GetPrevPos().first, dog.GetPrevPos().second},
                 {dog.GetPos().first, dog.GetPos().second},
-                0.6};
+                DOG_WIDTH};
     }
     GameSession& GetGameSession() {
         return game_session_;
@@ -616,7 +710,7 @@ public:
         }
         return nullptr;
     }
-    std::vector<DogInfo> UpdateGame(int time_interval);
+    std::vector<DogInfo> UpdateGame(int time_interval, TickStats* stats = nullptr);
     void SetLootGenParams(const double &period, const double &probability) {
         auto time_interval = std::chrono::milliseconds(static_cast<int>(period * 1000));
         loot_generator_ = loot_gen::LootGenerator(time_interval, probability);
@@ -624,6 +718,11 @@ public:
     void SetRetirementParams(const size_t& dog_retirement_time) {
         dog_retirement_time_ = dog_retirement_time;
     }
+    // Applies to the sessions added afterwards
+    void SetMotion(Motion motion) {
+        motion_ = motion;
+    }
+    void SyncPositions();
 private:
     using MapIdHasher = util::TaggedHasher<Map::Id>;
     using MapIdToIndex = std::unordered_map<Map::Id, size_t, MapIdHasher>;
@@ -645,6 +744,7 @@ private:
     std::uint32_t curr_session_id_ = 0;
     loot_gen::LootGenerator loot_generator_;
     size_t dog_retirement_time_ = 60000;
+    Motion motion_ = Motion::Stepping;
 };
 
 
@@ -0,0 +1,131 @@
+#include "model_json.h"
+#include <charconv>
+
+namespace model_json {
+
+std::string_view DirToStr(const model::Direction& dir) {
+    switch (dir) {
+        case model::Direction::NORTH:
+            return "U";
+        case model::Direction::SOUTH:
+            return "D";
+        case model::Direction::WEST:
+            return "L";
+        case model::Direction::EAST:
+            return "R";
+        case model::Direction::STOP:
+            return "";
+        default:
+            return "NULL";
+    }
+}
+
+namespace {
+
+void WriteDog(JsonWriter& writer, const model::Dog& dog, const model::PointF* extrapolated) {
+    const auto& pos = dog.GetPosition();
+    const auto& speed = dog.GetDogSpeed();
+    writer.StartObject();
+    writer.Key("pos").StartArray().Double(pos.x).Double(pos.y).EndArray();
+    if (extrapolated)
+        writer.Key("extrapolatedPos").StartArray().Double(extrapolated->x).Double(extrapolated->y).EndArray();
+    writer.Key("speed").StartArray().Double(speed.vx).Double(speed.vy).EndArray();
+    writer.Member("dir", DirToStr(dog.GetDir()));
+    writer.Key("bag").StartArray();
+    for (auto &obj: dog.GetBagContent())
+        writer.StartObject().Member("id", *obj.GetId()).Member("type", obj.GetType()).EndObject();
+    writer.EndArray();
+    writer.Member("score", dog.GetScore());
+    writer.EndObject();
+}
+
+} // namespace
+
+void WriteDog(JsonWriter& writer, const model::Dog& dog) {
+    WriteDog(writer, dog, nullptr);
+}
+
+void WriteLostObject(JsonWriter& writer, const model::LostObject& lost_object) {
+    const auto pos = lost_object.GetPosition();
+    writer.StartObject();
+    writer.Member("type", lost_object.GetType());
+    writer.Key("pos").StartArray().Double(pos.x).Double(pos.y).EndArray();
+    writer.EndObject();
+}
+
+void WriteIdKey(JsonWriter& writer, std::uint32_t id) {
+    char buf[16];
+    auto res = std::to_chars(buf, buf + sizeof(buf), id);
+    writer.Key({buf, static_cast<size_t>(res.ptr - buf)});
+}
+
+void WritePlayersInfo(JsonWriter& writer, const model::GameSessionBase& session) {
+    writer.StartObject();
+    for (auto &dog: session.GetDogs()) {
+        WriteIdKey(writer, *dog.GetId());
+        writer.StartObject().Member("name", dog.GetName()).EndObject();
+    }
+    writer.EndObject();
+}
+
+void WriteLostObjects(JsonWriter& writer, const model::GameSessionBase& session) {
+    writer.Key("lostObjects").StartObject();
+    for (auto &lost_object: session.GetLostObjects()) {
+        WriteIdKey(writer, *lost_object.GetId());
+        WriteLostObject(writer, lost_object);
+    }
+    writer.EndObject();
+}
+
+void WriteGameState(JsonWriter& writer, const model::GameSessionBase& session) {
+    writer.StartObject();
+    writer.Key("players").StartObject();
+    for (auto &dog: session.GetDogs()) {
+        WriteIdKey(writer, *dog.GetId());
+        WriteDog(writer, dog);
+    }
+    writer.EndObject();
+    WriteLostObjects(writer, session);
+    writer.EndObject();
+}
+
+void WriteGameState(JsonWriter& writer, const model::GameSession& session, const StateTime& time) {
+    writer.StartObject();
+    writer.Key("players").StartObject();
+    for (auto &dog: session.GetDogs()) {
+        WriteIdKey(writer, *dog.GetId());
+        if (time.ahead > 0) {
+            auto extrapolated = dog.Extrapolate(time.ahead, session.GetMap());
+            WriteDog(writer, dog, &extrapolated);
+        } else {
+            WriteDog(writer, dog, nullptr);
+        }
+    }
+    writer.EndObject();
+    WriteLostObjects(writer, session);
+    writer.Member("tickTime", time.tick);
+    if (time.ahead > 0)
+        writer.Member("time", time.tick + time.ahead);
+    writer.EndObject();
+}
+
+void WriteMapsList(JsonWriter& writer, const model::Game::Maps& maps) {
+    writer.StartArray();
+    for (const auto &map: maps)
+        writer.StartObject().Member("id", *map.GetId()).Member("name", map.GetName()).EndObject();
+    writer.EndArray();
+}
+
+void WriteRecords(JsonWriter& writer, const std::vector<model::DogInfo>& records) {
+    writer.StartArray();
+    for (auto &record: records) {
+        writer.StartObject();
+        writer.Member("name", record.name_);
+        writer.Member("score", record.score_);
+        writer.Member("playTime", static_cast<double>(record.playing_time_) / MILLISECONDS);
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
+
+} // namespace model_json
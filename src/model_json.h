@@ -0,0 +1,27 @@
+#pragma once
+#include "json_writer.h"
+#include "model.h"
+
+namespace model_json {
+
+using json_writer::JsonWriter;
+
+std::string_view DirToStr(const model::Direction& dir);
+
+void WriteDog(JsonWriter& writer, const model::Dog& dog);
+void WriteLostObject(JsonWriter& writer, const model::LostObject& lost_object);
+void WritePlayersInfo(JsonWriter& writer, const model::GameSessionBase& session);
+void WriteGameState(JsonWriter& writer, const model::GameSessionBase& session);
+
+struct StateTime {
+    // Game time of the tick the state is from, in seconds
+    double tick = 0;
+    // How far past the tick dog positions are extrapolated, in seconds; 0 for none
+    double ahead = 0;
+};
+// Adds "tickTime" and, when extrapolating, "time" and each dog's "extrapolatedPos"
+void WriteGameState(JsonWriter& writer, const model::GameSession& session, const StateTime& time);
+void WriteMapsList(JsonWriter& writer, const model::Game::Maps& maps);
+void WriteRecords(JsonWriter& writer, const std::vector<model::DogInfo>& records);
+
+} // namespace model_json
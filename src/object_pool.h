@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+namespace object_pool {
+
+// Per-thread cache of constructed objects. An object released on another thread
+// simply joins that thread's cache, so no list is ever shared between threads.
+// Whoever releases an object is responsible for dropping the state it should not keep.
+template <typename T, size_t MaxCached = 64>
+class ObjectPool {
+public:
+    struct Deleter {
+        void operator()(T* obj) const noexcept {
+            Release(obj);
+        }
+    };
+    using Handle = std::unique_ptr<T, Deleter>;
+
+    static Handle Acquire() {
+        auto& cache = Cache();
+        if (cache.objects.empty())
+            return Handle{new T()};
+        Handle obj {cache.objects.back()};
+        cache.objects.pop_back();
+        return obj;
+    }
+
+    static void Release(T* obj) noexcept {
+        auto& cache = Cache();
+        if (cache.objects.size() >= MaxCached || cache.objects.capacity() == 0 && !Reserve(cache)) {
+            delete obj;
+            return;
+        }
+        cache.objects.push_back(obj);
+    }
+private:
+    struct ThreadCache {
+        std::vector<T*> objects;
+
+        ~ThreadCache() {
+            for (auto obj: objects)
+                delete obj;
+        }
+    };
+
+    static ThreadCache& Cache() noexcept {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+    // Reserved once so that releasing never allocates
+    static bool Reserve(ThreadCache& cache) noexcept {
+        try {
+            cache.objects.reserve(MaxCached);
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+};
+
+} // namespace object_pool
@@ -1,4 +1,5 @@
 #include "postgres.h"
+#include <array>
 #include <iostream>
 
 #include <boost/uuid/random_generator.hpp>
@@ -9,7 +10,22 @@ namespace database {
 
 using UUIDType = boost::uuids::uuid;
 UUIDType NewUUID() {
-    return boost::uuids::random_generator()();
+    // Seeded once per thread, random_generator reads the system entropy source whenever one is made
+    thread_local boost::uuids::random_generator_mt19937 generator;
+    return generator();
+}
+
+// The 8-4-4-4-12 form of to_string, written into the buffer
+std::string_view FormatUUID(const UUIDType& uuid, std::array<char, 36>& buffer) {
+    constexpr char digits[] = "0123456789abcdef";
+    size_t pos = 0;
+    for (size_t i = 0; i < uuid.size(); ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10)
+            buffer[pos++] = '-';
+        buffer[pos++] = digits[uuid.data[i] >> 4];
+        buffer[pos++] = digits[uuid.data[i] & 0x0F];
+    }
+    return {buffer.data(), buffer.size()};
 }
 
 std::string UUIDToString(const UUIDType& uuid) {
@@ -56,10 +72,19 @@ std::vector<model::DogInfo> Database::GetPlayers(int start, int size) {
 }
 
 void Database::SavePlayers(const std::vector<model::DogInfo> &retired_players) {
+    if (retired_players.empty())
+        return;
+    std::array<char, 36> player_id;
     pqxx::work work{connection_};
-    for (auto &player: retired_players) {
-        auto player_id = UUIDToString(NewUUID());
-        work.exec_prepared(tag_ins_player, player_id, player.name_, player.score_, player.playing_time_);
+    if (retired_players.size() < COPY_MIN_BATCH) {
+        for (auto &player: retired_players)
+            work.exec_prepared(tag_ins_player, FormatUUID(NewUUID(), player_id), player.name_, player.score_, player.playing_time_);
+    } else {
+        // A single COPY instead of a round trip per row
+        auto stream = pqxx::stream_to::table(work, {"retired_players"sv}, {"id"sv, "name"sv, "score"sv, "play_time_ms"sv});
+        for (auto &player: retired_players)
+            stream.write_values(FormatUUID(NewUUID(), player_id), player.name_, player.score_, player.playing_time_);
+        stream.complete();
     }
     work.commit();
 }
@@ -9,16 +9,28 @@ using namespace std::literals;
 using pqxx::operator"" _zv;
 
 constexpr auto tag_ins_player = "ins_player"_zv, tag_get_players = "get_players"_zv;
+// Batches from this size on are written with COPY, smaller ones row by row with the prepared insert
+constexpr size_t COPY_MIN_BATCH = 8;
 
-class Database {
+// The records the API reads and writes; the handlers take this much of the database,
+// so that they can be run without Postgres
+class PlayerStore {
+public:
+    virtual ~PlayerStore() = default;
+    virtual std::vector<model::DogInfo> GetPlayers(int start, int size) = 0;
+    virtual void SavePlayers(const std::vector<model::DogInfo>& retired_players) = 0;
+};
+
+class Database: public PlayerStore {
 public:
     explicit Database(pqxx::connection connection);
     pqxx::connection& GetConnection() {
         return connection_;
     }
 
-    std::vector<model::DogInfo> GetPlayers(int start, int size);
-    void SavePlayers(const std::vector<model::DogInfo>& retired_players);
+    std::vector<model::DogInfo> GetPlayers(int start, int size) override;
+    // One transaction per call
+    void SavePlayers(const std::vector<model::DogInfo>& retired_players) override;
 
 private:
     pqxx::connection connection_;
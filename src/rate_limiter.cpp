@@ -0,0 +1,117 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <utility>
+
+namespace rate_limiter {
+
+namespace {
+
+std::uint64_t ToNanoseconds(Clock::time_point time) noexcept {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+}
+
+// Keeps arrival times, now plus at most the tolerance and two intervals, within 64 bits
+constexpr double MAX_TOLERANCE_NS = 1e18;
+
+std::optional<double> ParseNumber(std::string_view str) noexcept {
+    double value = 0;
+    auto res = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (res.ec != std::errc{} || res.ptr != str.data() + str.size() || !std::isfinite(value) || value < 0)
+        return std::nullopt;
+    return value;
+}
+
+} // namespace
+
+RateLimiter::RateLimiter(const Limit& limit):
+        interval_(limit.Enabled() ? static_cast<std::uint64_t>(std::clamp(1e9 / limit.rate, 1e9 / MAX_RATE, 1e9 / MIN_RATE)) : 0),
+        tolerance_(static_cast<std::uint64_t>(std::min(static_cast<double>(interval_) * std::max(0.0, limit.burst - 1),
+                                                       MAX_TOLERANCE_NS))),
+        shards_(std::make_unique<Shard[]>(NUM_SHARDS)) {}
+
+std::uint64_t RateLimiter::Mix(std::uint64_t key) noexcept {
+    // splitmix64 finalizer, player refs and IPv4 addresses are far from uniform
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    return key ^ (key >> 31);
+}
+
+RateLimiter::Cell& RateLimiter::Probe(Shard& shard, std::uint64_t key, std::uint64_t hash) noexcept {
+    const size_t mask = shard.cells.size() - 1;
+    // The low bits chose the shard
+    for (size_t i = (hash / NUM_SHARDS) & mask;; i = (i + 1) & mask) {
+        auto& cell = shard.cells[i];
+        if (cell.arrival == 0 || cell.key == key)
+            return cell;
+    }
+}
+
+void RateLimiter::Rebuild(Shard& shard, std::uint64_t now) {
+    size_t live = 0;
+    for (const auto& cell: shard.cells)
+        live += cell.arrival > now;
+    auto capacity = shard.cells.size();
+    if (live > capacity / 2)
+        capacity *= 2;
+    auto cells = std::exchange(shard.cells, std::vector<Cell>(capacity));
+    shard.size = 0;
+    for (const auto& cell: cells) {
+        if (cell.arrival > now) {
+            Probe(shard, cell.key, Mix(cell.key)) = cell;
+            ++shard.size;
+        }
+    }
+}
+
+Decision RateLimiter::Check(std::uint64_t key, Clock::time_point now_point) {
+    if (interval_ == 0)
+        return {};
+    const auto now = ToNanoseconds(now_point);
+    const auto hash = Mix(key);
+    auto& shard = shards_[hash % NUM_SHARDS];
+    std::lock_guard lock {shard.mutex};
+    auto* cell = &Probe(shard, key, hash);
+    if (cell->arrival == 0) {
+        // Keeps the load under 3/4 so that probes stay short
+        if (4 * (shard.size + 1) > 3 * shard.cells.size()) {
+            Rebuild(shard, now);
+            cell = &Probe(shard, key, hash);
+        }
+        *cell = {key, now};
+        ++shard.size;
+    }
+    const auto arrival = std::max(cell->arrival, now);
+    if (arrival - now > tolerance_)
+        return {false, std::chrono::nanoseconds{arrival - now - tolerance_}};
+    cell->arrival = arrival + interval_;
+    return {};
+}
+
+size_t RateLimiter::Size() const {
+    size_t size = 0;
+    for (size_t i = 0; i < NUM_SHARDS; ++i) {
+        std::lock_guard lock {shards_[i].mutex};
+        size += shards_[i].size;
+    }
+    return size;
+}
+
+std::optional<Limit> ParseLimit(std::string_view spec) noexcept {
+    auto colon = spec.find(':');
+    auto rate = ParseNumber(spec.substr(0, colon));
+    if (!rate || (*rate != 0 && (*rate < MIN_RATE || *rate > MAX_RATE)))
+        return std::nullopt;
+    if (colon == std::string_view::npos)
+        return Limit{*rate, 1};
+    auto burst = ParseNumber(spec.substr(colon + 1));
+    if (!burst || *burst < 1)
+        return std::nullopt;
+    return Limit{*rate, *burst};
+}
+
+} // namespace rate_limiter
@@ -0,0 +1,77 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace rate_limiter {
+
+using Clock = std::chrono::steady_clock;
+
+// Rates ParseLimit takes; the limiter's nanosecond intervals hold them, others are clamped into the range
+inline constexpr double MIN_RATE = 1e-6;
+inline constexpr double MAX_RATE = 1e9;
+
+struct Limit {
+    // Sustained requests per second, 0 disables the limit
+    double rate = 0;
+    // Requests allowed back to back on top of the sustained rate
+    double burst = 1;
+
+    bool Enabled() const noexcept {
+        return rate > 0;
+    }
+};
+
+struct Decision {
+    bool allowed = true;
+    // When the next request would be allowed, zero if this one was
+    Clock::duration retry_after {};
+};
+
+// Token buckets in GCRA form: a bucket is nothing but the time it becomes full
+// again (theoretical arrival time), one integer per key, kept in open-addressing
+// tables. A key whose bucket is full is indistinguishable from an absent one, so
+// idle keys are dropped whenever a table has to grow.
+// Thread-safe, keys are spread over independently locked shards.
+class RateLimiter {
+public:
+    explicit RateLimiter(const Limit& limit);
+
+    Decision Check(std::uint64_t key, Clock::time_point now = Clock::now());
+    size_t Size() const;
+private:
+    static constexpr size_t NUM_SHARDS = 64;
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    struct Cell {
+        std::uint64_t key = 0;
+        // 0 marks an empty cell
+        std::uint64_t arrival = 0;
+    };
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::vector<Cell> cells = std::vector<Cell>(MIN_CAPACITY);
+        size_t size = 0;
+    };
+
+    static std::uint64_t Mix(std::uint64_t key) noexcept;
+    static Cell& Probe(Shard& shard, std::uint64_t key, std::uint64_t hash) noexcept;
+    // Drops full buckets, doubling the table if it stays more than half full
+    static void Rebuild(Shard& shard, std::uint64_t now);
+
+    // Nanoseconds between two requests at the sustained rate
+    std::uint64_t interval_;
+    // How far the arrival time may run ahead of now, the burst
+    std::uint64_t tolerance_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+// "rate" or "rate:burst", e.g. "20:40"; a rate other than 0 has to be within MIN_RATE and MAX_RATE
+std::optional<Limit> ParseLimit(std::string_view spec) noexcept;
+
+} // namespace rate_limiter
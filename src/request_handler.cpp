@@ -1,44 +1,92 @@
 #include "request_handler.h"
-#include <map>
 
 namespace http_handler {
-std::unordered_map<std::string,std::string> ExtToContent = {
-        {".htm", "text/html"}, {".html", "text/html"}, {".css", "text/css"},
-        {".txt", "text/plain"}, {".js", "text/javascript"}, {".json", "application/json"},
-        {".xml", "application/xml"}, {".png", "image/png"}, {".jpg", "image/jpeg"},
-        {".jpe", "image/jpeg"}, {".jpeg", "image/jpeg"}, {".gif", "image/gif"},
-        {".bmp", "image/bmp"}, {".ico", "image/vnd.microsoft.icon"}, {".tiff", "image/tiff"},
-        {".tif", "image/tiff"}, {".svg", "image/svg+xml"}, {".svgz", "image/svg+xml"},
-        {".mp3", "audio/mpeg"}
-};
-
-std::string GetContentType(const char* filepath) {
-    auto ext = fs::path(filepath).extension();
-    std::string ext_string {ext};
-    if (auto pos = ExtToContent.find(ext_string); pos != ExtToContent.end())
-        return pos->second;
-    return "application/octet-stream";
+StringResponse MakeRangeNotSatisfiable(const StringRequest& req, std::uint64_t size) {
+    StringResponse response(http::status::range_not_satisfiable, req.version());
+    response.set(http::field::content_range, "bytes */" + std::to_string(size));
+    response.content_length(0);
+    response.keep_alive(req.keep_alive());
+    return response;
+}
+
+// Answers a Range request from either a cached buffer or an open file; nullopt means "send the full body"
+template <typename SetSource>
+std::optional<FileRequestResult> MakeRangeResponse(const StringRequest& req, std::uint64_t size, std::string_view content_type,
+                                                   std::string_view etag, std::string_view last_modified, SetSource&& set_source) {
+    auto [status, ranges] = byte_ranges::ParseRange(api_handler::AsStringView(req[http::field::range]), size);
+    if (status == byte_ranges::RangeStatus::Unsatisfiable)
+        return MakeRangeNotSatisfiable(req, size);
+    if (status != byte_ranges::RangeStatus::Satisfiable)
+        return std::nullopt;
+
+    RangeResponse response(http::status::partial_content, req.version());
+    set_source(response.body());
+    response.set(http::field::content_type, byte_ranges::MakeRangesBody(response.body(), ranges, content_type, size));
+    if (ranges.size() == 1)
+        response.set(http::field::content_range, byte_ranges::ContentRange(ranges.front(), size));
+    response.set(http::field::accept_ranges, "bytes");
+    if (!etag.empty())
+        response.set(http::field::etag, etag);
+    if (!last_modified.empty())
+        response.set(http::field::last_modified, last_modified);
+    response.keep_alive(req.keep_alive());
+    response.prepare_payload();
+    return response;
 }
 
-std::variant<FileResponse,StringResponse> MakeFileResponse(unsigned http_version, bool keep_alive, const char* filepath) {
+bool WantsRange(const StringRequest& req, std::string_view etag, std::chrono::system_clock::time_point modified) {
+    return req.count(http::field::range) != 0 &&
+           http_conditional::IfRangeMatches(api_handler::AsStringView(req[http::field::if_range]), etag, modified);
+}
+
+FileRequestResult MakeFileResponse(const StringRequest& req, http::file_body::value_type&& file, std::string_view content_type,
+                                   std::optional<std::chrono::system_clock::time_point> modified) {
+    std::string last_modified;
+    bool range = req.count(http::field::range) != 0 && req.count(http::field::if_range) == 0;
+    if (modified) {
+        last_modified = http_conditional::FormatHttpDate(*modified);
+        range = WantsRange(req, {}, *modified);
+    }
+
+    // Ranges are read from the file at their offsets, the file is never loaded as a whole
+    if (range) {
+        auto range_response = MakeRangeResponse(req, file.size(), content_type, {}, last_modified,
+                                                [&file](byte_ranges::RangesBody::value_type& body) {
+            body.file = std::make_shared<beast::file>(std::move(file.file()));
+        });
+        if (range_response.has_value())
+            return std::move(*range_response);
+    }
+
+    FileResponse response(http::status::ok, req.version());
+    response.set(http::field::content_type, content_type);
+    response.set(http::field::accept_ranges, "bytes");
+    if (!last_modified.empty())
+        response.set(http::field::last_modified, last_modified);
+    response.body() = std::move(file);
+    response.prepare_payload();
+    return response;
+}
+
+FileRequestResult MakeFileResponse(const StringRequest& req, const fs::path& filepath) {
     http::file_body::value_type file;
 
-    if (sys::error_code ec; file.open(filepath, beast::file_mode::read, ec), ec) {
-        StringResponse response(http::status::not_found, http_version);
+    if (sys::error_code ec; file.open(filepath.c_str(), beast::file_mode::read, ec), ec) {
+        StringResponse response(http::status::not_found, req.version());
         response.set(http::field::content_type, "text/plain");
         std::string_view body = "File not found"sv;
         response.body() = body;
         response.content_length(body.size());
-        response.keep_alive(keep_alive);
+        response.keep_alive(req.keep_alive());
         return response;
     }
 
-    FileResponse response(http::status::ok, http_version);
-    std::string content_type = GetContentType(filepath);
-    response.set(http::field::content_type, content_type);
-    response.body() = std::move(file);
-    response.prepare_payload();
-    return response;
+    std::error_code fs_ec;
+    const auto mtime = fs::last_write_time(filepath, fs_ec);
+    std::optional<std::chrono::system_clock::time_point> modified;
+    if (!fs_ec)
+        modified = std::chrono::time_point_cast<std::chrono::system_clock::duration>(std::chrono::file_clock::to_sys(mtime));
+    return MakeFileResponse(req, std::move(file), file_cache::GetContentType(filepath), modified);
 }
 
 std::optional<std::string> DecodeTarget(std::string_view req_target) {
@@ -53,20 +101,46 @@ std::optional<std::string> DecodeTarget(std::string_view req_target) {
     return std::nullopt;
 }
 
-bool IsSubPath(fs::path path, fs::path base) {
-    path = fs::weakly_canonical(path);
-    base = fs::weakly_canonical(base);
-    for (auto b = base.begin(), p = path.begin(); b != base.end(); ++b, ++p) {
-        if (p == path.end() || *p != *b) return false;
+FileRequestResult MakeCachedResponse(const StringRequest& req, const file_cache::Asset& asset) {
+    // Ranges always address the identity representation
+    bool range = WantsRange(req, asset.etag, asset.modified);
+    bool gzip = !range && asset.gzip && compression::ChooseEncoding(
+            api_handler::AsStringView(req[http::field::accept_encoding])) == compression::Encoding::Gzip;
+    const auto& etag = gzip ? asset.gzip_etag : asset.etag;
+
+    CachedResponse response(http::status::ok, req.version());
+    response.set(http::field::content_type, asset.content_type);
+    response.set(http::field::etag, etag);
+    response.set(http::field::last_modified, asset.last_modified);
+    if (asset.gzip)
+        response.set(http::field::vary, "Accept-Encoding");
+    response.keep_alive(req.keep_alive());
+
+    auto if_none_match = api_handler::AsStringView(req[http::field::if_none_match]);
+    bool not_modified = if_none_match.empty() ?
+            http_conditional::NotModifiedSince(api_handler::AsStringView(req[http::field::if_modified_since]), asset.modified) :
+            http_conditional::MatchesIfNoneMatch(if_none_match, etag);
+    if (not_modified) {
+        response.result(http::status::not_modified);
+        return response;
+    }
+    if (range) {
+        auto range_response = MakeRangeResponse(req, asset.data->size(), asset.content_type, asset.etag, asset.last_modified,
+                                                [&asset](byte_ranges::RangesBody::value_type& body) {
+            body.data = asset.data;
+        });
+        if (range_response.has_value())
+            return std::move(*range_response);
     }
-    return true;
+    response.set(http::field::accept_ranges, "bytes");
+    if (gzip)
+        response.set(http::field::content_encoding, "gzip");
+    response.body() = gzip ? asset.gzip : asset.data;
+    response.prepare_payload();
+    return response;
 }
 
-std::variant<FileResponse,StringResponse> RequestHandler::HandleFileRequest(StringRequest &&req) {
-    const auto file_response = [&req](const char* filepath) {
-        return MakeFileResponse(req.version(), req.keep_alive(), filepath);
-    };
-
+FileRequestResult RequestHandler::HandleFileRequest(StringRequest &&req) {
     const auto text_response = [&req](http::status status, std::string_view text) {
         return api_handler::MakeStringResponse(status, text, req.version(),
                                   req.keep_alive(), BasicLiterals::TextPlain, BasicLiterals::AllowGet);
@@ -79,12 +153,12 @@ std::variant<FileResponse,StringResponse> RequestHandler::HandleFileRequest(Stri
 
     auto decoded_target = DecodeTarget(target);
     if (decoded_target.has_value()) {
-        std::string base {static_dir_path_}, rel = decoded_target.value();
-        if (rel == "/")
-            rel += "index.html";
-        std::string real_path = base + rel;
-        if (IsSubPath(real_path, static_dir_path_))
-            return file_response(real_path.c_str());
+        if (auto asset = static_cache_.Find(decoded_target.value()))
+            return MakeCachedResponse(req, *asset);
+        // Not cacheable: the cache is off, the file is too large or it does not exist
+        auto real_path = static_cache_.Resolve(decoded_target.value());
+        if (!real_path.empty())
+            return MakeFileResponse(req, real_path);
         return text_response(http::status::bad_request, "Invalid request URL");
     }
     return text_response(http::status::bad_request, "Incorrect request URL");
@@ -99,4 +173,39 @@ StringResponse RequestHandler::ReportServerError(unsigned version, bool keep_ali
     response.keep_alive(keep_alive);
     return response;
 }
+
+StringResponse RequestHandler::ReportOverload(unsigned version, bool keep_alive) const {
+    auto response = api_handler::MakeStringResponse(http::status::service_unavailable, ResponseLiterals::Overloaded,
+                                                    version, keep_alive, BasicLiterals::AppJson, BasicLiterals::AllowAll);
+    response.set(http::field::retry_after, std::to_string(overload_.retry_after.count()));
+    return response;
+}
+
+std::string RequestHandler::RenderMetrics() const {
+    return server_metrics::Render({latency_.get(), connections_.get(), shed_requests_.Value(), rate_limited_.Value(),
+                                   dispatcher_.Stats(), ticker_.get(), api_handler_.PlayerWriter(), &api_handler_.Metrics()});
+}
+
+StringResponse RequestHandler::ServeMetrics(http::verb method, unsigned version, bool keep_alive) const {
+    if (method != http::verb::get && method != http::verb::head)
+        return api_handler::MakeStringResponse(http::status::method_not_allowed, ResponseLiterals::InvalidMethod,
+                                               version, keep_alive, BasicLiterals::AppJson, BasicLiterals::AllowGet);
+    auto response = api_handler::MakeStringResponse(http::status::ok, {}, version, keep_alive,
+                                                    metrics::CONTENT_TYPE, BasicLiterals::AllowGet);
+    response.body() = RenderMetrics();
+    response.content_length(response.body().size());
+    return response;
+}
+
+StringResponse RequestHandler::ServeTickTrace(http::verb method, unsigned version, bool keep_alive) {
+    if (method != http::verb::get && method != http::verb::head)
+        return api_handler::MakeStringResponse(http::status::method_not_allowed, ResponseLiterals::InvalidMethod,
+                                               version, keep_alive, BasicLiterals::AppJson, BasicLiterals::AllowGet);
+    auto response = api_handler::MakeStringResponse(http::status::ok, {}, version, keep_alive,
+                                                    BasicLiterals::AppJson, BasicLiterals::AllowGet);
+    response.body() = tick_profiler::ChromeTrace();
+    response.content_length(response.body().size());
+    return response;
+}
+
 }  // namespace http_handler
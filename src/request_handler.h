@@ -1,6 +1,18 @@
 #pragma once
 #include "http_server.h"
+#include "api_dispatcher.h"
 #include "api_handler.h"
+#include "compression.h"
+#include "file_cache.h"
+#include "byte_ranges.h"
+#include "rate_limiter.h"
+#include "access_log.h"
+#include "latency.h"
+#include "metrics.h"
+#include "server_metrics.h"
+#include "tick_profiler.h"
+#include "ticker.h"
+#include <boost/url.hpp>
 #include <filesystem>
 #include <optional>
 
@@ -17,7 +29,14 @@ using namespace std::literals;
 using StringRequest = http::request<http::string_body>;
 using StringResponse = http::response<http::string_body>;
 using FileResponse = http::response<http::file_body>;
-using time_point = std::chrono::system_clock::time_point;
+using CachedResponse = http::response<file_cache::SharedBufferBody>;
+using RangeResponse = http::response<byte_ranges::RangesBody>;
+using FileRequestResult = std::variant<FileResponse,StringResponse,CachedResponse,RangeResponse>;
+
+// Sends an open file, reading only the requested ranges of it. Without its modification time,
+// when that could not be read, the response has no validator and no If-Range matches.
+FileRequestResult MakeFileResponse(const StringRequest& req, http::file_body::value_type&& file, std::string_view content_type,
+                                   std::optional<std::chrono::system_clock::time_point> modified);
 
 struct ContentType {
     ContentType() = delete;
@@ -25,43 +44,135 @@ struct ContentType {
     constexpr static std::string_view APP_JSON = "application/json";
 };
 
+// Carried from a request to its response: both access log records are sampled together,
+// and the response is timed against the histograms of its endpoint
+struct AccessTrace {
+    latency::Clock::time_point start;
+    const access_log::Sampler& sampler;
+    latency::Recorder& latency;
+    std::uint32_t endpoint;
+    bool sampled;
+    // Only for requests that waited for the API strand
+    std::optional<latency::Clock::duration> queue_wait;
+};
+
+template <typename Body, typename Allocator>
+void LogRequest(const http::request<Body, http::basic_fields<Allocator>>& req, const net::ip::address& client) {
+    logger::Log("request received"sv, [&](json_writer::JsonWriter& data) {
+        data.StartObject()
+                .Member("ip", client.to_string())
+                .Member("URI", api_handler::AsStringView(req.target()))
+                .Member("method", api_handler::AsStringView(req.method_string()))
+                .EndObject();
+    });
+}
+
 template <typename Response>
-Response&& LogResponse(Response&& resp, time_point start) {
-    auto end = std::chrono::system_clock::now();
-    int duration = static_cast<int>((end - start).count() / 1000);
-
-    std::optional<std::string> content_type;
-    for (auto &el: resp.base()) {
-        if (el.name_string() == "Content-Type") {
-            content_type = el.value();
-            break;
-        }
-    }
-    auto content = content_type.has_value() ? content_type.value() : "null";
+void LogResponse(const Response& resp, const AccessTrace& trace, latency::Clock::duration elapsed) {
+    if (!trace.sampler.KeepResponse(trace.sampled, resp.result_int()))
+        return;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+    auto content_type = resp.base().find(http::field::content_type);
+    auto content = content_type != resp.base().end() ? api_handler::AsStringView(content_type->value()) : "null"sv;
 
-    json::value data {{"response_time"s, duration}, {"code"s, resp.result_int()}, {"content_type"s, content}};
-    BOOST_LOG_TRIVIAL(info) << logger::logging::add_value(logger::additional_data, data) << "response sent"s;
-    return std::forward<Response>(resp);
+    logger::Log("response sent"sv, [&](json_writer::JsonWriter& data) {
+        data.StartObject()
+                .Member("response_time", duration)
+                .Member("code", resp.result_int())
+                .Member("content_type", content)
+                .EndObject();
+    });
 }
 
+// Records the handler phases and logs the response, then hands it to the session,
+// which adds the time it takes to write it
+template <typename Send, typename Response>
+void Respond(const Send& send, Response&& resp, const AccessTrace& trace) {
+    const auto elapsed = latency::Clock::now() - trace.start;
+    const auto status = resp.result_int();
+    if (trace.queue_wait)
+        trace.latency.Record(trace.endpoint, status, latency::Phase::Queue, *trace.queue_wait);
+    trace.latency.Record(trace.endpoint, status, latency::Phase::Handler,
+                         elapsed - trace.queue_wait.value_or(latency::Clock::duration{}));
+    LogResponse(resp, trace, elapsed);
+    send(std::forward<Response>(resp), trace.endpoint);
+}
+
+
+using RateLimits = std::array<rate_limiter::Limit, router::ROUTE_COUNT>;
+
+struct OverloadOptions {
+    // Bounds of the API queues, requests past them are shed with 503
+    api_dispatcher::Options queues;
+    std::chrono::seconds retry_after {1};
+    // Per endpoint: token routes are limited per player, the others per client address
+    RateLimits rate_limits {};
+};
+
+// Movement must not wait behind leaderboard views, which wait on Postgres
+constexpr api_dispatcher::Priority PriorityOf(router::RouteId route) noexcept {
+    using router::RouteId;
+    using api_dispatcher::Priority;
+    switch (route) {
+        case RouteId::Action:
+        case RouteId::Tick:
+            return Priority::High;
+        case RouteId::State:
+        case RouteId::Players:
+            return Priority::Normal;
+        default:
+            return Priority::Low;
+    }
+}
 
 class RequestHandler: public std::enable_shared_from_this<RequestHandler> {
 public:
     using Strand = net::strand<net::io_context::executor_type>;
-    RequestHandler(model::Game& game, database::Database& db, std::string&& static_dir_path, Strand& api_strand, bool test = false, bool rand = false)
-        : api_handler_{game, db, test, rand},
-        static_dir_path_(std::forward<std::string>(static_dir_path)), api_strand_(api_strand) {}
+    RequestHandler(model::Game& game, database::PlayerStore& db, std::string&& static_dir_path, Strand& api_strand, bool test = false, bool rand = false,
+                   const compression::Options& compression = {}, file_cache::CacheMode cache_mode = file_cache::CacheMode::Immutable,
+                   const OverloadOptions& overload = {}, const access_log::SamplingOptions& sampling = {},
+                   const sim_schedule::Options& simulation = {})
+        : api_handler_{game, db, test, rand, compression, simulation},
+        static_dir_path_(std::forward<std::string>(static_dir_path)), api_strand_(api_strand), compression_(compression),
+        static_cache_(static_dir_path_, cache_mode), overload_(overload), dispatcher_(api_strand, overload.queues), sampler_(sampling) {
+        for (size_t i = 0; i < router::ROUTE_COUNT; ++i) {
+            if (overload.rate_limits[i].Enabled())
+                limiters_[i] = std::make_unique<rate_limiter::RateLimiter>(overload.rate_limits[i]);
+        }
+    }
 
     RequestHandler(const RequestHandler&) = delete;
     RequestHandler& operator=(const RequestHandler&) = delete;
 
-    std::variant<FileResponse,StringResponse> HandleFileRequest(StringRequest&& req);
+    FileRequestResult HandleFileRequest(StringRequest&& req);
+    file_cache::FileCache& GetStaticCache() {
+        return static_cache_;
+    }
     static StringResponse ReportServerError(unsigned version, bool keep_alive);
+    StringResponse ReportOverload(unsigned version, bool keep_alive) const;
+    size_t ApiQueueDepth() const noexcept {
+        return dispatcher_.Queued();
+    }
+    std::array<api_dispatcher::ClassStats, api_dispatcher::NUM_PRIORITIES> ApiQueueStats() const noexcept {
+        return dispatcher_.Stats();
+    }
+    std::uint64_t ShedRequests() const noexcept {
+        return shed_requests_.Value();
+    }
+    std::uint64_t RateLimitedRequests() const noexcept {
+        return rate_limited_.Value();
+    }
+    // Histograms per endpoint (access_log numbering), status class and phase;
+    // sessions record the write phases when listening with it
+    const std::shared_ptr<latency::Recorder>& Latency() const noexcept {
+        return latency_;
+    }
     const std::vector<app::Player>& GetPlayers() const noexcept {
         return api_handler_.GetPlayers();
     }
-    void DeletePlayer(const std::uint32_t& dog_id) {
-        api_handler_.DeletePlayer(dog_id);
+    void DeletePlayer(const app::PlayerRef& player) {
+        api_handler_.DeletePlayer(player);
     }
     void AddPlayer(const app::PlayerBase& player, model::GameSession& session) {
         api_handler_.AddPlayer(player, session);
@@ -69,38 +180,191 @@ public:
     api_handler::ApiHandler& GetApiHandler() {
         return api_handler_;
     }
+    // Connections are counted by the listeners, the scrape reports them when given the tracker
+    void SetConnectionTracker(std::shared_ptr<const http_server::ConnectionTracker> connections) {
+        connections_ = std::move(connections);
+    }
+    // Reported by the scrape when the game runs on its own ticker
+    void SetTicker(std::shared_ptr<const ticker::Ticker> ticker) {
+        ticker_ = std::move(ticker);
+    }
+    // Reads only atomics and published copies, never the game strand
+    std::string RenderMetrics() const;
+    StringResponse ServeMetrics(http::verb method, unsigned version, bool keep_alive) const;
+    // The latest tick phases recorded with --tick-trace, as Chrome trace-event JSON
+    static StringResponse ServeTickTrace(http::verb method, unsigned version, bool keep_alive);
 
     template <typename Body, typename Allocator, typename Send>
-    void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
-        auto start = std::chrono::system_clock::now();
-        std::string target {req.target()};
-        if (target.starts_with("/api/")) {
+    void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send, const net::ip::address& client = {}) {
+        auto start = latency::Clock::now();
+        auto target = api_handler::AsStringView(req.target());
+        if (target == RequestLiterals::MetricsTarget) {
+            auto trace = StartTrace(start, access_log::METRICS, req, client);
+            try {
+                return Respond(send, ServeMetrics(req.method(), req.version(), req.keep_alive()), trace);
+            } catch (...) {
+                return Respond(send, ReportServerError(req.version(), req.keep_alive()), trace);
+            }
+        }
+        if (target == RequestLiterals::TickTraceTarget && api_handler_.TestMode() && tick_profiler::Enabled()) {
+            auto trace = StartTrace(start, access_log::TICK_TRACE, req, client);
+            try {
+                return Respond(send, ServeTickTrace(req.method(), req.version(), req.keep_alive()), trace);
+            } catch (...) {
+                return Respond(send, ReportServerError(req.version(), req.keep_alive()), trace);
+            }
+        }
+        if (target.starts_with(RequestLiterals::ApiPrefix)) {
+            auto match = router::MatchRoute(target);
+            auto trace = StartTrace(start, match ? access_log::EndpointOf(match->id) : access_log::UNKNOWN_TARGET, req, client);
+            if (!match)
+                return Respond(send, api_handler::MakeStringResponse(http::status::bad_request, ResponseLiterals::InvalidTarget,
+                        req.version(), req.keep_alive(), BasicLiterals::AppJson, BasicLiterals::AllowAll), trace);
+            if (!router::RequiresToken(match->id)) {
+                if (auto res = CheckRateLimit(match->id, ClientKey(client), req.version(), req.keep_alive()))
+                    return Respond(send, std::move(*res), trace);
+            }
+            if (match->id == router::RouteId::Maps || match->id == router::RouteId::Map) {
+                // Map documents are immutable and precomputed, no need to queue on the API strand
+                try {
+                    return Respond(send, api_handler_.HandleMapRequests(req, *match), trace);
+                } catch (...) {
+                    return Respond(send, ReportServerError(req.version(), req.keep_alive()), trace);
+                }
+            }
+            auto route = match->id;
+            std::optional<app::PlayerRef> player;
+            if (router::RequiresToken(route)) {
+                // Rejected tokens are answered right here, the API strand only sees known players
+                try {
+                    auto auth = api_handler_.Authenticate(req, route);
+                    if (auto res = std::get_if<StringResponse>(&auth))
+                        return Respond(send, std::move(*res), trace);
+                    player = std::get<app::PlayerRef>(auth);
+                } catch (...) {
+                    return Respond(send, ReportServerError(req.version(), req.keep_alive()), trace);
+                }
+                if (auto res = CheckRateLimit(route, PlayerKey(*player), req.version(), req.keep_alive()))
+                    return Respond(send, std::move(*res), trace);
+            }
             auto version = req.version();
             auto keep_alive = req.keep_alive();
-            auto handle = [self = shared_from_this(), send,
-                    req = std::forward<decltype(req)>(req), version, keep_alive, start] {
+            auto encoding = compression_.Enabled() ?
+                    compression::ChooseEncoding(api_handler::AsStringView(req[http::field::accept_encoding])) : compression::Encoding::Identity;
+            // The match refers to the target of the request, whose buffer moves into the task with it
+            auto handle = [self = shared_from_this(), send, req = std::forward<decltype(req)>(req), version, keep_alive,
+                    trace, queued = latency::Clock::now(), encoding, match = *match, player]() mutable {
+                trace.queue_wait = latency::Clock::now() - queued;
                 try {
                     assert(self->api_strand_.running_in_this_thread());
-                    return send(LogResponse(self->api_handler_.HandleApiRequest(const_cast<const StringRequest&&>(req)), start));
+                    auto response = player ?
+                            self->api_handler_.HandleApiRequest(const_cast<const StringRequest&&>(req), match, *player) :
+                            self->api_handler_.HandleApiRequest(const_cast<const StringRequest&&>(req), match);
+                    return self->SendCompressed(std::move(response), encoding, send, trace);
                 } catch (...) {
-                    send(LogResponse(self->ReportServerError(version, keep_alive), start));
+                    Respond(send, self->ReportServerError(version, keep_alive), trace);
                 }
             };
-            return net::dispatch(api_strand_, handle);
+            // Shedding here costs no strand time, which is what an overloaded strand is short of
+            if (!dispatcher_.Post(PriorityOf(route), std::move(handle))) {
+                shed_requests_.Add();
+                return Respond(send, ReportOverload(version, keep_alive), trace);
+            }
         }
         else {
-            auto res = HandleFileRequest(std::forward<decltype(req)>(req));
-            if (holds_alternative<StringResponse>(res))
-                send(LogResponse(std::get<StringResponse>(res), start));
-            else
-                send(LogResponse(std::get<FileResponse>(res), start));
+            auto trace = StartTrace(start, access_log::STATIC_FILES, req, client);
+            std::visit([&send, &trace](auto&& res) {
+                Respond(send, std::move(res), trace);
+            }, HandleFileRequest(std::forward<decltype(req)>(req)));
         }
     }
 
 private:
+    // The address is only turned into text for the requests that are logged
+    template <typename Request>
+    AccessTrace StartTrace(latency::Clock::time_point start, size_t endpoint, const Request& req, const net::ip::address& client) {
+        bool sampled = sampler_.SampleRequest(endpoint);
+        if (sampled)
+            LogRequest(req, client);
+        return {start, sampler_, *latency_, static_cast<std::uint32_t>(endpoint), sampled, std::nullopt};
+    }
+
+    static std::uint64_t ClientKey(const net::ip::address& client) noexcept {
+        if (client.is_v4())
+            return client.to_v4().to_uint();
+        const auto v6 = client.to_v6();
+        // Clients of a dual-stack listener come as ::ffff:a.b.c.d and share the IPv4 keys
+        if (v6.is_v4_mapped())
+            return net::ip::make_address_v4(net::ip::v4_mapped, v6).to_uint();
+        // A client holds a whole /64, so only the network half is keyed; the top bit
+        // keeps it apart from the 32-bit IPv4 keys
+        auto bytes = v6.to_bytes();
+        std::uint64_t hi = 0;
+        for (size_t i = 0; i < 8; ++i)
+            hi = (hi << 8) | bytes[i];
+        return hi ^ (1ull << 63);
+    }
+    static std::uint64_t PlayerKey(const app::PlayerRef& player) noexcept {
+        return player.Pack();
+    }
+
+    // Checked off the strand, a client over its limit costs the strand nothing
+    std::optional<StringResponse> CheckRateLimit(router::RouteId route, std::uint64_t key, unsigned version, bool keep_alive) {
+        auto& limiter = limiters_[static_cast<size_t>(route)];
+        if (!limiter)
+            return std::nullopt;
+        auto decision = limiter->Check(key);
+        if (decision.allowed)
+            return std::nullopt;
+        rate_limited_.Add();
+        auto response = api_handler::MakeStringResponse(http::status::too_many_requests, ResponseLiterals::TooManyRequests,
+                                                        version, keep_alive, BasicLiterals::AppJson, BasicLiterals::AllowAll);
+        // Retry-After is in whole seconds, rounded up so that the retry is not refused again
+        auto seconds = std::chrono::ceil<std::chrono::seconds>(decision.retry_after).count();
+        response.set(http::field::retry_after, std::to_string(std::max<std::int64_t>(1, seconds)));
+        return response;
+    }
+
+    // Large compressible bodies are deflated off the API strand, on the connection's own executor
+    // when the sender has one: in thread-per-core mode that keeps every core compressing its own responses
+    template <typename Send>
+    void SendCompressed(StringResponse&& res, compression::Encoding encoding, const Send& send, const AccessTrace& trace) {
+        auto decision = compression::Decide(api_handler::AsStringView(res[http::field::content_type]),
+                                            res.count(http::field::content_encoding) != 0, res.body().size(), encoding, compression_);
+        if (decision.vary)
+            res.set(http::field::vary, "Accept-Encoding");
+        if (!decision.compress)
+            return Respond(send, std::move(res), trace);
+        net::post(net::get_associated_executor(send, api_strand_.get_inner_executor()),
+                  [res = std::move(res), encoding, send, trace, level = compression_.level]() mutable {
+            // Nothing may escape a posted handler, a body that fails to deflate goes out as is
+            try {
+                res.body() = compression::Compress(res.body(), encoding, level);
+                res.set(http::field::content_encoding, compression::EncodingName(encoding));
+                res.content_length(res.body().size());
+            } catch (const std::exception& ex) {
+                logger::Log("error"sv, [&](json_writer::JsonWriter& data) {
+                    data.StartObject().Member("text", std::string_view{ex.what()}).Member("where", "compress"sv).EndObject();
+                });
+            }
+            Respond(send, std::move(res), trace);
+        });
+    }
+
     api_handler::ApiHandler api_handler_;
     fs::path static_dir_path_;
     Strand& api_strand_;
+    compression::Options compression_;
+    file_cache::FileCache static_cache_;
+    OverloadOptions overload_;
+    api_dispatcher::PriorityDispatcher dispatcher_;
+    metrics::Counter shed_requests_;
+    std::array<std::unique_ptr<rate_limiter::RateLimiter>, router::ROUTE_COUNT> limiters_;
+    metrics::Counter rate_limited_;
+    access_log::Sampler sampler_;
+    std::shared_ptr<latency::Recorder> latency_ = std::make_shared<latency::Recorder>(access_log::NUM_ENDPOINTS);
+    std::shared_ptr<const http_server::ConnectionTracker> connections_;
+    std::shared_ptr<const ticker::Ticker> ticker_;
 };
 
 }  // namespace http_handler
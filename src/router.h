@@ -0,0 +1,173 @@
+#pragma once
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+using literal = std::string_view;
+
+class RequestLiterals {
+public:
+    static constexpr literal ApiPrefix = "/api/";
+    static constexpr literal JoinTarget = "/api/v1/game/join";
+    static constexpr literal MoveTarget = "/api/v1/game/player/action";
+    static constexpr literal PlayersTarget = "/api/v1/game/players";
+    static constexpr literal GameStateTarget = "/api/v1/game/state";
+    static constexpr literal TickTarget = "/api/v1/game/tick";
+    static constexpr literal RecordsTarget = "/api/v1/game/records";
+    static constexpr literal MapsTarget = "/api/v1/maps";
+    static constexpr literal MapTarget = "/api/v1/maps/";
+    static constexpr literal MetricsTarget = "/metrics";
+    static constexpr literal TickTraceTarget = "/debug/tick-trace";
+};
+
+namespace router {
+
+enum class RouteId : std::uint8_t {
+    Join,
+    Action,
+    Players,
+    State,
+    Tick,
+    Records,
+    Maps,
+    Map
+};
+
+inline constexpr size_t ROUTE_COUNT = static_cast<size_t>(RouteId::Map) + 1;
+
+// Names used in configuration, indexed by RouteId
+inline constexpr std::array<literal, ROUTE_COUNT> ROUTE_NAMES {
+    "join", "action", "players", "state", "tick", "records", "maps", "map"
+};
+
+constexpr std::optional<RouteId> RouteFromName(std::string_view name) noexcept {
+    for (size_t i = 0; i < ROUTE_COUNT; ++i) {
+        if (ROUTE_NAMES[i] == name)
+            return static_cast<RouteId>(i);
+    }
+    return std::nullopt;
+}
+
+struct Route {
+    literal path;
+    RouteId id;
+};
+
+// Exact-path routes; "/api/v1/maps/{id}" is the only parametrized one and is matched by prefix
+inline constexpr std::array ROUTES {
+    Route{RequestLiterals::JoinTarget, RouteId::Join},
+    Route{RequestLiterals::MoveTarget, RouteId::Action},
+    Route{RequestLiterals::PlayersTarget, RouteId::Players},
+    Route{RequestLiterals::GameStateTarget, RouteId::State},
+    Route{RequestLiterals::TickTarget, RouteId::Tick},
+    Route{RequestLiterals::RecordsTarget, RouteId::Records},
+    Route{RequestLiterals::MapsTarget, RouteId::Maps},
+};
+
+// Routes whose requests carry a player token
+constexpr bool RequiresToken(RouteId id) noexcept {
+    return id == RouteId::Action || id == RouteId::Players || id == RouteId::State;
+}
+
+struct Match {
+    RouteId id;
+    // "{id}" of "/api/v1/maps/{id}", empty for other routes
+    std::string_view param;
+    // everything after '?', without it
+    std::string_view query;
+};
+
+namespace detail {
+
+constexpr std::uint32_t Hash(std::string_view str, std::uint32_t seed) noexcept {
+    std::uint32_t hash = 2166136261u ^ seed;
+    for (char ch: str) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+constexpr size_t TABLE_SIZE = 16;
+static_assert(ROUTES.size() < TABLE_SIZE);
+
+struct PerfectHash {
+    std::uint32_t seed = 0;
+    std::array<std::int8_t, TABLE_SIZE> slots {};
+};
+
+// Searches for a seed under which every route lands in its own slot, so a lookup
+// costs one hash and at most one string comparison
+constexpr PerfectHash BuildPerfectHash() {
+    for (std::uint32_t seed = 0; seed < 1024; ++seed) {
+        PerfectHash table {seed, {}};
+        table.slots.fill(-1);
+        bool collision = false;
+        for (size_t i = 0; i < ROUTES.size() && !collision; ++i) {
+            auto& slot = table.slots[Hash(ROUTES[i].path, seed) % TABLE_SIZE];
+            collision = slot != -1;
+            slot = static_cast<std::int8_t>(i);
+        }
+        if (!collision)
+            return table;
+    }
+    throw "no collision-free seed for the route table";
+}
+
+inline constexpr PerfectHash TABLE = BuildPerfectHash();
+
+} // namespace detail
+
+constexpr std::optional<Match> MatchRoute(std::string_view target) noexcept {
+    std::string_view query;
+    if (auto pos = target.find('?'); pos != std::string_view::npos) {
+        query = target.substr(pos + 1);
+        target = target.substr(0, pos);
+    }
+    if (target.size() > RequestLiterals::MapTarget.size() && target.starts_with(RequestLiterals::MapTarget))
+        return Match{RouteId::Map, target.substr(RequestLiterals::MapTarget.size()), query};
+    if (target.size() > 1 && target.back() == '/')
+        target.remove_suffix(1);
+    auto index = detail::TABLE.slots[detail::Hash(target, detail::TABLE.seed) % detail::TABLE_SIZE];
+    if (index < 0 || ROUTES[index].path != target)
+        return std::nullopt;
+    return Match{ROUTES[index].id, {}, query};
+}
+
+// Value of a query parameter, undecoded
+constexpr std::optional<std::string_view> QueryParam(std::string_view query, std::string_view name) noexcept {
+    while (!query.empty()) {
+        auto end = query.find('&');
+        auto param = query.substr(0, end);
+        auto eq = param.find('=');
+        if (param.substr(0, eq) == name)
+            return eq == std::string_view::npos ? std::string_view{} : param.substr(eq + 1);
+        if (end == std::string_view::npos)
+            break;
+        query.remove_prefix(end + 1);
+    }
+    return std::nullopt;
+}
+
+// Integer query parameter: the default when absent, nullopt when malformed
+inline std::optional<int> IntQueryParam(std::string_view query, std::string_view name, int default_value) noexcept {
+    auto value = QueryParam(query, name);
+    if (!value.has_value())
+        return default_value;
+    int result = 0;
+    auto res = std::from_chars(value->data(), value->data() + value->size(), result);
+    if (res.ec != std::errc{} || res.ptr != value->data() + value->size())
+        return std::nullopt;
+    return result;
+}
+
+static_assert(MatchRoute("/api/v1/game/state")->id == RouteId::State);
+static_assert(MatchRoute("/api/v1/game/records?start=0&maxItems=10")->query == "start=0&maxItems=10");
+static_assert(MatchRoute("/api/v1/maps/map1")->param == "map1");
+static_assert(MatchRoute("/api/v1/maps/")->id == RouteId::Maps);
+static_assert(!MatchRoute("/api/v1/game/stat").has_value());
+static_assert(RouteFromName("records") == RouteId::Records);
+
+} // namespace router
@@ -0,0 +1,74 @@
+#include "runtime.h"
+#include "logger.h"
+
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace runtime {
+
+using namespace std::literals;
+
+bool PinCurrentThread(unsigned cpu) noexcept {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+Runtime::Runtime(unsigned num_threads, bool thread_per_core):
+        num_threads_(std::max(1u, num_threads)), thread_per_core_(thread_per_core) {
+    const unsigned num_contexts = thread_per_core_ ? num_threads_ : 1;
+    // A concurrency hint of 1 lets asio skip locking inside a context only one thread runs
+    const int hint = thread_per_core_ ? 1 : static_cast<int>(num_threads_);
+    contexts_.reserve(num_contexts);
+    guards_.reserve(num_contexts);
+    for (unsigned i = 0; i < num_contexts; ++i) {
+        contexts_.push_back(std::make_unique<net::io_context>(hint));
+        guards_.push_back(net::make_work_guard(*contexts_.back()));
+    }
+}
+
+void Runtime::Run() {
+    auto work = [this](unsigned index) {
+        if (thread_per_core_) {
+            const auto cpu = index % std::max(1u, std::thread::hardware_concurrency());
+            // The context still runs, only wherever the scheduler puts it
+            if (!PinCurrentThread(cpu)) {
+                logger::Log("thread not pinned"sv, [&](json_writer::JsonWriter& data) {
+                    data.StartObject().Member("context", index).Member("cpu", cpu).EndObject();
+                });
+            }
+            contexts_[index]->run();
+        } else {
+            Main().run();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads_ - 1);
+    for (unsigned i = 1; i < num_threads_; ++i)
+        workers.emplace_back(work, i);
+    try {
+        work(0);
+    } catch (...) {
+        Stop();
+        for (auto& worker: workers)
+            worker.join();
+        throw;
+    }
+    for (auto& worker: workers)
+        worker.join();
+}
+
+void Runtime::Stop() {
+    for (auto& context: contexts_)
+        context->stop();
+}
+
+} // namespace runtime
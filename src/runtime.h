@@ -0,0 +1,54 @@
+#pragma once
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace runtime {
+
+namespace net = boost::asio;
+
+// Binds the calling thread to one CPU; returns false where affinity is unavailable
+bool PinCurrentThread(unsigned cpu) noexcept;
+
+// Owns the io_contexts and the threads running them.
+// Shared mode: one io_context run by every thread.
+// Thread-per-core mode: one single-threaded io_context per thread, each thread pinned to its core.
+// Context 0 is the main one: it owns the game strand, timers and signals.
+class Runtime {
+public:
+    Runtime(unsigned num_threads, bool thread_per_core);
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+
+    net::io_context& Main() noexcept {
+        return *contexts_.front();
+    }
+    // Contexts that should accept connections: all of them in thread-per-core mode, the main one otherwise
+    const std::vector<std::unique_ptr<net::io_context>>& Contexts() const noexcept {
+        return contexts_;
+    }
+    bool ThreadPerCore() const noexcept {
+        return thread_per_core_;
+    }
+    unsigned NumThreads() const noexcept {
+        return num_threads_;
+    }
+
+    // Runs the contexts on NumThreads() threads, the calling one included, until Stop();
+    // every worker is joined before it returns
+    void Run();
+    // Thread-safe
+    void Stop();
+private:
+    using WorkGuard = net::executor_work_guard<net::io_context::executor_type>;
+
+    unsigned num_threads_;
+    bool thread_per_core_;
+    std::vector<std::unique_ptr<net::io_context>> contexts_;
+    // Keep contexts without pending work, a core with no connections yet, from returning early
+    std::vector<WorkGuard> guards_;
+};
+
+} // namespace runtime
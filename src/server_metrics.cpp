@@ -0,0 +1,100 @@
+#include "server_metrics.h"
+
+#include "access_log.h"
+#include "logger.h"
+
+namespace server_metrics {
+
+std::string Render(const Sources& sources) {
+    metrics::TextWriter writer;
+    constexpr std::string_view status_classes[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+    // Every response goes through the handler phase, which makes its histograms the request count
+    writer.Family("game_http_requests_total", metrics::Type::Counter, "Responses by endpoint and status class");
+    for (std::uint32_t endpoint = 0; endpoint < sources.latency->NumLabels(); ++endpoint) {
+        for (size_t status_class = 0; status_class < latency::NUM_STATUS_CLASSES; ++status_class) {
+            auto count = sources.latency->Snapshot(endpoint, status_class, latency::Phase::Handler).count;
+            if (count != 0)
+                writer.Sample("game_http_requests_total", {{"endpoint", access_log::EndpointName(endpoint)},
+                                                           {"code", status_classes[status_class]}}, count);
+        }
+    }
+    writer.Family("game_http_request_duration_seconds", metrics::Type::Histogram,
+                  "Request latency by endpoint, status class and phase");
+    for (std::uint32_t endpoint = 0; endpoint < sources.latency->NumLabels(); ++endpoint) {
+        for (size_t status_class = 0; status_class < latency::NUM_STATUS_CLASSES; ++status_class) {
+            for (size_t phase = 0; phase < latency::NUM_PHASES; ++phase) {
+                auto snapshot = sources.latency->Snapshot(endpoint, status_class, static_cast<latency::Phase>(phase));
+                if (snapshot.count != 0)
+                    writer.Histogram("game_http_request_duration_seconds", {
+                            {"endpoint", access_log::EndpointName(endpoint)}, {"code", status_classes[status_class]},
+                            {"phase", latency::PhaseName(static_cast<latency::Phase>(phase))}}, snapshot);
+            }
+        }
+    }
+
+    if (sources.connections) {
+        auto stats = sources.connections->Stats();
+        writer.Family("game_http_connections_open", metrics::Type::Gauge, "Open client connections")
+                .Sample("game_http_connections_open", {}, std::uint64_t{stats.active});
+        writer.Family("game_http_connections_accepted_total", metrics::Type::Counter, "Connections admitted")
+                .Sample("game_http_connections_accepted_total", {}, stats.accepted);
+        writer.Family("game_http_connections_rejected_total", metrics::Type::Counter, "Connections refused at a limit")
+                .Sample("game_http_connections_rejected_total", {{"limit", "total"}}, stats.rejected_total_limit)
+                .Sample("game_http_connections_rejected_total", {{"limit", "ip"}}, stats.rejected_ip_limit);
+        writer.Family("game_http_connections_idle_reaped_total", metrics::Type::Counter, "Idle connections closed")
+                .Sample("game_http_connections_idle_reaped_total", {}, stats.idle_reaped);
+    }
+    writer.Family("game_http_shed_total", metrics::Type::Counter, "API requests refused with 503, queues full")
+            .Sample("game_http_shed_total", {}, sources.shed_requests);
+    writer.Family("game_http_rate_limited_total", metrics::Type::Counter, "Requests refused with 429")
+            .Sample("game_http_rate_limited_total", {}, sources.rate_limited_requests);
+
+    constexpr std::string_view priorities[] = {"high", "normal", "low"};
+    const auto& queues = sources.queues;
+    writer.Family("game_api_queued", metrics::Type::Gauge, "API requests waiting for the game strand");
+    for (size_t i = 0; i < queues.size(); ++i)
+        writer.Sample("game_api_queued", {{"priority", priorities[i]}}, std::uint64_t{queues[i].queued});
+    writer.Family("game_api_dispatched_total", metrics::Type::Counter, "API requests run on the game strand");
+    for (size_t i = 0; i < queues.size(); ++i)
+        writer.Sample("game_api_dispatched_total", {{"priority", priorities[i]}}, queues[i].dispatched);
+
+    const auto log_stats = logger::GetStats();
+    writer.Family("game_log_records_total", metrics::Type::Counter, "Log records by outcome")
+            .Sample("game_log_records_total", {{"outcome", "written"}}, log_stats.written)
+            .Sample("game_log_records_total", {{"outcome", "dropped"}}, log_stats.dropped);
+
+    if (sources.ticker) {
+        auto stats = sources.ticker->GetStats();
+        writer.Family("game_ticks_total", metrics::Type::Counter, "Ticks run by the game ticker")
+                .Sample("game_ticks_total", {}, stats.ticks);
+        writer.Family("game_tick_overruns_total", metrics::Type::Counter, "Ticks that ended past the next deadline")
+                .Sample("game_tick_overruns_total", {}, stats.overruns);
+        writer.Family("game_ticks_skipped_total", metrics::Type::Counter, "Tick deadlines dropped after overruns")
+                .Sample("game_ticks_skipped_total", {}, stats.skipped);
+        writer.Family("game_tick_jitter_seconds", metrics::Type::Histogram, "Lateness of the ticker timer")
+                .Histogram("game_tick_jitter_seconds", {}, stats.jitter);
+    }
+    if (auto player_writer = sources.player_writer) {
+        auto stats = player_writer->GetStats();
+        writer.Family("game_db_queued", metrics::Type::Gauge, "Retired players waiting to be written to the database")
+                .Sample("game_db_queued", {}, stats.queued);
+        writer.Family("game_db_records_total", metrics::Type::Counter, "Retired players by what became of them")
+                .Sample("game_db_records_total", {{"outcome", "committed"}}, stats.committed)
+                .Sample("game_db_records_total", {{"outcome", "spilled"}}, stats.spilled)
+                .Sample("game_db_records_total", {{"outcome", "replayed"}}, stats.replayed)
+                .Sample("game_db_records_total", {{"outcome", "dropped"}}, stats.dropped);
+        writer.Family("game_db_batches_total", metrics::Type::Counter, "Batches committed to the database")
+                .Sample("game_db_batches_total", {}, stats.batches);
+        writer.Family("game_db_failed_commits_total", metrics::Type::Counter, "Batches the database did not take")
+                .Sample("game_db_failed_commits_total", {}, stats.failed_commits);
+        writer.Family("game_db_write_duration_seconds", metrics::Type::Histogram,
+                      "Committing a batch of retired players on the writer thread")
+                .Histogram("game_db_write_duration_seconds", {}, stats.commit_duration);
+    }
+    if (sources.game)
+        sources.game->Write(writer);
+    return writer.Release();
+}
+
+} // namespace server_metrics
@@ -0,0 +1,31 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "api_dispatcher.h"
+#include "db_writer.h"
+#include "http_server.h"
+#include "latency.h"
+#include "metrics.h"
+#include "ticker.h"
+
+namespace server_metrics {
+
+// What a /metrics scrape reports; latency is required, the other pointers left empty leave their families out
+struct Sources {
+    // Histograms per endpoint (access_log numbering), status class and phase
+    const latency::Recorder* latency = nullptr;
+    const http_server::ConnectionTracker* connections = nullptr;
+    std::uint64_t shed_requests = 0;
+    std::uint64_t rate_limited_requests = 0;
+    std::array<api_dispatcher::ClassStats, api_dispatcher::NUM_PRIORITIES> queues {};
+    const ticker::Ticker* ticker = nullptr;
+    const db_writer::WriteBehind* player_writer = nullptr;
+    const metrics::GameMetrics* game = nullptr;
+};
+
+// The body of a scrape, in the Prometheus text format. Reads only atomics and published copies.
+std::string Render(const Sources& sources);
+
+} // namespace server_metrics
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+
+namespace sim_schedule {
+
+struct Options {
+    // Longest simulation step in milliseconds, a longer tick is split; 0 runs each tick as one step
+    int substep = 0;
+    // Game time in milliseconds between state snapshots published to clients; 0 serves the live state
+    int snapshot_period = 0;
+    // Longest time in milliseconds dog positions in state responses are extrapolated past the last
+    // tick; 0 for none. Extrapolated states are written per request from the live state.
+    int max_extrapolation = 0;
+};
+
+// Coordinates the simulation and snapshot schedules: a tick is run as substeps,
+// and a snapshot is due at the end of the tick completing a snapshot period.
+// Both count game time, so they keep in step whatever the tick period.
+class Schedule {
+public:
+    explicit Schedule(const Options& options = {}): options_(options) {}
+
+    // Calls step(ms) for every substep of a tick of nof_ms; true when a snapshot is due after it
+    template <typename Step>
+    bool Advance(int nof_ms, Step&& step) {
+        int remaining = nof_ms;
+        do {
+            int length = options_.substep > 0 ? std::min(remaining, options_.substep) : remaining;
+            step(length);
+            remaining -= length;
+        } while (remaining > 0);
+        if (options_.snapshot_period <= 0)
+            return false;
+        since_snapshot_ += nof_ms;
+        if (since_snapshot_ < options_.snapshot_period)
+            return false;
+        // A tick longer than the period publishes once, not to make up for the snapshots it spans
+        since_snapshot_ %= options_.snapshot_period;
+        return true;
+    }
+
+    bool Snapshots() const noexcept {
+        return options_.snapshot_period > 0;
+    }
+    const Options& GetOptions() const noexcept {
+        return options_;
+    }
+private:
+    Options options_;
+    int since_snapshot_ = 0;
+};
+
+} // namespace sim_schedule
@@ -0,0 +1,124 @@
+#include "tick_profiler.h"
+#include "json_writer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+
+namespace tick_profiler {
+
+namespace {
+
+// Ticks run on one strand at a time, so the lock is hardly ever contended
+struct Ring {
+    std::mutex mutex;
+    std::vector<Event> events;
+    size_t next = 0;
+    size_t size = 0;
+    Clock::time_point epoch;
+    std::atomic<std::uint64_t> missed {0};
+};
+
+Ring& GetRing() {
+    static Ring ring;
+    return ring;
+}
+
+std::uint32_t ThreadIndex() noexcept {
+    static std::atomic<std::uint32_t> next {1};
+    thread_local const std::uint32_t index = next.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+} // namespace
+
+void Enable(size_t capacity) {
+    auto& ring = GetRing();
+    std::lock_guard lock {ring.mutex};
+    ring.events.assign(capacity, Event{});
+    ring.next = 0;
+    ring.size = 0;
+    ring.epoch = Clock::now();
+    ring.missed.store(0, std::memory_order_relaxed);
+    detail::enabled.store(capacity != 0, std::memory_order_relaxed);
+}
+
+void Disable() noexcept {
+    detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+void Record(std::string_view name, std::uint32_t session, Clock::time_point start, Clock::time_point end) noexcept {
+    auto& ring = GetRing();
+    std::unique_lock lock {ring.mutex, std::try_to_lock};
+    if (!lock.owns_lock()) {
+        ring.missed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // Disabled and re-enabled with no room in between
+    if (ring.events.empty())
+        return;
+    ring.events[ring.next] = {name, session, ThreadIndex(), start, end - start};
+    ring.next = (ring.next + 1) % ring.events.size();
+    ring.size = std::min(ring.size + 1, ring.events.size());
+}
+
+std::uint64_t Missed() noexcept {
+    return GetRing().missed.load(std::memory_order_relaxed);
+}
+
+std::vector<Event> Events() {
+    auto& ring = GetRing();
+    std::lock_guard lock {ring.mutex};
+    std::vector<Event> events;
+    events.reserve(ring.size);
+    const auto first = (ring.next + ring.events.size() - ring.size) % std::max<size_t>(ring.events.size(), 1);
+    for (size_t i = 0; i < ring.size; ++i)
+        events.push_back(ring.events[(first + i) % ring.events.size()]);
+    return events;
+}
+
+std::string ChromeTrace() {
+    const auto events = Events();
+    const auto epoch = [] {
+        auto& ring = GetRing();
+        std::lock_guard lock {ring.mutex};
+        return ring.epoch;
+    }();
+    const auto us = [](Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+    json_writer::JsonWriter writer {128 + events.size() * 96};
+    writer.StartObject().Key("traceEvents").StartArray();
+    for (const auto& event: events) {
+        writer.StartObject()
+                .Member("name", event.name)
+                .Member("cat", "tick")
+                .Member("ph", "X")
+                .Member("ts", us(event.start - epoch))
+                .Member("dur", us(event.duration))
+                .Member("pid", 1)
+                .Member("tid", event.thread);
+        if (event.session != NO_SESSION)
+            writer.Key("args").StartObject().Member("session", event.session).EndObject();
+        writer.EndObject();
+    }
+    writer.EndArray()
+            .Member("displayTimeUnit", "ms")
+            .Key("otherData").StartObject().Member("missed", Missed()).EndObject()
+            .EndObject();
+    return writer.Release();
+}
+
+bool WriteChromeTrace(const std::string& path) {
+    const auto temporary = path + ".tmp";
+    {
+        std::ofstream out {temporary, std::ios::binary | std::ios::trunc};
+        out << ChromeTrace();
+        if (!out.flush())
+            return false;
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+} // namespace tick_profiler
@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Scoped timing of the phases of a game tick, kept in a ring of the latest events
+// and exported as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Disabled, a scope costs one relaxed load.
+namespace tick_profiler {
+
+using Clock = std::chrono::steady_clock;
+
+// Phases not tied to a session, e.g. saving the whole game state
+inline constexpr std::uint32_t NO_SESSION = UINT32_MAX;
+
+struct Event {
+    // A literal: events outlive the scope that records them
+    std::string_view name;
+    std::uint32_t session;
+    std::uint32_t thread;
+    Clock::time_point start;
+    Clock::duration duration;
+};
+
+namespace detail {
+inline std::atomic<bool> enabled {false};
+} // namespace detail
+
+inline bool Enabled() noexcept {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Starts recording into a ring of the last `capacity` events, dropping the earlier ones
+void Enable(size_t capacity);
+void Disable() noexcept;
+
+// Never waits nor throws: an event finding the ring busy, e.g. being exported, is dropped and counted
+void Record(std::string_view name, std::uint32_t session, Clock::time_point start, Clock::time_point end) noexcept;
+// Events dropped since Enable
+std::uint64_t Missed() noexcept;
+// Oldest first
+std::vector<Event> Events();
+// {"traceEvents": [...]} of complete ("X") events, times in microseconds since Enable;
+// otherData.missed is the number of events dropped
+std::string ChromeTrace();
+// Writes ChromeTrace() through a temporary file renamed over `path`, so a reader never
+// sees half a trace; false when it cannot be written
+bool WriteChromeTrace(const std::string& path);
+
+class Scope {
+public:
+    explicit Scope(std::string_view name, std::uint32_t session = NO_SESSION) noexcept
+            : name_(name), session_(session), start_(Enabled() ? Clock::now() : Clock::time_point{}) {}
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope() noexcept {
+        if (start_ != Clock::time_point{})
+            Record(name_, session_, start_, Clock::now());
+    }
+private:
+    std::string_view name_;
+    std::uint32_t session_;
+    Clock::time_point start_;
+};
+
+} // namespace tick_profiler
@@ -2,25 +2,51 @@
 
 namespace ticker {
 void Ticker::Start() {
-    last_tick_ = std::chrono::steady_clock::now();
     auto handle = [self = shared_from_this()] {
+        self->last_deadline_ = net::steady_timer::clock_type::now();
+        self->deadline_ = self->last_deadline_ + self->period_;
         self->ScheduleTick();
     };
     net::dispatch(strand_, handle);
 }
 
+Stats Ticker::GetStats() const {
+    Stats stats;
+    stats.ticks = ticks_.load(std::memory_order_relaxed);
+    stats.overruns = overruns_.load(std::memory_order_relaxed);
+    stats.skipped = skipped_.load(std::memory_order_relaxed);
+    jitter_.AddTo(stats.jitter);
+    duration_.AddTo(stats.duration);
+    return stats;
+}
+
 void Ticker::ScheduleTick() {
-    timer_.expires_after(period_);
+    // A deadline already past fires at once, which is how missed ticks catch up
+    timer_.expires_at(deadline_);
     timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
         self->OnTick(ec);
     });
 }
 
 void Ticker::OnTick(sys::error_code ec) {
-    auto current_tick = std::chrono::steady_clock::now();
-    auto period = std::chrono::duration_cast<duration>(current_tick - last_tick_);
-    handler_(period);
-    last_tick_ = current_tick;
+    if (ec == net::error::operation_aborted)
+        return;
+    const auto fired = net::steady_timer::clock_type::now();
+    jitter_.Record(fired - deadline_);
+    if (overrun_ == OverrunPolicy::Skip && fired - deadline_ >= period_) {
+        auto missed = (fired - deadline_) / period_;
+        deadline_ += missed * period_;
+        skipped_.fetch_add(static_cast<std::uint64_t>(missed), std::memory_order_relaxed);
+    }
+    handler_(deadline_ - last_deadline_);
+    const auto done = net::steady_timer::clock_type::now();
+    duration_.Record(done - fired);
+    ticks_.fetch_add(1, std::memory_order_relaxed);
+
+    last_deadline_ = deadline_;
+    deadline_ += period_;
+    if (done > deadline_)
+        overruns_.fetch_add(1, std::memory_order_relaxed);
     ScheduleTick();
 }
 } // namespace ticker
@@ -1,9 +1,14 @@
 #pragma once
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <stdexcept>
 #include <utility>
 #include <boost/beast.hpp>
 #include <boost/asio/strand.hpp>
 
+#include "latency.h"
+
 namespace ticker {
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -11,26 +16,64 @@ namespace sys = boost::system;
 namespace net = boost::asio;
 using duration = net::steady_timer::duration;
 
+// What to do when a tick ends past the deadline of the next one
+enum class OverrunPolicy {
+    // Run the missed ticks back to back, each advancing the game by one period
+    CatchUp,
+    // Drop the missed deadlines, the next tick advances the game by all the time they covered
+    Skip
+};
+
+struct Stats {
+    std::uint64_t ticks = 0;
+    // Ticks that ended past the next deadline
+    std::uint64_t overruns = 0;
+    // Deadlines dropped under OverrunPolicy::Skip
+    std::uint64_t skipped = 0;
+    // How late the timer fired after the deadline
+    latency::HistogramSnapshot jitter;
+    // Handler run time
+    latency::HistogramSnapshot duration;
+};
+
+// Calls the handler on the strand at fixed deadlines, start + n * period, so neither the handler
+// run time nor timer lateness accumulate. The handler is passed the time between the deadlines
+// of consecutive ticks: the game time advances by exactly the schedule.
 class Ticker: public std::enable_shared_from_this<Ticker> {
 public:
     using Strand = net::strand<net::io_context::executor_type>;
     using Handler = std::function<void(duration delta)>;
     using ms = std::chrono::milliseconds;
 
-    Ticker(Strand& strand, ms period, Handler handler): strand_(strand), handler_(std::move(handler)),
-                                                       period_(std::chrono::duration_cast<duration>(period)) {}
+    // Throws std::invalid_argument when the period is not positive
+    Ticker(Strand& strand, ms period, Handler handler, OverrunPolicy overrun = OverrunPolicy::CatchUp):
+            strand_(strand), handler_(std::move(handler)), period_(std::chrono::duration_cast<duration>(period)),
+            overrun_(overrun) {
+        if (period_ <= duration::zero())
+            throw std::invalid_argument("Tick period must be positive");
+    }
     void Start();
+    // Thread-safe
+    Stats GetStats() const;
 
 private:
+    using time_point = net::steady_timer::time_point;
+
     void ScheduleTick();
     void OnTick(sys::error_code ec);
 
     Strand& strand_;
     net::steady_timer timer_ {strand_};
     duration period_;
-    decltype(std::chrono::steady_clock::now()) last_tick_;
+    OverrunPolicy overrun_;
+    time_point deadline_;
+    time_point last_deadline_;
     Handler handler_;
+
+    std::atomic<std::uint64_t> ticks_ {0};
+    std::atomic<std::uint64_t> overruns_ {0};
+    std::atomic<std::uint64_t> skipped_ {0};
+    latency::AtomicHistogram jitter_;
+    latency::AtomicHistogram duration_;
 };
 } // namespace ticker
-
-
@@ -0,0 +1,175 @@
+#include "token.h"
+#include <algorithm>
+#include <bit>
+#include <thread>
+
+namespace token {
+
+namespace {
+
+constexpr char HEX_DIGITS[] = "0123456789abcdef";
+constexpr size_t MIN_CAPACITY = 16;
+
+void EncodeHalf(std::uint64_t value, char* out) noexcept {
+    for (int i = TOKEN_LENGTH / 2 - 1; i >= 0; --i) {
+        out[i] = HEX_DIGITS[value & 0xf];
+        value >>= 4;
+    }
+}
+
+} // namespace
+
+std::string EncodeToken(const TokenKey& key) {
+    std::string token(TOKEN_LENGTH, '0');
+    EncodeHalf(key.hi, token.data());
+    EncodeHalf(key.lo, token.data() + TOKEN_LENGTH / 2);
+    return token;
+}
+
+TokenDirectory::ReadGuard::ReadGuard(const TokenDirectory& directory) noexcept {
+    for (;;) {
+        auto epoch = directory.epoch_.load();
+        count_ = &directory.readers_[epoch & 1].value;
+        count_->fetch_add(1);
+        // A writer flipped the epoch in between and may not wait for this reader: retry
+        if (directory.epoch_.load() == epoch)
+            break;
+        count_->fetch_sub(1, std::memory_order_release);
+    }
+}
+
+TokenDirectory::ReadGuard::~ReadGuard() {
+    count_->fetch_sub(1, std::memory_order_release);
+}
+
+TokenDirectory::TokenDirectory(size_t capacity): table_(new Table(MIN_CAPACITY)) {
+    Reserve(capacity);
+}
+
+TokenDirectory::~TokenDirectory() {
+    delete table_.load();
+}
+
+void TokenDirectory::Store(Slot& slot, SlotState state, const TokenKey& key, Value value) noexcept {
+    auto seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.state.store(state, std::memory_order_relaxed);
+    slot.hi.store(key.hi, std::memory_order_relaxed);
+    slot.lo.store(key.lo, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+std::optional<TokenDirectory::Value> TokenDirectory::Find(const TokenKey& key) const noexcept {
+    ReadGuard guard{*this};
+    const Table* table = table_.load(std::memory_order_acquire);
+    for (size_t i = TokenKeyHasher{}(key) & table->mask;; i = (i + 1) & table->mask) {
+        const Slot& slot = table->slots[i];
+        for (;;) {
+            auto seq = slot.seq.load(std::memory_order_acquire);
+            if (seq & 1)
+                continue;
+            auto state = slot.state.load(std::memory_order_relaxed);
+            auto hi = slot.hi.load(std::memory_order_relaxed);
+            auto lo = slot.lo.load(std::memory_order_relaxed);
+            auto value = slot.value.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq)
+                continue;
+            if (state == EMPTY)
+                return std::nullopt;
+            if (state == LIVE && hi == key.hi && lo == key.lo)
+                return value;
+            break;
+        }
+    }
+}
+
+bool TokenDirectory::Insert(const TokenKey& key, Value value) {
+    std::lock_guard lock{write_mutex_};
+    Table* table = table_.load(std::memory_order_relaxed);
+    auto size = size_.load(std::memory_order_relaxed);
+    // Keep at most 3/4 of the slots occupied, erased ones included, so probe chains stay short
+    // and every probe ends on an empty slot
+    if ((size + erased_ + 1) * 4 > (table->mask + 1) * 3) {
+        Rehash(size + 1 > (table->mask + 1) / 2 ? (table->mask + 1) * 2 : table->mask + 1);
+        table = table_.load(std::memory_order_relaxed);
+    }
+    Slot* reusable = nullptr;
+    for (size_t i = TokenKeyHasher{}(key) & table->mask;; i = (i + 1) & table->mask) {
+        auto& slot = table->slots[i];
+        auto state = slot.state.load(std::memory_order_relaxed);
+        if (state == EMPTY) {
+            if (reusable == nullptr)
+                reusable = &slot;
+            else
+                --erased_;
+            break;
+        }
+        if (state == ERASED) {
+            if (reusable == nullptr)
+                reusable = &slot;
+        } else if (slot.hi.load(std::memory_order_relaxed) == key.hi && slot.lo.load(std::memory_order_relaxed) == key.lo)
+            return false;
+    }
+    Store(*reusable, LIVE, key, value);
+    size_.store(size + 1, std::memory_order_relaxed);
+    return true;
+}
+
+bool TokenDirectory::Erase(const TokenKey& key) {
+    std::lock_guard lock{write_mutex_};
+    Table* table = table_.load(std::memory_order_relaxed);
+    for (size_t i = TokenKeyHasher{}(key) & table->mask;; i = (i + 1) & table->mask) {
+        auto& slot = table->slots[i];
+        auto state = slot.state.load(std::memory_order_relaxed);
+        if (state == EMPTY)
+            return false;
+        if (state == LIVE && slot.hi.load(std::memory_order_relaxed) == key.hi &&
+                slot.lo.load(std::memory_order_relaxed) == key.lo) {
+            Store(slot, ERASED, key, slot.value.load(std::memory_order_relaxed));
+            size_.fetch_sub(1, std::memory_order_relaxed);
+            ++erased_;
+            return true;
+        }
+    }
+}
+
+void TokenDirectory::Reserve(size_t count) {
+    std::lock_guard lock{write_mutex_};
+    auto capacity = std::bit_ceil(std::max(MIN_CAPACITY, count + count / 3 + 1));
+    if (capacity > table_.load(std::memory_order_relaxed)->mask + 1)
+        Rehash(capacity);
+}
+
+void TokenDirectory::Rehash(size_t capacity) {
+    auto fresh = std::make_unique<Table>(capacity);
+    Table* old = table_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= old->mask; ++i) {
+        const auto& slot = old->slots[i];
+        if (slot.state.load(std::memory_order_relaxed) != LIVE)
+            continue;
+        TokenKey key {slot.hi.load(std::memory_order_relaxed), slot.lo.load(std::memory_order_relaxed)};
+        size_t j = TokenKeyHasher{}(key) & fresh->mask;
+        while (fresh->slots[j].state.load(std::memory_order_relaxed) != EMPTY)
+            j = (j + 1) & fresh->mask;
+        Store(fresh->slots[j], LIVE, key, slot.value.load(std::memory_order_relaxed));
+    }
+    erased_ = 0;
+    table_.store(fresh.release());
+    WaitForReaders();
+    delete old;
+}
+
+void TokenDirectory::WaitForReaders() noexcept {
+    // Readers entering from now on see the new table; the ones counted under the
+    // previous epoch may still hold the old one
+    auto epoch = epoch_.fetch_add(1);
+    // Sequentially consistent with the reader's increment and epoch check: either the reader
+    // sees the new epoch and retries, or its count is seen here
+    while (readers_[epoch & 1].value.load() != 0)
+        std::this_thread::yield();
+}
+
+} // namespace token
@@ -0,0 +1,148 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace token {
+
+constexpr size_t TOKEN_LENGTH = 32;
+
+// Binary form of the 32 hex digit player token: hi holds the first 16 digits
+struct TokenKey {
+    std::uint64_t hi = 0;
+    std::uint64_t lo = 0;
+
+    auto operator<=>(const TokenKey&) const = default;
+};
+
+struct TokenKeyHasher {
+    size_t operator()(const TokenKey& key) const noexcept {
+        // Tokens are uniformly random, mixing both halves is enough
+        return static_cast<size_t>(key.hi ^ (key.lo * 0x9E3779B97F4A7C15ull));
+    }
+};
+
+namespace detail {
+
+// 0..15 for lowercase hex digits, 0xff for everything else
+constexpr auto HEX_VALUES = [] {
+    std::array<std::uint8_t, 256> table {};
+    table.fill(0xff);
+    for (int i = 0; i < 10; ++i)
+        table['0' + i] = static_cast<std::uint8_t>(i);
+    for (int i = 0; i < 6; ++i)
+        table['a' + i] = static_cast<std::uint8_t>(10 + i);
+    return table;
+}();
+
+// Branch-free: invalid digits are collected in a flag and checked once
+constexpr std::optional<std::uint64_t> DecodeHalf(std::string_view hex) noexcept {
+    std::uint64_t value = 0;
+    std::uint8_t invalid = 0;
+    for (char ch: hex) {
+        auto digit = HEX_VALUES[static_cast<unsigned char>(ch)];
+        invalid |= digit;
+        value = (value << 4) | (digit & 0xf);
+    }
+    if (invalid & 0xf0)
+        return std::nullopt;
+    return value;
+}
+
+} // namespace detail
+
+// Tokens are issued in lowercase hex; anything else cannot belong to a player
+constexpr std::optional<TokenKey> DecodeToken(std::string_view hex) noexcept {
+    if (hex.size() != TOKEN_LENGTH)
+        return std::nullopt;
+    auto hi = detail::DecodeHalf(hex.substr(0, TOKEN_LENGTH / 2));
+    auto lo = detail::DecodeHalf(hex.substr(TOKEN_LENGTH / 2));
+    if (!hi || !lo)
+        return std::nullopt;
+    return TokenKey{*hi, *lo};
+}
+
+// Lowercase hex, zero-padded: the token format handed out to clients
+std::string EncodeToken(const TokenKey& key);
+
+// Open-addressing map from token keys to 64-bit values, readable from any thread.
+// Linear probing over a power-of-two array of inline slots. Readers take no lock: every
+// slot is a seqlock, and a table replaced on growth is freed only after the readers
+// that entered before the swap have left. Writers are serialized by a mutex.
+class TokenDirectory {
+public:
+    using Value = std::uint64_t;
+
+    explicit TokenDirectory(size_t capacity = 0);
+    ~TokenDirectory();
+    TokenDirectory(const TokenDirectory&) = delete;
+    TokenDirectory& operator=(const TokenDirectory&) = delete;
+
+    // false if the key is already present
+    bool Insert(const TokenKey& key, Value value);
+    bool Erase(const TokenKey& key);
+    void Reserve(size_t count);
+    std::optional<Value> Find(const TokenKey& key) const noexcept;
+
+    size_t Size() const noexcept {
+        return size_.load(std::memory_order_relaxed);
+    }
+private:
+    enum SlotState : std::uint32_t {
+        EMPTY,
+        LIVE,
+        ERASED
+    };
+
+    struct alignas(32) Slot {
+        // odd while a writer is updating the slot
+        std::atomic<std::uint32_t> seq {0};
+        std::atomic<std::uint32_t> state {EMPTY};
+        std::atomic<std::uint64_t> hi {0};
+        std::atomic<std::uint64_t> lo {0};
+        std::atomic<Value> value {0};
+    };
+
+    struct Table {
+        explicit Table(size_t capacity): slots(new Slot[capacity]), mask(capacity - 1) {}
+        std::unique_ptr<Slot[]> slots;
+        size_t mask;
+    };
+
+    struct alignas(64) ReaderCount {
+        std::atomic<std::int64_t> value {0};
+    };
+
+    // Pins the current table for the lifetime of a lookup
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const TokenDirectory& directory) noexcept;
+        ~ReadGuard();
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    private:
+        std::atomic<std::int64_t>* count_;
+    };
+
+    static void Store(Slot& slot, SlotState state, const TokenKey& key, Value value) noexcept;
+    void Rehash(size_t capacity);
+    void WaitForReaders() noexcept;
+
+    std::atomic<Table*> table_;
+    mutable std::atomic<std::uint64_t> epoch_ {0};
+    mutable std::array<ReaderCount, 2> readers_;
+    std::mutex write_mutex_;
+    std::atomic<size_t> size_ {0};
+    size_t erased_ = 0;
+};
+
+static_assert(DecodeToken("0123456789abcdef00000000000000ff")->hi == 0x0123456789abcdefull);
+static_assert(DecodeToken("0123456789abcdef00000000000000ff")->lo == 0xffull);
+static_assert(!DecodeToken("0123456789ABCDEF00000000000000ff").has_value());
+
+} // namespace token
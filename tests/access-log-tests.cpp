@@ -0,0 +1,95 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/access_log.h"
+
+using namespace std::literals;
+
+namespace {
+
+int CountSampled(const access_log::Sampler& sampler, size_t endpoint, int requests) {
+    int sampled = 0;
+    for (int i = 0; i < requests; ++i)
+        sampled += sampler.SampleRequest(endpoint);
+    return sampled;
+}
+
+} // namespace
+
+SCENARIO("Access log sampling") {
+    const auto state = access_log::EndpointOf(router::RouteId::State);
+    const auto join = access_log::EndpointOf(router::RouteId::Join);
+
+    GIVEN("default options") {
+        access_log::Sampler sampler;
+        THEN("every request and response is logged") {
+            CHECK(CountSampled(sampler, state, 1000) == 1000);
+            CHECK(CountSampled(sampler, access_log::STATIC_FILES, 1000) == 1000);
+            CHECK(sampler.KeepResponse(true, 200));
+            CHECK(sampler.KeepResponse(true, 404));
+        }
+    }
+
+    GIVEN("state polls sampled at 1% and successful responses at half") {
+        access_log::SamplingOptions options;
+        REQUIRE(access_log::ApplySamplingSpec(options, "state=0.01"sv));
+        REQUIRE(access_log::ApplySamplingSpec(options, "2xx=0.5"sv));
+        access_log::Sampler sampler {options};
+
+        THEN("about that share of state requests is logged") {
+            auto sampled = CountSampled(sampler, state, 100000);
+            CHECK(sampled > 800);
+            CHECK(sampled < 1200);
+        }
+        THEN("other endpoints are not affected") {
+            CHECK(CountSampled(sampler, join, 1000) == 1000);
+        }
+        THEN("successful responses of sampled requests are thinned out, other classes are not") {
+            int kept = 0;
+            for (int i = 0; i < 10000; ++i)
+                kept += sampler.KeepResponse(true, 200);
+            CHECK(kept > 4500);
+            CHECK(kept < 5500);
+            CHECK(sampler.KeepResponse(true, 404));
+        }
+        THEN("responses of requests left out are not logged") {
+            CHECK_FALSE(sampler.KeepResponse(false, 404));
+        }
+        THEN("server errors are always logged") {
+            CHECK(sampler.KeepResponse(false, 500));
+            CHECK(sampler.KeepResponse(false, 503));
+        }
+    }
+
+    GIVEN("an endpoint turned off") {
+        access_log::SamplingOptions options;
+        REQUIRE(access_log::ApplySamplingSpec(options, "static=0"sv));
+        access_log::Sampler sampler {options};
+        THEN("none of its requests are logged") {
+            CHECK(CountSampled(sampler, access_log::STATIC_FILES, 1000) == 0);
+        }
+    }
+
+    GIVEN("malformed specs") {
+        access_log::SamplingOptions options;
+        THEN("they are refused") {
+            CHECK_FALSE(access_log::ApplySamplingSpec(options, "state"sv));
+            CHECK_FALSE(access_log::ApplySamplingSpec(options, "state=2"sv));
+            CHECK_FALSE(access_log::ApplySamplingSpec(options, "state=-0.5"sv));
+            CHECK_FALSE(access_log::ApplySamplingSpec(options, "nowhere=0.5"sv));
+            CHECK_FALSE(access_log::ApplySamplingSpec(options, "6xx=0.5"sv));
+            CHECK_FALSE(access_log::ApplySamplingSpec(options, "5xx=0.5"sv));
+            CHECK(access_log::ApplySamplingSpec(options, "unknown=0.5"sv));
+        }
+    }
+}
+
+TEST_CASE("Access log sampling benchmark", "[.benchmark]") {
+    access_log::SamplingOptions options;
+    access_log::ApplySamplingSpec(options, "state=0.01"sv);
+    access_log::Sampler sampler {options};
+    const auto state = access_log::EndpointOf(router::RouteId::State);
+    BENCHMARK("sampling decision") {
+        return sampler.SampleRequest(state);
+    };
+}
@@ -0,0 +1,253 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <boost/beast/http.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/action_request.h"
+#include "../src/app.h"
+#include "../src/request_handler.h"
+
+using namespace std::literals;
+namespace http = boost::beast::http;
+namespace net = boost::asio;
+
+namespace {
+
+// Only allocations made on the measuring thread while it measures are counted
+thread_local bool counting = false;
+std::atomic<size_t> allocations {0};
+
+void* Allocate(size_t size, size_t alignment) {
+    if (counting)
+        ++allocations;
+    size = size == 0 ? 1 : size;
+    void* ptr = alignment <= alignof(std::max_align_t) ? std::malloc(size)
+            : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (!ptr)
+        throw std::bad_alloc{};
+    return ptr;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    return Allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+struct PlayersFixture {
+    model::Map map = [] {
+        model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 3.0, 3, "{}"s};
+        map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 10, 0});
+        return map;
+    }();
+    loot_gen::LootGenerator loot_generator;
+    model::GameSession session{model::GameSession::Id{0u}, map, loot_generator};
+    app::Players players;
+};
+
+// The action route never reaches the database
+struct NoDatabase: database::PlayerStore {
+    std::vector<model::DogInfo> GetPlayers(int, int) override {
+        return {};
+    }
+    void SavePlayers(const std::vector<model::DogInfo>&) override {}
+};
+
+// A request handler with one joined player. Requests run on this thread, the API strand included,
+// from the handler's entry to the response reaching the session.
+class ActionRoute {
+public:
+    ActionRoute() {
+        logger::SetLoggingEnabled(false);
+        model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 3.0, 3, "{}"s};
+        map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 10, 0});
+        game_.AddMap(map);
+        handler_ = std::make_shared<http_handler::RequestHandler>(game_, db_, ""s, strand_, true, false,
+                                                                  compression::Options{}, file_cache::CacheMode::Off);
+        http_handler::StringRequest join {http::verb::post, "/api/v1/game/join", 11};
+        join.set(http::field::content_type, "application/json");
+        join.body() = R"({"userName":"Rex","mapId":"map1"})";
+        REQUIRE(Run(std::move(join)).status == 200);
+        token_ = handler_->GetPlayers().front().GetToken();
+    }
+    ~ActionRoute() {
+        logger::SetLoggingEnabled(true);
+    }
+
+    struct Result {
+        unsigned status = 0;
+        // Header fields of the response, beast allocates each one
+        size_t fields = 0;
+        size_t allocations = 0;
+    };
+
+    http_handler::StringRequest Action(std::string_view move, std::string_view token = {}) const {
+        http_handler::StringRequest req {http::verb::post, "/api/v1/game/player/action", 11};
+        req.set(http::field::authorization, "Bearer "s + std::string{token.empty() ? token_ : token});
+        req.set(http::field::content_type, "application/json");
+        req.body() = R"({"move":")"s + std::string{move} + R"("})"s;
+        return req;
+    }
+    Result Run(http_handler::StringRequest&& req) {
+        result_ = {};
+        net::post(ioc_, [this, &req] {
+            allocations = 0;
+            counting = true;
+            (*handler_)(std::move(req), Send{this});
+        });
+        ioc_.restart();
+        ioc_.run();
+        return result_;
+    }
+    model::Direction DogDirection() {
+        const auto& player = handler_->GetPlayers().front();
+        return game_.FindDog(player.GetDogId(), player.GetSessionId())->GetDir();
+    }
+private:
+    struct Send {
+        ActionRoute* route;
+
+        template <typename Response>
+        void operator()(Response&& res, std::uint32_t) const {
+            counting = false;
+            route->result_ = {res.result_int(), static_cast<size_t>(std::distance(res.begin(), res.end())),
+                              allocations.load()};
+        }
+    };
+
+    model::Game game_;
+    NoDatabase db_;
+    net::io_context ioc_;
+    http_handler::RequestHandler::Strand strand_ = net::make_strand(ioc_);
+    std::shared_ptr<http_handler::RequestHandler> handler_;
+    std::string token_;
+    Result result_;
+};
+
+}  // namespace
+
+SCENARIO("Move request body parsing") {
+    GIVEN("well-formed bodies") {
+        THEN("the direction is recognized") {
+            CHECK(action_request::ParseMove(R"({"move":"L"})") == model::Direction::WEST);
+            CHECK(action_request::ParseMove(R"( { "move" : "U" } )") == model::Direction::NORTH);
+            CHECK(action_request::ParseMove(R"({"move":""})") == model::Direction::STOP);
+            CHECK(action_request::ParseMove(R"({"extra":"x","move":"D"})") == model::Direction::SOUTH);
+        }
+        THEN("shapes the scanner skips are handled by the full parser") {
+            CHECK(action_request::ParseMove(R"({"m\u006fve":"R"})") == model::Direction::EAST);
+            CHECK(action_request::ParseMove(R"({"move":"R","meta":{"seq":1}})") == model::Direction::EAST);
+        }
+    }
+    GIVEN("malformed bodies") {
+        THEN("they are rejected") {
+            CHECK_FALSE(action_request::ParseMove("").has_value());
+            CHECK_FALSE(action_request::ParseMove("{}").has_value());
+            CHECK_FALSE(action_request::ParseMove(R"({"move":"X"})").has_value());
+            CHECK_FALSE(action_request::ParseMove(R"({"move":1})").has_value());
+            CHECK_FALSE(action_request::ParseMove(R"({"move":"L"} x)").has_value());
+            CHECK_FALSE(action_request::ParseMove(R"({"move":"L")").has_value());
+            CHECK_FALSE(action_request::ParseMove(R"(["move","L"])").has_value());
+        }
+    }
+}
+
+SCENARIO("Authorization header parsing") {
+    GIVEN("header values") {
+        THEN("only a bearer token of the right length is accepted") {
+            CHECK(action_request::ExtractBearerToken("Bearer 0123456789abcdef0123456789abcdef") ==
+                  "0123456789abcdef0123456789abcdef"sv);
+            CHECK_FALSE(action_request::ExtractBearerToken("Bearer 0123456789abcdef").has_value());
+            CHECK_FALSE(action_request::ExtractBearerToken("Basic 0123456789abcdef0123456789abcdef").has_value());
+        }
+    }
+}
+
+SCENARIO("Action request hot path") {
+    // The operation asio allocates to start the idle strand, outside this code
+    constexpr size_t STRAND_ALLOCATIONS = 1;
+    // The JSON error body, longer than a short string
+    constexpr size_t ERROR_BODY_ALLOCATIONS = 1;
+    constexpr auto UNKNOWN_TOKEN = "ffffffffffffffffffffffffffffffff"sv;
+
+    GIVEN("a joined player and a request handler past its first responses") {
+        ActionRoute route;
+        // The first response of each status class allocates its latency histogram
+        REQUIRE(route.Run(route.Action("R")).status == 200);
+        REQUIRE(route.Run(route.Action("D")).status == 200);
+        REQUIRE(route.Run(route.Action("L", UNKNOWN_TOKEN)).status == 401);
+
+        WHEN("an action goes through the whole route") {
+            auto result = route.Run(route.Action("L"));
+
+            THEN("the dog turns, allocating only the response headers and the strand start") {
+                CHECK(result.status == 200);
+                CHECK(route.DogDirection() == model::Direction::WEST);
+                CHECK(result.fields == 5);
+                CHECK(result.allocations == result.fields + STRAND_ALLOCATIONS);
+            }
+        }
+        WHEN("the token is unknown") {
+            auto result = route.Run(route.Action("L", UNKNOWN_TOKEN));
+
+            THEN("it is rejected before the strand, allocating only the response") {
+                CHECK(result.status == 401);
+                CHECK(route.DogDirection() != model::Direction::WEST);
+                CHECK(result.allocations == result.fields + ERROR_BODY_ALLOCATIONS);
+            }
+        }
+    }
+}
+
+SCENARIO_METHOD(PlayersFixture, "Players of different sessions") {
+    GIVEN("two sessions whose first dogs both have id 0") {
+        model::GameSession other{model::GameSession::Id{1u}, map, loot_generator};
+        auto first_id = session.AddDog("Rex"s);
+        auto second_id = other.AddDog("Max"s);
+        REQUIRE(first_id == second_id);
+        auto [first, first_token] = players.AddPlayer(first_id, session);
+        auto [second, second_token] = players.AddPlayer(second_id, other);
+
+        THEN("each token finds the player of its own session") {
+            CHECK(players.FindByToken(first_token)->GetSessionId() == session.GetId());
+            CHECK(players.FindByToken(second_token)->GetSessionId() == other.GetId());
+        }
+        WHEN("the second player moves") {
+            players.FindByToken(second_token)->setDogSpeed(model::Direction::WEST);
+            THEN("only its own dog turns") {
+                CHECK(other.FindDog(second_id)->GetDir() == model::Direction::WEST);
+                CHECK(session.FindDog(first_id)->GetDir() != model::Direction::WEST);
+            }
+        }
+        WHEN("the first player retires") {
+            players.DeletePLayer({first_id, session.GetId()});
+            THEN("the second one is still there") {
+                CHECK(players.FindByToken(first_token) == nullptr);
+                CHECK(players.FindByToken(second_token) != nullptr);
+            }
+        }
+    }
+}
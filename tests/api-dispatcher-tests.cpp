@@ -0,0 +1,104 @@
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/api_dispatcher.h"
+
+using namespace std::literals;
+namespace net = boost::asio;
+using api_dispatcher::Priority;
+
+SCENARIO("Priority dispatcher") {
+    net::io_context ioc;
+    auto strand = net::make_strand(ioc);
+    std::vector<std::string> order;
+    auto task = [&order](std::string name) {
+        return [&order, name = std::move(name)] {
+            order.push_back(name);
+        };
+    };
+
+    GIVEN("queued records views followed by movement input") {
+        api_dispatcher::PriorityDispatcher dispatcher {strand};
+        for (int i = 0; i < 3; ++i)
+            REQUIRE(dispatcher.Post(Priority::Low, task("records"s + std::to_string(i))));
+        REQUIRE(dispatcher.Post(Priority::Normal, task("state")));
+        REQUIRE(dispatcher.Post(Priority::High, task("action")));
+        CHECK(dispatcher.Queued() == 5);
+
+        WHEN("the strand runs") {
+            ioc.run();
+            THEN("higher classes go first and each class stays FIFO") {
+                CHECK(order == std::vector<std::string>{"action", "state", "records0", "records1", "records2"});
+                CHECK(dispatcher.Queued() == 0);
+            }
+            THEN("queue waits are recorded per class") {
+                auto stats = dispatcher.Stats();
+                CHECK(stats[0].dispatched == 1);
+                CHECK(stats[1].dispatched == 1);
+                CHECK(stats[2].dispatched == 3);
+                CHECK(stats[2].max_wait_us >= stats[2].total_wait_us / 3);
+            }
+        }
+    }
+
+    GIVEN("a flood of high priority work") {
+        api_dispatcher::Options options;
+        options.max_skips = 2;
+        api_dispatcher::PriorityDispatcher dispatcher {strand, options};
+        REQUIRE(dispatcher.Post(Priority::Low, task("join")));
+        for (int i = 0; i < 6; ++i)
+            REQUIRE(dispatcher.Post(Priority::High, task("action")));
+
+        WHEN("the strand runs") {
+            ioc.run();
+            THEN("the low class is not starved") {
+                CHECK(order == std::vector<std::string>{"action", "action", "join", "action", "action", "action", "action"});
+            }
+        }
+    }
+
+    GIVEN("bounded queues") {
+        api_dispatcher::Options options;
+        options.queue_capacity = 2;
+        options.max_queued = 3;
+        api_dispatcher::PriorityDispatcher dispatcher {strand, options};
+
+        THEN("a full class refuses new tasks without affecting the others") {
+            CHECK(dispatcher.Post(Priority::Low, task("records")));
+            CHECK(dispatcher.Post(Priority::Low, task("records")));
+            CHECK_FALSE(dispatcher.Post(Priority::Low, task("records")));
+            CHECK(dispatcher.Post(Priority::High, task("action")));
+            CHECK(dispatcher.Stats()[2].rejected == 1);
+        }
+        THEN("the total bound applies across classes") {
+            CHECK(dispatcher.Post(Priority::Low, task("records")));
+            CHECK(dispatcher.Post(Priority::Normal, task("state")));
+            CHECK(dispatcher.Post(Priority::High, task("action")));
+            CHECK_FALSE(dispatcher.Post(Priority::High, task("action")));
+            ioc.run();
+            CHECK(order.size() == 3);
+        }
+    }
+
+    GIVEN("a move-only task and one larger than the task buffer") {
+        api_dispatcher::PriorityDispatcher dispatcher {strand};
+        auto name = std::make_unique<std::string>("move-only");
+        REQUIRE(dispatcher.Post(Priority::Normal, [&order, name = std::move(name)] {
+            order.push_back(*name);
+        }));
+        std::array<char, api_dispatcher::Task::CAPACITY + 1> padding {'l', 'a', 'r', 'g', 'e'};
+        REQUIRE(dispatcher.Post(Priority::Normal, [&order, padding] {
+            order.emplace_back(padding.data());
+        }));
+
+        WHEN("the strand runs") {
+            ioc.run();
+            THEN("both run, in order") {
+                CHECK(order == std::vector<std::string>{"move-only", "large"});
+            }
+        }
+    }
+}
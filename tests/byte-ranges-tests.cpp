@@ -0,0 +1,134 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/byte_ranges.h"
+#include "../src/http_conditional.h"
+
+using namespace std::literals;
+using byte_ranges::ParseRange;
+using byte_ranges::RangeStatus;
+
+namespace {
+
+std::vector<std::pair<std::uint64_t, std::uint64_t>> Spans(const std::vector<byte_ranges::ByteRange>& ranges) {
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> spans;
+    for (const auto& range: ranges)
+        spans.emplace_back(range.offset, range.length);
+    return spans;
+}
+
+using Spanned = std::vector<std::pair<std::uint64_t, std::uint64_t>>;
+
+}  // namespace
+
+SCENARIO("Range header parsing") {
+    GIVEN("a representation of 1000 bytes") {
+        constexpr std::uint64_t size = 1000;
+
+        THEN("closed ranges are clipped to the representation") {
+            auto [status, ranges] = ParseRange("bytes=0-99", size);
+            CHECK(status == RangeStatus::Satisfiable);
+            CHECK(Spans(ranges) == Spanned{{0, 100}});
+            CHECK(Spans(ParseRange("bytes=990-2000", size).second) == Spanned{{990, 10}});
+            CHECK(Spans(ParseRange("Bytes= 5-5 ", size).second) == Spanned{{5, 1}});
+        }
+        THEN("open-ended ranges run to the end") {
+            CHECK(Spans(ParseRange("bytes=900-", size).second) == Spanned{{900, 100}});
+            CHECK(Spans(ParseRange("bytes=999-", size).second) == Spanned{{999, 1}});
+        }
+        THEN("suffix ranges take the last bytes, at most all of them") {
+            CHECK(Spans(ParseRange("bytes=-100", size).second) == Spanned{{900, 100}});
+            CHECK(Spans(ParseRange("bytes=-5000", size).second) == Spanned{{0, 1000}});
+        }
+        THEN("several ranges are kept in order") {
+            auto [status, ranges] = ParseRange("bytes=0-9, 20-29,-10", size);
+            CHECK(status == RangeStatus::Satisfiable);
+            CHECK(Spans(ranges) == Spanned{{0, 10}, {20, 10}, {990, 10}});
+        }
+        THEN("ranges past the end are unsatisfiable, unless another one is not") {
+            CHECK(ParseRange("bytes=1000-", size).first == RangeStatus::Unsatisfiable);
+            CHECK(ParseRange("bytes=1000-1999", size).first == RangeStatus::Unsatisfiable);
+            CHECK(ParseRange("bytes=-0", size).first == RangeStatus::Unsatisfiable);
+            CHECK(Spans(ParseRange("bytes=1000-, 0-0", size).second) == Spanned{{0, 1}});
+        }
+        THEN("more than 16 ranges make the header ignored") {
+            std::string header = "bytes=0-0";
+            for (int i = 1; i < 16; ++i)
+                header += "," + std::to_string(i * 10) + "-" + std::to_string(i * 10);
+            CHECK(ParseRange(header, size).first == RangeStatus::Satisfiable);
+            CHECK(ParseRange(header + ",500-500", size).first == RangeStatus::Ignored);
+            CHECK(ParseRange(header + ",500-500", size, 17).first == RangeStatus::Satisfiable);
+        }
+        THEN("malformed headers and other units are ignored") {
+            for (auto header: {""sv, "bytes="sv, "bytes=,"sv, "items=0-1"sv, "bytes 0-1"sv, "bytes=0"sv,
+                               "bytes=a-1"sv, "bytes=1-a"sv, "bytes=5-2"sv, "bytes=--1"sv, "bytes=0-1,x"sv}) {
+                CAPTURE(header);
+                CHECK(ParseRange(header, size).first == RangeStatus::Ignored);
+            }
+        }
+    }
+    GIVEN("an empty representation") {
+        THEN("no range can be satisfied") {
+            CHECK(ParseRange("bytes=0-", 0).first == RangeStatus::Unsatisfiable);
+            CHECK(ParseRange("bytes=0-0", 0).first == RangeStatus::Unsatisfiable);
+            CHECK(ParseRange("bytes=-1", 0).first == RangeStatus::Unsatisfiable);
+            CHECK(ParseRange("bytes=x", 0).first == RangeStatus::Ignored);
+        }
+    }
+}
+
+SCENARIO("Ranges body") {
+    GIVEN("one range") {
+        byte_ranges::RangesBody::value_type body;
+        auto content_type = byte_ranges::MakeRangesBody(body, {{10, 5}}, "text/plain", 100);
+        THEN("it is sent as is, with the representation's type") {
+            CHECK(content_type == "text/plain");
+            CHECK(byte_ranges::RangesBody::size(body) == 5);
+            CHECK(byte_ranges::ContentRange({10, 5}, 100) == "bytes 10-14/100");
+        }
+    }
+    GIVEN("several ranges") {
+        byte_ranges::RangesBody::value_type body;
+        auto content_type = byte_ranges::MakeRangesBody(body, {{0, 5}, {50, 5}}, "text/plain", 100);
+        THEN("they become multipart/byteranges parts, each with its Content-Range") {
+            REQUIRE(content_type.starts_with("multipart/byteranges; boundary="));
+            auto boundary = content_type.substr(content_type.find('=') + 1);
+            REQUIRE(body.parts.size() == 2);
+            CHECK(body.parts[0].header.starts_with("--" + boundary + "\r\n"));
+            CHECK(body.parts[1].header.find("Content-Range: bytes 50-54/100\r\n") != std::string::npos);
+            CHECK(body.trailer == "\r\n--" + boundary + "--\r\n");
+            CHECK(byte_ranges::RangesBody::size(body) ==
+                  body.parts[0].header.size() + body.parts[1].header.size() + 10 + body.trailer.size());
+        }
+    }
+}
+
+SCENARIO("If-Range") {
+    using http_conditional::IfRangeMatches;
+    const auto modified = std::chrono::system_clock::from_time_t(784111777);
+    const auto date = "Sun, 06 Nov 1994 08:49:37 GMT"sv;
+    const auto etag = R"("0123-4567")"sv;
+
+    GIVEN("no If-Range") {
+        THEN("the range is honored") {
+            CHECK(IfRangeMatches({}, etag, modified));
+        }
+    }
+    GIVEN("an entity tag") {
+        THEN("only the same strong tag matches") {
+            CHECK(IfRangeMatches(etag, etag, modified));
+            CHECK_FALSE(IfRangeMatches(R"("0123-4568")", etag, modified));
+            CHECK_FALSE(IfRangeMatches("W/"s + std::string{etag}, etag, modified));
+            CHECK_FALSE(IfRangeMatches(etag, "W/"s + std::string{etag}, modified));
+            CHECK_FALSE(IfRangeMatches(etag, {}, modified));
+        }
+    }
+    GIVEN("an HTTP-date") {
+        THEN("only the exact modification time, to the second, matches") {
+            CHECK(IfRangeMatches(date, etag, modified));
+            CHECK(IfRangeMatches(date, {}, modified + 500ms));
+            CHECK_FALSE(IfRangeMatches(date, etag, modified + 1s));
+            CHECK_FALSE(IfRangeMatches(date, etag, modified - 1s));
+            CHECK_FALSE(IfRangeMatches("yesterday", etag, modified));
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/compression.h"
+
+#include <zlib.h>
+
+using namespace std::literals;
+using compression::Encoding;
+
+namespace {
+
+// Window bits as the stream was written: 15 for a zlib (deflate) stream, 15 + 16 for gzip
+std::string Inflate(std::string_view data, int window_bits) {
+    z_stream stream {};
+    REQUIRE(inflateInit2(&stream, window_bits) == Z_OK);
+    std::string out(1 << 20, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+    auto result = inflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    REQUIRE(result == Z_STREAM_END);
+    return out;
+}
+
+} // namespace
+
+SCENARIO("Accept-Encoding negotiation") {
+    using compression::ChooseEncoding;
+
+    GIVEN("codings without q-values") {
+        THEN("gzip wins over deflate, whatever the order") {
+            CHECK(ChooseEncoding("gzip") == Encoding::Gzip);
+            CHECK(ChooseEncoding("deflate") == Encoding::Deflate);
+            CHECK(ChooseEncoding("deflate, gzip") == Encoding::Gzip);
+            CHECK(ChooseEncoding("x-gzip") == Encoding::Gzip);
+            CHECK(ChooseEncoding("GZip") == Encoding::Gzip);
+        }
+        THEN("an empty or unknown list means identity") {
+            CHECK(ChooseEncoding("") == Encoding::Identity);
+            CHECK(ChooseEncoding("br, zstd") == Encoding::Identity);
+            CHECK(ChooseEncoding("identity") == Encoding::Identity);
+        }
+    }
+    GIVEN("q-values") {
+        THEN("the higher one wins") {
+            CHECK(ChooseEncoding("gzip;q=0.5, deflate") == Encoding::Deflate);
+            CHECK(ChooseEncoding("gzip;q=0.8, deflate;q=0.9") == Encoding::Deflate);
+            CHECK(ChooseEncoding("gzip; q=0.9 , deflate;q=0.1") == Encoding::Gzip);
+            CHECK(ChooseEncoding("gzip;Q=1.0, deflate;q=1") == Encoding::Gzip);
+        }
+        THEN("q=0 rules a coding out") {
+            CHECK(ChooseEncoding("gzip;q=0") == Encoding::Identity);
+            CHECK(ChooseEncoding("gzip;q=0, deflate") == Encoding::Deflate);
+            CHECK(ChooseEncoding("gzip;q=0.000, deflate;q=0") == Encoding::Identity);
+        }
+        THEN("a malformed q-value rules a coding out") {
+            CHECK(ChooseEncoding("gzip;q=high, deflate;q=0.1") == Encoding::Deflate);
+        }
+    }
+    GIVEN("a wildcard") {
+        THEN("it stands for the codings not named") {
+            CHECK(ChooseEncoding("*") == Encoding::Gzip);
+            CHECK(ChooseEncoding("gzip;q=0, *") == Encoding::Deflate);
+            CHECK(ChooseEncoding("*;q=0.5, deflate") == Encoding::Deflate);
+            CHECK(ChooseEncoding("*;q=0") == Encoding::Identity);
+            CHECK(ChooseEncoding("*;q=0, gzip") == Encoding::Gzip);
+        }
+        THEN("identity next to it changes nothing") {
+            CHECK(ChooseEncoding("identity, *;q=0") == Encoding::Identity);
+            CHECK(ChooseEncoding("identity;q=1, *;q=0.5") == Encoding::Gzip);
+        }
+    }
+}
+
+SCENARIO("Response compression") {
+    std::string body;
+    for (int i = 0; i < 1000; ++i)
+        body += R"({"id":"dog)" + std::to_string(i) + R"(","pos":[1.5,2.5]},)";
+
+    GIVEN("a body compressed with gzip and deflate") {
+        auto gzip = compression::Compress(body, Encoding::Gzip, 6);
+        auto deflate = compression::Compress(body, Encoding::Deflate, 6);
+        THEN("both inflate back to the body and are smaller") {
+            CHECK(gzip.size() < body.size());
+            CHECK(deflate.size() < body.size());
+            CHECK(Inflate(gzip, 15 + 16) == body);
+            CHECK(Inflate(deflate, 15) == body);
+        }
+        THEN("the gzip stream has the gzip header") {
+            REQUIRE(gzip.size() > 2);
+            CHECK(static_cast<unsigned char>(gzip[0]) == 0x1f);
+            CHECK(static_cast<unsigned char>(gzip[1]) == 0x8b);
+        }
+        AND_WHEN("the thread's streams are reused at another level") {
+            auto again = compression::Compress(body, Encoding::Gzip, 6);
+            auto fast = compression::Compress(body, Encoding::Gzip, 1);
+            THEN("every stream starts over") {
+                CHECK(again == gzip);
+                CHECK(Inflate(fast, 15 + 16) == body);
+                CHECK(Inflate(compression::Compress("", Encoding::Deflate, 1), 15).empty());
+            }
+        }
+    }
+
+    GIVEN("the decision for a handler's response") {
+        using compression::Decide;
+        const compression::Options options {6, 1024};
+
+        THEN("compressible bodies past the minimum size are compressed, with Vary") {
+            auto decision = Decide("application/json", false, 1024, Encoding::Gzip, options);
+            CHECK(decision.vary);
+            CHECK(decision.compress);
+        }
+        THEN("short bodies and identity clients still get Vary") {
+            auto small = Decide("application/json", false, 1023, Encoding::Gzip, options);
+            CHECK(small.vary);
+            CHECK_FALSE(small.compress);
+            auto identity = Decide("text/html", false, 4096, Encoding::Identity, options);
+            CHECK(identity.vary);
+            CHECK_FALSE(identity.compress);
+        }
+        THEN("a disabled level compresses nothing") {
+            auto decision = Decide("application/json", false, 4096, Encoding::Gzip, {0, 1024});
+            CHECK(decision.vary);
+            CHECK_FALSE(decision.compress);
+        }
+        THEN("bodies that are not compressible or already encoded are left alone") {
+            auto image = Decide("image/png", false, 4096, Encoding::Gzip, options);
+            CHECK_FALSE(image.vary);
+            CHECK_FALSE(image.compress);
+            auto encoded = Decide("application/json", true, 4096, Encoding::Gzip, options);
+            CHECK_FALSE(encoded.vary);
+            CHECK_FALSE(encoded.compress);
+        }
+    }
+}
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/db_writer.h"
+
+using namespace std::literals;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Stands in for the database: keeps the committed batches, fails or stalls on demand
+class FakeDatabase {
+public:
+    void Save(const std::vector<model::DogInfo>& batch) {
+        std::unique_lock lock {mutex_};
+        changed_.wait(lock, [this] {
+            return !stalled_;
+        });
+        if (failing_)
+            throw std::runtime_error("connection refused");
+        batches_.push_back(batch.size());
+        for (const auto& record: batch)
+            names_.push_back(record.name_);
+        changed_.notify_all();
+    }
+    db_writer::WriteBehind::Sink Sink() {
+        return [this](const auto& batch) {
+            Save(batch);
+        };
+    }
+    void SetFailing(bool failing) {
+        std::lock_guard lock {mutex_};
+        failing_ = failing;
+    }
+    void SetStalled(bool stalled) {
+        {
+            std::lock_guard lock {mutex_};
+            stalled_ = stalled;
+        }
+        changed_.notify_all();
+    }
+    // Waits up to a second for that many records
+    bool WaitFor(size_t records) {
+        std::unique_lock lock {mutex_};
+        return changed_.wait_for(lock, 1s, [this, records] {
+            return names_.size() >= records;
+        });
+    }
+    std::vector<size_t> Batches() {
+        std::lock_guard lock {mutex_};
+        return batches_;
+    }
+    std::vector<std::string> Names() {
+        std::lock_guard lock {mutex_};
+        return names_;
+    }
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool failing_ = false;
+    bool stalled_ = false;
+    std::vector<size_t> batches_;
+    std::vector<std::string> names_;
+};
+
+std::vector<model::DogInfo> Players(size_t count, size_t first = 0) {
+    std::vector<model::DogInfo> players;
+    for (size_t i = first; i < first + count; ++i)
+        players.emplace_back(static_cast<std::uint32_t>(i), "Dog "s + std::to_string(i), i * 10, i * 1000);
+    return players;
+}
+
+template <typename Predicate>
+bool Eventually(Predicate predicate) {
+    for (int i = 0; i < 1000; ++i) {
+        if (predicate())
+            return true;
+        std::this_thread::sleep_for(1ms);
+    }
+    return false;
+}
+
+}  // namespace
+
+SCENARIO("Write-behind database queue") {
+    FakeDatabase db;
+    const auto spill_path = (fs::temp_directory_path() / "db-writer-tests.spill").string();
+    fs::remove(spill_path);
+    fs::remove(spill_path + ".replay");
+
+    GIVEN("batches of three and a long delay") {
+        db_writer::WriteBehind writer {db.Sink(), {100, 3, 10s}};
+        WHEN("seven players retire one by one") {
+            for (auto& player: Players(7))
+                writer.Push({player});
+            THEN("full batches are committed at once, the rest at shutdown") {
+                REQUIRE(db.WaitFor(6));
+                CHECK(db.Batches() == std::vector<size_t>{3, 3});
+                writer.Shutdown();
+                CHECK(db.Batches() == std::vector<size_t>{3, 3, 1});
+                auto stats = writer.GetStats();
+                CHECK(stats.committed == 7);
+                CHECK(stats.batches == 3);
+                CHECK(stats.queued == 0);
+                CHECK(stats.commit_duration.count == 3);
+            }
+        }
+        WHEN("nobody retires") {
+            writer.Push({});
+            writer.Shutdown();
+            THEN("nothing is written") {
+                CHECK(db.Batches().empty());
+            }
+        }
+    }
+
+    GIVEN("large batches and a short delay") {
+        db_writer::WriteBehind writer {db.Sink(), {100, 100, 20ms}};
+        const auto start = std::chrono::steady_clock::now();
+        writer.Push(Players(2));
+        THEN("a batch that does not fill up is committed after the delay") {
+            REQUIRE(db.WaitFor(2));
+            CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+            CHECK(db.Batches() == std::vector<size_t>{2});
+        }
+    }
+
+    GIVEN("a database outage and a spill file") {
+        db.SetFailing(true);
+        db_writer::Options options {100, 2, 1ms};
+        options.spill_path = spill_path;
+        options.retry_delay = 20ms;
+        db_writer::WriteBehind writer {db.Sink(), options};
+        writer.Push(Players(3));
+        writer.Push(Players(2, 3));
+
+        THEN("the players are spilled to disk") {
+            REQUIRE(Eventually([&writer] { return writer.GetStats().spilled == 5; }));
+            CHECK(writer.GetStats().failed_commits >= 1);
+            CHECK(db.Names().empty());
+        }
+        WHEN("the database comes back") {
+            REQUIRE(Eventually([&writer] { return writer.GetStats().spilled == 5; }));
+            db.SetFailing(false);
+            THEN("the spilled players are committed once each and the spill file goes") {
+                REQUIRE(db.WaitFor(5));
+                REQUIRE(Eventually([&writer] { return writer.GetStats().replayed == 5; }));
+                auto names = db.Names();
+                std::sort(names.begin(), names.end());
+                CHECK(names == std::vector{"Dog 0"s, "Dog 1"s, "Dog 2"s, "Dog 3"s, "Dog 4"s});
+                CHECK(Eventually([&spill_path] { return !fs::exists(spill_path); }));
+            }
+        }
+        WHEN("the server stops during the outage") {
+            writer.Push(Players(1, 5));
+            writer.Shutdown();
+            THEN("everything is in the spill file, for the next run to write") {
+                std::ifstream in {spill_path, std::ios::binary};
+                CHECK(db_writer::ReadSpill(in).size() == 6);
+                in.close();
+
+                db.SetFailing(false);
+                db_writer::WriteBehind next {db.Sink(), options};
+                REQUIRE(db.WaitFor(6));
+                next.Shutdown();
+                CHECK(next.GetStats().replayed == 6);
+                CHECK_FALSE(fs::exists(spill_path));
+            }
+        }
+    }
+
+    GIVEN("a spill file whose replay fails half-way, with the spill file unwritable by then") {
+        {
+            std::ofstream out {spill_path, std::ios::binary};
+            db_writer::WriteSpill(out, Players(4));
+        }
+        std::atomic<int> calls = 0;
+        std::atomic<bool> down = true;
+        db_writer::Options options {100, 2, 1ms};
+        options.spill_path = spill_path;
+        options.retry_delay = 5ms;
+        db_writer::WriteBehind writer {[&](const std::vector<model::DogInfo>& batch) {
+            // The first batch goes in, then a directory takes the spill file's place
+            if (++calls == 2)
+                fs::create_directory(spill_path);
+            if (calls > 1 && down)
+                throw std::runtime_error("connection refused");
+            db.Save(batch);
+        }, options};
+
+        WHEN("the failed rest cannot be spilled") {
+            REQUIRE(Eventually([&calls] { return calls >= 3; }));
+            THEN("the replay file is kept, holding the players not yet committed") {
+                std::ifstream in {spill_path + ".replay", std::ios::binary};
+                auto kept = db_writer::ReadSpill(in);
+                REQUIRE(kept.size() == 2);
+                CHECK(kept[0].name_ == "Dog 2");
+                CHECK(kept[1].name_ == "Dog 3");
+                CHECK(writer.GetStats().replayed == 2);
+            }
+            AND_WHEN("the database comes back") {
+                fs::remove(spill_path);
+                down = false;
+                THEN("every player is committed once") {
+                    REQUIRE(Eventually([&writer] { return writer.GetStats().replayed == 4; }));
+                    CHECK(db.Names() == std::vector{"Dog 0"s, "Dog 1"s, "Dog 2"s, "Dog 3"s});
+                    CHECK(Eventually([&spill_path] { return !fs::exists(spill_path + ".replay"); }));
+                }
+            }
+        }
+        writer.Shutdown();
+        fs::remove(spill_path);
+    }
+
+    GIVEN("a database outage, no spill file and a drop overflow policy") {
+        db.SetFailing(true);
+        db_writer::Options options {4, 2, 1ms, db_writer::OverflowPolicy::Drop};
+        options.retry_delay = 10s;
+        db_writer::WriteBehind writer {db.Sink(), options};
+        writer.Push(Players(2));
+        REQUIRE(Eventually([&writer] { return writer.GetStats().failed_commits == 1; }));
+
+        WHEN("more players retire than the queue holds") {
+            writer.Push(Players(6, 2));
+            THEN("the failed batch holds up the queue and the overflow is dropped") {
+                auto stats = writer.GetStats();
+                CHECK(stats.queued == 4);
+                CHECK(stats.dropped == 2);
+            }
+            THEN("shutdown writes what was kept once the database is back") {
+                db.SetFailing(false);
+                writer.Shutdown();
+                CHECK(db.Names().size() == 6);
+                CHECK(writer.GetStats().committed == 6);
+            }
+        }
+    }
+
+    GIVEN("a stalled database and a block overflow policy") {
+        db.SetStalled(true);
+        db_writer::WriteBehind writer {db.Sink(), {2, 2, 1ms, db_writer::OverflowPolicy::Block}};
+        writer.Push(Players(2));
+        REQUIRE(Eventually([&writer] { return writer.GetStats().queued == 0; }));
+        writer.Push(Players(2, 2));
+
+        WHEN("one more player retires") {
+            std::atomic<bool> pushed = false;
+            std::thread producer {[&] {
+                writer.Push(Players(1, 4));
+                pushed = true;
+            }};
+            std::this_thread::sleep_for(50ms);
+            const bool waited = !pushed;
+            db.SetStalled(false);
+            producer.join();
+            THEN("the push waits for room, and nothing is lost") {
+                CHECK(waited);
+                writer.Shutdown();
+                CHECK(db.Names().size() == 5);
+                CHECK(writer.GetStats().dropped == 0);
+                // The stalled commit is timed on the writer thread, not on the pushing one
+                CHECK(writer.GetStats().commit_duration.max_us >= 50'000);
+            }
+        }
+    }
+
+    GIVEN("spilling overflow without a spill file") {
+        THEN("the writer refuses the options") {
+            CHECK_THROWS_AS((db_writer::WriteBehind{db.Sink(), {4, 2, 1ms, db_writer::OverflowPolicy::Spill}}),
+                            std::invalid_argument);
+        }
+    }
+
+    fs::remove(spill_path);
+    fs::remove(spill_path + ".replay");
+}
+
+SCENARIO("Spill file format") {
+    GIVEN("players with awkward names") {
+        std::vector<model::DogInfo> players {{0, "Rex"s, 10, 1000}, {0, "two words\nand a line"s, 0, 5}, {0, ""s, 3, 7}};
+        std::stringstream spill;
+        db_writer::WriteSpill(spill, players);
+
+        THEN("they read back as written") {
+            auto read = db_writer::ReadSpill(spill);
+            REQUIRE(read.size() == 3);
+            for (size_t i = 0; i < players.size(); ++i) {
+                CHECK(read[i].name_ == players[i].name_);
+                CHECK(read[i].score_ == players[i].score_);
+                CHECK(read[i].playing_time_ == players[i].playing_time_);
+            }
+        }
+        WHEN("the file was cut off in the middle of a record") {
+            auto data = spill.str();
+            std::stringstream cut {data.substr(0, data.size() - 5)};
+            THEN("the complete records are read") {
+                CHECK(db_writer::ReadSpill(cut).size() == 2);
+            }
+        }
+    }
+}
@@ -0,0 +1,266 @@
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/model.h"
+#include "../src/model_serialization.h"
+
+using namespace std::literals;
+using model::Direction;
+
+namespace {
+
+// A square of roads 20 across with a road through the middle, all crossing
+model::Map MakeMap() {
+    model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 4.0, 3, "{}"s};
+    map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 20, 0});
+    map.AddRoad({model::Road::VERTICAL, {0, 0}, 20, 1});
+    map.AddRoad({model::Road::VERTICAL, {10, 0}, 20, 2});
+    map.AddRoad({model::Road::HORIZONTAL, {0, 20}, 20, 3});
+    map.AddRoad({model::Road::VERTICAL, {20, 0}, 20, 4});
+    map.FillIntersections();
+    map.AddOffice(model::Office{model::Office::Id{"o0"s}, {15, 20}, {0, 0}});
+    map.SetLootTypes(2);
+    map.AddObject(0, 10);
+    map.AddObject(1, 20);
+    return map;
+}
+
+struct Command {
+    int at;
+    size_t dog;
+    Direction dir;
+};
+
+struct DogState {
+    model::PointF pos;
+    size_t score;
+    size_t bag;
+};
+
+// Runs the scripted game in ticks of tick_ms, the state of the dogs every 500 ms
+std::vector<std::vector<DogState>> Run(model::Motion motion, int tick_ms, const std::vector<Command>& script) {
+    model::Game game;
+    game.SetLootGenParams(5.0, 0.0);
+    game.SetMotion(motion);
+    auto map = MakeMap();
+    game.AddMap(map);
+    auto session_id = game.AddSession(game.GetMap(0));
+    auto session = game.FindSession(session_id);
+    std::vector<model::Dog::Id> dogs;
+    for (int i = 0; i < 3; ++i)
+        dogs.push_back(game.AddDog("Dog "s + std::to_string(i), session_id));
+    session->AddNewObject(model::LostObject{0u, 0, {5.0, 0.0}});
+    session->AddNewObject(model::LostObject{1u, 1, {10.0, 7.0}});
+    session->AddNewObject(model::LostObject{2u, 0, {3.0, 20.0}});
+
+    std::vector<std::vector<DogState>> states;
+    for (int time = 0; time < 12000; time += tick_ms) {
+        for (const auto& command: script) {
+            if (command.at == time)
+                session->SetDogSpeed(dogs[command.dog], command.dir);
+        }
+        game.UpdateGame(tick_ms);
+        if ((time + tick_ms) % 500 != 0)
+            continue;
+        game.SyncPositions();
+        auto& state = states.emplace_back();
+        for (auto id: dogs) {
+            auto dog = session->FindDog(id);
+            state.push_back({dog->GetPosition(), dog->GetScore(), dog->BagSize()});
+        }
+    }
+    return states;
+}
+
+// Plays the script stepping until restore_at, saves and restores the session into a game with the
+// given motion, and plays the rest in ticks of tick_ms; the states from restore_at on
+std::vector<std::vector<DogState>> RunRestored(model::Motion motion, int tick_ms, int restore_at,
+                                               const std::vector<Command>& script) {
+    std::stringstream saved;
+    model::GameSession::Id session_id {0u};
+    {
+        model::Game game;
+        game.SetLootGenParams(5.0, 0.0);
+        auto map = MakeMap();
+        game.AddMap(map);
+        session_id = game.AddSession(game.GetMap(0));
+        auto session = game.FindSession(session_id);
+        std::vector<model::Dog::Id> dogs;
+        for (int i = 0; i < 3; ++i)
+            dogs.push_back(game.AddDog("Dog "s + std::to_string(i), session_id));
+        session->AddNewObject(model::LostObject{0u, 0, {5.0, 0.0}});
+        session->AddNewObject(model::LostObject{1u, 1, {10.0, 7.0}});
+        session->AddNewObject(model::LostObject{2u, 0, {3.0, 20.0}});
+        for (int time = 0; time < restore_at; time += 10) {
+            for (const auto& command: script) {
+                if (command.at == time)
+                    session->SetDogSpeed(dogs[command.dog], command.dir);
+            }
+            game.UpdateGame(10);
+        }
+        boost::archive::binary_oarchive archive {saved};
+        archive << serialization::GameSessionRepr{*session};
+    }
+
+    model::Game game;
+    game.SetLootGenParams(5.0, 0.0);
+    game.SetMotion(motion);
+    auto map = MakeMap();
+    game.AddMap(map);
+    {
+        serialization::GameSessionRepr repr;
+        boost::archive::binary_iarchive archive {saved};
+        archive >> repr;
+        game.AddGameSession(repr.Restore());
+    }
+    auto session = game.FindSession(session_id);
+    std::vector<std::vector<DogState>> states;
+    for (int time = restore_at; time < 12000; time += tick_ms) {
+        for (const auto& command: script) {
+            if (command.at == time)
+                session->SetDogSpeed(model::Dog::Id{static_cast<std::uint32_t>(command.dog)}, command.dir);
+        }
+        game.UpdateGame(tick_ms);
+        if ((time + tick_ms) % 500 != 0)
+            continue;
+        game.SyncPositions();
+        auto& state = states.emplace_back();
+        for (const auto& dog: session->GetDogs())
+            state.push_back({dog.GetPosition(), dog.GetScore(), dog.BagSize()});
+    }
+    return states;
+}
+
+void CheckSameStates(const std::vector<std::vector<DogState>>& expected,
+                     const std::vector<std::vector<DogState>>& actual) {
+    REQUIRE(expected.size() == actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        for (size_t dog = 0; dog < expected[i].size(); ++dog) {
+            INFO("at " << (i + 1) * 500 << " ms, dog " << dog);
+            CHECK(std::abs(expected[i][dog].pos.x - actual[i][dog].pos.x) < 1e-3);
+            CHECK(std::abs(expected[i][dog].pos.y - actual[i][dog].pos.y) < 1e-3);
+            CHECK(expected[i][dog].score == actual[i][dog].score);
+            CHECK(expected[i][dog].bag == actual[i][dog].bag);
+        }
+    }
+}
+
+}  // namespace
+
+SCENARIO("Event-driven motion") {
+    GIVEN("dogs turning at crossings, stopping at road ends, gathering loot and delivering it") {
+        const std::vector<Command> script {
+            {0, 0, Direction::EAST}, {2500, 0, Direction::SOUTH}, {8000, 0, Direction::EAST},
+            {0, 1, Direction::SOUTH}, {5500, 1, Direction::EAST},
+            {0, 2, Direction::EAST}, {1000, 2, Direction::WEST}, {1500, 2, Direction::STOP},
+            {2000, 2, Direction::WEST}, {3000, 2, Direction::NORTH}, {4000, 2, Direction::SOUTH},
+        };
+        auto stepping = Run(model::Motion::Stepping, 10, script);
+
+        THEN("the stepping game plays out as scripted") {
+            const auto& end = stepping.back();
+            CHECK(std::abs(end[0].pos.x - 20.4) < 1e-9);
+            CHECK(end[0].score == 30);
+            CHECK(end[1].score == 10);
+            CHECK(std::abs(end[2].pos.y - 20.4) < 1e-9);
+        }
+        THEN("events match it at the same tick length") {
+            CheckSameStates(stepping, Run(model::Motion::Events, 10, script));
+        }
+        THEN("events match it at longer ticks") {
+            CheckSameStates(stepping, Run(model::Motion::Events, 100, script));
+            CheckSameStates(stepping, Run(model::Motion::Events, 500, script));
+        }
+    }
+
+    GIVEN("a game saved and restored while its dogs are running") {
+        const std::vector<Command> script {
+            {0, 0, Direction::EAST}, {2500, 0, Direction::SOUTH}, {8000, 0, Direction::EAST},
+            {0, 1, Direction::SOUTH}, {5500, 1, Direction::EAST},
+            {0, 2, Direction::EAST}, {1000, 2, Direction::WEST}, {1500, 2, Direction::STOP},
+            {2000, 2, Direction::WEST}, {4000, 2, Direction::SOUTH},
+        };
+        constexpr int RESTORE_AT = 3000;
+        auto stepping = RunRestored(model::Motion::Stepping, 10, RESTORE_AT, script);
+
+        THEN("the restored stepping game carries on as if it had not stopped") {
+            auto uninterrupted = Run(model::Motion::Stepping, 10, script);
+            uninterrupted.erase(uninterrupted.begin(), uninterrupted.begin() + RESTORE_AT / 500);
+            CheckSameStates(uninterrupted, stepping);
+        }
+        THEN("restored events match it") {
+            CheckSameStates(stepping, RunRestored(model::Motion::Events, 10, RESTORE_AT, script));
+            CheckSameStates(stepping, RunRestored(model::Motion::Events, 500, RESTORE_AT, script));
+        }
+    }
+
+    GIVEN("a dog running along a long road") {
+        model::Game game;
+        game.SetLootGenParams(5.0, 0.0);
+        game.SetMotion(model::Motion::Events);
+        model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 3.0, 3, "{}"s};
+        map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 1000, 0});
+        game.AddMap(map);
+        auto session_id = game.AddSession(game.GetMap(0));
+        auto session = game.FindSession(session_id);
+        auto id = game.AddDog("Rex"s, session_id);
+        session->SetDogSpeed(id, Direction::EAST);
+        auto dog = session->FindDog(id);
+
+        WHEN("the game ticks for a while") {
+            for (int i = 0; i < 10; ++i)
+                game.UpdateGame(100);
+            THEN("the dog is left alone until its event, due at the end of the road") {
+                CHECK(dog->Anchor() == 0.0);
+                CHECK(dog->GetPosition() == model::PointF{0.0, 0.0});
+                CHECK(std::abs(dog->NextEvent() - 1000.4 / 3) < 1e-9);
+            }
+            THEN("its position is brought up to date when read") {
+                game.SyncPositions();
+                CHECK(std::abs(dog->GetPosition().x - 3.0) < 1e-9);
+                CHECK(dog->Anchor() == 1.0);
+            }
+        }
+        WHEN("it is stopped") {
+            game.UpdateGame(500);
+            session->SetDogSpeed(id, Direction::STOP);
+            game.UpdateGame(500);
+            game.SyncPositions();
+            THEN("it stays where it was, with nothing scheduled") {
+                CHECK(std::abs(dog->GetPosition().x - 1.5) < 1e-9);
+                CHECK(std::isinf(dog->NextEvent()));
+            }
+        }
+    }
+}
+
+TEST_CASE("Event-driven motion benchmark", "[.benchmark]") {
+    auto make_game = [](model::Motion motion) {
+        auto game = std::make_unique<model::Game>();
+        game->SetLootGenParams(5.0, 0.0);
+        game->SetMotion(motion);
+        model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 1.0, 3, "{}"s};
+        map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 1000000, 0});
+        game->AddMap(map);
+        auto session_id = game->AddSession(game->GetMap(0));
+        for (int i = 0; i < 200; ++i) {
+            auto id = game->AddDog("Dog "s + std::to_string(i), session_id);
+            game->FindSession(session_id)->SetDogSpeed(id, Direction::EAST);
+        }
+        return game;
+    };
+    auto stepping = make_game(model::Motion::Stepping);
+    auto events = make_game(model::Motion::Events);
+    BENCHMARK("stepping tick, 200 moving dogs") {
+        return stepping->UpdateGame(100).size();
+    };
+    BENCHMARK("event tick, 200 moving dogs") {
+        return events->UpdateGame(100).size();
+    };
+}
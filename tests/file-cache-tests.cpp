@@ -0,0 +1,134 @@
+#include <fstream>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/file_cache.h"
+
+using namespace std::literals;
+namespace fs = std::filesystem;
+using file_cache::CacheMode;
+using file_cache::FileCache;
+
+namespace {
+
+// A static root of its own, removed afterwards
+class StaticRoot {
+public:
+    StaticRoot(): path_(fs::temp_directory_path() / "file-cache-tests") {
+        fs::remove_all(path_);
+        fs::create_directories(path_ / "dir");
+    }
+    ~StaticRoot() {
+        std::error_code ec;
+        fs::remove_all(path_, ec);
+    }
+    void Write(std::string_view rel, std::string_view data) const {
+        std::ofstream {path_ / rel, std::ios::binary} << data;
+    }
+    const fs::path& Path() const noexcept {
+        return path_;
+    }
+private:
+    fs::path path_;
+};
+
+}  // namespace
+
+SCENARIO("Static file cache") {
+    StaticRoot root;
+    root.Write("index.html", "<html></html>");
+    root.Write("a.txt", std::string(40, 'a'));
+    root.Write("dir/b.txt", std::string(40, 'b'));
+    root.Write("dir/c.txt", std::string(40, 'c'));
+    root.Write("big.txt", std::string(200, 'd'));
+
+    GIVEN("a cache bounded to 100 bytes") {
+        FileCache cache {root.Path(), CacheMode::Immutable, FileCache::DEFAULT_MAX_FILE_SIZE, 100};
+
+        WHEN("files of 120 bytes in total are requested") {
+            auto a = cache.Find("/a.txt");
+            auto b = cache.Find("/dir/b.txt");
+            auto c = cache.Find("/dir/c.txt");
+            THEN("every one is served, and entries are evicted to stay within the bound") {
+                REQUIRE(a);
+                REQUIRE(b);
+                REQUIRE(c);
+                CHECK(*c->data == std::string(40, 'c'));
+                CHECK(cache.Size() == 2);
+                CHECK(cache.Bytes() == 80);
+                CHECK(cache.Find("/dir/c.txt") == c);
+            }
+        }
+        WHEN("a file larger than the whole bound is requested") {
+            cache.Find("/a.txt");
+            auto big = cache.Find("/big.txt");
+            THEN("it is served but not kept, and nothing is evicted for it") {
+                REQUIRE(big);
+                CHECK(big->data->size() == 200);
+                CHECK(cache.Size() == 1);
+                CHECK(cache.Bytes() == 40);
+                CHECK(cache.Find("/big.txt") != big);
+            }
+        }
+    }
+    GIVEN("a cache with a per-file limit") {
+        FileCache cache {root.Path(), CacheMode::Immutable, 100};
+        THEN("larger files are left to the disk") {
+            CHECK(cache.Find("/big.txt") == nullptr);
+            CHECK(cache.Find("/a.txt") != nullptr);
+        }
+    }
+
+    GIVEN("an unbounded cache") {
+        FileCache cache {root.Path(), CacheMode::Immutable};
+
+        WHEN("one file is requested through different spellings of its path") {
+            auto plain = cache.Find("/dir/b.txt");
+            auto dotted = cache.Find("/dir/./b.txt");
+            auto parent = cache.Find("/dir/../dir/b.txt");
+            auto doubled = cache.Find("//dir//b.txt");
+            THEN("it is cached once, under its canonical path") {
+                REQUIRE(plain);
+                CHECK(dotted == plain);
+                CHECK(parent == plain);
+                CHECK(doubled == plain);
+                CHECK(cache.Size() == 1);
+                CHECK(cache.Bytes() == 40);
+            }
+        }
+        WHEN("a symbolic link to a cached file is requested") {
+            fs::create_symlink(root.Path() / "a.txt", root.Path() / "link.txt");
+            auto file = cache.Find("/a.txt");
+            auto link = cache.Find("/link.txt");
+            THEN("the link resolves to the file's entry") {
+                CHECK(link == file);
+                CHECK(cache.Size() == 1);
+            }
+        }
+        WHEN("the root is requested") {
+            auto index = cache.Find("/");
+            THEN("it is the index page, shared with its own path") {
+                REQUIRE(index);
+                CHECK(cache.Find("/index.html") == index);
+                CHECK(cache.Size() == 1);
+            }
+        }
+        WHEN("paths outside the root or missing files are requested") {
+            THEN("nothing is found and nothing is cached") {
+                CHECK(cache.Find("/../../etc/passwd") == nullptr);
+                CHECK(cache.Find("/missing.txt") == nullptr);
+                CHECK(cache.Find("/dir") == nullptr);
+                CHECK(cache.Size() == 0);
+            }
+        }
+        WHEN("the whole root is preloaded") {
+            cache.Preload();
+            THEN("every file is cached once, and later lookups hit those entries") {
+                CHECK(cache.Size() == 5);
+                CHECK(cache.Bytes() == 13 + 40 * 3 + 200);
+                auto b = cache.Find("/dir/b.txt");
+                CHECK(cache.Find("/dir/../dir/b.txt") == b);
+                CHECK(cache.Size() == 5);
+            }
+        }
+    }
+}
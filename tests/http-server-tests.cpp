@@ -0,0 +1,258 @@
+#include <thread>
+#include <boost/asio/steady_timer.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/http_server.h"
+
+using namespace std::literals;
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+
+using StringResponse = http::response<http::string_body>;
+
+// Echoes the target; "/slow" is answered later than the requests following it.
+// Every response is sent with latency label 0.
+class EchoServer {
+public:
+    explicit EchoServer(const http_server::ListenOptions& options = {}) {
+        logger::SetLoggingEnabled(false);
+        auto handler = [this](http::request<http::string_body>&& req, auto&& send) {
+            StringResponse res{http::status::ok, req.version()};
+            res.body() = std::string{req.target()};
+            res.keep_alive(req.keep_alive());
+            res.prepare_payload();
+            if (req.target() != "/slow")
+                return send(std::move(res), 0u);
+            auto timer = std::make_shared<net::steady_timer>(ioc_, 50ms);
+            timer->async_wait([timer, send, res = std::move(res)](beast::error_code) mutable {
+                send(std::move(res), 0u);
+            });
+        };
+        endpoint_ = http_server::ServeHttp(ioc_, {net::ip::make_address("127.0.0.1"), 0}, handler, options);
+        thread_ = std::thread{[this] {
+            ioc_.run();
+        }};
+    }
+    ~EchoServer() {
+        ioc_.stop();
+        thread_.join();
+        logger::SetLoggingEnabled(true);
+    }
+
+    tcp::socket Connect(net::io_context& client_ioc) const {
+        tcp::socket socket{client_ioc};
+        socket.connect(endpoint_);
+        return socket;
+    }
+private:
+    net::io_context ioc_{1};
+    tcp::endpoint endpoint_;
+    std::thread thread_;
+};
+
+std::string GetRequest(std::string_view target) {
+    return "GET "s + std::string{target} + " HTTP/1.1\r\nHost: localhost\r\n\r\n"s;
+}
+
+}  // namespace
+
+SCENARIO("Coroutine HTTP session") {
+    EchoServer server;
+    net::io_context client_ioc;
+    auto socket = server.Connect(client_ioc);
+    beast::flat_buffer buffer;
+
+    GIVEN("pipelined requests whose handlers finish out of order") {
+        net::write(socket, net::buffer(GetRequest("/slow") + GetRequest("/fast") + GetRequest("/last")));
+
+        THEN("responses come back in request order") {
+            for (auto target: {"/slow"sv, "/fast"sv, "/last"sv}) {
+                StringResponse res;
+                http::read(socket, buffer, res);
+                CHECK(res.body() == target);
+            }
+        }
+    }
+
+    GIVEN("more pipelined requests than the session reads ahead") {
+        std::string batch;
+        for (size_t i = 0; i < 3 * http_server::MAX_PIPELINE_DEPTH; ++i)
+            batch += GetRequest("/" + std::to_string(i));
+        net::write(socket, net::buffer(batch));
+
+        THEN("all of them are answered in order") {
+            for (size_t i = 0; i < 3 * http_server::MAX_PIPELINE_DEPTH; ++i) {
+                StringResponse res;
+                http::read(socket, buffer, res);
+                CHECK(res.body() == "/" + std::to_string(i));
+            }
+        }
+    }
+
+    GIVEN("a request closing the connection") {
+        http::request<http::string_body> req{http::verb::get, "/bye", 11};
+        req.keep_alive(false);
+        http::write(socket, req);
+
+        THEN("it is answered and the server closes its side") {
+            StringResponse res;
+            http::read(socket, buffer, res);
+            CHECK(res.body() == "/bye");
+            CHECK(res.need_eof());
+            beast::error_code ec;
+            http::read(socket, buffer, res, ec);
+            CHECK(ec == http::error::end_of_stream);
+        }
+    }
+}
+
+SCENARIO("Connection admission control") {
+    net::io_context client_ioc;
+    beast::flat_buffer buffer;
+
+    GIVEN("a server limited to two connections, one per address") {
+        http_server::ConnectionLimits limits;
+        limits.max_connections = 2;
+        limits.max_connections_per_ip = 1;
+        auto tracker = std::make_shared<http_server::ConnectionTracker>(limits);
+        EchoServer server{{false, tracker}};
+        auto first = server.Connect(client_ioc);
+        http::write(first, http::request<http::string_body>{http::verb::get, "/first", 11});
+        StringResponse res;
+        http::read(first, buffer, res);
+
+        WHEN("a second connection comes from the same address") {
+            auto second = server.Connect(client_ioc);
+            THEN("it is closed without an answer") {
+                beast::error_code ec;
+                http::write(second, http::request<http::string_body>{http::verb::get, "/second", 11}, ec);
+                http::read(second, buffer, res, ec);
+                CHECK(ec);
+                CHECK(tracker->Stats().rejected_ip_limit == 1);
+                CHECK(tracker->Stats().active == 1);
+            }
+        }
+        WHEN("the first connection is closed") {
+            first.close();
+            THEN("its slot is released") {
+                for (int i = 0; i < 100 && tracker->Stats().active != 0; ++i)
+                    std::this_thread::sleep_for(5ms);
+                CHECK(tracker->Stats().active == 0);
+            }
+        }
+        WHEN("the first connection is reset") {
+            first.set_option(net::socket_base::linger{true, 0});
+            first.close();
+            THEN("its slot is released at once, not when it would have gone idle") {
+                for (int i = 0; i < 100 && tracker->Stats().active != 0; ++i)
+                    std::this_thread::sleep_for(5ms);
+                CHECK(tracker->Stats().active == 0);
+            }
+        }
+    }
+
+    GIVEN("a server reaping idle connections") {
+        http_server::ConnectionLimits limits;
+        limits.idle_timeout = 50ms;
+        auto tracker = std::make_shared<http_server::ConnectionTracker>(limits);
+        EchoServer server{{false, tracker}};
+        auto socket = server.Connect(client_ioc);
+
+        WHEN("a keep-alive connection stays idle after a response") {
+            http::write(socket, http::request<http::string_body>{http::verb::get, "/once", 11});
+            StringResponse res;
+            http::read(socket, buffer, res);
+            THEN("the server closes it") {
+                beast::error_code ec;
+                http::read(socket, buffer, res, ec);
+                CHECK(ec == http::error::end_of_stream);
+                CHECK(tracker->Stats().idle_reaped == 1);
+            }
+        }
+        WHEN("a request body arrives slower than the idle timeout") {
+            net::write(socket, net::buffer("POST /body HTTP/1.1\r\nHost: localhost\r\nContent-Length: 10\r\n\r\n12345"sv));
+            std::this_thread::sleep_for(120ms);
+            net::write(socket, net::buffer("67890"sv));
+            THEN("the request is read and answered, the connection was not idle") {
+                StringResponse res;
+                http::read(socket, buffer, res);
+                CHECK(res.body() == "/body");
+                CHECK(tracker->Stats().idle_reaped == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("Response latency") {
+    GIVEN("a server recording latency") {
+        auto recorder = std::make_shared<latency::Recorder>(1);
+        http_server::ListenOptions options;
+        options.latency = recorder;
+        EchoServer server{options};
+        net::io_context client_ioc;
+        auto socket = server.Connect(client_ioc);
+        beast::flat_buffer buffer;
+
+        WHEN("a slow and a fast request are pipelined") {
+            net::write(socket, net::buffer(GetRequest("/slow") + GetRequest("/fast")));
+            for (int i = 0; i < 2; ++i) {
+                StringResponse res;
+                http::read(socket, buffer, res);
+            }
+            // Recorded once the write completes, which the client may see first
+            auto total = recorder->Snapshot(0, 1, latency::Phase::Total);
+            for (int i = 0; i < 100 && total.count < 2; ++i) {
+                std::this_thread::sleep_for(5ms);
+                total = recorder->Snapshot(0, 1, latency::Phase::Total);
+            }
+            THEN("both responses are timed, the fast one including its wait behind the slow one") {
+                CHECK(total.count == 2);
+                CHECK(total.Percentile(0) >= 50'000);
+                CHECK(recorder->Snapshot(0, 1, latency::Phase::Write).count == 2);
+                CHECK(recorder->Snapshot(0, 1, latency::Phase::Write).max_us < 50'000);
+            }
+        }
+    }
+}
+
+// One server thread: requests per second per core is the request count divided by the mean time
+// Measures the current session only; the callback session it replaced is not kept to compare against
+TEST_CASE("Keep-alive throughput benchmark", "[.benchmark]") {
+    // Whole pipelined batches, so both loops send the same number of requests
+    constexpr int REQUESTS = 1024;
+    static_assert(REQUESTS % http_server::MAX_PIPELINE_DEPTH == 0);
+    EchoServer server;
+    net::io_context client_ioc;
+    auto socket = server.Connect(client_ioc);
+    beast::flat_buffer buffer;
+    http::request<http::string_body> req{http::verb::get, "/bench", 11};
+    req.set(http::field::host, "localhost");
+    std::string batch;
+    for (size_t i = 0; i < http_server::MAX_PIPELINE_DEPTH; ++i)
+        batch += GetRequest("/bench");
+
+    BENCHMARK("1024 keep-alive requests, one at a time") {
+        for (int i = 0; i < REQUESTS; ++i) {
+            http::write(socket, req);
+            StringResponse res;
+            http::read(socket, buffer, res);
+        }
+        return REQUESTS;
+    };
+
+    BENCHMARK("1024 keep-alive requests, pipelined") {
+        for (int i = 0; i < REQUESTS; i += http_server::MAX_PIPELINE_DEPTH) {
+            net::write(socket, net::buffer(batch));
+            for (size_t j = 0; j < http_server::MAX_PIPELINE_DEPTH; ++j) {
+                StringResponse res;
+                http::read(socket, buffer, res);
+            }
+        }
+        return REQUESTS;
+    };
+}
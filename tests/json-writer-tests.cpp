@@ -0,0 +1,173 @@
+#include <boost/json.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/model_json.h"
+
+using namespace std::literals;
+namespace json = boost::json;
+
+namespace {
+
+// Reference DOM encoding of the game state as it was built before the streaming writer
+json::object LoadPlayer(const model::Dog& dog) {
+    json::object dog_info;
+    json::array pos_json, speed_json, bag_json;
+    auto pos = dog.GetPos(), speed = dog.GetSpeed();
+    pos_json.emplace_back(pos.first);
+    pos_json.emplace_back(pos.second);
+    speed_json.emplace_back(speed.first);
+    speed_json.emplace_back(speed.second);
+    for (auto &obj: dog.GetBagContent()) {
+        json::object obj_json;
+        obj_json.emplace("id", *obj.GetId());
+        obj_json.emplace("type", obj.GetType());
+        bag_json.emplace_back(obj_json);
+    }
+    dog_info.emplace("pos", pos_json);
+    dog_info.emplace("speed", speed_json);
+    dog_info.emplace("dir", std::string{model_json::DirToStr(dog.GetDir())});
+    dog_info.emplace("bag", bag_json);
+    dog_info.emplace("score", dog.GetScore());
+    return dog_info;
+}
+
+std::string GameStateDom(const model::GameSessionBase& session) {
+    json::object game_state, dogs_json, lost_objects_json;
+    for (auto &dog: session.GetDogs())
+        dogs_json.emplace(std::to_string(*dog.GetId()), LoadPlayer(dog));
+    for (auto &lost_object: session.GetLostObjects()) {
+        json::object object_info;
+        json::array pos_json;
+        pos_json.emplace_back(lost_object.GetPos().first);
+        pos_json.emplace_back(lost_object.GetPos().second);
+        object_info.emplace("type", lost_object.GetType());
+        object_info.emplace("pos", pos_json);
+        lost_objects_json.emplace(std::to_string(*lost_object.GetId()), object_info);
+    }
+    game_state.emplace("players", dogs_json);
+    game_state.emplace("lostObjects", lost_objects_json);
+    return json::serialize(game_state);
+}
+
+struct SessionFixture {
+    model::Map map = [] {
+        model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 3.0, 3, "{}"s};
+        map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 1000, 0});
+        map.SetLootTypes(2);
+        return map;
+    }();
+    loot_gen::LootGenerator loot_generator;
+    model::GameSession session{model::GameSession::Id{0u}, map, loot_generator};
+
+    void AddDogs(int count) {
+        const model::Direction dirs[] = {model::Direction::NORTH, model::Direction::SOUTH,
+                                         model::Direction::WEST, model::Direction::EAST, model::Direction::STOP};
+        for (int i = 0; i < count; ++i) {
+            auto id = session.AddDog("Dog \""s + std::to_string(i) + "\"\n"s);
+            auto dog = session.FindDog(id);
+            dog->SetPos({i * 0.37, 0.1 * (i % 7)});
+            dog->SetSpeed(dirs[i % 5]);
+            dog->AddPoints(i * 10);
+            for (int j = 0; j < i % 4; ++j)
+                dog->GatherLostObject({model::LostObject::Id{static_cast<std::uint32_t>(j)}, static_cast<size_t>(j % 2), {1.0, 2.0}});
+        }
+    }
+};
+
+}  // namespace
+
+SCENARIO_METHOD(SessionFixture, "Streaming game state encoding") {
+    GIVEN("a session with dogs") {
+        AddDogs(20);
+
+        WHEN("the state is written with the streaming writer") {
+            json_writer::JsonWriter writer;
+            model_json::WriteGameState(writer, session);
+
+            THEN("it is byte-identical to the DOM serialization") {
+                CHECK(writer.View() == GameStateDom(session));
+            }
+        }
+    }
+
+    GIVEN("doubles of various magnitudes") {
+        const double values[] = {0.0, -0.0, 1.0, 0.5, 0.1, 2.4, -13.25, 1e-7, 123456.789, 1e21, 4.0 / 3};
+        THEN("they are formatted like json::serialize") {
+            for (double v: values) {
+                json_writer::JsonWriter writer;
+                writer.Double(v);
+                INFO("value: " << v);
+                CHECK(writer.View() == json::serialize(json::value(v)));
+                CHECK(json::parse(writer.View()).as_double() == v);
+            }
+        }
+    }
+
+    GIVEN("a reused writer") {
+        json_writer::JsonWriter writer;
+        writer.StartArray().Uint(1).Uint(2).EndArray();
+        writer.Reset();
+        writer.StartObject().Member("a", 1).Member("b", "x"sv).EndObject();
+        THEN("only the latest document is kept") {
+            CHECK(writer.View() == R"({"a":1,"b":"x"})"sv);
+        }
+    }
+}
+
+SCENARIO_METHOD(SessionFixture, "Timed game state") {
+    GIVEN("a dog heading east along a road") {
+        auto id = session.AddDog("Rex"s);
+        auto dog = session.FindDog(id);
+        dog->SetPos({990.0, 0.0});
+        dog->SetSpeed(model::Direction::EAST);
+
+        WHEN("the state is written with no extrapolation") {
+            json_writer::JsonWriter writer;
+            model_json::WriteGameState(writer, session, {12.5});
+            auto state = json::parse(writer.View());
+            THEN("it carries the tick time and the dog's velocity only") {
+                CHECK(state.at("tickTime") == 12.5);
+                CHECK_FALSE(state.as_object().contains("time"));
+                const auto& player = state.at("players").at(std::to_string(*id));
+                CHECK(player.at("speed") == json::array{3.0, 0.0});
+                CHECK_FALSE(player.as_object().contains("extrapolatedPos"));
+            }
+        }
+        WHEN("it is extrapolated a second ahead") {
+            json_writer::JsonWriter writer;
+            model_json::WriteGameState(writer, session, {12.5, 1.0});
+            auto state = json::parse(writer.View());
+            const auto& player = state.at("players").at(std::to_string(*id));
+            THEN("the dog is shown further along, its tick position unchanged") {
+                CHECK(state.at("time") == 13.5);
+                CHECK(player.at("pos") == json::array{990.0, 0.0});
+                CHECK(player.at("extrapolatedPos") == json::array{993.0, 0.0});
+            }
+        }
+        WHEN("it is extrapolated past the end of the road") {
+            json_writer::JsonWriter writer;
+            model_json::WriteGameState(writer, session, {12.5, 10.0});
+            auto state = json::parse(writer.View());
+            THEN("the position is clamped to the road bounds") {
+                const auto& player = state.at("players").at(std::to_string(*id));
+                CHECK(player.at("extrapolatedPos") == json::array{1000.0 + model::ROAD_BORDER, 0.0});
+            }
+        }
+    }
+}
+
+TEST_CASE_METHOD(SessionFixture, "Game state encoding benchmark", "[.benchmark]") {
+    AddDogs(1000);
+    json_writer::JsonWriter writer;
+
+    BENCHMARK("DOM, 1000 dogs") {
+        return GameStateDom(session);
+    };
+
+    BENCHMARK("streaming writer, 1000 dogs") {
+        writer.Reset();
+        model_json::WriteGameState(writer, session);
+        return writer.Size();
+    };
+}
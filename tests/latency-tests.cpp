@@ -0,0 +1,118 @@
+#include <thread>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/latency.h"
+
+using namespace std::literals;
+using latency::Buckets;
+using latency::Phase;
+
+SCENARIO("Latency histogram buckets") {
+    GIVEN("the bucket layout") {
+        THEN("small values are exact") {
+            for (std::uint64_t value = 0; value < 32; ++value) {
+                CHECK(Buckets::IndexOf(value) == value);
+                CHECK(Buckets::LowerBound(value) == value);
+                CHECK(Buckets::UpperBound(value) == value);
+            }
+        }
+        THEN("buckets are contiguous and hold the values mapped to them") {
+            bool contiguous = true, holds = true;
+            for (size_t i = 1; i < Buckets::COUNT; ++i)
+                contiguous = contiguous && Buckets::LowerBound(i) == Buckets::UpperBound(i - 1) + 1;
+            for (std::uint64_t value = 1; value < (std::uint64_t{1} << Buckets::MAX_BITS); value = value * 3 / 2 + 1) {
+                auto index = Buckets::IndexOf(value);
+                holds = holds && index < Buckets::COUNT
+                        && Buckets::LowerBound(index) <= value && value <= Buckets::UpperBound(index);
+            }
+            CHECK(contiguous);
+            CHECK(holds);
+        }
+        THEN("a bucket is at most 1/16 of its values wide") {
+            bool precise = true;
+            for (size_t i = 32; i < Buckets::COUNT; ++i)
+                precise = precise && (Buckets::UpperBound(i) - Buckets::LowerBound(i) + 1) * 16 <= Buckets::LowerBound(i);
+            CHECK(precise);
+        }
+        THEN("values past the range land in the last bucket") {
+            CHECK(Buckets::IndexOf(UINT64_MAX) == Buckets::COUNT - 1);
+        }
+    }
+}
+
+SCENARIO("Latency recorder") {
+    GIVEN("a recorder of two endpoints") {
+        latency::Recorder recorder {2};
+
+        WHEN("nothing is recorded") {
+            THEN("snapshots are empty") {
+                auto snapshot = recorder.Snapshot(0, 1, Phase::Total);
+                CHECK(snapshot.count == 0);
+                CHECK(snapshot.Percentile(0.99) == 0);
+            }
+        }
+        WHEN("1 to 1000 ms are recorded for one endpoint") {
+            for (int ms = 1; ms <= 1000; ++ms)
+                recorder.Record(0, 200, Phase::Handler, std::chrono::milliseconds{ms});
+            auto snapshot = recorder.Snapshot(0, 1, Phase::Handler);
+            THEN("percentiles are within the bucket precision") {
+                CHECK(snapshot.count == 1000);
+                CHECK(snapshot.sum_us == 500'500'000);
+                CHECK(snapshot.max_us == 1'000'000);
+                CHECK(snapshot.Percentile(0.5) >= 500'000);
+                CHECK(snapshot.Percentile(0.5) <= 500'000 * 17 / 16);
+                CHECK(snapshot.Percentile(0.99) >= 990'000);
+                CHECK(snapshot.Percentile(1) == 1'000'000);
+            }
+            THEN("other endpoints, status classes and phases are not affected") {
+                CHECK(recorder.Snapshot(1, 1, Phase::Handler).count == 0);
+                CHECK(recorder.Snapshot(0, 4, Phase::Handler).count == 0);
+                CHECK(recorder.Snapshot(0, 1, Phase::Queue).count == 0);
+            }
+        }
+        WHEN("responses of several status classes are recorded") {
+            recorder.Record(1, 204, Phase::Total, 1ms);
+            recorder.Record(1, 304, Phase::Total, 1ms);
+            recorder.Record(1, 429, Phase::Total, 1ms);
+            recorder.Record(1, 503, Phase::Total, 1ms);
+            THEN("each class has its own histogram") {
+                for (size_t status_class = 1; status_class < latency::NUM_STATUS_CLASSES; ++status_class)
+                    CHECK(recorder.Snapshot(1, status_class, Phase::Total).count == 1);
+            }
+        }
+        WHEN("many threads record at once") {
+            constexpr int THREADS = 24, VALUES = 10000;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([&recorder] {
+                    for (int i = 0; i < VALUES; ++i)
+                        recorder.Record(0, 200, Phase::Write, std::chrono::microseconds{i % 100});
+                });
+            }
+            for (auto& thread: threads)
+                thread.join();
+            THEN("the shards add up") {
+                auto snapshot = recorder.Snapshot(0, 1, Phase::Write);
+                CHECK(snapshot.count == THREADS * VALUES);
+                CHECK(snapshot.max_us == 99);
+            }
+        }
+        WHEN("a label out of range is recorded") {
+            recorder.Record(2, 200, Phase::Total, 1ms);
+            THEN("it is ignored") {
+                CHECK(recorder.Snapshot(2, 1, Phase::Total).count == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("Latency recorder benchmark", "[.benchmark]") {
+    latency::Recorder recorder {10};
+    std::uint32_t i = 0;
+    BENCHMARK("record") {
+        ++i;
+        recorder.Record(i % 10, 200, Phase::Handler, std::chrono::microseconds{i % 5000});
+    };
+}
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <boost/json.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/logger.h"
+
+using namespace std::literals;
+namespace json = boost::json;
+
+namespace {
+
+std::vector<json::object> ParseLines(const std::string& text) {
+    std::vector<json::object> lines;
+    std::istringstream in {text};
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(json::parse(line).as_object());
+    return lines;
+}
+
+} // namespace
+
+SCENARIO("Log record ring") {
+    GIVEN("a small ring") {
+        logger::RecordRing ring {1024};
+        const auto now = logger::Clock::now();
+
+        WHEN("records are pushed and drained") {
+            CHECK(ring.TryPush(now, R"({"a":1})"sv, "first"sv));
+            CHECK(ring.TryPush(now, ""sv, "second"sv));
+            std::vector<std::string> messages, data;
+            auto count = ring.Drain([&](const logger::RecordRing::Record& record) {
+                data.emplace_back(record.data);
+                messages.emplace_back(record.message);
+                CHECK(record.time == now);
+            });
+            THEN("they come out in order and intact") {
+                CHECK(count == 2);
+                CHECK(messages == std::vector<std::string>{"first", "second"});
+                CHECK(data == std::vector<std::string>{R"({"a":1})", ""});
+                CHECK(ring.Empty());
+            }
+        }
+        WHEN("it is full") {
+            const std::string message(200, 'x');
+            int pushed = 0;
+            while (ring.TryPush(now, ""sv, message))
+                ++pushed;
+            THEN("pushes fail until it is drained") {
+                CHECK(pushed == 4);
+                CHECK(ring.Drain([](const auto&) {}) == 4);
+                CHECK(ring.TryPush(now, ""sv, message));
+            }
+        }
+        WHEN("records keep wrapping around the end of the buffer") {
+            size_t drained = 0;
+            bool intact = true;
+            for (int i = 0; i < 1000; ++i) {
+                auto message = std::to_string(i) + std::string(i % 97, '.');
+                REQUIRE(ring.TryPush(now, ""sv, message));
+                drained += ring.Drain([&](const logger::RecordRing::Record& record) {
+                    intact = intact && record.message == message;
+                });
+            }
+            THEN("no record is split or lost") {
+                CHECK(drained == 1000);
+                CHECK(intact);
+            }
+        }
+        WHEN("the end of the buffer left over is shorter than a record header") {
+            THEN("it is skipped, without writing past the buffer") {
+                // A record takes a 24-byte header and its text, rounded up to 8 bytes
+                for (size_t tail: {8, 16}) {
+                    INFO("tail of " << tail << " bytes");
+                    logger::RecordRing fresh {1024};
+                    size_t pushed = 0, intact = 0;
+                    for (size_t size: {size_t{504}, 496 - tail, size_t{24}, size_t{24}, size_t{48}}) {
+                        const auto message = std::string(size - 24, 'x');
+                        REQUIRE(fresh.TryPush(now, ""sv, message));
+                        ++pushed;
+                        fresh.Drain([&](const logger::RecordRing::Record& record) {
+                            intact += record.message == message;
+                        });
+                    }
+                    CHECK(intact == pushed);
+                    CHECK(fresh.Empty());
+                }
+            }
+        }
+        WHEN("a record is larger than half the ring") {
+            THEN("it is refused") {
+                CHECK_FALSE(ring.Fits(""sv, std::string(600, 'x')));
+                CHECK_FALSE(ring.TryPush(now, ""sv, std::string(600, 'x')));
+            }
+        }
+    }
+}
+
+SCENARIO("Asynchronous logging") {
+    std::ostringstream out;
+    logger::Options options;
+    options.output = &out;
+    options.idle_wait = 1ms;
+
+    GIVEN("a running logger") {
+        logger::InitLogging(options);
+
+        WHEN("records are logged") {
+            logger::Log(json::value{{"code", 200}}, "response sent"sv);
+            logger::Log("request received"sv, [](json_writer::JsonWriter& data) {
+                data.StartObject().Member("URI", "/api/v1/maps"sv).EndObject();
+            });
+            logger::Write({}, "quote \" and\nnewline"sv);
+            logger::ShutdownLogging();
+
+            THEN("every line keeps the timestamp, data and message layout") {
+                auto lines = ParseLines(out.str());
+                REQUIRE(lines.size() == 3);
+                for (const auto& line: lines) {
+                    CHECK(line.size() == 3);
+                    CHECK(line.at("timestamp").as_string().size() >= "2000-01-01T00:00:00"sv.size());
+                }
+                CHECK(lines[0].at("data") == json::value{{"code", 200}});
+                CHECK(lines[0].at("message") == "response sent");
+                CHECK(lines[1].at("data").at("URI") == "/api/v1/maps");
+                CHECK(lines[2].at("data").is_null());
+                CHECK(lines[2].at("message") == "quote \" and\nnewline");
+            }
+        }
+        WHEN("logging is disabled") {
+            logger::SetLoggingEnabled(false);
+            logger::Log(json::value{}, "hidden"sv);
+            logger::SetLoggingEnabled(true);
+            logger::ShutdownLogging();
+            THEN("nothing is written") {
+                CHECK(out.str().empty());
+            }
+        }
+        logger::ShutdownLogging();
+    }
+
+    GIVEN("the binary format") {
+        std::ostringstream binary;
+        options.output = &binary;
+        options.format = logger::Format::Binary;
+        logger::InitLogging(options);
+
+        WHEN("records are logged and the log is decoded") {
+            logger::Log(json::value{{"code", 200}}, "response sent"sv);
+            logger::Write({}, "quote \" and\nnewline"sv);
+            std::thread other {[] {
+                logger::Log(json::value{{"thread", "other"}}, "from another thread"sv);
+            }};
+            other.join();
+            logger::ShutdownLogging();
+
+            std::istringstream in {binary.str()};
+            std::ostringstream decoded;
+            auto count = logger::DecodeBinaryLog(in, decoded);
+
+            THEN("it is smaller and gives back the lines of the JSON format") {
+                CHECK(count == 3);
+                auto lines = ParseLines(decoded.str());
+                REQUIRE(lines.size() == 3);
+                CHECK(binary.str().size() < decoded.str().size() / 2);
+                std::vector<std::string> messages;
+                for (const auto& line: lines)
+                    messages.emplace_back(line.at("message").as_string());
+                std::sort(messages.begin(), messages.end());
+                CHECK(messages == std::vector<std::string>{"from another thread", "quote \" and\nnewline", "response sent"});
+                for (const auto& line: lines) {
+                    if (line.at("message") == "response sent")
+                        CHECK(line.at("data") == json::value{{"code", 200}});
+                    else if (line.at("message") == "from another thread")
+                        CHECK(line.at("data").at("thread") == "other");
+                    else
+                        CHECK(line.at("data").is_null());
+                }
+            }
+        }
+        WHEN("the log is cut off in the middle of a record") {
+            logger::Write({}, "first"sv);
+            logger::Write({}, "second"sv);
+            logger::ShutdownLogging();
+            auto text = binary.str();
+            std::istringstream in {text.substr(0, text.size() - 3)};
+            std::ostringstream decoded;
+            THEN("the records before it are decoded") {
+                CHECK(logger::DecodeBinaryLog(in, decoded) == 1);
+            }
+        }
+        WHEN("the input is not a binary log") {
+            logger::ShutdownLogging();
+            std::istringstream in {R"({"timestamp":"2024-01-01T00:00:00"})"};
+            std::ostringstream decoded;
+            THEN("decoding fails") {
+                CHECK_THROWS_AS(logger::DecodeBinaryLog(in, decoded), std::runtime_error);
+            }
+        }
+        logger::ShutdownLogging();
+    }
+
+    GIVEN("the blocking overflow policy and a tiny ring") {
+        options.ring_size = 1024;
+        options.overflow = logger::OverflowPolicy::Block;
+        logger::InitLogging(options);
+        const auto before = logger::GetStats();
+
+        WHEN("several threads log far more than the ring holds") {
+            constexpr int THREADS = 4, RECORDS = 2000;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([t] {
+                    for (int i = 0; i < RECORDS; ++i)
+                        logger::Log(json::value{{"thread", t}, {"seq", i}}, "record"sv);
+                });
+            }
+            for (auto& thread: threads)
+                thread.join();
+            logger::ShutdownLogging();
+
+            THEN("every record is written, in order per thread") {
+                auto lines = ParseLines(out.str());
+                REQUIRE(lines.size() == THREADS * RECORDS);
+                std::vector<std::int64_t> next(THREADS, 0);
+                bool ordered = true;
+                for (const auto& line: lines) {
+                    const auto& data = line.at("data").as_object();
+                    auto& expected = next[data.at("thread").as_int64()];
+                    ordered = ordered && data.at("seq").as_int64() == expected++;
+                }
+                CHECK(ordered);
+                auto stats = logger::GetStats();
+                CHECK(stats.dropped == before.dropped);
+                CHECK(stats.written - before.written == THREADS * RECORDS);
+            }
+        }
+        logger::ShutdownLogging();
+    }
+
+    GIVEN("the dropping overflow policy and a tiny ring") {
+        options.ring_size = 1024;
+        options.overflow = logger::OverflowPolicy::Drop;
+        logger::InitLogging(options);
+        const auto before = logger::GetStats();
+
+        WHEN("a burst overruns the ring") {
+            constexpr int RECORDS = 10000;
+            for (int i = 0; i < RECORDS; ++i)
+                logger::Write({}, "burst"sv);
+            logger::ShutdownLogging();
+
+            THEN("the caller never waits and every record is accounted for") {
+                auto stats = logger::GetStats();
+                auto written = stats.written - before.written;
+                CHECK(written == ParseLines(out.str()).size());
+                CHECK(written + stats.dropped - before.dropped == RECORDS);
+            }
+        }
+        WHEN("the logger is shut down while threads are logging") {
+            constexpr int THREADS = 4, RECORDS = 5000;
+            // Records logged after the shutdown are written to std::clog
+            std::ostringstream late;
+            auto* clog_buffer = std::clog.rdbuf(late.rdbuf());
+            std::atomic<int> started {0};
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([&started] {
+                    started.fetch_add(1);
+                    for (int i = 0; i < RECORDS; ++i)
+                        logger::Write({}, "racing"sv);
+                });
+            }
+            while (started.load() != THREADS)
+                std::this_thread::yield();
+            logger::ShutdownLogging();
+            for (auto& thread: threads)
+                thread.join();
+            std::clog.rdbuf(clog_buffer);
+
+            THEN("no record is pushed after the final drain: each is written or dropped") {
+                auto stats = logger::GetStats();
+                auto written = stats.written - before.written;
+                CHECK(written == ParseLines(out.str()).size() + ParseLines(late.str()).size());
+                CHECK(written + stats.dropped - before.dropped == THREADS * RECORDS);
+            }
+        }
+        logger::ShutdownLogging();
+    }
+}
+
+TEST_CASE("Logging benchmark", "[.benchmark]") {
+    std::ostringstream out;
+    logger::Options options;
+    options.output = &out;
+    logger::InitLogging(options);
+    BENCHMARK("request log record") {
+        logger::Log("request received"sv, [](json_writer::JsonWriter& data) {
+            data.StartObject().Member("ip", "127.0.0.1"sv).Member("URI", "/api/v1/game/state"sv)
+                    .Member("method", "GET"sv).EndObject();
+        });
+    };
+    logger::ShutdownLogging();
+}
@@ -0,0 +1,134 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/api_handler.h"
+
+using namespace std::literals;
+using compression::Encoding;
+namespace http = boost::beast::http;
+
+namespace {
+
+// The map routes never reach the database
+struct NoDatabase: database::PlayerStore {
+    std::vector<model::DogInfo> GetPlayers(int, int) override {
+        return {};
+    }
+    void SavePlayers(const std::vector<model::DogInfo>&) override {}
+};
+
+model::Game MakeGame() {
+    model::Game game;
+    for (auto id: {"map1"s, "map2"s}) {
+        // Long enough to be compressed at the default minimum size
+        std::string json = R"({"id":")" + id + R"(","name":"Map","roads":[)";
+        for (int i = 0; i < 100; ++i)
+            json += R"({"x0":0,"y0":)" + std::to_string(i) + R"(,"x1":40},)";
+        json += R"({"x0":0,"y0":0,"y1":20}]})";
+        model::Map map {model::Map::Id{id}, "Map"s, 1.0, 3, json};
+        map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 40, 0});
+        game.AddMap(map);
+    }
+    return game;
+}
+
+api_handler::StringRequest MapRequest(std::string_view target, std::string_view if_none_match = {},
+                                      std::string_view accept_encoding = {}) {
+    api_handler::StringRequest req {http::verb::get, target, 11};
+    if (!if_none_match.empty())
+        req.set(http::field::if_none_match, if_none_match);
+    if (!accept_encoding.empty())
+        req.set(http::field::accept_encoding, accept_encoding);
+    return req;
+}
+
+}  // namespace
+
+SCENARIO("Map catalog documents") {
+    auto game = MakeGame();
+
+    GIVEN("a catalog with compression on") {
+        map_catalog::MapCatalog catalog {game.GetMaps(), {}};
+        const auto* doc = catalog.FindMap("map1");
+        REQUIRE(doc != nullptr);
+
+        THEN("every representation has its own strong ETag") {
+            CHECK(doc->HasVariants());
+            CHECK(doc->ETag(Encoding::Identity).size() == 18);
+            CHECK(doc->ETag(Encoding::Identity).starts_with('"'));
+            CHECK(doc->ETag(Encoding::Identity).ends_with('"'));
+            CHECK(doc->ETag(Encoding::Gzip).ends_with("-gzip\""));
+            CHECK(doc->ETag(Encoding::Deflate).ends_with("-deflate\""));
+            CHECK(doc->Select(Encoding::Gzip).second == Encoding::Gzip);
+            CHECK(doc->Select(Encoding::Identity).first == game.GetMap(0).GetJsonString());
+        }
+        THEN("the tag follows the content, not the catalog") {
+            map_catalog::MapCatalog again {game.GetMaps(), {}};
+            CHECK(again.FindMap("map1")->ETag(Encoding::Identity) == doc->ETag(Encoding::Identity));
+            CHECK(catalog.FindMap("map2")->ETag(Encoding::Identity) != doc->ETag(Encoding::Identity));
+            CHECK(catalog.GetList().ETag(Encoding::Identity) != doc->ETag(Encoding::Identity));
+        }
+        THEN("unknown maps are not found") {
+            CHECK(catalog.FindMap("map3") == nullptr);
+        }
+    }
+    GIVEN("a catalog with compression off") {
+        map_catalog::MapCatalog catalog {game.GetMaps(), {0, 1024}};
+        const auto* doc = catalog.FindMap("map1");
+        THEN("every coding gets the identity body and tag") {
+            CHECK_FALSE(doc->HasVariants());
+            CHECK(doc->Select(Encoding::Gzip).second == Encoding::Identity);
+            CHECK(doc->ETag(Encoding::Gzip) == doc->ETag(Encoding::Identity));
+        }
+    }
+}
+
+SCENARIO("Conditional map requests") {
+    auto game = MakeGame();
+    NoDatabase db;
+    api_handler::ApiHandler handler {game, db};
+    map_catalog::MapCatalog catalog {game.GetMaps(), {}};
+    const auto etag = std::string{catalog.FindMap("map1")->ETag(Encoding::Identity)};
+    const auto gzip_etag = std::string{catalog.FindMap("map1")->ETag(Encoding::Gzip)};
+
+    auto get = [&handler](const api_handler::StringRequest& req) {
+        return handler.HandleMapRequests(req, *router::MatchRoute(api_handler::AsStringView(req.target())));
+    };
+
+    GIVEN("a request without If-None-Match") {
+        auto res = get(MapRequest("/api/v1/maps/map1"));
+        THEN("the map is sent with its ETag") {
+            CHECK(res.result() == http::status::ok);
+            CHECK(api_handler::AsStringView(res[http::field::etag]) == etag);
+            CHECK(res.body() == game.GetMap(0).GetJsonString());
+            CHECK(api_handler::AsStringView(res[http::field::vary]) == "Accept-Encoding");
+        }
+    }
+    GIVEN("the ETag the client holds") {
+        THEN("a single tag, a list holding it, its weak form and * are answered with 304") {
+            for (auto if_none_match: {etag, R"("0000000000000000", )" + etag, "W/" + etag, "*"s}) {
+                auto res = get(MapRequest("/api/v1/maps/map1", if_none_match));
+                CHECK(res.result() == http::status::not_modified);
+                CHECK(res.body().empty());
+                CHECK(api_handler::AsStringView(res[http::field::etag]) == etag);
+            }
+        }
+        THEN("a tag of another map or another coding is not") {
+            auto other = get(MapRequest("/api/v1/maps/map2", etag));
+            CHECK(other.result() == http::status::ok);
+            auto gzip = get(MapRequest("/api/v1/maps/map1", etag, "gzip"));
+            CHECK(gzip.result() == http::status::ok);
+            CHECK(api_handler::AsStringView(gzip[http::field::content_encoding]) == "gzip");
+            CHECK(api_handler::AsStringView(gzip[http::field::etag]) == gzip_etag);
+            CHECK(get(MapRequest("/api/v1/maps/map1", gzip_etag, "gzip")).result() == http::status::not_modified);
+        }
+    }
+    GIVEN("the map list") {
+        auto res = get(MapRequest("/api/v1/maps"));
+        auto list_etag = std::string{api_handler::AsStringView(res[http::field::etag])};
+        THEN("it is tagged and revalidated the same way") {
+            CHECK(res.result() == http::status::ok);
+            CHECK(list_etag == catalog.GetList().ETag(Encoding::Identity));
+            CHECK(get(MapRequest("/api/v1/maps", list_etag)).result() == http::status::not_modified);
+        }
+    }
+}
@@ -0,0 +1,274 @@
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/access_log.h"
+#include "../src/http_server.h"
+#include "../src/metrics.h"
+#include "../src/server_metrics.h"
+
+using namespace std::literals;
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+
+using StringResponse = http::response<http::string_body>;
+
+bool Contains(const std::string& text, std::string_view line) {
+    return text.find(std::string{line} + "\n") != std::string::npos;
+}
+
+// Serves the server's own rendering per request on the server's thread, as /metrics is served off the game strand
+class MetricsServer {
+public:
+    MetricsServer(const latency::Recorder& latency, const metrics::Counter& shed, const metrics::GameMetrics& game)
+            : latency_(latency), shed_(shed), game_(game) {
+        logger::SetLoggingEnabled(false);
+        auto handler = [this](http::request<http::string_body>&& req, auto&& send) {
+            server_metrics::Sources sources;
+            sources.latency = &latency_;
+            sources.connections = tracker_.get();
+            sources.shed_requests = shed_.Value();
+            sources.game = &game_;
+            StringResponse res{http::status::ok, req.version()};
+            res.set(http::field::content_type, metrics::CONTENT_TYPE);
+            res.body() = server_metrics::Render(sources);
+            res.keep_alive(req.keep_alive());
+            res.prepare_payload();
+            send(std::move(res));
+        };
+        http_server::ListenOptions options;
+        options.tracker = tracker_;
+        endpoint_ = http_server::ServeHttp(ioc_, {net::ip::make_address("127.0.0.1"), 0}, handler, options);
+        thread_ = std::thread{[this] {
+            ioc_.run();
+        }};
+    }
+    ~MetricsServer() {
+        ioc_.stop();
+        thread_.join();
+        logger::SetLoggingEnabled(true);
+    }
+
+    StringResponse Scrape() const {
+        net::io_context client_ioc;
+        tcp::socket socket{client_ioc};
+        socket.connect(endpoint_);
+        http::request<http::string_body> req{http::verb::get, "/metrics", 11};
+        req.set(http::field::host, "localhost");
+        http::write(socket, req);
+        beast::flat_buffer buffer;
+        StringResponse res;
+        http::read(socket, buffer, res);
+        return res;
+    }
+private:
+    const latency::Recorder& latency_;
+    const metrics::Counter& shed_;
+    const metrics::GameMetrics& game_;
+    std::shared_ptr<http_server::ConnectionTracker> tracker_ = std::make_shared<http_server::ConnectionTracker>();
+    net::io_context ioc_{1};
+    tcp::endpoint endpoint_;
+    std::thread thread_;
+};
+
+}  // namespace
+
+SCENARIO("Sharded counter") {
+    GIVEN("a counter") {
+        metrics::Counter counter;
+        WHEN("many threads add to it at once") {
+            constexpr int THREADS = 24, ADDS = 10000;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([&counter] {
+                    for (int i = 0; i < ADDS; ++i)
+                        counter.Add();
+                });
+            }
+            for (auto& thread: threads)
+                thread.join();
+            THEN("no addition is lost") {
+                CHECK(counter.Value() == THREADS * ADDS);
+            }
+        }
+    }
+}
+
+SCENARIO("Prometheus text format") {
+    metrics::TextWriter writer;
+
+    GIVEN("a family of samples") {
+        writer.Family("game_requests_total", metrics::Type::Counter, "Requests served")
+                .Sample("game_requests_total", {}, std::uint64_t{7})
+                .Sample("game_requests_total", {{"endpoint", "state"}, {"code", "2xx"}}, std::uint64_t{42})
+                .Sample("game_temperature", {{"map", "a \"quoted\\ map\nname"}}, 1.5);
+        THEN("it is rendered with HELP and TYPE lines and escaped label values") {
+            CHECK(writer.Text() == "# HELP game_requests_total Requests served\n"
+                                   "# TYPE game_requests_total counter\n"
+                                   "game_requests_total 7\n"
+                                   "game_requests_total{endpoint=\"state\",code=\"2xx\"} 42\n"
+                                   "game_temperature{map=\"a \\\"quoted\\\\ map\\nname\"} 1.5\n");
+        }
+    }
+
+    GIVEN("a histogram") {
+        latency::AtomicHistogram histogram;
+        for (auto value: {50us, 200us, 3000000us, 20000000us})
+            histogram.Record(value);
+        latency::HistogramSnapshot snapshot;
+        histogram.AddTo(snapshot);
+        writer.Histogram("game_tick_seconds", {{"phase", "move"}}, snapshot);
+        const auto& text = writer.Text();
+
+        THEN("buckets are cumulative, in seconds, up to +Inf") {
+            CHECK(Contains(text, R"(game_tick_seconds_bucket{phase="move",le="0.0001"} 1)"));
+            CHECK(Contains(text, R"(game_tick_seconds_bucket{phase="move",le="0.00025"} 2)"));
+            CHECK(Contains(text, R"(game_tick_seconds_bucket{phase="move",le="2.5"} 2)"));
+            CHECK(Contains(text, R"(game_tick_seconds_bucket{phase="move",le="5"} 3)"));
+            CHECK(Contains(text, R"(game_tick_seconds_bucket{phase="move",le="10"} 3)"));
+            CHECK(Contains(text, R"(game_tick_seconds_bucket{phase="move",le="+Inf"} 4)"));
+            CHECK(Contains(text, R"(game_tick_seconds_sum{phase="move"} 23.00025)"));
+            CHECK(Contains(text, R"(game_tick_seconds_count{phase="move"} 4)"));
+        }
+    }
+}
+
+SCENARIO("Game metrics") {
+    model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 3.0, 3, "{}"s};
+    map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 10, 0});
+    model::Game game;
+    game.SetLootGenParams(5.0, 0.0);
+    game.AddMap(map);
+    auto session = game.AddSession(game.GetMap(0));
+    game.AddDog("Rex"s, session);
+    game.AddDog("Max"s, session);
+    metrics::GameMetrics metrics;
+
+    GIVEN("a tick") {
+        model::TickStats stats;
+        auto retired = game.UpdateGame(100, &stats);
+        metrics.OnTick(stats, retired.size(), 1ms);
+        metrics.OnPlayersHandOff(300us);
+
+        WHEN("no session was published yet") {
+            THEN("no session is reported") {
+                CHECK(metrics.Sessions().empty());
+            }
+        }
+        WHEN("the sessions are published") {
+            metrics.PublishSessions(game);
+            THEN("their entity counts are reported") {
+                auto sessions = metrics.Sessions();
+                REQUIRE(sessions.size() == 1);
+                CHECK(sessions[0].map == "map1");
+                CHECK(sessions[0].dogs == 2);
+                CHECK(sessions[0].loot == game.GetSessions().front().NumberOfLostObjects());
+
+                metrics::TextWriter writer;
+                metrics.Write(writer);
+                CHECK(Contains(writer.Text(), R"(game_session_dogs{session="0",map="map1"} 2)"));
+                CHECK(Contains(writer.Text(), "game_tick_duration_seconds_count 1"));
+                CHECK(Contains(writer.Text(), R"(game_tick_phase_duration_seconds_count{phase="collide"} 1)"));
+                CHECK(Contains(writer.Text(), "game_db_handoff_duration_seconds_count 1"));
+            }
+        }
+    }
+    GIVEN("a saved state") {
+        metrics.OnSaveState(2ms, 1234);
+        metrics.OnSaveState(2ms, 1000);
+        metrics::TextWriter writer;
+        metrics.Write(writer);
+        THEN("the last size and the total are reported") {
+            CHECK(Contains(writer.Text(), "game_save_state_bytes 1000"));
+            CHECK(Contains(writer.Text(), "game_save_state_bytes_total 2234"));
+            CHECK(Contains(writer.Text(), "game_save_state_duration_seconds_count 2"));
+        }
+    }
+}
+
+SCENARIO("Metrics scrape") {
+    latency::Recorder latency {access_log::NUM_ENDPOINTS};
+    metrics::Counter shed;
+    metrics::GameMetrics game;
+    MetricsServer server {latency, shed, game};
+
+    GIVEN("counters updated by other threads") {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&latency, &shed] {
+                for (int i = 0; i < 1000; ++i) {
+                    latency.Record(access_log::STATIC_FILES, 200, latency::Phase::Handler, 100us);
+                    shed.Add();
+                }
+            });
+        }
+        for (auto& thread: threads)
+            thread.join();
+        game.OnSaveState(1ms, 512);
+
+        WHEN("the endpoint is scraped") {
+            auto res = server.Scrape();
+            THEN("the text format carries their values") {
+                CHECK(res.result() == http::status::ok);
+                CHECK(res[http::field::content_type] == metrics::CONTENT_TYPE);
+                CHECK(Contains(res.body(), R"(game_http_requests_total{endpoint="static",code="2xx"} 4000)"));
+                CHECK(Contains(res.body(), R"(game_http_request_duration_seconds_count{endpoint="static",code="2xx",phase="handler"} 4000)"));
+                CHECK(Contains(res.body(), "game_http_shed_total 4000"));
+                CHECK(Contains(res.body(), "game_http_connections_open 1"));
+                CHECK(Contains(res.body(), "game_save_state_bytes 512"));
+            }
+            THEN("every line is a comment or a sample of a family declared before it") {
+                std::istringstream lines {res.body()};
+                std::set<std::string> families;
+                std::string family;
+                bool well_formed = true;
+                for (std::string line; std::getline(lines, line);) {
+                    if (line.starts_with("# HELP "))
+                        continue;
+                    if (line.starts_with("# TYPE ")) {
+                        family = line.substr(7, line.find(' ', 7) - 7);
+                        well_formed = well_formed && families.insert(family).second;
+                        continue;
+                    }
+                    auto space = line.rfind(' ');
+                    well_formed = well_formed && line.starts_with(family) && space != std::string::npos
+                                  && space + 1 < line.size()
+                                  && line.find_first_not_of("0123456789.e+-", space + 1) == std::string::npos;
+                }
+                CHECK(well_formed);
+                for (auto name: {"game_http_requests_total", "game_http_connections_open", "game_http_shed_total",
+                                 "game_api_queued", "game_log_records_total", "game_tick_duration_seconds"})
+                    CHECK(families.contains(name));
+                // Not running on a ticker nor writing to a database
+                CHECK_FALSE(families.contains("game_ticks_total"));
+                CHECK_FALSE(families.contains("game_db_queued"));
+            }
+        }
+        WHEN("it is scraped again after more requests") {
+            auto before = server.Scrape();
+            shed.Add(5);
+            latency.Record(access_log::STATIC_FILES, 404, latency::Phase::Handler, 100us);
+            auto after = server.Scrape();
+            THEN("the counters have moved on") {
+                CHECK(Contains(before.body(), "game_http_shed_total 4000"));
+                CHECK(Contains(after.body(), "game_http_shed_total 4005"));
+                CHECK(Contains(after.body(), R"(game_http_requests_total{endpoint="static",code="4xx"} 1)"));
+                CHECK(Contains(after.body(), "game_http_connections_accepted_total 2"));
+            }
+        }
+    }
+}
+
+TEST_CASE("Sharded counter benchmark", "[.benchmark]") {
+    metrics::Counter counter;
+    BENCHMARK("add") {
+        counter.Add();
+    };
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/postgres.h"
+
+using namespace std::literals;
+
+namespace {
+
+// These need a running Postgres at GAME_DB_URL, and do nothing without one. Everything is
+// written into a schema of its own, dropped afterwards, so the real retired_players is left alone.
+class ScratchDatabase {
+public:
+    static std::optional<pqxx::connection> Connect() {
+        const char* url = std::getenv("GAME_DB_URL");
+        if (!url)
+            return std::nullopt;
+        pqxx::connection connection {url};
+        {
+            pqxx::nontransaction setup {connection};
+            setup.exec("DROP SCHEMA IF EXISTS postgres_tests CASCADE; CREATE SCHEMA postgres_tests;"_zv);
+            // Lasts for the session, so the tables Database makes go into the schema
+            setup.exec("SET search_path TO postgres_tests;"_zv);
+        }
+        return connection;
+    }
+
+    explicit ScratchDatabase(pqxx::connection connection): db_(std::move(connection)) {}
+    ~ScratchDatabase() {
+        // A schema left behind, e.g. by a lost connection, is dropped by the next Connect
+        try {
+            pqxx::nontransaction cleanup {db_.GetConnection()};
+            cleanup.exec("DROP SCHEMA postgres_tests CASCADE;"_zv);
+        } catch (...) {
+        }
+    }
+    database::Database& operator*() {
+        return db_;
+    }
+    database::Database* operator->() {
+        return &db_;
+    }
+
+private:
+    database::Database db_;
+};
+
+std::vector<model::DogInfo> Players(size_t count) {
+    std::vector<model::DogInfo> players;
+    for (size_t i = 0; i < count; ++i)
+        players.emplace_back(0, "Dog "s + std::to_string(i), i, 1000 + i);
+    return players;
+}
+
+}  // namespace
+
+SCENARIO("Saving retired players") {
+    auto connection = ScratchDatabase::Connect();
+    if (!connection) {
+        WARN("GAME_DB_URL is not set, the database is not tested");
+        return;
+    }
+    ScratchDatabase db {std::move(*connection)};
+
+    GIVEN("a batch too small for COPY and one written with it") {
+        auto small = Players(database::COPY_MIN_BATCH - 1);
+        auto large = Players(database::COPY_MIN_BATCH * 10);
+        db->SavePlayers(small);
+        db->SavePlayers(large);
+
+        THEN("every player is read back, each with an id of its own") {
+            auto players = db->GetPlayers(0, 1000);
+            REQUIRE(players.size() == small.size() + large.size());
+            CHECK(players.front().score_ == large.back().score_);
+            CHECK(players.front().name_ == large.back().name_);
+            CHECK(players.front().playing_time_ == large.back().playing_time_);
+
+            pqxx::nontransaction query {db->GetConnection()};
+            auto ids = query.exec1("SELECT count(id), count(DISTINCT id) FROM retired_players;"_zv);
+            CHECK(ids[0].as<size_t>() == players.size());
+            CHECK(ids[1].as<size_t>() == players.size());
+        }
+        WHEN("nobody retires") {
+            db->SavePlayers({});
+            THEN("nothing is written") {
+                CHECK(db->GetPlayers(0, 1000).size() == small.size() + large.size());
+            }
+        }
+    }
+}
+
+TEST_CASE("Retired players write benchmark", "[.benchmark]") {
+    auto connection = ScratchDatabase::Connect();
+    if (!connection) {
+        WARN("GAME_DB_URL is not set, nothing to benchmark");
+        return;
+    }
+    ScratchDatabase db {std::move(*connection)};
+    // One transaction per batch: divide the batch size by the mean for rows per second.
+    // The batches on either side of COPY_MIN_BATCH show whether the threshold is where COPY starts to pay.
+    for (size_t size: {size_t{1}, database::COPY_MIN_BATCH - 1, database::COPY_MIN_BATCH, size_t{100}, size_t{10000}}) {
+        auto players = Players(size);
+        BENCHMARK("batch of "s + std::to_string(size)) {
+            db->SavePlayers(players);
+        };
+    }
+}
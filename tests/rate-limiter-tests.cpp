@@ -0,0 +1,92 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/rate_limiter.h"
+
+using namespace std::literals;
+using rate_limiter::Clock;
+
+SCENARIO("GCRA rate limiter") {
+    const auto start = Clock::now();
+
+    GIVEN("a limit of 10 requests per second with a burst of 3") {
+        rate_limiter::RateLimiter limiter {{10, 3}};
+
+        WHEN("a client sends a burst") {
+            THEN("the burst passes and the next request is refused until a token is back") {
+                for (int i = 0; i < 3; ++i)
+                    CHECK(limiter.Check(1, start).allowed);
+                auto decision = limiter.Check(1, start);
+                CHECK_FALSE(decision.allowed);
+                CHECK(decision.retry_after == 100ms);
+                CHECK_FALSE(limiter.Check(1, start + 99ms).allowed);
+                CHECK(limiter.Check(1, start + 100ms).allowed);
+            }
+        }
+        WHEN("a client keeps to the sustained rate") {
+            THEN("it is never refused") {
+                for (int i = 0; i < 100; ++i)
+                    CHECK(limiter.Check(1, start + i * 100ms).allowed);
+            }
+        }
+        WHEN("one client exhausts its bucket") {
+            for (int i = 0; i < 4; ++i)
+                limiter.Check(1, start);
+            THEN("other clients are not affected") {
+                CHECK(limiter.Check(2, start).allowed);
+            }
+        }
+        WHEN("many clients went quiet") {
+            for (std::uint64_t key = 0; key < 100000; ++key)
+                limiter.Check(key, start);
+            limiter.Check(1, start + 1s);
+            for (std::uint64_t key = 100000; key < 200000; ++key)
+                limiter.Check(key, start + 1s);
+            THEN("their full buckets are swept away") {
+                CHECK(limiter.Size() < 200000);
+            }
+        }
+    }
+
+    GIVEN("rates beyond what nanosecond intervals hold") {
+        rate_limiter::RateLimiter fast {{1e12, 1}};
+        rate_limiter::RateLimiter slow {{1e-12, 1}};
+        THEN("they are limited at the nearest rate that is held") {
+            CHECK(fast.Check(1, start).allowed);
+            CHECK(fast.Check(1, start).retry_after == 1ns);
+            CHECK(slow.Check(1, start).allowed);
+            CHECK(slow.Check(1, start).retry_after == std::chrono::nanoseconds{static_cast<std::int64_t>(1e9 / rate_limiter::MIN_RATE)});
+        }
+    }
+
+    GIVEN("a disabled limit") {
+        rate_limiter::RateLimiter limiter {{}};
+        THEN("everything passes and nothing is stored") {
+            for (int i = 0; i < 10; ++i)
+                CHECK(limiter.Check(1, start).allowed);
+            CHECK(limiter.Size() == 0);
+        }
+    }
+}
+
+SCENARIO("Rate limit specification") {
+    CHECK(rate_limiter::ParseLimit("20")->rate == 20);
+    CHECK(rate_limiter::ParseLimit("20")->burst == 1);
+    CHECK(rate_limiter::ParseLimit("0.5:4")->rate == 0.5);
+    CHECK(rate_limiter::ParseLimit("0.5:4")->burst == 4);
+    CHECK_FALSE(rate_limiter::ParseLimit("").has_value());
+    CHECK_FALSE(rate_limiter::ParseLimit("fast").has_value());
+    CHECK_FALSE(rate_limiter::ParseLimit("10:0").has_value());
+    CHECK_FALSE(rate_limiter::ParseLimit("-1").has_value());
+    CHECK_FALSE(rate_limiter::ParseLimit("2e9").has_value());
+    CHECK_FALSE(rate_limiter::ParseLimit("1e-9").has_value());
+    CHECK(rate_limiter::ParseLimit("0")->rate == 0);
+}
+
+TEST_CASE("Rate limiter benchmark", "[.benchmark]") {
+    rate_limiter::RateLimiter limiter {{1000, 100}};
+    std::uint64_t key = 0;
+    BENCHMARK("check across 64K players") {
+        return limiter.Check(++key % 65536).allowed;
+    };
+}
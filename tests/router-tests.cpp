@@ -0,0 +1,167 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/api_handler.h"
+#include "../src/router.h"
+
+using namespace std::literals;
+using router::RouteId;
+
+namespace {
+
+// The dispatch chain the route table replaced, kept as the benchmark baseline
+std::optional<RouteId> StartsWithChain(std::string_view target) {
+    if (target.starts_with(RequestLiterals::JoinTarget))
+        return RouteId::Join;
+    else if (target.starts_with(RequestLiterals::MoveTarget))
+        return RouteId::Action;
+    else if (target.starts_with(RequestLiterals::PlayersTarget))
+        return RouteId::Players;
+    else if (target.starts_with(RequestLiterals::GameStateTarget))
+        return RouteId::State;
+    else if (target.starts_with(RequestLiterals::TickTarget))
+        return RouteId::Tick;
+    else if (target.starts_with(RequestLiterals::RecordsTarget))
+        return RouteId::Records;
+    else if (target.starts_with(RequestLiterals::MapTarget))
+        return RouteId::Map;
+    else if (target.starts_with(RequestLiterals::MapsTarget))
+        return RouteId::Maps;
+    return std::nullopt;
+}
+
+// Remembers the page of records it was asked for
+struct RecordsDatabase: database::PlayerStore {
+    std::vector<model::DogInfo> GetPlayers(int start, int size) override {
+        asked = {start, size};
+        return {};
+    }
+    void SavePlayers(const std::vector<model::DogInfo>&) override {}
+
+    std::optional<std::pair<int, int>> asked;
+};
+
+constexpr std::string_view TARGETS[] = {
+    "/api/v1/game/join", "/api/v1/game/player/action", "/api/v1/game/players", "/api/v1/game/state",
+    "/api/v1/game/tick", "/api/v1/game/records?start=10&maxItems=20", "/api/v1/maps", "/api/v1/maps/map1",
+};
+
+}  // namespace
+
+SCENARIO("Route table") {
+    GIVEN("every registered route") {
+        THEN("its path resolves to its id") {
+            for (auto& route: router::ROUTES) {
+                auto match = router::MatchRoute(route.path);
+                REQUIRE(match.has_value());
+                CHECK(match->id == route.id);
+                CHECK(match->param.empty());
+                CHECK(match->query.empty());
+            }
+        }
+        THEN("it resolves the same way as the former dispatch chain") {
+            for (auto target: TARGETS)
+                CHECK(router::MatchRoute(target)->id == StartsWithChain(target));
+        }
+    }
+
+    GIVEN("targets with a query string or a trailing slash") {
+        THEN("the query is split off and the slash ignored") {
+            auto match = router::MatchRoute("/api/v1/game/records/?start=5");
+            REQUIRE(match.has_value());
+            CHECK(match->id == RouteId::Records);
+            CHECK(match->query == "start=5"sv);
+            CHECK(router::MatchRoute("/api/v1/game/state?")->id == RouteId::State);
+        }
+    }
+
+    GIVEN("a map target") {
+        auto match = router::MatchRoute("/api/v1/maps/town?x=1");
+        THEN("the map id is captured as the parameter") {
+            REQUIRE(match.has_value());
+            CHECK(match->id == RouteId::Map);
+            CHECK(match->param == "town"sv);
+            CHECK(match->query == "x=1"sv);
+        }
+    }
+
+    GIVEN("unknown targets") {
+        THEN("nothing matches, including prefixes and extensions of known paths") {
+            CHECK_FALSE(router::MatchRoute("/api/v1/game").has_value());
+            CHECK_FALSE(router::MatchRoute("/api/v1/game/stateful").has_value());
+            CHECK_FALSE(router::MatchRoute("/api/v2/maps").has_value());
+            CHECK_FALSE(router::MatchRoute("").has_value());
+        }
+    }
+}
+
+SCENARIO("Query parameters") {
+    GIVEN("a query string") {
+        constexpr auto query = "start=10&maxItems=x&flag&maxItems=5"sv;
+        THEN("the first occurrence of a parameter is returned") {
+            CHECK(router::QueryParam(query, "start") == "10"sv);
+            CHECK(router::QueryParam(query, "flag") == ""sv);
+            CHECK_FALSE(router::QueryParam(query, "star").has_value());
+        }
+        THEN("integer parameters fall back to the default or report malformed values") {
+            CHECK(router::IntQueryParam(query, "start", 0) == 10);
+            CHECK(router::IntQueryParam(query, "missing", 100) == 100);
+            CHECK_FALSE(router::IntQueryParam(query, "maxItems", 100).has_value());
+            CHECK_FALSE(router::IntQueryParam(query, "flag", 100).has_value());
+        }
+    }
+}
+
+SCENARIO("Routed API handlers") {
+    namespace http = boost::beast::http;
+    model::Game game;
+    RecordsDatabase db;
+    api_handler::ApiHandler handler {game, db};
+    auto get = [&handler](std::string_view target) {
+        api_handler::StringRequest req {http::verb::get, target, 11};
+        return handler.HandleApiRequest(std::move(req), *router::MatchRoute(target));
+    };
+
+    GIVEN("records requests") {
+        THEN("the page comes from the matched query, with defaults for what is missing") {
+            CHECK(get("/api/v1/game/records?start=10&maxItems=20").result() == http::status::ok);
+            CHECK(db.asked == std::pair{10, 20});
+            CHECK(get("/api/v1/game/records").result() == http::status::ok);
+            CHECK(db.asked == std::pair{0, api_handler::MAX_RECORDS});
+            CHECK(get("/api/v1/game/records/?maxItems=5").result() == http::status::ok);
+            CHECK(db.asked == std::pair{0, 5});
+        }
+        THEN("malformed, negative or too large parameters are refused before the database") {
+            for (auto target: {"/api/v1/game/records?start=x"sv, "/api/v1/game/records?start=-1"sv,
+                               "/api/v1/game/records?maxItems=101"sv}) {
+                CAPTURE(target);
+                CHECK(get(target).result() == http::status::bad_request);
+            }
+            CHECK_FALSE(db.asked.has_value());
+        }
+    }
+    GIVEN("map targets") {
+        THEN("the list is served with or without the trailing slash, unknown maps are not found") {
+            auto list = get("/api/v1/maps");
+            CHECK(list.result() == http::status::ok);
+            CHECK(get("/api/v1/maps/").body() == list.body());
+            CHECK(get("/api/v1/maps/town").result() == http::status::not_found);
+        }
+    }
+}
+
+TEST_CASE("Route dispatch benchmark", "[.benchmark]") {
+    BENCHMARK("starts_with chain") {
+        int sum = 0;
+        for (auto target: TARGETS)
+            sum += static_cast<int>(*StartsWithChain(target));
+        return sum;
+    };
+
+    BENCHMARK("perfect-hash route table") {
+        int sum = 0;
+        for (auto target: TARGETS)
+            sum += static_cast<int>(router::MatchRoute(target)->id);
+        return sum;
+    };
+}
@@ -0,0 +1,118 @@
+#include <mutex>
+#include <set>
+#include <thread>
+#include <boost/asio/post.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/http_server.h"
+#include "../src/runtime.h"
+
+using namespace std::literals;
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+
+// Every context reports the thread it runs on, the last report stops the runtime
+std::set<std::thread::id> CollectThreads(runtime::Runtime& rt) {
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    size_t reported = 0;
+    for (auto& context: rt.Contexts()) {
+        net::post(*context, [&] {
+            std::lock_guard lock{mutex};
+            threads.insert(std::this_thread::get_id());
+            if (++reported == rt.Contexts().size())
+                rt.Stop();
+        });
+    }
+    rt.Run();
+    return threads;
+}
+
+} // namespace
+
+SCENARIO("Runtime") {
+    GIVEN("a shared runtime") {
+        runtime::Runtime rt{4, false};
+        THEN("all threads share the main context") {
+            CHECK(rt.Contexts().size() == 1);
+            CHECK_FALSE(rt.ThreadPerCore());
+        }
+        WHEN("it is stopped") {
+            auto threads = CollectThreads(rt);
+            THEN("Run returns with every worker joined") {
+                CHECK(threads.size() == 1);
+            }
+        }
+    }
+    GIVEN("a thread-per-core runtime") {
+        runtime::Runtime rt{3, true};
+        THEN("each thread owns a context") {
+            CHECK(rt.Contexts().size() == 3);
+            CHECK(&rt.Main() == rt.Contexts().front().get());
+        }
+        WHEN("work is posted to every context") {
+            auto threads = CollectThreads(rt);
+            THEN("each context runs on its own thread") {
+                CHECK(threads.size() == 3);
+            }
+        }
+        WHEN("some contexts have no work") {
+            net::post(rt.Main(), [&rt] {
+                rt.Stop();
+            });
+            rt.Run();
+            THEN("idle contexts keep running until the runtime is stopped") {
+                for (auto& context: rt.Contexts())
+                    CHECK(context->stopped());
+            }
+        }
+    }
+}
+
+SCENARIO("Per-core listeners share a port") {
+    logger::SetLoggingEnabled(false);
+    GIVEN("a listener with SO_REUSEPORT on every context") {
+        runtime::Runtime rt{2, true};
+        // Answers from the executor the sender is associated with, "ok" if it is the connection's core
+        auto handler = [&rt](http::request<http::string_body>&& req, auto&& send) {
+            net::post(net::get_associated_executor(send, rt.Main().get_executor()),
+                      [version = req.version(), send, reader = std::this_thread::get_id()] {
+                http::response<http::string_body> res{http::status::ok, version};
+                res.body() = std::this_thread::get_id() == reader ? "ok" : "moved";
+                res.keep_alive(false);
+                res.prepare_payload();
+                send(std::move(res));
+            });
+        };
+        const http_server::ListenOptions options {true};
+        auto endpoint = http_server::ServeHttp(rt.Main(), {net::ip::make_address("127.0.0.1"), 0}, handler, options);
+        for (size_t i = 1; i < rt.Contexts().size(); ++i)
+            CHECK(http_server::ServeHttp(*rt.Contexts()[i], endpoint, handler, options) == endpoint);
+        std::thread server {[&rt] {
+            rt.Run();
+        }};
+
+        WHEN("clients connect") {
+            THEN("every request is answered on the core that read it") {
+                net::io_context client_ioc;
+                for (int i = 0; i < 16; ++i) {
+                    tcp::socket socket{client_ioc};
+                    socket.connect(endpoint);
+                    http::request<http::string_body> req{http::verb::get, "/", 11};
+                    http::write(socket, req);
+                    beast::flat_buffer buffer;
+                    http::response<http::string_body> res;
+                    http::read(socket, buffer, res);
+                    CHECK(res.body() == "ok");
+                }
+            }
+        }
+        rt.Stop();
+        server.join();
+    }
+    logger::SetLoggingEnabled(true);
+}
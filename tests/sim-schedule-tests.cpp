@@ -0,0 +1,94 @@
+#include <numeric>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/model.h"
+#include "../src/sim_schedule.h"
+
+using namespace std::literals;
+
+namespace {
+
+std::vector<int> Steps(sim_schedule::Schedule& schedule, int nof_ms, bool* snapshot = nullptr) {
+    std::vector<int> steps;
+    bool due = schedule.Advance(nof_ms, [&steps](int step) {
+        steps.push_back(step);
+    });
+    if (snapshot)
+        *snapshot = due;
+    return steps;
+}
+
+}  // namespace
+
+SCENARIO("Simulation schedule") {
+    GIVEN("default options") {
+        sim_schedule::Schedule schedule;
+        THEN("a tick is one step and the live state is served") {
+            CHECK(Steps(schedule, 50) == std::vector{50});
+            CHECK(Steps(schedule, 0) == std::vector{0});
+            CHECK_FALSE(schedule.Snapshots());
+        }
+    }
+
+    GIVEN("10 ms substeps") {
+        sim_schedule::Schedule schedule {{10, 0}};
+        THEN("ticks are split into substeps covering them exactly") {
+            CHECK(Steps(schedule, 30) == std::vector{10, 10, 10});
+            CHECK(Steps(schedule, 25) == std::vector{10, 10, 5});
+            CHECK(Steps(schedule, 7) == std::vector{7});
+        }
+    }
+
+    GIVEN("a snapshot every 100 ms of game time") {
+        sim_schedule::Schedule schedule {{10, 100}};
+        WHEN("the game ticks every 30 ms") {
+            std::vector<int> due_at;
+            for (int tick = 1; tick <= 10; ++tick) {
+                bool due = false;
+                Steps(schedule, 30, &due);
+                if (due)
+                    due_at.push_back(tick * 30);
+            }
+            THEN("snapshots follow the game time, at the first tick boundary past each period") {
+                CHECK(due_at == std::vector{120, 210, 300});
+            }
+        }
+        WHEN("a single tick spans several periods") {
+            bool due = false;
+            Steps(schedule, 250, &due);
+            THEN("one snapshot is published and the rest of the time carries over") {
+                CHECK(due);
+                Steps(schedule, 40, &due);
+                CHECK_FALSE(due);
+                Steps(schedule, 10, &due);
+                CHECK(due);
+            }
+        }
+    }
+
+    GIVEN("a game moving a dog through substeps") {
+        auto run = [](const sim_schedule::Options& options) {
+            model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 3.0, 3, "{}"s};
+            map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 10, 0});
+            model::Game game;
+            game.SetLootGenParams(5.0, 0.0);
+            game.AddMap(map);
+            auto session = game.AddSession(game.GetMap(0));
+            auto dog = game.AddDog("Rex"s, session);
+            game.FindDog(dog, session)->SetSpeed(model::Direction::EAST);
+            sim_schedule::Schedule schedule {options};
+            schedule.Advance(1000, [&game](int step) {
+                game.UpdateGame(step);
+            });
+            return game.FindDog(dog, session)->GetPosition();
+        };
+        THEN("it ends where a single step takes it") {
+            auto whole = run({});
+            auto split = run({10, 0});
+            CHECK(std::abs(whole.x - split.x) < 1e-9);
+            CHECK(std::abs(whole.y - split.y) < 1e-9);
+            CHECK(whole.x > 2.9);
+        }
+    }
+}
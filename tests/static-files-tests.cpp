@@ -0,0 +1,222 @@
+#include <fstream>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/request_handler.h"
+
+using namespace std::literals;
+namespace fs = std::filesystem;
+namespace http = boost::beast::http;
+namespace net = boost::asio;
+using http_handler::FileRequestResult;
+
+namespace {
+
+struct NoDatabase: database::PlayerStore {
+    std::vector<model::DogInfo> GetPlayers(int, int) override {
+        return {};
+    }
+    void SavePlayers(const std::vector<model::DogInfo>&) override {}
+};
+
+using Fields = std::initializer_list<std::pair<http::field, std::string_view>>;
+
+http_handler::StringRequest Request(std::string_view target, Fields fields = {}) {
+    http_handler::StringRequest req {http::verb::get, target, 11};
+    for (auto [field, value]: fields)
+        req.set(field, value);
+    return req;
+}
+
+// A static root with one 1000-byte page, served by a handler with the given cache mode
+class StaticFiles {
+public:
+    explicit StaticFiles(file_cache::CacheMode mode): root_(fs::temp_directory_path() / "static-files-tests") {
+        fs::remove_all(root_);
+        fs::create_directories(root_);
+        std::ofstream {root_ / "page.txt", std::ios::binary} << body_;
+        std::ofstream {root_ / "empty.txt", std::ios::binary};
+        // A whole second, so that the HTTP-date of the file is exact
+        fs::last_write_time(root_ / "page.txt", std::chrono::file_clock::from_sys(std::chrono::system_clock::from_time_t(784111777)));
+        handler_ = std::make_shared<http_handler::RequestHandler>(game_, db_, root_.string(), strand_, false, false,
+                                                                   compression::Options{}, mode);
+    }
+    ~StaticFiles() {
+        std::error_code ec;
+        fs::remove_all(root_, ec);
+    }
+
+    FileRequestResult Get(std::string_view target, Fields fields = {}) {
+        return handler_->HandleFileRequest(Request(target, fields));
+    }
+    fs::path Path(std::string_view rel) const {
+        return root_ / rel;
+    }
+    static constexpr std::string_view DATE = "Sun, 06 Nov 1994 08:49:37 GMT";
+private:
+    fs::path root_;
+    std::string body_ = [] {
+        std::string body;
+        for (int i = 0; i < 1000; ++i)
+            body.push_back(static_cast<char>('a' + i % 26));
+        return body;
+    }();
+    model::Game game_;
+    NoDatabase db_;
+    net::io_context ioc_;
+    http_handler::RequestHandler::Strand strand_ = net::make_strand(ioc_);
+    std::shared_ptr<http_handler::RequestHandler> handler_;
+};
+
+unsigned Status(const FileRequestResult& result) {
+    return std::visit([](const auto& res) {
+        return res.result_int();
+    }, result);
+}
+
+std::string Header(const FileRequestResult& result, http::field field) {
+    return std::visit([field](const auto& res) {
+        return std::string{api_handler::AsStringView(res[field])};
+    }, result);
+}
+
+// Sections of their own under each GIVEN that calls it
+void CheckRanges(StaticFiles& files, bool cached) {
+    WHEN("a single range is requested") {
+        auto res = files.Get("/page.txt", {{http::field::range, "bytes=100-199"}});
+        THEN("it is sent as 206 with its Content-Range") {
+            CHECK(Status(res) == 206);
+            CHECK(Header(res, http::field::content_range) == "bytes 100-199/1000");
+            CHECK(Header(res, http::field::content_length) == "100");
+            REQUIRE(std::holds_alternative<http_handler::RangeResponse>(res));
+            const auto& parts = std::get<http_handler::RangeResponse>(res).body().parts;
+            REQUIRE(parts.size() == 1);
+            CHECK(parts.front().offset == 100);
+            CHECK(parts.front().length == 100);
+        }
+    }
+    WHEN("several ranges are requested") {
+        auto res = files.Get("/page.txt", {{http::field::range, "bytes=0-9,-10"}});
+        THEN("they are sent as multipart/byteranges") {
+            CHECK(Status(res) == 206);
+            CHECK(Header(res, http::field::content_type).starts_with("multipart/byteranges; boundary="));
+            CHECK(Header(res, http::field::content_range).empty());
+        }
+    }
+    WHEN("a range past the end is requested") {
+        THEN("it is answered with 416 and the size") {
+            auto res = files.Get("/page.txt", {{http::field::range, "bytes=1000-"}});
+            CHECK(Status(res) == 416);
+            CHECK(Header(res, http::field::content_range) == "bytes */1000");
+            auto empty = files.Get("/empty.txt", {{http::field::range, "bytes=0-"}});
+            CHECK(Status(empty) == 416);
+            CHECK(Header(empty, http::field::content_range) == "bytes */0");
+        }
+    }
+    WHEN("a malformed range is requested") {
+        auto res = files.Get("/page.txt", {{http::field::range, "items=0-9"}});
+        THEN("the whole file is sent") {
+            CHECK(Status(res) == 200);
+            CHECK(Header(res, http::field::content_length) == "1000");
+            CHECK(Header(res, http::field::accept_ranges) == "bytes");
+        }
+    }
+    WHEN("If-Range holds a date") {
+        THEN("the range is sent while the date is the file's") {
+            CHECK(Status(files.Get("/page.txt", {{http::field::range, "bytes=0-9"},
+                                                 {http::field::if_range, StaticFiles::DATE}})) == 206);
+            CHECK(Status(files.Get("/page.txt", {{http::field::range, "bytes=0-9"},
+                                                 {http::field::if_range, "Mon, 07 Nov 1994 08:49:37 GMT"}})) == 200);
+        }
+    }
+    WHEN("If-Range holds an entity tag") {
+        auto etag = Header(files.Get("/page.txt"), http::field::etag);
+        THEN("the range is sent only for the current tag") {
+            if (cached) {
+                REQUIRE_FALSE(etag.empty());
+                CHECK(Status(files.Get("/page.txt", {{http::field::range, "bytes=0-9"}, {http::field::if_range, etag}})) == 206);
+            } else {
+                // Files sent from the disk carry no ETag, no tag can match them
+                CHECK(etag.empty());
+            }
+            auto stale = files.Get("/page.txt", {{http::field::range, "bytes=0-9"}, {http::field::if_range, R"("0-0")"}});
+            CHECK(Status(stale) == 200);
+            CHECK(Header(stale, http::field::content_length) == "1000");
+        }
+    }
+}
+
+}  // namespace
+
+SCENARIO("Range requests for static files") {
+    GIVEN("files served from the cache") {
+        StaticFiles files {file_cache::CacheMode::Immutable};
+        CheckRanges(files, true);
+    }
+    GIVEN("files served from the disk") {
+        StaticFiles files {file_cache::CacheMode::Off};
+        CheckRanges(files, false);
+    }
+}
+
+SCENARIO("Validators of static files") {
+    GIVEN("a cached file") {
+        StaticFiles files {file_cache::CacheMode::Immutable};
+        auto res = files.Get("/page.txt");
+        const auto etag = Header(res, http::field::etag);
+
+        THEN("it carries its modification date and an ETag") {
+            CHECK(Status(res) == 200);
+            CHECK(Header(res, http::field::last_modified) == StaticFiles::DATE);
+            CHECK_FALSE(etag.empty());
+        }
+        THEN("If-Modified-Since at or after that date is answered with 304") {
+            auto same = files.Get("/page.txt", {{http::field::if_modified_since, StaticFiles::DATE}});
+            CHECK(Status(same) == 304);
+            CHECK(Header(same, http::field::last_modified) == StaticFiles::DATE);
+            CHECK(Status(files.Get("/page.txt", {{http::field::if_modified_since, "Mon, 07 Nov 1994 08:49:37 GMT"}})) == 304);
+        }
+        THEN("an earlier or malformed date gets the file") {
+            CHECK(Status(files.Get("/page.txt", {{http::field::if_modified_since, "Sun, 06 Nov 1994 08:49:36 GMT"}})) == 200);
+            CHECK(Status(files.Get("/page.txt", {{http::field::if_modified_since, "06.11.1994"}})) == 200);
+        }
+        THEN("If-None-Match takes precedence over If-Modified-Since") {
+            CHECK(Status(files.Get("/page.txt", {{http::field::if_none_match, etag},
+                                                 {http::field::if_modified_since, "Sat, 01 Jan 1994 00:00:00 GMT"}})) == 304);
+            CHECK(Status(files.Get("/page.txt", {{http::field::if_none_match, R"("0-0")"},
+                                                 {http::field::if_modified_since, StaticFiles::DATE}})) == 200);
+        }
+    }
+    GIVEN("a file served from the disk") {
+        StaticFiles files {file_cache::CacheMode::Off};
+        auto res = files.Get("/page.txt");
+        THEN("it carries its modification date") {
+            CHECK(Status(res) == 200);
+            CHECK(Header(res, http::field::last_modified) == StaticFiles::DATE);
+        }
+    }
+    GIVEN("a file whose modification time could not be read") {
+        StaticFiles files {file_cache::CacheMode::Off};
+        auto respond = [&files](Fields fields) {
+            http::file_body::value_type file;
+            boost::beast::error_code ec;
+            file.open(files.Path("page.txt").c_str(), boost::beast::file_mode::read, ec);
+            REQUIRE_FALSE(ec);
+            return http_handler::MakeFileResponse(Request("/page.txt", fields), std::move(file), "text/plain", std::nullopt);
+        };
+        THEN("the response has no Last-Modified") {
+            auto res = respond({});
+            CHECK(Status(res) == 200);
+            CHECK(Header(res, http::field::last_modified).empty());
+            CHECK(Header(res, http::field::content_length) == "1000");
+        }
+        THEN("a range is still served, without a validator") {
+            auto res = respond({{http::field::range, "bytes=0-9"}});
+            CHECK(Status(res) == 206);
+            CHECK(Header(res, http::field::last_modified).empty());
+        }
+        THEN("no If-Range matches it, the whole file is sent") {
+            CHECK(Status(respond({{http::field::range, "bytes=0-9"}, {http::field::if_range, StaticFiles::DATE}})) == 200);
+            CHECK(Status(respond({{http::field::range, "bytes=0-9"}, {http::field::if_range, R"("0-0")"}})) == 200);
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <thread>
+#include <boost/json.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/model.h"
+#include "../src/tick_profiler.h"
+
+using namespace std::literals;
+namespace json = boost::json;
+
+SCENARIO("Tick profiler") {
+    GIVEN("a disabled profiler") {
+        tick_profiler::Disable();
+        tick_profiler::Enable(0);
+        {
+            tick_profiler::Scope scope {"move", 1};
+        }
+        THEN("scopes record nothing") {
+            CHECK_FALSE(tick_profiler::Enabled());
+            CHECK(tick_profiler::Events().empty());
+        }
+    }
+
+    GIVEN("a profiler keeping four events") {
+        tick_profiler::Enable(4);
+
+        WHEN("more scopes end than it keeps") {
+            for (std::uint32_t session = 0; session < 6; ++session)
+                tick_profiler::Scope scope {"move", session};
+            THEN("the latest ones are kept, oldest first") {
+                auto events = tick_profiler::Events();
+                REQUIRE(events.size() == 4);
+                for (std::uint32_t i = 0; i < 4; ++i) {
+                    CHECK(events[i].name == "move");
+                    CHECK(events[i].session == i + 2);
+                    CHECK(events[i].duration >= tick_profiler::Clock::duration::zero());
+                }
+                CHECK(std::is_sorted(events.begin(), events.end(), [](const auto& lhs, const auto& rhs) {
+                    return lhs.start < rhs.start;
+                }));
+            }
+        }
+        WHEN("scopes end while the events are being read") {
+            constexpr std::uint32_t SCOPES = 100000;
+            tick_profiler::Enable(SCOPES);
+            std::atomic<bool> done {false};
+            std::thread reader {[&done] {
+                while (!done.load())
+                    tick_profiler::Events();
+            }};
+            for (std::uint32_t i = 0; i < SCOPES; ++i)
+                tick_profiler::Scope scope {"move", i};
+            done.store(true);
+            reader.join();
+            THEN("a scope finding the ring busy is dropped and counted, not waited for") {
+                CHECK(tick_profiler::Events().size() + tick_profiler::Missed() == SCOPES);
+            }
+        }
+        WHEN("it is re-enabled") {
+            {
+                tick_profiler::Scope scope {"move", 1};
+            }
+            tick_profiler::Enable(4);
+            THEN("earlier events are gone") {
+                CHECK(tick_profiler::Events().empty());
+            }
+        }
+        tick_profiler::Disable();
+    }
+
+    GIVEN("a game ticking with the profiler on") {
+        model::Map map{model::Map::Id{"map1"s}, "Map 1"s, 3.0, 3, "{}"s};
+        map.AddRoad({model::Road::HORIZONTAL, {0, 0}, 10, 0});
+        model::Game game;
+        game.SetLootGenParams(5.0, 0.0);
+        game.AddMap(map);
+        auto session = game.AddSession(game.GetMap(0));
+        game.AddDog("Rex"s, session);
+        tick_profiler::Enable(100);
+        game.UpdateGame(100);
+        {
+            tick_profiler::Scope scope {"save_state"};
+        }
+        tick_profiler::Disable();
+
+        THEN("every phase of the session is recorded") {
+            std::set<std::string_view> names;
+            for (const auto& event: tick_profiler::Events()) {
+                names.insert(event.name);
+                if (event.name != "save_state")
+                    CHECK(event.session == *session);
+            }
+            CHECK(names == std::set<std::string_view>{"move", "loot", "retire", "find_gather_events",
+                                                      "process_events", "save_state"});
+        }
+        THEN("the Chrome trace lists them as complete events") {
+            auto trace = json::parse(tick_profiler::ChromeTrace());
+            const auto& events = trace.at("traceEvents").as_array();
+            CHECK(events.size() == 6);
+            CHECK(trace.at("otherData").at("missed") == 0);
+            for (const auto& event: events) {
+                CHECK(event.at("ph") == "X");
+                CHECK(event.at("ts").to_number<double>() >= 0);
+                CHECK(event.at("dur").to_number<double>() >= 0);
+                CHECK(event.as_object().contains("args") == (event.at("name") != "save_state"));
+            }
+        }
+        THEN("the same trace is written to a file") {
+            const auto path = (std::filesystem::temp_directory_path() / "tick-profiler-tests.json").string();
+            REQUIRE(tick_profiler::WriteChromeTrace(path));
+            std::ifstream in {path, std::ios::binary};
+            std::string written {std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+            CHECK(written == tick_profiler::ChromeTrace());
+            CHECK_FALSE(std::filesystem::exists(path + ".tmp"));
+            std::filesystem::remove(path);
+            CHECK_FALSE(tick_profiler::WriteChromeTrace((std::filesystem::temp_directory_path() / "missing" / "trace.json").string()));
+        }
+    }
+}
+
+TEST_CASE("Tick profiler benchmark", "[.benchmark]") {
+    tick_profiler::Disable();
+    BENCHMARK("disabled scope") {
+        tick_profiler::Scope scope {"move", 1};
+    };
+    tick_profiler::Enable(1 << 16);
+    BENCHMARK("enabled scope") {
+        tick_profiler::Scope scope {"move", 1};
+    };
+    tick_profiler::Disable();
+}
@@ -0,0 +1,114 @@
+#include <thread>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/ticker.h"
+
+using namespace std::literals;
+namespace net = boost::asio;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Tick {
+    Clock::time_point at;
+    ticker::duration delta;
+};
+
+// Runs a ticker for a number of ticks; the handler of tick i sleeps for busy(i)
+template <typename Busy>
+std::vector<Tick> RunTicks(ticker::Ticker::ms period, size_t count, Busy busy,
+                           ticker::OverrunPolicy overrun = ticker::OverrunPolicy::CatchUp,
+                           ticker::Stats* stats = nullptr) {
+    net::io_context ioc;
+    auto strand = net::make_strand(ioc);
+    std::vector<Tick> ticks;
+    std::shared_ptr<ticker::Ticker> tick;
+    tick = std::make_shared<ticker::Ticker>(strand, period, [&](ticker::duration delta) {
+        ticks.push_back({Clock::now(), delta});
+        std::this_thread::sleep_for(busy(ticks.size() - 1));
+        if (ticks.size() == count)
+            ioc.stop();
+    }, overrun);
+    tick->Start();
+    ioc.run();
+    if (stats)
+        *stats = tick->GetStats();
+    return ticks;
+}
+
+ticker::duration Sum(const std::vector<Tick>& ticks) {
+    ticker::duration sum {};
+    for (const auto& tick: ticks)
+        sum += tick.delta;
+    return sum;
+}
+
+}  // namespace
+
+SCENARIO("Fixed-rate ticker") {
+    GIVEN("a handler taking a good part of the period") {
+        const auto start = Clock::now();
+        ticker::Stats stats;
+        auto ticks = RunTicks(10ms, 20, [](size_t) { return 4ms; }, ticker::OverrunPolicy::CatchUp, &stats);
+
+        THEN("the handler time does not push the schedule back") {
+            REQUIRE(ticks.size() == 20);
+            // Rescheduling after the handler would take 20 * 14 ms
+            CHECK(ticks.back().at - start < 250ms);
+            CHECK(ticks.back().at - start >= 200ms);
+        }
+        THEN("each tick advances the game by exactly one period") {
+            for (const auto& tick: ticks)
+                CHECK(tick.delta == ticker::duration{10ms});
+        }
+        THEN("nothing overran and every tick is timed") {
+            CHECK(stats.ticks == 20);
+            CHECK(stats.overruns == 0);
+            CHECK(stats.jitter.count == 20);
+            CHECK(stats.duration.Percentile(0.5) >= 4000);
+        }
+    }
+
+    GIVEN("a tick overrunning three periods and the catch-up policy") {
+        ticker::Stats stats;
+        auto ticks = RunTicks(10ms, 10, [](size_t i) { return i == 1 ? 35ms : 0ms; },
+                              ticker::OverrunPolicy::CatchUp, &stats);
+
+        THEN("the missed ticks run, and the game time keeps to the schedule") {
+            REQUIRE(ticks.size() == 10);
+            CHECK(Sum(ticks) == ticker::duration{100ms});
+            CHECK(stats.overruns >= 1);
+            CHECK(stats.skipped == 0);
+            // The ticks missed while overrunning fire at once
+            CHECK(ticks[3].at - ticks[2].at < 5ms);
+        }
+    }
+
+    GIVEN("a tick overrunning three periods and the skip policy") {
+        ticker::Stats stats;
+        auto ticks = RunTicks(10ms, 5, [](size_t i) { return i == 1 ? 35ms : 0ms; },
+                              ticker::OverrunPolicy::Skip, &stats);
+
+        THEN("missed deadlines are dropped, the next tick covers their time") {
+            REQUIRE(ticks.size() == 5);
+            CHECK(stats.skipped >= 2);
+            CHECK(ticks[2].delta >= ticker::duration{30ms});
+            CHECK(Sum(ticks) == ticker::duration{10ms} * (5 + stats.skipped));
+            CHECK(ticks[3].at - ticks[2].at >= 3ms);
+        }
+    }
+}
+
+SCENARIO("Ticker period") {
+    net::io_context ioc;
+    auto strand = net::make_strand(ioc);
+    auto handler = [](ticker::duration) {};
+
+    GIVEN("a period that is not positive") {
+        THEN("the ticker is not made") {
+            CHECK_THROWS_AS(ticker::Ticker(strand, 0ms, handler, ticker::OverrunPolicy::Skip), std::invalid_argument);
+            CHECK_THROWS_AS(ticker::Ticker(strand, -5ms, handler), std::invalid_argument);
+        }
+    }
+}
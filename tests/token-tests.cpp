@@ -0,0 +1,163 @@
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "../src/token.h"
+
+using namespace std::literals;
+
+namespace {
+
+// Token formatting as it was done before the binary keys
+std::string StreamToken(std::uint64_t hi, std::uint64_t lo) {
+    std::stringstream res;
+    res << std::setfill('0') << std::setw(16) << std::hex << hi;
+    res << std::setfill('0') << std::setw(16) << std::hex << lo;
+    return res.str();
+}
+
+std::vector<token::TokenKey> RandomKeys(size_t count) {
+    std::mt19937_64 generator{42};
+    std::vector<token::TokenKey> keys(count);
+    for (auto& key: keys)
+        key = {generator(), generator()};
+    return keys;
+}
+
+}  // namespace
+
+SCENARIO("Token encoding") {
+    GIVEN("random keys") {
+        auto keys = RandomKeys(1000);
+        keys.push_back({0, 0});
+        keys.push_back({~0ull, 1});
+        THEN("encoding matches the stream formatting and decodes back") {
+            for (auto& key: keys) {
+                auto token = token::EncodeToken(key);
+                CHECK(token == StreamToken(key.hi, key.lo));
+                CHECK(token::DecodeToken(token) == key);
+            }
+        }
+    }
+    GIVEN("malformed tokens") {
+        THEN("they are not decoded") {
+            CHECK_FALSE(token::DecodeToken("").has_value());
+            CHECK_FALSE(token::DecodeToken("0123456789abcdef0123456789abcde").has_value());
+            CHECK_FALSE(token::DecodeToken("0123456789abcdef0123456789abcdeg").has_value());
+        }
+    }
+}
+
+SCENARIO("Token directory") {
+    GIVEN("a directory filled with keys") {
+        token::TokenDirectory directory;
+        auto keys = RandomKeys(10000);
+        for (size_t i = 0; i < keys.size(); ++i)
+            REQUIRE(directory.Insert(keys[i], i));
+
+        THEN("every key is found and duplicates are refused") {
+            CHECK(directory.Size() == keys.size());
+            for (size_t i = 0; i < keys.size(); ++i)
+                CHECK(directory.Find(keys[i]) == i);
+            CHECK_FALSE(directory.Insert(keys[0], 1));
+            CHECK_FALSE(directory.Find({1, 2}).has_value());
+        }
+
+        WHEN("half of the keys are erased and others inserted in their place") {
+            for (size_t i = 0; i < keys.size(); i += 2)
+                CHECK(directory.Erase(keys[i]));
+            auto more = RandomKeys(20000);
+            for (size_t i = keys.size(); i < more.size(); ++i)
+                REQUIRE(directory.Insert(more[i], i));
+
+            THEN("lookups stay consistent") {
+                CHECK(directory.Size() == keys.size() / 2 + more.size() - keys.size());
+                for (size_t i = 0; i < keys.size(); ++i)
+                    CHECK(directory.Find(keys[i]).has_value() == (i % 2 == 1));
+                for (size_t i = keys.size(); i < more.size(); ++i)
+                    CHECK(directory.Find(more[i]) == i);
+                CHECK_FALSE(directory.Erase(keys[0]));
+            }
+        }
+    }
+}
+
+SCENARIO("Token directory under concurrent readers") {
+    GIVEN("stable keys and a writer churning through others") {
+        token::TokenDirectory directory;
+        auto stable = RandomKeys(1000);
+        auto churn = RandomKeys(101000);
+        for (size_t i = 0; i < stable.size(); ++i)
+            directory.Insert(stable[i], i * 3);
+
+        WHEN("readers look up the stable keys while the table grows and is rehashed") {
+            std::atomic<bool> stop {false};
+            std::atomic<size_t> errors {0};
+            std::vector<std::thread> readers;
+            for (int t = 0; t < 4; ++t)
+                readers.emplace_back([&] {
+                    while (!stop) {
+                        for (size_t i = 0; i < stable.size(); ++i)
+                            if (directory.Find(stable[i]) != i * 3)
+                                ++errors;
+                        if (directory.Find({1, 2}).has_value())
+                            ++errors;
+                    }
+                });
+            // churn shares its first 1000 keys with stable, skip them
+            for (size_t i = stable.size(); i < churn.size(); ++i) {
+                directory.Insert(churn[i], i);
+                if (i >= 2 * stable.size())
+                    directory.Erase(churn[i - stable.size()]);
+            }
+            stop = true;
+            for (auto& reader: readers)
+                reader.join();
+
+            THEN("every lookup sees a consistent entry") {
+                CHECK(errors == 0);
+                CHECK(directory.Size() == 2 * stable.size());
+            }
+        }
+    }
+}
+
+TEST_CASE("Token lookup benchmark", "[.benchmark]") {
+    constexpr size_t LIVE_TOKENS = 1'000'000;
+    auto keys = RandomKeys(LIVE_TOKENS);
+    std::vector<std::string> tokens;
+    tokens.reserve(LIVE_TOKENS);
+    std::unordered_map<std::string, size_t> by_string;
+    token::TokenDirectory directory{LIVE_TOKENS};
+    for (size_t i = 0; i < LIVE_TOKENS; ++i) {
+        tokens.push_back(token::EncodeToken(keys[i]));
+        by_string.emplace(tokens.back(), i);
+        directory.Insert(keys[i], i);
+    }
+
+    BENCHMARK("unordered_map<std::string>, 1M tokens") {
+        size_t sum = 0;
+        for (size_t i = 0; i < LIVE_TOKENS; i += 97)
+            sum += by_string.find(tokens[i])->second;
+        return sum;
+    };
+
+    BENCHMARK("TokenDirectory with hex decoding, 1M tokens") {
+        size_t sum = 0;
+        for (size_t i = 0; i < LIVE_TOKENS; i += 97)
+            sum += *directory.Find(*token::DecodeToken(tokens[i]));
+        return sum;
+    };
+
+    BENCHMARK("token formatting, stringstream") {
+        return StreamToken(keys[0].hi, keys[0].lo);
+    };
+
+    BENCHMARK("token formatting, EncodeToken") {
+        return token::EncodeToken(keys[0]);
+    };
+}